@@ -0,0 +1,96 @@
+/**
+ * Host Benchmark Harness
+ *
+ * Minimal registry and timing helpers for the `native` benchmark build.
+ * Each bench_*.cpp file registers cases with ESPIR_BENCH(); bench_main.cpp
+ * runs them all, or only those whose name contains argv[1].
+ */
+
+#ifndef ESPIR_BENCH_H
+#define ESPIR_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+struct BenchResult
+{
+    double meanNs;
+    double p50Ns;
+    double p99Ns;
+    double opsPerSec;
+};
+
+class BenchRunner
+{
+private:
+    int failureCount;
+    std::vector<double> samples;
+
+    static void printDuration(double ns);
+
+public:
+    BenchRunner() : failureCount(0) {}
+
+    // Times each call of fn() individually and reports mean/p50/p99 latency
+    template <typename Fn>
+    BenchResult measure(const char *label, uint32_t iterations, Fn &&fn)
+    {
+        samples.clear();
+        samples.reserve(iterations);
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            fn();
+            auto t1 = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        }
+        double totalNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return finish(label, totalNs);
+    }
+
+    BenchResult finish(const char *label, double totalNs);
+    void report(const char *label, double value, const char *unit);
+    bool check(bool condition, const char *what);
+    int failures() const { return failureCount; }
+};
+
+struct BenchCase
+{
+    const char *name;
+    void (*fn)(BenchRunner &);
+};
+
+std::vector<BenchCase> &benchRegistry();
+
+struct BenchRegistrar
+{
+    BenchRegistrar(const char *name, void (*fn)(BenchRunner &)) { benchRegistry().push_back({name, fn}); }
+};
+
+#define ESPIR_BENCH(name)                                          \
+    static void bench_##name(BenchRunner &bench);                  \
+    static BenchRegistrar benchRegistrar_##name(#name, bench_##name); \
+    static void bench_##name(BenchRunner &bench)
+
+// Heap allocations (malloc/calloc/realloc) made by the process so far;
+// always 0 where the allocator cannot be interposed
+uint64_t benchAllocationCount();
+
+// Heap bytes held now, and the most held since benchResetHeapPeak(); both
+// 0 where the allocator cannot be interposed
+size_t benchHeapInUse();
+size_t benchHeapPeak();
+void benchResetHeapPeak();
+
+// Keeps the optimizer from discarding a computed value
+template <typename T>
+inline void benchKeep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif // ESPIR_BENCH_H
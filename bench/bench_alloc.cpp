@@ -0,0 +1,126 @@
+/**
+ * Allocation Counter
+ *
+ * Interposes the glibc allocator so benchmarks can assert that a hot path
+ * does not touch the heap, and measure how much of it a path holds at
+ * its peak.
+ */
+
+#include "bench.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount(0);
+    std::atomic<int64_t> heapInUse(0);
+    std::atomic<int64_t> heapPeak(0);
+
+    void *track(void *ptr)
+    {
+#if defined(__GLIBC__)
+        if (!ptr)
+            return ptr;
+        int64_t now = heapInUse.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed) + malloc_usable_size(ptr);
+        int64_t peak = heapPeak.load(std::memory_order_relaxed);
+        while (now > peak && !heapPeak.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+        {
+        }
+#endif
+        return ptr;
+    }
+
+    void untrack(void *ptr)
+    {
+#if defined(__GLIBC__)
+        if (ptr)
+            heapInUse.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+#endif
+    }
+}
+
+uint64_t benchAllocationCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t benchHeapInUse()
+{
+    int64_t now = heapInUse.load(std::memory_order_relaxed);
+    return now > 0 ? now : 0;
+}
+
+size_t benchHeapPeak()
+{
+    int64_t peak = heapPeak.load(std::memory_order_relaxed);
+    return peak > 0 ? peak : 0;
+}
+
+void benchResetHeapPeak()
+{
+    heapPeak.store(heapInUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *ptr);
+
+    void *malloc(size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return track(__libc_malloc(size));
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return track(__libc_calloc(count, size));
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        untrack(ptr);
+        void *moved = __libc_realloc(ptr, size);
+        if (!moved && size)
+            track(ptr); // Left as it was
+        return track(moved);
+    }
+
+    // Aligned allocations are counted too, so that their frees balance
+    void *memalign(size_t alignment, size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return track(__libc_memalign(alignment, size));
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void **out, size_t alignment, size_t size)
+    {
+        void *ptr = memalign(alignment, size);
+        if (!ptr)
+            return ENOMEM;
+        *out = ptr;
+        return 0;
+    }
+
+    void free(void *ptr)
+    {
+        untrack(ptr);
+        __libc_free(ptr);
+    }
+}
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Binary Protocol Benchmarks
+ *
+ * TRANSMIT round trip (BLE write -> IR send -> notification) over the JSON
+ * and binary codecs, heap allocations per round trip, and the framing
+ * error paths.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "binary_protocol.h"
+#include <hal_native.h>
+
+namespace
+{
+    std::string frame(uint8_t opcode, uint16_t requestId, std::initializer_list<uint8_t> tlvs, uint8_t version = BIN_VERSION)
+    {
+        std::string f;
+        f.push_back((char)BIN_MAGIC);
+        f.push_back((char)version);
+        f.push_back((char)opcode);
+        f.push_back((char)(requestId & 0xFF));
+        f.push_back((char)(requestId >> 8));
+        f.push_back(0);
+        for (uint8_t b : tlvs)
+            f.push_back((char)b);
+        return f;
+    }
+
+    uint8_t replyStatus(const std::string &reply)
+    {
+        return reply.size() >= BIN_HEADER_SIZE && (uint8_t)reply[0] == BIN_MAGIC ? (uint8_t)reply[5] : 0xFF;
+    }
+
+    uint16_t replyRequestId(const std::string &reply)
+    {
+        return reply.size() >= BIN_HEADER_SIZE ? (uint8_t)reply[3] | ((uint8_t)reply[4] << 8) : 0;
+    }
+}
+
+ESPIR_BENCH(binary_protocol)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 50, 20);
+    halBleConnect(247);
+
+    const std::string transmitJson = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-49\",\"command\":\"cmd-19\"}}";
+
+    halBleWrite(frame(BIN_OP_PING, 9, {}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_NOT_NEGOTIATED, "binary frame before HELLO is refused");
+
+    halBleWrite(frame(BIN_OP_HELLO, 1, {BIN_TAG_VERSION, 1, 9}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_OK && (uint8_t)fw.lastNotification[2] == (BIN_OP_HELLO | BIN_RESPONSE_FLAG),
+                "HELLO negotiates a version");
+    bench.check(fw.lastNotification.size() > 8 && (uint8_t)fw.lastNotification[8] == BIN_VERSION, "HELLO settles on the firmware version");
+
+    std::string resolve = frame(BIN_OP_RESOLVE, 2, {});
+    resolve += std::string("\x12\x09" "device-49" "\x13\x06" "cmd-19", 19);
+    halBleWrite(resolve);
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_OK && fw.lastNotification.size() == BIN_HEADER_SIZE + 6,
+                "RESOLVE maps names to ids");
+    uint8_t deviceId = fw.lastNotification[8], commandId = fw.lastNotification[11];
+
+    // Frames are built up front so the measured loops only exercise the firmware
+    const std::string transmitBinary = frame(BIN_OP_TRANSMIT, 7, {BIN_TAG_DEVICE_ID, 1, deviceId, BIN_TAG_COMMAND_ID, 1, commandId});
+
+    resetIRSends();
+    halBleWrite(transmitBinary);
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_OK && replyRequestId(fw.lastNotification) == 7, "binary TRANSMIT echoes the request id");
+    bench.check(irSendCount() == 1 && lastIRSendWas(NEC, 0x20DF0000ULL | (49 << 8) | 19, 32), "binary TRANSMIT sends the resolved code");
+
+    // Round trips
+    uint32_t before = fw.notificationCount;
+    bench.measure("JSON TRANSMIT round trip", 5000, [&]
+                  { halBleWrite(transmitJson); });
+    bench.report("JSON TRANSMIT reply size", fw.lastNotification.size(), "bytes");
+    bench.measure("binary TRANSMIT round trip", 5000, [&]
+                  { halBleWrite(transmitBinary); });
+    bench.report("binary TRANSMIT reply size", fw.lastNotification.size(), "bytes");
+    bench.check(fw.notificationCount - before == 10000, "every round trip is answered");
+
+    uint64_t allocations = benchAllocationCount();
+    for (int i = 0; i < 100; i++)
+        halBleWrite(transmitJson);
+    bench.report("JSON TRANSMIT heap allocations", (benchAllocationCount() - allocations) / 100.0, "per round trip");
+
+    allocations = benchAllocationCount();
+    for (int i = 0; i < 100; i++)
+        halBleWrite(transmitBinary);
+    uint64_t binaryAllocations = benchAllocationCount() - allocations;
+    bench.report("binary TRANSMIT heap allocations", binaryAllocations / 100.0, "per round trip");
+    bench.check(binaryAllocations == 0, "binary TRANSMIT round trip does not allocate");
+
+    // Error paths
+    halBleWrite(frame(BIN_OP_TRANSMIT, 3, {BIN_TAG_DEVICE_ID, 1, deviceId, BIN_TAG_COMMAND_ID, 4, commandId}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_MALFORMED, "truncated TLV is rejected");
+    halBleWrite(frame(BIN_OP_TRANSMIT, 4, {BIN_TAG_DEVICE_ID, 1, deviceId}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_MISSING_PARAMETER, "missing command id is rejected");
+    halBleWrite(frame(BIN_OP_TRANSMIT, 5, {BIN_TAG_DEVICE_ID, 1, 0xFE, BIN_TAG_COMMAND_ID, 1, 0}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_NOT_FOUND, "unknown device id is rejected");
+    halBleWrite(frame(0x7F, 6, {}));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_UNKNOWN_OPCODE, "unknown opcode is rejected");
+    halBleWrite(frame(BIN_OP_PING, 8, {}, 2));
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_UNSUPPORTED_VERSION, "frame with another version is rejected");
+
+    // Negotiation is per connection
+    halBleDisconnect();
+    halBleConnect(247);
+    halBleWrite(transmitBinary);
+    bench.check(replyStatus(fw.lastNotification) == BIN_STATUS_NOT_NEGOTIATED, "reconnect requires a new HELLO");
+}
@@ -0,0 +1,149 @@
+/**
+ * BLE Transfer Benchmarks
+ *
+ * Effective throughput of the fragmenting transfer layer against the
+ * simulated characteristic, which truncates notifications at the MTU and
+ * packs them into 7.5 ms connection events of 4 packets. Also checks that
+ * fragmented writes are reassembled, that a broken chain is dropped, that
+ * messages past 64 KB carry a long length, and that credit flow control
+ * bounds the packets in flight.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "metrics.h"
+#include <hal_native.h>
+
+namespace
+{
+    std::string payloadOf(size_t size)
+    {
+        std::string payload;
+        for (size_t i = 0; i < size; i++)
+            payload += (char)('a' + (i * 7) % 26);
+        return payload;
+    }
+
+    std::vector<std::string> fragmentsOf(const std::string &message, uint16_t mtu, uint8_t &sequence)
+    {
+        std::vector<std::string> packets;
+        uint8_t packet[BLE_MAX_MTU];
+        BleFragmenter fragmenter((const uint8_t *)message.data(), message.size(), mtu - BLE_ATT_OVERHEAD, sequence);
+        do
+        {
+            size_t length = fragmenter.next(packet);
+            packets.emplace_back((const char *)packet, length);
+        } while (!fragmenter.done());
+        return packets;
+    }
+
+    std::string creditFrame(uint8_t credits)
+    {
+        const char frame[] = {(char)BLE_FRAGMENT_MAGIC, 0, BLE_FRAG_CREDIT, (char)credits};
+        return std::string(frame, sizeof(frame));
+    }
+}
+
+ESPIR_BENCH(ble_transfer)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    BLEManager &ble = fw.bleManager;
+    char label[96];
+
+    bench.check(NimBLEDevice::getMTU() == BLE_MAX_MTU, "the largest MTU is requested");
+    halBleConnect(527);
+    bench.check(ble.getMTU() == BLE_MAX_MTU, "a larger peer MTU settles at ours");
+
+    // Throughput versus payload size and MTU
+    const uint16_t mtus[] = {23, 185, 247, 517};
+    const size_t sizes[] = {100, 512, 2048, 8192};
+    bool intact = true;
+    for (uint16_t mtu : mtus)
+    {
+        halBleConnect(mtu);
+        snprintf(label, sizeof(label), "MTU %u: one notification carries", mtu);
+        bench.report(label, mtu - BLE_ATT_OVERHEAD, "bytes");
+        for (size_t size : sizes)
+        {
+            std::string payload = payloadOf(size);
+            uint32_t packets = halGetNotifyCount();
+            halBleResetAirtime();
+            ble.sendResponse(String(payload.c_str()));
+            packets = halGetNotifyCount() - packets;
+            intact &= fw.lastNotification == payload;
+
+            snprintf(label, sizeof(label), "MTU %u, %u B: throughput (%u packets)", mtu, (unsigned)size, packets);
+            bench.report(label, size * 1e6 / halBleAirtimeUs(), "bytes/s");
+        }
+    }
+    bench.check(intact, "every payload arrives whole at every MTU");
+
+    halBleConnect(247);
+    String large(payloadOf(2048).c_str());
+    bench.measure("sendResponse(2048 B) at MTU 247", 5000, [&]
+                  { ble.sendResponse(large); });
+
+    // Fragmented writes from the central
+    halBleConnect(23);
+    uint8_t sequence = 0;
+    std::string command = "{\"command\":\"GET_STATUS\",\"parameters\":{\"pad\":\"" + payloadOf(300) + "\"}}";
+    uint32_t replies = fw.notificationCount;
+    std::vector<std::string> packets = fragmentsOf(command, 23, sequence);
+    for (const std::string &packet : packets)
+        halBleWrite(packet);
+    bench.check(packets.size() > 1 && fw.notificationCount == replies + 1 &&
+                    fw.lastNotification.find("System status retrieved") != std::string::npos,
+                "a fragmented command is reassembled and answered");
+
+    replies = fw.notificationCount;
+    packets = fragmentsOf(command, 23, sequence);
+    packets.erase(packets.begin() + 1);
+    for (const std::string &packet : packets)
+        halBleWrite(packet);
+    bench.check(fw.notificationCount == replies, "a command with a lost fragment is dropped");
+    bench.check(std::string(ble.getStatus().c_str()).find("\"fragmentsDropped\":1") != std::string::npos, "the dropped command is counted");
+    for (const std::string &packet : fragmentsOf(command, 23, sequence))
+        halBleWrite(packet);
+    bench.check(fw.notificationCount == replies + 1, "the next command goes through");
+
+    // Past 64 KB the first fragment carries a 4-byte length
+    std::string huge = payloadOf(70000), assembled;
+    packets = fragmentsOf(huge, 247, sequence);
+    bool complete = false;
+    for (const std::string &packet : packets)
+        complete = fw.assembler.add((const uint8_t *)packet.data(), packet.size(), assembled);
+    bench.check((packets[0][2] & BLE_FRAG_LONG) && complete && assembled == huge, "a message past 64 KB is framed with a long length");
+
+    // Credit flow control: the central grants a window of 4 as it consumes packets
+    uint32_t granted = 4, received = 0;
+    bool withinWindow = true;
+    halSetNotifyHook([&](const uint8_t *data, size_t length)
+                     {
+                         received++;
+                         withinWindow &= received <= granted;
+                         if (fw.assembler.add(data, length, fw.lastNotification))
+                             fw.notificationCount++;
+                         if (received == granted)
+                         {
+                             granted += 4;
+                             halBleWrite(creditFrame(4));
+                         } });
+    halBleWrite(creditFrame(4));
+    std::string payload = payloadOf(2048);
+    bool sent = ble.sendResponse(String(payload.c_str()));
+    bench.check(sent && withinWindow && fw.lastNotification == payload, "flow control never exceeds the granted window");
+
+    // A central that stops granting stalls the message until the timeout
+    halSetNotifyHook([&](const uint8_t *data, size_t length)
+                     { received++; });
+    received = 0;
+    halBleConnect(23);
+    halBleWrite(creditFrame(2));
+    uint32_t timeouts = metrics.get(METRIC_BLE_FLOW_TIMEOUTS);
+    sent = ble.sendResponse(String(payload.c_str()));
+    bench.check(!sent && received == 2, "a stalled central times out after its credits");
+    bench.check(metrics.get(METRIC_BLE_FLOW_TIMEOUTS) == timeouts + 1, "the timeout is counted");
+
+    fw.captureNotifications();
+    halBleConnect(247);
+}
@@ -0,0 +1,361 @@
+/**
+ * BLE Transmit Queue Benchmarks
+ *
+ * The outbound rings on their own (priority, coalescing, wrap-around and
+ * the cost of a queue round trip), then BLEManager with its task running
+ * against a slow central: how long a sender is held up, replies
+ * overtaking queued events, streamed replies keeping their place,
+ * delivery across a reconnect (even one quicker than the sender), drops when full (at once from the write
+ * callback) and retries when the host runs out of notification buffers. The task
+ * scenario runs in a child process because the BLE task never exits.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string messageOf(char tag, size_t size)
+    {
+        std::string message(size, tag);
+        message[0] = '{';
+        return message;
+    }
+
+    bool pushString(BleTxQueue &queue, BleTxLane lane, const std::string &message, uint8_t key = BLE_TX_NO_COALESCE)
+    {
+        return queue.push(lane, (const uint8_t *)message.data(), message.size(), key);
+    }
+
+    std::string popString(BleTxQueue &queue)
+    {
+        BleTxMessage message;
+        if (!queue.front(message))
+            return "";
+        std::string data((const char *)message.data, message.length);
+        queue.pop(message.lane);
+        return data;
+    }
+
+    void runQueueChecks(BenchRunner &bench)
+    {
+        static uint8_t replies[1024], events[512];
+        BleTxQueue queue(replies, sizeof(replies), events, sizeof(events));
+
+        pushString(queue, BLE_LANE_EVENT, "event-1");
+        pushString(queue, BLE_LANE_REPLY, "reply-1");
+        pushString(queue, BLE_LANE_EVENT, "event-2");
+        pushString(queue, BLE_LANE_REPLY, "reply-2");
+        std::string order;
+        for (int i = 0; i < 4; i++)
+            order += popString(queue) + " ";
+        bench.check(order == "reply-1 reply-2 event-1 event-2 ", "replies drain before events, each lane in order");
+
+        // Coalescing replaces unsent events with the same key only
+        for (int i = 0; i < 5; i++)
+            pushString(queue, BLE_LANE_EVENT, "status-" + std::to_string(i), 7);
+        pushString(queue, BLE_LANE_EVENT, "learn", BLE_TX_NO_COALESCE);
+        order = "";
+        while (queue.getQueued() > 0)
+            order += popString(queue) + " ";
+        bench.check(order == "status-4 learn " && queue.getCoalesced() == 4, "an event replaces unsent events with its key");
+
+        // The message being sent is never replaced under the sender
+        BleTxMessage sending;
+        pushString(queue, BLE_LANE_EVENT, "status-a", 7);
+        queue.front(sending);
+        pushString(queue, BLE_LANE_EVENT, "status-b", 7);
+        bool kept = std::string((const char *)sending.data, sending.length) == "status-a";
+        queue.pop(sending.lane);
+        bench.check(kept && popString(queue) == "status-b", "the in-flight message is not coalesced");
+
+        // Wrap-around: messages of varying length stay intact and in order
+        bool intact = true;
+        uint32_t pushed = 0, popped = 0;
+        std::vector<std::string> expected;
+        for (int i = 0; i < 5000; i++)
+        {
+            std::string message = messageOf('a' + i % 26, 1 + (i * 37) % 300);
+            if (pushString(queue, BLE_LANE_REPLY, message))
+            {
+                expected.push_back(message);
+                pushed++;
+            }
+            if (i % 3 != 0 && popped < pushed)
+                intact &= popString(queue) == expected[popped++];
+        }
+        while (popped < pushed)
+            intact &= popString(queue) == expected[popped++];
+        bench.check(intact && pushed > 3000, "messages survive wrapping the ring");
+        bench.check(queue.getQueued() == 0 && queue.getBytesUsed() == 0, "a drained queue holds no bytes");
+
+        std::string large = messageOf('x', sizeof(replies));
+        bench.check(!pushString(queue, BLE_LANE_REPLY, large), "a message larger than its lane is refused");
+        while (pushString(queue, BLE_LANE_EVENT, messageOf('e', 100)))
+        {
+        }
+        bench.check(queue.getQueued() == 4 && pushString(queue, BLE_LANE_REPLY, "reply"), "a full event lane leaves the reply lane free");
+        while (queue.getQueued() > 0)
+            popString(queue);
+
+        std::string status = messageOf('s', 300);
+        bench.measure("queue round trip (push, front, pop) of 300 B", 200000, [&]
+                      {
+                          pushString(queue, BLE_LANE_REPLY, status);
+                          popString(queue); });
+        bench.report("queue RAM (reply + event lanes)", BLE_TX_REPLY_QUEUE_BYTES + BLE_TX_EVENT_QUEUE_BYTES, "bytes");
+    }
+
+    std::mutex receivedMutex;
+    std::vector<std::string> received;
+    uint32_t packetDelayUs = 0;
+
+    void captureMessages()
+    {
+        static NotificationAssembler assembler;
+        halSetNotifyHook([](const uint8_t *data, size_t length)
+                         {
+                             if (packetDelayUs)
+                                 std::this_thread::sleep_for(std::chrono::microseconds(packetDelayUs));
+                             std::string message;
+                             if (assembler.add(data, length, message))
+                             {
+                                 std::lock_guard<std::mutex> lock(receivedMutex);
+                                 received.push_back(message);
+                             } });
+    }
+
+    std::vector<std::string> takeReceived()
+    {
+        std::lock_guard<std::mutex> lock(receivedMutex);
+        std::vector<std::string> messages;
+        messages.swap(received);
+        return messages;
+    }
+
+    // Waits until `count` messages have arrived, then for stragglers
+    std::vector<std::string> waitForMessages(size_t count, int timeoutMs = 2000)
+    {
+        for (int waited = 0; waited < timeoutMs; waited++)
+        {
+            {
+                std::lock_guard<std::mutex> lock(receivedMutex);
+                if (received.size() >= count)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return takeReceived();
+    }
+
+    bool statusHas(BLEManager &ble, const char *field)
+    {
+        return std::string(ble.getStatus().c_str()).find(field) != std::string::npos;
+    }
+
+    void runTaskScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        BLEManager &ble = fw.bleManager;
+        halBleConnect(23);
+        captureMessages();
+
+        // A slow link: 2 ms per packet. Inline, the sender waits for every packet
+        String large(messageOf('r', 1024).c_str());
+        packetDelayUs = 2000;
+        auto t0 = std::chrono::steady_clock::now();
+        ble.sendResponse(large);
+        double inlineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        takeReceived();
+
+        bench.check(ble.startTask(), "BLE task starts");
+        t0 = std::chrono::steady_clock::now();
+        bool queued = ble.sendResponse(large);
+        double queuedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::vector<std::string> messages = waitForMessages(1);
+        bench.report("1 KB reply at MTU 23, 2 ms/packet: sender blocked inline", inlineMs, "ms");
+        bench.report("1 KB reply at MTU 23, 2 ms/packet: sender blocked queued", queuedMs, "ms");
+        bench.check(queued && messages.size() == 1 && messages[0] == large.c_str(), "a queued reply arrives whole");
+        bench.check(queuedMs * 10 < inlineMs, "queueing frees the sender from the link rate");
+
+        // A reply queued behind a burst of events overtakes them
+        for (int i = 0; i < 6; i++)
+            ble.sendNotification(String(messageOf('e', 200).c_str()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ble.sendResponse(String("{\"reply\":1}"));
+        messages = waitForMessages(7);
+        size_t replyAt = messages.size();
+        for (size_t i = 0; i < messages.size(); i++)
+            if (messages[i] == "{\"reply\":1}")
+                replyAt = i;
+        bench.report("reply position behind 6 queued events", replyAt, "messages");
+        bench.check(messages.size() == 7 && replyAt <= 1, "a reply overtakes queued events");
+
+        // A streamed reply waits for the replies queued before it
+        std::string streamed = messageOf('s', 600);
+        BleStreamProducer produce = [](JsonSink &sink, void *context)
+        {
+            const std::string &text = *static_cast<std::string *>(context);
+            sink.write(text.data(), text.size());
+        };
+        ble.sendResponse(large);
+        bool streamSent = ble.sendStream(streamed.size(), produce, &streamed);
+        messages = waitForMessages(2);
+        bench.check(streamSent && messages.size() == 2 && messages[0] == large.c_str() && messages[1] == streamed,
+                    "a streamed reply follows the replies queued before it");
+        packetDelayUs = 0;
+
+        halBleDisconnect();
+        ble.sendResponse(String("{\"reply\":0}"));
+        bench.check(!ble.sendStream(streamed.size(), produce, &streamed) && statusHas(ble, "\"droppedReplies\":1"),
+                    "a stream that cannot be sent is counted as a dropped reply");
+        halBleConnect(23);
+        messages = waitForMessages(1);
+
+        // Disconnected: messages wait, status events coalesce, replies lead
+        halBleDisconnect();
+        for (int i = 0; i < 10; i++)
+            ble.sendNotification(String(("{\"status\":" + std::to_string(i) + "}").c_str()), 1);
+        ble.sendNotification(String("{\"event\":\"LEARN_RESULT\"}"));
+        ble.sendResponse(String("{\"reply\":2}"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        bench.check(takeReceived().empty(), "nothing is sent while disconnected");
+        halBleConnect(23);
+        messages = waitForMessages(3);
+        bench.check(messages.size() == 3 && messages[0] == "{\"reply\":2}" && messages[1] == "{\"status\":9}" &&
+                        messages[2] == "{\"event\":\"LEARN_RESULT\"}",
+                    "queued messages follow the reconnect, coalesced to the latest status");
+        bench.check(statusHas(ble, "\"coalesced\":9"), "coalesced events are counted");
+
+        // Full lanes: events are dropped at once, replies after a short wait
+        halBleDisconnect();
+        String event(messageOf('e', 500).c_str()), reply(messageOf('r', 1000).c_str());
+        int events = 0, replies = 0;
+        while (ble.sendNotification(event))
+            events++;
+        while (ble.sendResponse(reply))
+            replies++;
+        bench.check(events == BLE_TX_EVENT_QUEUE_BYTES / 504 && replies == BLE_TX_REPLY_QUEUE_BYTES / 1004, "each lane holds what fits");
+        bench.check(statusHas(ble, "\"droppedReplies\":2") && statusHas(ble, "\"droppedEvents\":1"), "refused messages are counted");
+
+        // Replying from the write callback, as a BUSY rejection does, must
+        // not hold the BLE host up while the lane waits on it
+        bool hostQueued = true;
+        double hostMs = 0;
+        ble.setCommandCallback([&](const char *json, size_t length)
+                               {
+                                   auto start = std::chrono::steady_clock::now();
+                                   hostQueued = ble.sendResponse(reply);
+                                   hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); });
+        halBleWrite("{\"command\":\"GET_STATUS\"}");
+        bench.report("reply from the write callback, lane full", hostMs, "ms");
+        bench.check(!hostQueued && hostMs < BLE_TX_QUEUE_WAIT_MS / 5 && statusHas(ble, "\"droppedReplies\":3"),
+                    "a reply from the write callback is dropped at once when the lane is full");
+        ble.setCommandCallback([&fw](const char *json, size_t length)
+                               { fw.cmdProcessor.processCommand(json, length); });
+        halBleConnect(247);
+        messages = waitForMessages(events + replies);
+        bench.check((int)messages.size() == events + replies, "the backlog drains after reconnecting");
+
+        // Out of host buffers: a packet is retried after a back-off
+        halBleFailNotifies(3);
+        ble.sendResponse(String("{\"reply\":3}"));
+        messages = waitForMessages(1);
+        bench.check(messages.size() == 1 && messages[0] == "{\"reply\":3}" && statusHas(ble, "\"retries\":3"),
+                    "rejected notifications are retried until sent");
+
+        halBleFailNotifies(BLE_TX_MAX_RETRIES + 1);
+        ble.sendResponse(String("{\"reply\":4}"));
+        ble.sendResponse(String("{\"reply\":5}"));
+        messages = waitForMessages(1, 2 * BLE_TX_MAX_RETRIES * BLE_TX_RETRY_MS + 500);
+        bench.check(messages.size() == 1 && messages[0] == "{\"reply\":5}" && statusHas(ble, "\"abandoned\":1"),
+                    "a message the host keeps rejecting is abandoned");
+
+        // Cut off mid-message: sent again whole on the next connection
+        halBleConnect(23);
+        bool cut = false;
+        static NotificationAssembler assembler;
+        halSetNotifyHook([&cut](const uint8_t *data, size_t length)
+                         {
+                             std::string message;
+                             if (!cut)
+                             {
+                                 cut = true;
+                                 halBleDisconnect();
+                             }
+                             else if (assembler.add(data, length, message))
+                             {
+                                 std::lock_guard<std::mutex> lock(receivedMutex);
+                                 received.push_back(message);
+                             } });
+        ble.sendResponse(large);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        halBleConnect(23);
+        messages = waitForMessages(1);
+        bench.check(cut && messages.size() == 1 && messages[0] == large.c_str(), "a message cut by a disconnect is resent whole");
+
+        // Reconnected before the sender sees the disconnect: the rest of the
+        // message must not go out on the new link with the old framing
+        halBleConnect(247);
+        cut = false;
+        std::vector<std::string> packets;
+        static NotificationAssembler relinked;
+        halSetNotifyHook([&cut, &packets](const uint8_t *data, size_t length)
+                         {
+                             std::string message;
+                             if (!cut)
+                             {
+                                 cut = true;
+                                 halBleDisconnect();
+                                 halBleConnect(23);
+                                 return;
+                             }
+                             std::lock_guard<std::mutex> lock(receivedMutex);
+                             packets.push_back(std::string((const char *)data, length));
+                             if (relinked.add(data, length, message))
+                                 received.push_back(message); });
+        ble.sendResponse(large);
+        messages = waitForMessages(1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::string restart;
+        {
+            std::lock_guard<std::mutex> lock(receivedMutex);
+            messages.insert(messages.end(), received.begin(), received.end());
+            received.clear();
+            if (!packets.empty())
+                restart = packets[0];
+        }
+        bool restarted = restart.size() >= 3 && restart.size() <= 20 && (uint8_t)restart[0] == BLE_FRAGMENT_MAGIC &&
+                         restart[1] == 0 && (restart[2] & BLE_FRAG_FIRST);
+        bench.check(cut && restarted && messages.size() == 1 && messages[0] == large.c_str(),
+                    "a message cut by a quick reconnect restarts with the new link's framing");
+    }
+}
+
+ESPIR_BENCH(ble_tx_queue)
+{
+    runQueueChecks(bench);
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        BenchRunner childBench;
+        runTaskScenario(childBench);
+        fflush(stdout);
+        _exit(childBench.failures() == 0 ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    bench.check(child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "BLE task scenario completed");
+}
@@ -0,0 +1,146 @@
+/**
+ * Capture Pool Benchmarks
+ *
+ * Learned captures, their copies and queued raw transmissions share pool
+ * buffers: the capture path must not allocate, copies must not duplicate
+ * the timings and every buffer must return to the pool. Runs in a child
+ * process because it starts an IR task.
+ */
+
+#include "bench.h"
+#include "ir_manager.h"
+#include "hal_native.h"
+#include "bench_fixture.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    std::vector<uint16_t> necFrame()
+    {
+        std::vector<uint16_t> raw = {9000, 4500};
+        for (int bit = 31; bit >= 0; bit--)
+        {
+            raw.push_back(560);
+            raw.push_back((0x20DF10EFu >> bit) & 1 ? 1690 : 560);
+        }
+        raw.push_back(560);
+        return raw;
+    }
+
+    bool waitFor(const std::atomic<bool> &flag)
+    {
+        for (int i = 0; i < 2000 && !flag; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return flag;
+    }
+
+    void onTransmitted(void *context, bool success)
+    {
+        static_cast<std::atomic<bool> *>(context)->store(true);
+    }
+
+    void runPoolScenario(BenchRunner &bench)
+    {
+        static IRManager ir;
+        halRmtReset(); // Channels the parent's fixture set up
+        ir.begin();
+        CapturePool &pool = ir.getCapturePool();
+        const std::vector<uint16_t> raw = necFrame();
+
+        // Capture: the receiver buffer moves into a pool buffer once and
+        // every copy of the learned code shares it
+        uint64_t allocations = 0;
+        bool shared = true, intact = true;
+        const int captures = 200;
+        for (int i = 0; i < captures; i++)
+        {
+            ir.startLearning();
+            injectIRTimings(raw.data(), raw.size());
+            uint64_t before = benchAllocationCount();
+            ir.update();
+            IRCode learned = ir.getLearnedCode();
+            IRCode copy = learned;
+            allocations += benchAllocationCount() - before;
+            shared &= learned.rawData && learned.rawData == copy.rawData && learned.rawData == learned.buffer.data();
+            intact &= learned.rawLen == raw.size() && memcmp(learned.rawData, raw.data(), raw.size() * sizeof(uint16_t)) == 0;
+        }
+        bench.report("heap allocations per capture", (double)allocations / captures, "allocs");
+        bench.check(allocations == 0, "learning a raw capture does not allocate");
+        bench.check(shared, "copies of a learned code share its pool buffer");
+        bench.check(intact, "pool buffer holds the captured timings");
+        bench.check(pool.getUsed() == 1, "only the last learned code holds a buffer");
+
+        IRCode learned = ir.getLearnedCode();
+        bench.measure("copy learned code handle", 20000, [&]
+                      { IRCode copy = learned; });
+
+        // Exhaustion: a capture still reports its protocol fields, the raw
+        // part is dropped and counted
+        ir.startLearning();
+        learned = IRCode();
+        std::vector<RawBuffer> held;
+        while (RawBuffer buffer = pool.acquire())
+            held.push_back(buffer);
+        uint32_t failures = pool.getFailures();
+        injectIRTimings(raw.data(), raw.size());
+        ir.update();
+        learned = ir.getLearnedCode();
+        bench.check(learned.protocol == NEC && learned.rawLen == 0 && !learned.buffer,
+                    "an exhausted pool drops raw timings but keeps the code");
+        bench.check(pool.getFailures() > failures, "allocation failures are counted");
+        bench.check(pool.getPeakUsed() == CAPTURE_POOL_BUFFERS, "peak usage reaches the pool size");
+        held.clear();
+        learned = IRCode();
+        bench.check(pool.getUsed() == 0, "released handles return every buffer");
+
+        // Queued transmissions: a pool-backed code is shared with the job,
+        // any other raw code is copied into a buffer the job owns
+        ir.startTask();
+        ir.startLearning();
+        injectIRTimings(raw.data(), raw.size());
+        for (int i = 0; i < 2000 && !ir.hasLearnedCode(); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        learned = ir.getLearnedCode();
+
+        uint32_t acquisitions = pool.getAcquisitions();
+        std::atomic<bool> done(false);
+        bench.check(ir.queueTransmit(learned, onTransmitted, &done) && waitFor(done), "learned code transmits from the queue");
+        bench.check(pool.getAcquisitions() == acquisitions, "transmitting a learned code does not copy it");
+
+        std::vector<uint16_t> stored(raw);
+        IRCode external = IRCode();
+        external.protocol = UNKNOWN;
+        external.rawData = stored.data();
+        external.rawLen = stored.size();
+        done = false;
+        bench.check(ir.queueTransmit(external, onTransmitted, &done) && waitFor(done), "stored code transmits from the queue");
+        bench.check(pool.getAcquisitions() == acquisitions + 1, "a stored code is copied into one pool buffer");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        bench.check(pool.getUsed() == 1, "finished transmissions release their buffers");
+
+        bench.report("pool buffers", pool.getCapacity(), "buffers");
+        bench.report("pool peak used", pool.getPeakUsed(), "buffers");
+        bench.report("pool bytes", (double)CAPTURE_POOL_BUFFERS * MAX_IR_CODE_SIZE * sizeof(uint16_t), "bytes");
+    }
+}
+
+ESPIR_BENCH(capture_pool)
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        BenchRunner childBench;
+        runPoolScenario(childBench);
+        fflush(stdout);
+        _exit(childBench.failures() == 0 ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    bench.check(child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0, "capture pool scenario completed");
+}
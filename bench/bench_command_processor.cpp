@@ -0,0 +1,299 @@
+/**
+ * Command Processor Benchmarks
+ *
+ * End-to-end cost of processCommand() for the common commands, and of the
+ * full BLE write path through CharacteristicCallbacks::onWrite().
+ *
+ * streamed_replies compares LIST_DEVICES and EXPORT_DEVICES written from
+ * the store straight into BLE packets with the document pipeline they
+ * replace, for time and peak heap, and checks the streamed JSON.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+
+ESPIR_BENCH(command_processor)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 50, 20);
+
+    const String getStatus = "{\"command\":\"GET_STATUS\",\"parameters\":{}}";
+    const String transmitFirst = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-0\",\"command\":\"cmd-0\"}}";
+    const String transmitLast = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-49\",\"command\":\"cmd-19\"}}";
+    const String listDevices = "{\"command\":\"LIST_DEVICES\",\"parameters\":{}}";
+    const String unknown = "{\"command\":\"NOPE\",\"parameters\":{}}";
+    const String invalid = "{\"command\":";
+
+    uint32_t before = fw.notificationCount;
+    bench.measure("processCommand(GET_STATUS)", 2000, [&]
+                  { fw.cmdProcessor.processCommand(getStatus); });
+    bench.check(fw.notificationCount - before == 2000, "GET_STATUS sends one response per command");
+
+    resetIRSends();
+    bench.measure("processCommand(TRANSMIT) first slot", 5000, [&]
+                  { fw.cmdProcessor.processCommand(transmitFirst); });
+    bench.measure("processCommand(TRANSMIT) last slot", 5000, [&]
+                  { fw.cmdProcessor.processCommand(transmitLast); });
+    bench.check(irSendCount() == 10000, "every TRANSMIT reaches the transmitter");
+
+    bench.measure("processCommand(LIST_DEVICES) 50 devices", 500, [&]
+                  { fw.cmdProcessor.processCommand(listDevices); });
+    bench.measure("processCommand(unknown command)", 5000, [&]
+                  { fw.cmdProcessor.processCommand(unknown); });
+    bench.measure("processCommand(invalid JSON)", 5000, [&]
+                  { fw.cmdProcessor.processCommand(invalid); });
+
+    const std::string transmitWrite = transmitLast.c_str();
+    bench.measure("BLE onWrite -> notify (TRANSMIT)", 5000, [&]
+                  { halBleWrite(transmitWrite); });
+    bench.report("TRANSMIT response size", fw.lastNotification.size(), "bytes");
+
+    // A five-code scene: five TRANSMITs against one BATCH, firmware side only
+    std::vector<String> sceneTransmits;
+    String batch = "{\"command\":\"BATCH\",\"parameters\":{\"steps\":[";
+    for (int i = 0; i < 5; i++)
+    {
+        String device = "device-" + String(i * 10 + 9), command = "cmd-" + String(i * 4 + 3);
+        sceneTransmits.push_back("{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"" + device + "\",\"command\":\"" + command + "\"}}");
+        batch += String(i ? "," : "") + "{\"device\":\"" + device + "\",\"command\":\"" + command + "\"}";
+    }
+    batch += "]}}";
+
+    resetIRSends();
+    before = fw.notificationCount;
+    bench.measure("5-code scene as 5x processCommand(TRANSMIT)", 2000, [&]
+                  {
+                      for (const String &transmit : sceneTransmits)
+                          fw.cmdProcessor.processCommand(transmit); });
+    bench.check(fw.notificationCount - before == 10000, "separate TRANSMITs answer every code");
+    before = fw.notificationCount;
+    bench.measure("5-code scene as processCommand(BATCH)", 2000, [&]
+                  { fw.cmdProcessor.processCommand(batch); });
+    bench.check(fw.notificationCount - before == 2000 && fw.lastNotification.find("\"sends\":5") != std::string::npos,
+                "a BATCH answers once for the whole scene");
+    bench.check(irSendCount() == 20000, "every code of both scenes reaches the transmitter");
+}
+
+namespace
+{
+    // The library as read back from a reply, to replay the old pipeline
+    struct Row
+    {
+        std::string name, type, manufacturer, model;
+        std::vector<std::pair<std::string, std::string>> commands;
+        uint32_t id, commandCount;
+    };
+
+    std::vector<Row> readRows(const std::string &reply)
+    {
+        DynamicJsonDocument doc(262144);
+        deserializeJson(doc, reply);
+        std::vector<Row> rows;
+        for (JsonObject device : doc["data"]["devices"].as<JsonArray>())
+        {
+            Row row;
+            row.name = device["name"].as<const char *>();
+            row.type = device["type"].as<const char *>();
+            row.manufacturer = device["manufacturer"].as<const char *>();
+            row.model = device["model"].as<const char *>();
+            row.id = device["id"] | 0;
+            row.commandCount = device["commandCount"] | 0;
+            for (JsonObject command : device["commands"].as<JsonArray>())
+                row.commands.emplace_back(command["name"].as<const char *>(), command["description"].as<const char *>());
+            rows.push_back(row);
+        }
+        return rows;
+    }
+
+    // What a reply cost before streaming: the body filled into a document
+    // by pointer, serialized, parsed back, copied into the envelope
+    // document and serialized again before it was queued
+    void legacyReply(FirmwareFixture &fw, DynamicJsonDocument &body)
+    {
+        String bodyJson;
+        serializeJson(body, bodyJson);
+        DynamicJsonDocument parsed(body.capacity());
+        deserializeJson(parsed, bodyJson);
+        DynamicJsonDocument response(256 + parsed.memoryUsage());
+        response["status"] = "OK";
+        response["message"] = "Device list retrieved";
+        response["timestamp"] = millis();
+        response["data"] = parsed;
+        String responseJson;
+        serializeJson(response, responseJson);
+        fw.bleManager.sendResponse(responseJson);
+    }
+
+    void legacyListDevices(FirmwareFixture &fw, const std::vector<Row> &rows)
+    {
+        DynamicJsonDocument doc(2048);
+        JsonArray devices = doc.createNestedArray("devices");
+        for (const Row &row : rows)
+        {
+            JsonObject device = devices.createNestedObject();
+            device["id"] = row.id;
+            device["name"] = row.name.c_str();
+            device["type"] = row.type.c_str();
+            device["manufacturer"] = row.manufacturer.c_str();
+            device["model"] = row.model.c_str();
+            device["commandCount"] = row.commandCount;
+        }
+        doc["count"] = rows.size();
+        legacyReply(fw, doc);
+    }
+
+    void legacyExport(FirmwareFixture &fw, const std::vector<Row> &rows)
+    {
+        DynamicJsonDocument doc(4096);
+        JsonArray devices = doc.createNestedArray("devices");
+        for (const Row &row : rows)
+        {
+            JsonObject device = devices.createNestedObject();
+            device["name"] = row.name.c_str();
+            device["type"] = row.type.c_str();
+            device["manufacturer"] = row.manufacturer.c_str();
+            device["model"] = row.model.c_str();
+            JsonArray commands = device.createNestedArray("commands");
+            for (const auto &entry : row.commands)
+            {
+                JsonObject command = commands.createNestedObject();
+                command["name"] = entry.first.c_str();
+                command["description"] = entry.second.c_str();
+            }
+        }
+        doc["version"] = "1.0";
+        doc["exported"] = millis();
+        legacyReply(fw, doc);
+    }
+
+    // Heap held at the peak of one call, above what was held before it
+    template <typename Fn>
+    size_t peakHeap(Fn &&fn)
+    {
+        size_t before = benchHeapInUse();
+        benchResetHeapPeak();
+        fn();
+        return benchHeapPeak() - before;
+    }
+
+    size_t devicesIn(const std::string &reply)
+    {
+        DynamicJsonDocument doc(262144);
+        if (deserializeJson(doc, reply))
+            return 0;
+        return doc["data"]["devices"].size();
+    }
+}
+
+ESPIR_BENCH(streamed_replies)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    const String listDevices = "{\"command\":\"LIST_DEVICES\",\"parameters\":{},\"requestId\":\"list-1\"}";
+    const String exportDevices = "{\"command\":\"EXPORT_DEVICES\",\"parameters\":{}}";
+
+    // The streamed reply is the JSON the String form builds, in the envelope
+    populateDevices(fw.deviceManager, 50, 20);
+    Device odd;
+    odd.name = "Den \"TV\" \\ 2";
+    odd.type = "TV\tbox";
+    odd.commandCount = 0;
+    fw.deviceManager.removeDevice("device-49");
+    fw.deviceManager.addDevice(odd);
+    fw.cmdProcessor.processCommand(listDevices);
+    std::string list = fw.lastNotification;
+    DynamicJsonDocument parsed(65536);
+    bool valid = !deserializeJson(parsed, list);
+    bench.check(valid && parsed["status"].as<String>() == "OK" && parsed["requestId"].as<String>() == "list-1" && parsed["data"]["count"] == 50,
+                "LIST_DEVICES streams a valid reply with its requestId");
+    bench.check(list.find(fw.deviceManager.getDeviceList().c_str()) != std::string::npos,
+                "the streamed list is the one getDeviceList() returns");
+    bench.check(valid && parsed["data"]["devices"][49]["name"].as<String>() == "Den \"TV\" \\ 2" &&
+                    parsed["data"]["devices"][49]["type"].as<String>() == "TV\tbox",
+                "names are escaped");
+    populateDevices(fw.deviceManager, 50, 20);
+
+    fw.cmdProcessor.processCommand(exportDevices);
+    std::string exported = fw.lastNotification;
+    std::vector<Row> exportRows = readRows(exported);
+    size_t commands = 0;
+    for (const Row &row : exportRows)
+        commands += row.commands.size();
+    bench.report("EXPORT_DEVICES reply, 50 x 20", exported.size(), "bytes");
+    bench.check(exportRows.size() == 50 && commands == 1000, "EXPORT_DEVICES carries every device and command");
+
+    // The smallest MTU: every byte goes out in 20-byte packets
+    halBleConnect(23);
+    fw.cmdProcessor.processCommand(exportDevices);
+    std::vector<Row> smallMtuRows = readRows(fw.lastNotification);
+    bench.check(smallMtuRows.size() == 50 && smallMtuRows.back().commands.size() == 20,
+                "a streamed reply reassembles at the smallest MTU");
+    halBleConnect(247);
+
+    // Ordinary descriptions take the same library past 64 KB
+    fw.deviceManager.reset();
+    for (int d = 0; d < 50; d++)
+    {
+        Device device;
+        device.name = "device-" + String(d);
+        device.commandCount = 0;
+        fw.deviceManager.addDevice(device);
+        for (int c = 0; c < 20; c++)
+        {
+            IRCommand command;
+            command.name = "cmd-" + String(c);
+            command.description = "Sent from the living room remote profile, learned from the original handset";
+            command.code = IRCode();
+            command.code.protocol = NEC;
+            command.code.data = 0x20DF0000ULL | (d << 8) | c;
+            command.code.bits = 32;
+            fw.deviceManager.addCommand(device.name, command);
+        }
+    }
+    fw.cmdProcessor.processCommand(exportDevices);
+    std::vector<Row> longRows = readRows(fw.lastNotification);
+    bench.report("EXPORT_DEVICES reply, 50 x 20 with descriptions", fw.lastNotification.size(), "bytes");
+    bench.check(fw.lastNotification.size() > BLE_FRAG_MAX_MESSAGE && longRows.size() == 50 && longRows.back().commands.size() == 20,
+                "a streamed reply past 64 KB arrives whole");
+    populateDevices(fw.deviceManager, 50, 20);
+
+    fw.cmdProcessor.processCommand(listDevices);
+    std::vector<Row> listRows = readRows(fw.lastNotification);
+
+    // The old pipeline, then the streamed one, for the same library
+    legacyListDevices(fw, listRows);
+    bench.report("LIST_DEVICES devices in reply, before", devicesIn(fw.lastNotification), "devices");
+    size_t legacyListPeak = peakHeap([&]
+                                     { legacyListDevices(fw, listRows); });
+    size_t legacyExportPeak = peakHeap([&]
+                                       { legacyExport(fw, exportRows); });
+    size_t listPeak = peakHeap([&]
+                               { fw.cmdProcessor.processCommand(listDevices); });
+    size_t exportPeak = peakHeap([&]
+                                 { fw.cmdProcessor.processCommand(exportDevices); });
+    bench.report("LIST_DEVICES peak heap, before", legacyListPeak, "bytes");
+    bench.report("LIST_DEVICES peak heap, streamed", listPeak, "bytes");
+    bench.report("EXPORT_DEVICES peak heap, before", legacyExportPeak, "bytes");
+    bench.report("EXPORT_DEVICES peak heap, streamed", exportPeak, "bytes");
+
+    bench.measure("LIST_DEVICES 50 devices, before", 500, [&]
+                  { legacyListDevices(fw, listRows); });
+    bench.measure("LIST_DEVICES 50 devices, streamed", 500, [&]
+                  { fw.cmdProcessor.processCommand(listDevices); });
+    bench.measure("export 50 x 20, before", 100, [&]
+                  { legacyExport(fw, exportRows); });
+    bench.measure("EXPORT_DEVICES 50 x 20, streamed", 100, [&]
+                  { fw.cmdProcessor.processCommand(exportDevices); });
+
+    // Memory does not follow the library's size
+    populateDevices(fw.deviceManager, 2, 2);
+    fw.cmdProcessor.processCommand(exportDevices);
+    size_t smallPeak = peakHeap([&]
+                                { fw.cmdProcessor.processCommand(exportDevices); });
+    bench.report("EXPORT_DEVICES peak heap, 2 x 2", smallPeak, "bytes");
+    bench.check(exportPeak <= smallPeak + 256, "a streamed export holds the same heap for 2 x 2 as for 50 x 20");
+    bench.check(exportPeak * 4 < legacyExportPeak, "streaming holds a fraction of the document pipeline's heap");
+}
@@ -0,0 +1,190 @@
+/**
+ * Command Table Benchmarks
+ *
+ * Every command name finds its own entry through the compile-time perfect
+ * hash and nothing else does; parameters that are missing or of the wrong
+ * type are answered before the handler runs. Measures finding the entry
+ * and checking the parameters of each command, against the strcmp chain
+ * and required-field check it replaced.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "command_table.h"
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char *const commandNames[] = {
+        CMD_LEARN, CMD_STOP_LEARN, CMD_TRANSMIT, CMD_LIST_DEVICES, CMD_EXPORT_DEVICES, CMD_ADD_DEVICE,
+        CMD_DELETE_DEVICE, CMD_BATCH, CMD_ADD_MACRO, CMD_RUN_MACRO, CMD_DELETE_MACRO, CMD_LIST_MACROS,
+        CMD_GET_STATUS, CMD_MONITOR, CMD_TRACE, CMD_RESET};
+    const size_t commandCount = sizeof(commandNames) / sizeof(commandNames[0]);
+
+    // A typical request for each command, in commandNames order
+    const char *const requests[commandCount] = {
+        "{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":3}}",
+        "{\"command\":\"STOP_LEARN\",\"parameters\":{}}",
+        "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\",\"command\":\"cmd-4\"}}",
+        "{\"command\":\"LIST_DEVICES\",\"parameters\":{}}",
+        "{\"command\":\"EXPORT_DEVICES\",\"parameters\":{}}",
+        "{\"command\":\"ADD_DEVICE\",\"parameters\":{\"name\":\"tv\",\"type\":\"TV\",\"manufacturer\":\"LG\",\"model\":\"C1\"}}",
+        "{\"command\":\"DELETE_DEVICE\",\"parameters\":{\"name\":\"tv\"}}",
+        "{\"command\":\"BATCH\",\"parameters\":{\"steps\":[{\"device\":\"device-1\",\"command\":\"cmd-1\"}]}}",
+        "{\"command\":\"ADD_MACRO\",\"parameters\":{\"name\":\"movie\",\"steps\":[{\"device\":\"device-1\",\"command\":\"cmd-1\"}]}}",
+        "{\"command\":\"RUN_MACRO\",\"parameters\":{\"name\":\"movie\"}}",
+        "{\"command\":\"DELETE_MACRO\",\"parameters\":{\"name\":\"movie\"}}",
+        "{\"command\":\"LIST_MACROS\",\"parameters\":{}}",
+        "{\"command\":\"GET_STATUS\",\"parameters\":{}}",
+        "{\"command\":\"MONITOR\",\"parameters\":{\"enabled\":true}}",
+        "{\"command\":\"TRACE\",\"parameters\":{\"clear\":false}}",
+        "{\"command\":\"RESET\",\"parameters\":{\"type\":\"soft\"}}",
+    };
+
+    bool routes(const JsonDocument &doc)
+    {
+        const CommandProcessor::CommandSpec *spec = CommandProcessor::findCommand(doc["command"] | "");
+        const CommandParam *failed;
+        return spec && checkParameters(doc["parameters"], spec->params, spec->missing != nullptr, failed) == PARAMS_OK;
+    }
+
+    // What dispatch did before the table: strcmp down the chain, then the
+    // handler's required-field check
+    bool legacyValidate(const JsonDocument &cmd, const char *const requiredFields[], int fieldCount)
+    {
+        if (!cmd.containsKey("parameters") || !cmd["parameters"].is<JsonObject>())
+            return false;
+        for (int i = 0; i < fieldCount; i++)
+        {
+            if (!cmd["parameters"].containsKey(requiredFields[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool legacyRoutes(const JsonDocument &doc)
+    {
+        static const char *const transmitFields[] = {"device", "command"};
+        static const char *const addDeviceFields[] = {"name", "type"};
+        static const char *const nameField[] = {"name"};
+        static const char *const stepsField[] = {"steps"};
+        static const char *const macroFields[] = {"name", "steps"};
+
+        const char *command = doc["command"] | "";
+        for (size_t i = 0; i < commandCount; i++)
+        {
+            if (strcmp(command, commandNames[i]) != 0)
+                continue;
+            switch (i)
+            {
+            case 2:
+                return legacyValidate(doc, transmitFields, 2);
+            case 5:
+                return legacyValidate(doc, addDeviceFields, 2);
+            case 6:
+            case 9:
+            case 10:
+                return legacyValidate(doc, nameField, 1);
+            case 7:
+                return legacyValidate(doc, stepsField, 1);
+            case 8:
+                return legacyValidate(doc, macroFields, 2);
+            default:
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool replied(FirmwareFixture &fw, const char *json, const char *expected)
+    {
+        fw.cmdProcessor.processCommand(json, strlen(json));
+        return fw.lastNotification.find(expected) != std::string::npos;
+    }
+}
+
+ESPIR_BENCH(command_table)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 20, 10);
+
+    bool allFound = true;
+    for (const char *name : commandNames)
+    {
+        const CommandProcessor::CommandSpec *spec = CommandProcessor::findCommand(name);
+        allFound = allFound && spec && strcmp(spec->name, name) == 0;
+    }
+    bench.check(allFound, "every command name finds its own entry");
+    bench.check(!CommandProcessor::findCommand("") && !CommandProcessor::findCommand("TRANS") &&
+                    !CommandProcessor::findCommand("transmit") && !CommandProcessor::findCommand("TRANSMITS") &&
+                    !CommandProcessor::findCommand("GET_STATUS_"),
+                "other names find nothing");
+
+    // Parameters are answered from the table before the handler runs
+    bench.check(replied(fw, "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\"}}",
+                        "\"error\":\"MISSING_PARAMETERS\",\"details\":\"Device and command parameters required\""),
+                "a missing required parameter gets the command's own message");
+    bench.check(replied(fw, "{\"command\":\"LEARN\"}", "Parameters must be a valid object"),
+                "a command that needs parameters refuses a request without them");
+    bench.check(replied(fw, "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":7,\"command\":\"cmd-4\"}}",
+                        "\"error\":\"INVALID_PARAMETER\",\"details\":\"device must be a string\""),
+                "a parameter of the wrong type is named");
+    bench.check(replied(fw, "{\"command\":\"BATCH\",\"parameters\":{\"steps\":{}}}", "steps must be an array") &&
+                    replied(fw, "{\"command\":\"MONITOR\",\"parameters\":{\"enabled\":\"yes\"}}", "enabled must be true or false") &&
+                    replied(fw, "{\"command\":\"LEARN\",\"parameters\":{\"timeout\":\"soon\"}}", "timeout must be an integer"),
+                "arrays, booleans and integers are checked too");
+    bench.check(replied(fw, "{\"command\":\"LIST_DEVICES\"}", "Device list retrieved"),
+                "commands with optional parameters run without them");
+    bench.check(replied(fw, "{\"command\":\"NOPE\",\"parameters\":{}}", "UNKNOWN_COMMAND"), "unknown commands are refused");
+
+    // Finding the entry and checking the parameters, per command
+    std::vector<DynamicJsonDocument> docs;
+    docs.reserve(commandCount);
+    for (const char *request : requests)
+    {
+        docs.emplace_back(1024);
+        deserializeJson(docs.back(), request);
+    }
+    bool allRoute = true, legacyAgrees = true;
+    for (const DynamicJsonDocument &doc : docs)
+    {
+        allRoute = allRoute && routes(doc);
+        legacyAgrees = legacyAgrees && legacyRoutes(doc);
+    }
+    bench.check(allRoute && legacyAgrees, "each typical request passes both dispatchers");
+
+    for (size_t i = 0; i < commandCount; i++)
+    {
+        std::string label = std::string("table ") + commandNames[i];
+        const DynamicJsonDocument &doc = docs[i];
+        bench.measure(label.c_str(), 100000, [&]
+                      { benchKeep(routes(doc)); });
+    }
+    bench.measure("table, all 16 commands", 10000, [&]
+                  {
+                      for (const DynamicJsonDocument &doc : docs)
+                          benchKeep(routes(doc)); });
+    bench.measure("strcmp chain, all 16 commands", 10000, [&]
+                  {
+                      for (const DynamicJsonDocument &doc : docs)
+                          benchKeep(legacyRoutes(doc)); });
+    bench.measure("strcmp chain RESET (last)", 100000, [&]
+                  { benchKeep(legacyRoutes(docs.back())); });
+
+    // The name lookup on its own, without the documents
+    bench.measure("findCommand, all 16 names", 100000, [&]
+                  {
+                      for (const char *name : commandNames)
+                          benchKeep(CommandProcessor::findCommand(name)); });
+    bench.measure("strcmp chain, all 16 names", 100000, [&]
+                  {
+                      for (const char *name : commandNames)
+                      {
+                          size_t i = 0;
+                          while (i < commandCount && strcmp(name, commandNames[i]) != 0)
+                              i++;
+                          benchKeep(i);
+                      } });
+}
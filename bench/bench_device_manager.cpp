@@ -0,0 +1,1099 @@
+/**
+ * Device Manager Benchmarks
+ *
+ * Persistence cost (every mutation appends one record to the LittleFS
+ * write-ahead log, against rewriting its device record and the manifest),
+ * boot and lazy-load cost of the record store, and command lookup latency,
+ * through the DeviceManager at the configured limits and through a bare
+ * CommandIndex at larger ones. device_power_loss cuts power at every byte
+ * of a mutation script and checks what a reboot recovers;
+ * device_load_failure cuts a record short and checks the device is left
+ * read-only rather than saved with half its commands, and
+ * device_write_failure fails a record write during compaction and checks
+ * the change survives the retry, and device_replay_raw_failure damages a
+ * logged command's timings. device_store
+ * reports the DRAM footprint of the store against the String-based layout
+ * and checks slot and arena reuse. device_code_sharing stores one learned
+ * button twice and checks it is found as a duplicate and stored once;
+ * device_raw_arena fills the raw arena to its limit and checks it loads
+ * and replays whole; device_import imports codes and libraries that do
+ * not fit, and imports an export back.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <hal_native.h>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+ESPIR_BENCH(device_persistence)
+{
+    DeviceManager &dm = firmwareFixture().deviceManager;
+    const int sizes[] = {1, 10, 50};
+    double firstBytes = 0, lastBytes = 0;
+
+    for (int deviceCount : sizes)
+    {
+        populateDevices(dm, deviceCount, 20);
+        dm.compactStorage();
+        Device device;
+        dm.getDevice("device-0", device);
+
+        LittleFS.resetCounters();
+        char label[64];
+        snprintf(label, sizeof(label), "updateDevice (log append), %d devices", deviceCount);
+        const uint32_t iterations = 500;
+        bench.measure(label, iterations, [&]
+                      { dm.updateDevice(device); });
+
+        snprintf(label, sizeof(label), "flash bytes written/op, %d devices", deviceCount);
+        lastBytes = (double)LittleFS.getBytesWritten() / iterations;
+        firstBytes = firstBytes ? firstBytes : lastBytes;
+        bench.report(label, lastBytes, "bytes");
+        bench.check(LittleFS.getFilesWritten() == iterations, "each metadata change commits one log append");
+    }
+    bench.check(lastBytes == firstBytes, "log append cost does not grow with the library");
+
+    // A command change appends one record; the rewrite it replaces is one
+    // device record plus the manifest, which is what a compaction writes
+    IRCommand command;
+    command.name = "cmd-5";
+    command.description = "Benchmark command";
+    command.code.protocol = NEC;
+    command.code.data = 0x20DF0705;
+    command.code.bits = 32;
+    command.code.rawData = nullptr;
+    command.code.rawLen = 0;
+
+    LittleFS.resetCounters();
+    const uint32_t iterations = 250;
+    BenchResult logged = bench.measure("remove + re-add command (log), 50 devices", iterations, [&]
+                                       {
+                                           dm.removeCommand("device-7", "cmd-5");
+                                           dm.addCommand("device-7", command); });
+    double logBytes = (double)LittleFS.getBytesWritten() / (2 * iterations);
+    bench.report("command mutations/s (log), 50 devices", 2 * logged.opsPerSec, "ops/s");
+    bench.report("flash bytes written/mutation (log, compaction included), 50 devices", logBytes, "bytes");
+
+    LittleFS.resetCounters();
+    BenchResult rewritten = bench.measure("remove + re-add command (rewrite), 50 devices", iterations, [&]
+                                          {
+                                              dm.removeCommand("device-7", "cmd-5");
+                                              dm.compactStorage();
+                                              dm.addCommand("device-7", command);
+                                              dm.compactStorage(); });
+    double rewriteBytes = (double)LittleFS.getBytesWritten() / (2 * iterations);
+    bench.report("command mutations/s (rewrite), 50 devices", 2 * rewritten.opsPerSec, "ops/s");
+    bench.report("flash bytes written/mutation (rewrite), 50 devices", rewriteBytes, "bytes");
+    bench.check(logBytes * 4 < rewriteBytes, "the log writes a fraction of a record rewrite");
+
+    // Bulk setup stays on appends; compactions only follow the log's size
+    LittleFS.resetCounters();
+    BenchResult bulk = bench.measure("bulk setup, 50 devices x 20 commands", 1, [&]
+                                     { populateDevices(dm, 50, 20); });
+    bench.report("bulk setup mutations/s", 1050 / (bulk.meanNs / 1e9), "ops/s");
+    bench.report("bulk setup flash bytes written", LittleFS.getBytesWritten(), "bytes");
+}
+
+namespace
+{
+    // Everything a reboot should bring back, in a comparable form
+    std::string fingerprint(DeviceManager &dm)
+    {
+        static const char *const devices[] = {"tv", "amp"};
+        static const char *const commands[] = {"power", "raw", "vol", "mute", "power2"};
+        std::string result;
+        char line[160];
+
+        for (const char *name : devices)
+        {
+            Device device;
+            if (!dm.getDevice(name, device))
+                continue;
+            snprintf(line, sizeof(line), "%s#%u %s/%s/%s %u;", name, device.id, device.type.c_str(), device.manufacturer.c_str(),
+                     device.model.c_str(), device.commandCount);
+            result += line;
+
+            for (const char *commandName : commands)
+            {
+                IRCode code;
+                uint8_t deviceId, commandId;
+                if (!dm.getCommand(name, commandName, code) || !dm.findCommandId(name, commandName, deviceId, commandId))
+                    continue;
+                uint32_t rawSum = 0;
+                for (uint16_t i = 0; i < code.rawLen; i++)
+                    rawSum = rawSum * 31 + code.rawData[i];
+                snprintf(line, sizeof(line), " %s#%u %d %llx/%u raw %u:%u;", commandName, commandId, (int)code.protocol,
+                         (unsigned long long)code.data, code.bits, code.rawLen, rawSum);
+                result += line;
+            }
+        }
+
+        for (const char *name : {"scene", "night"})
+        {
+            MacroStep steps[BATCH_MAX_STEPS];
+            uint8_t count;
+            if (!dm.getMacro(name, steps, count))
+                continue;
+            result += std::string("macro ") + name;
+            for (uint8_t i = 0; i < count; i++)
+            {
+                snprintf(line, sizeof(line), " %u.%u x%u +%u", steps[i].deviceId, steps[i].commandId, steps[i].repeat, steps[i].delayMs);
+                result += line;
+            }
+            result += ";";
+        }
+        return result;
+    }
+
+    // A macro of the given device/command pairs, resolved to their ids
+    bool storeMacro(DeviceManager &dm, const char *name, std::initializer_list<std::pair<const char *, const char *>> pairs)
+    {
+        MacroStep steps[BATCH_MAX_STEPS];
+        uint8_t count = 0;
+        for (const auto &pair : pairs)
+        {
+            MacroStep &step = steps[count++];
+            if (!dm.findCommandId(pair.first, pair.second, step.deviceId, step.commandId))
+                return false;
+            step.repeat = count;
+            step.delayMs = 100 * count;
+        }
+        return dm.setMacro(name, steps, count);
+    }
+
+    IRCommand necCommand(const char *name, uint64_t data)
+    {
+        IRCommand command;
+        command.name = name;
+        command.description = "Power loss";
+        command.code.protocol = NEC;
+        command.code.data = data;
+        command.code.bits = 32;
+        command.code.rawData = nullptr;
+        command.code.rawLen = 0;
+        return command;
+    }
+
+    Device namedDevice(const char *name, const char *model)
+    {
+        Device device;
+        device.name = name;
+        device.type = "TV";
+        device.manufacturer = "Bench";
+        device.model = model;
+        device.commandCount = 0;
+        return device;
+    }
+}
+
+ESPIR_BENCH(device_power_loss)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    static uint16_t timings[40];
+    for (int i = 0; i < 40; i++)
+        timings[i] = 400 + 13 * i;
+
+    // Every kind of mutation, with a compaction in the middle
+    const std::vector<std::function<void(DeviceManager &)>> script = {
+        [](DeviceManager &dm)
+        { dm.addDevice(namedDevice("tv", "M1")); },
+        [](DeviceManager &dm)
+        { dm.addCommand("tv", necCommand("power", 0x20DF10EF)); },
+        [](DeviceManager &dm)
+        {
+            IRCommand raw = necCommand("raw", 0);
+            raw.code.protocol = UNKNOWN;
+            raw.code.bits = 0;
+            raw.code.rawData = timings;
+            raw.code.rawLen = 40;
+            dm.addCommand("tv", raw);
+        },
+        [](DeviceManager &dm)
+        { dm.addDevice(namedDevice("amp", "A1")); },
+        [](DeviceManager &dm)
+        { dm.addCommand("amp", necCommand("vol", 0x5EA158A7)); },
+        [](DeviceManager &dm)
+        { dm.updateDevice(namedDevice("tv", "M2")); },
+        [](DeviceManager &dm)
+        { storeMacro(dm, "scene", {{"tv", "power"}, {"amp", "vol"}}); },
+        [](DeviceManager &dm)
+        { dm.compactStorage(); },
+        [](DeviceManager &dm)
+        { storeMacro(dm, "night", {{"amp", "vol"}, {"tv", "raw"}, {"amp", "vol"}}); },
+        [](DeviceManager &dm)
+        { dm.removeMacro("scene"); },
+        [](DeviceManager &dm)
+        { dm.removeCommand("tv", "power"); },
+        [](DeviceManager &dm)
+        { dm.addCommand("amp", necCommand("mute", 0x5EA138C7)); },
+        [](DeviceManager &dm)
+        { dm.removeDevice("tv"); },
+        [](DeviceManager &dm)
+        { dm.addDevice(namedDevice("tv", "M3")); },
+        [](DeviceManager &dm)
+        { dm.addCommand("tv", necCommand("power2", 0x20DF10EE)); },
+        [](DeviceManager &dm)
+        { dm.updateDevice(namedDevice("amp", "A2")); },
+    };
+
+    // Reference run: the state after each step, and the flash bytes written by its end
+    std::vector<std::string> states;
+    std::vector<uint32_t> written;
+    LittleFS.format();
+    writer->begin();
+    LittleFS.resetCounters();
+    states.push_back(fingerprint(*writer));
+    written.push_back(0);
+    for (const auto &step : script)
+    {
+        step(*writer);
+        states.push_back(fingerprint(*writer));
+        written.push_back(LittleFS.getBytesWritten());
+    }
+    bench.report("flash bytes written by the script", written.back(), "bytes");
+
+    // Then cut power before every byte of it and reboot
+    uint32_t foreign = 0, lost = 0, stuck = 0;
+    for (uint32_t cut = 0; cut <= written.back(); cut++)
+    {
+        LittleFS.format();
+        writer->begin();
+        halFsCutPowerAfter(cut);
+        for (const auto &step : script)
+            step(*writer);
+        halFsRestorePower();
+
+        reader->begin();
+        std::string state = fingerprint(*reader);
+        size_t durable = 0;
+        while (durable + 1 < written.size() && written[durable + 1] <= cut)
+            durable++;
+
+        bool known = false, current = false;
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            known |= states[i] == state;
+            current |= i >= durable && states[i] == state;
+        }
+        foreign += !known;
+        lost += known && !current;
+
+        // Whatever the crash left behind, new mutations must survive the next boot
+        reader->addDevice(namedDevice("probe", "P1"));
+        writer->begin();
+        stuck += !writer->deviceExists("probe");
+    }
+    halFsRestorePower();
+
+    bench.report("crash points simulated", written.back() + 1, "cuts");
+    bench.check(foreign == 0, "every crash recovers a state the script passed through");
+    bench.check(lost == 0, "no mutation is lost once its log append completed");
+    bench.check(stuck == 0, "the log takes new records after a torn one");
+    bench.check(states.back().find("macro night 1.0 x1 +100 0.1 x2 +200 1.0 x3 +300;") != std::string::npos &&
+                    states.back().find("macro scene") == std::string::npos,
+                "macros are part of the recovered state");
+
+    bench.measure("boot + replay of the script's log", 200, [&]
+                  { reader->begin(); });
+}
+
+namespace
+{
+    std::vector<uint8_t> readFile(const char *path)
+    {
+        File file = LittleFS.open(path, "r");
+        std::vector<uint8_t> contents(file ? file.size() : 0);
+        if (file)
+            file.read(contents.data(), contents.size());
+        return contents;
+    }
+
+    void writeFile(const char *path, const std::vector<uint8_t> &contents, size_t length)
+    {
+        File file = LittleFS.open(path, "w");
+        file.write(contents.data(), length);
+        file.close();
+    }
+
+    long storageStat(DeviceManager &dm, const char *key)
+    {
+        DynamicJsonDocument status(1024);
+        deserializeJson(status, dm.getStatus());
+        return status["storage"][key].as<long>();
+    }
+}
+
+ESPIR_BENCH(device_load_failure)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    const char *path = STORAGE_DIR "/d00.bin";
+    LittleFS.format();
+    writer->begin();
+    writer->addDevice(namedDevice("tv", "M1"));
+    for (int i = 0; i < 10; i++)
+        writer->addCommand("tv", necCommand(("cmd-" + String(i)).c_str(), 0x20DF0000 + i));
+    writer->addDevice(namedDevice("amp", "A1"));
+    writer->addCommand("amp", necCommand("vol", 0x5EA158A7));
+    writer->compactStorage();
+
+    // The tv's record, cut off half way through its commands
+    std::vector<uint8_t> record = readFile(path);
+    writeFile(path, record, record.size() / 2);
+    std::vector<uint8_t> cut = readFile(path);
+
+    reader->begin();
+    IRCode code;
+    Device device;
+    String deviceName, commandName;
+    bench.check(!reader->getCommand("tv", "cmd-0", code) && !reader->findDuplicate(necCommand("", 0x20DF0000).code, deviceName, commandName) &&
+                    reader->getDevice("tv", device) && device.commandCount == 10,
+                "a record cut short serves none of its commands and keeps its count");
+    bench.check(!reader->addCommand("tv", necCommand("new", 0x20DF00FF)) && !reader->removeCommand("tv", "cmd-9"),
+                "the device takes no command changes");
+    bench.check(reader->getCommand("amp", "vol", code) && storageStat(*reader, "failedDevices") == 1,
+                "other devices load, and GET_STATUS counts the failed one");
+
+    // Changes elsewhere and a compaction leave the record alone
+    reader->updateDevice(namedDevice("tv", "M2"));
+    reader->addCommand("amp", necCommand("mute", 0x5EA138C7));
+    reader->compactStorage();
+    bench.check(readFile(path) == cut, "its record file is not rewritten");
+
+    writeFile(path, record, record.size());
+    reader->begin();
+    bench.check(reader->getCommand("tv", "cmd-0", code) && reader->getCommand("tv", "cmd-9", code) &&
+                    reader->getDevice("tv", device) && device.commandCount == 10 && device.model == "M2" &&
+                    reader->getCommand("amp", "mute", code) && storageStat(*reader, "failedDevices") == 0,
+                "with the record repaired every command is back");
+}
+
+ESPIR_BENCH(device_write_failure)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    LittleFS.format();
+    writer->begin();
+    writer->addDevice(namedDevice("tv", "M1"));
+    writer->addCommand("tv", necCommand("power", 0x20DF10EF));
+    writer->compactStorage();
+
+    // The tv's record cannot be written when the change is compacted
+    writer->addCommand("tv", necCommand("mute", 0x20DF906F));
+    halFsFailWrites(STORAGE_DIR "/d00.bin");
+    bool failed = !writer->compactStorage();
+    reader->begin();
+    IRCode code;
+    bench.check(failed && reader->getCommand("tv", "mute", code), "a failed compaction keeps the log");
+
+    // The retry writes the record before it restarts the log
+    halFsFailWrites(nullptr);
+    bool retried = writer->compactStorage();
+    reader->begin();
+    bench.check(retried && reader->getCommand("tv", "mute", code) && code.data == 0x20DF906F &&
+                    reader->getCommand("tv", "power", code),
+                "the change survives the retry and a reboot");
+}
+
+namespace
+{
+    uint32_t logCrc(const uint8_t *data, size_t length, uint32_t crc = 0)
+    {
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+        return ~crc;
+    }
+
+    // Gives the logged command `name` a raw length past MAX_IR_CODE_SIZE,
+    // with a valid CRC, as a record written by a build with a longer limit
+    bool damageLoggedRaw(std::vector<uint8_t> &log, const char *name)
+    {
+        for (size_t at = 9; at + 7 <= log.size();)
+        {
+            size_t length = log[at + 1] | (log[at + 2] << 8);
+            uint8_t *payload = &log[at + 3];
+            size_t nameAt = 15, descriptionAt = nameAt + 1 + payload[nameAt];
+            if (log[at] == 4 && payload[nameAt] == strlen(name) && memcmp(payload + nameAt + 1, name, strlen(name)) == 0)
+            {
+                size_t rawAt = descriptionAt + 1 + payload[descriptionAt];
+                payload[rawAt] = 0xFF;
+                payload[rawAt + 1] = 0xFF;
+                uint32_t crc = logCrc(payload, length, logCrc(&log[at], 3));
+                for (int i = 0; i < 4; i++)
+                    payload[length + i] = crc >> (8 * i);
+                return true;
+            }
+            at += 7 + length;
+        }
+        return false;
+    }
+}
+
+ESPIR_BENCH(device_replay_raw_failure)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    static uint16_t timings[40];
+    for (int i = 0; i < 40; i++)
+        timings[i] = 400 + 13 * i;
+    LittleFS.format();
+    writer->begin();
+    writer->addDevice(namedDevice("tv", "M1"));
+    writer->addCommand("tv", necCommand("power", 0x20DF10EF));
+    writer->compactStorage();
+
+    IRCommand raw = necCommand("learned", 0);
+    raw.code.protocol = UNKNOWN;
+    raw.code.bits = 0;
+    raw.code.rawData = timings;
+    raw.code.rawLen = 40;
+    writer->addCommand("tv", raw);
+    writer->addCommand("tv", necCommand("mute", 0x20DF906F));
+
+    std::vector<uint8_t> log = readFile(STORAGE_LOG);
+    bench.check(damageLoggedRaw(log, "learned"), "the logged raw command is found");
+    writeFile(STORAGE_LOG, log, log.size());
+
+    reader->begin();
+    IRCode code;
+    bench.check(!reader->getCommand("tv", "learned", code) && reader->getCommand("tv", "mute", code) &&
+                    reader->getCommand("tv", "power", code),
+                "a logged command whose timings do not load is left out, the rest replays");
+
+    reader->compactStorage();
+    reader->begin();
+    Device device;
+    bench.check(!reader->getCommand("tv", "learned", code) && reader->getDevice("tv", device) && device.commandCount == 2,
+                "a compaction does not save it as an empty code");
+}
+
+namespace
+{
+    // An undecoded button as a learn job stores it: pulse-distance bits
+    // with receiver jitter, canonicalized
+    std::vector<uint16_t> learnedButton(uint64_t value, uint32_t seed)
+    {
+        std::vector<uint16_t> timings = {3400, 1700};
+        for (int bit = 0; bit < 48; bit++)
+        {
+            timings.push_back(430);
+            timings.push_back((value >> bit) & 1 ? 1290 : 430);
+        }
+        timings.push_back(430);
+        for (uint16_t &us : timings)
+        {
+            seed = seed * 1103515245 + 12345;
+            us = us + (seed >> 16) % 81 - 40;
+        }
+        static IRCanonicalizer canonicalizer;
+        timings.resize(canonicalizer.canonicalize(timings.data(), timings.size()));
+        return timings;
+    }
+
+    IRCommand rawCommand(const char *name, std::vector<uint16_t> &timings)
+    {
+        IRCommand command = necCommand(name, 0);
+        command.code.protocol = UNKNOWN;
+        command.code.bits = 0;
+        command.code.rawData = timings.data();
+        command.code.rawLen = timings.size();
+        return command;
+    }
+
+    long memoryStat(DeviceManager &dm, const char *key)
+    {
+        DynamicJsonDocument status(1024);
+        deserializeJson(status, dm.getStatus());
+        return status["memory"][key].as<long>();
+    }
+}
+
+ESPIR_BENCH(device_code_sharing)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    LittleFS.format();
+    writer->begin();
+    writer->addDevice(namedDevice("tv", "M1"));
+    writer->addDevice(namedDevice("amp", "A1"));
+
+    // The same button learned twice, and a different one
+    std::vector<uint16_t> power = learnedButton(0x5A3C96E1F00Full, 1);
+    std::vector<uint16_t> again = learnedButton(0x5A3C96E1F00Full, 2);
+    std::vector<uint16_t> mute = learnedButton(0x5A3C96E1F00Eull, 3);
+    IRCommand powerCommand = rawCommand("power", power), onCommand = rawCommand("on", again), muteCommand = rawCommand("mute", mute);
+
+    String device, command;
+    bench.check(writer->addCommand("tv", powerCommand) && !writer->findDuplicate(muteCommand.code, device, command),
+                "a different button is not a duplicate");
+    bench.check(writer->findDuplicate(onCommand.code, device, command) && device == "tv" && command == "power",
+                "a second capture of a stored button is found as its duplicate");
+
+    long words = memoryStat(*writer, "rawWords");
+    IRCode stored, shared;
+    bench.check(writer->addCommand("amp", onCommand) && memoryStat(*writer, "rawWords") == words &&
+                    memoryStat(*writer, "sharedCodes") == 1 && writer->getCommand("tv", "power", stored) &&
+                    writer->getCommand("amp", "on", shared) && shared.rawData == stored.rawData,
+                "the duplicate shares the stored timings instead of copying them");
+    bench.check(writer->addCommand("tv", muteCommand) && memoryStat(*writer, "rawWords") > words &&
+                    memoryStat(*writer, "sharedCodes") == 1,
+                "a different button gets its own timings");
+
+    writer->addCommand("tv", necCommand("vol", 0x20DF40BF));
+    IRCode volume = necCommand("", 0x20DF40BF).code;
+    bench.check(writer->findDuplicate(volume, device, command) && command == "vol", "decoded codes are matched by value");
+
+    // After a reboot, lazily loaded commands share again
+    std::vector<uint16_t> expected(stored.rawData, stored.rawData + stored.rawLen);
+    reader->begin();
+    bench.check(reader->findDuplicate(powerCommand.code, device, command) && reader->getCommand("tv", "power", stored) &&
+                    reader->getCommand("amp", "on", shared) && shared.rawData == stored.rawData &&
+                    memoryStat(*reader, "sharedCodes") == 1,
+                "shared timings are shared again after a reboot");
+
+    bench.check(reader->removeCommand("tv", "power") && reader->getCommand("amp", "on", shared) &&
+                    shared.rawLen == expected.size() && std::equal(expected.begin(), expected.end(), shared.rawData) &&
+                    memoryStat(*reader, "sharedCodes") == 0,
+                "removing one holder leaves the other's timings intact");
+
+    // Twenty buttons, each learned twice under different names
+    reader->reset();
+    reader->addDevice(namedDevice("tv", "M1"));
+    reader->addDevice(namedDevice("alias", "M1"));
+    for (int i = 0; i < 20; i++)
+    {
+        std::vector<uint16_t> first = learnedButton(0x5A3C96E1F000ull + i * 0x111, 100 + i);
+        std::vector<uint16_t> second = learnedButton(0x5A3C96E1F000ull + i * 0x111, 200 + i);
+        String name = "button-" + String(i);
+        reader->addCommand("tv", rawCommand(name.c_str(), first));
+        reader->addCommand("alias", rawCommand(name.c_str(), second));
+    }
+    bench.report("raw arena, 20 buttons stored twice", memoryStat(*reader, "rawWords") * 2, "bytes");
+    bench.report("  codes shared", memoryStat(*reader, "sharedCodes"), "commands");
+    bench.check(memoryStat(*reader, "sharedCodes") == 20, "every second copy is shared");
+
+    DeviceManager &dm = firmwareFixture().deviceManager;
+    populateDevices(dm, 50, 20);
+    IRCode hit = necCommand("", 0x20DF0000ULL | (49 << 8) | 19).code, miss = necCommand("", 0x12345678).code;
+    bool found = false;
+    bench.measure("findDuplicate hit (50x20)", 20000, [&]
+                  { found = dm.findDuplicate(hit, device, command); benchKeep(found); });
+    bench.check(found && device == "device-49" && command == "cmd-19", "findDuplicate finds the stored command");
+    bench.measure("findDuplicate miss (50x20)", 20000, [&]
+                  { found = dm.findDuplicate(miss, device, command); benchKeep(found); });
+    IRCode learned = rawCommand("", power).code;
+    bench.measure("findDuplicate raw miss (50x20)", 20000, [&]
+                  { found = dm.findDuplicate(learned, device, command); benchKeep(found); });
+}
+
+namespace
+{
+    // Distinct codes by length: 200 timings for the first, one fewer each after
+    std::vector<uint16_t> arenaTimings(int n)
+    {
+        std::vector<uint16_t> timings(200 - n);
+        for (size_t i = 0; i < timings.size(); i++)
+            timings[i] = 300 * (1 + i % 8);
+        return timings;
+    }
+
+    // Every command of every device, with its timings, after loading them all
+    std::string rawLibrary(DeviceManager &dm)
+    {
+        String device, command;
+        dm.findDuplicate(IRCode(), device, command);
+        std::string library;
+        IRCode code;
+        for (int d = 0; d < 6; d++)
+        {
+            for (int c = 0; c < 10; c++)
+            {
+                String deviceName = "raw-" + String(d), commandName = "cmd-" + String(c);
+                if (!dm.getCommand(deviceName, commandName, code))
+                    continue;
+                library += std::string(deviceName.c_str()) + "/" + commandName.c_str() + ":";
+                for (uint16_t i = 0; i < code.rawLen; i++)
+                    library += std::to_string(code.rawData[i]) + ",";
+                library += ";";
+            }
+        }
+        return library;
+    }
+}
+
+ESPIR_BENCH(device_raw_arena)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    LittleFS.format();
+    writer->begin();
+
+    // Distinct undecoded buttons, ten to a device, until one is refused
+    int stored = 0;
+    bool refused = false;
+    for (int d = 0; d < 5 && !refused; d++)
+    {
+        String deviceName = "raw-" + String(d);
+        writer->addDevice(namedDevice(deviceName.c_str(), "R1"));
+        for (int c = 0; c < 10 && !refused; c++)
+        {
+            std::vector<uint16_t> timings = arenaTimings(stored);
+            refused = !writer->addCommand(deviceName, rawCommand(("cmd-" + String(c)).c_str(), timings));
+            stored += !refused;
+        }
+    }
+    long used = memoryStat(*writer, "rawWords"), available = memoryStat(*writer, "rawAvailable");
+    bench.report("undecoded buttons stored (~200 timings)", stored, "buttons");
+    bench.report("raw arena in use", used * 2, "bytes");
+    bench.check(refused && used <= STORE_RAW_ARENA_SIZE - STORE_RAW_SPARE && available == STORE_RAW_ARENA_SIZE - STORE_RAW_SPARE - used &&
+                    available < 2 + (long)arenaTimings(stored).size(),
+                "new timings are refused once only the spare is left, and GET_STATUS says so");
+    std::vector<uint16_t> tooMany = arenaTimings(stored);
+    bench.check(!writer->hasRawSpace(rawCommand("", tooMany).code), "hasRawSpace agrees");
+
+    // Copies of a stored button and decoded codes take no timings
+    writer->addDevice(namedDevice("raw-5", "R1"));
+    bool shared = true;
+    for (int c = 0; c < 5; c++)
+    {
+        std::vector<uint16_t> copy = arenaTimings(0);
+        shared = shared && writer->addCommand("raw-5", rawCommand(("cmd-" + String(c)).c_str(), copy));
+    }
+    bench.check(shared && writer->addCommand("raw-5", necCommand("cmd-5", 0x20DF10EF)) && memoryStat(*writer, "rawWords") == used,
+                "shared copies and decoded codes are still taken");
+
+    // A full arena loads back, the shared copies too: loads share as they read
+    writer->compactStorage();
+    std::string library = rawLibrary(*writer);
+    reader->begin();
+    bench.check(rawLibrary(*reader) == library && storageStat(*reader, "failedDevices") == 0 &&
+                    memoryStat(*reader, "rawWords") == used,
+                "a full arena loads back after a reboot");
+
+    // And replays: room made and filled again through the log alone
+    writer->removeCommand("raw-1", "cmd-3");
+    writer->removeCommand("raw-0", "cmd-0");
+    std::vector<uint16_t> again = arenaTimings(stored + 1);
+    bool added = writer->addCommand("raw-1", rawCommand("cmd-3", again));
+    std::vector<uint16_t> copy = arenaTimings(0);
+    added = added && writer->addCommand("raw-0", rawCommand("cmd-0", copy));
+    library = rawLibrary(*writer);
+    reader->begin();
+    bench.check(added && rawLibrary(*reader) == library && storageStat(*reader, "failedDevices") == 0 &&
+                    memoryStat(*reader, "rawWords") == memoryStat(*writer, "rawWords"),
+                "a full arena replays from the log");
+
+    bench.measure("boot + load a full raw arena", 200, [&]
+                  { reader->begin(); rawLibrary(*reader); });
+}
+
+namespace
+{
+    // An import document: one device per entry of `devices`, each holding
+    // the given commands as "name":{code} pairs already serialized
+    std::string importDocument(const std::vector<std::pair<std::string, std::string>> &devices)
+    {
+        std::string json = "{\"devices\":[";
+        for (size_t d = 0; d < devices.size(); d++)
+        {
+            json += (d ? ",{" : "{") + std::string("\"name\":\"") + devices[d].first +
+                    "\",\"type\":\"TV\",\"manufacturer\":\"Bench\",\"model\":\"M1\",\"commands\":[" + devices[d].second + "]}";
+        }
+        return json + "],\"version\":\"1.0\"}";
+    }
+
+    std::string importCommand(const char *name, IRManager &ir, const IRCode &code)
+    {
+        return std::string("{\"name\":\"") + name + "\",\"description\":\"Imported\",\"code\":" + ir.encodeIRCode(code).c_str() + "}";
+    }
+
+    bool sameCode(const IRCode &a, const IRCode &b)
+    {
+        return a.protocol == b.protocol && a.data == b.data && a.bits == b.bits && a.rawLen == b.rawLen &&
+               (!a.rawLen || memcmp(a.rawData, b.rawData, a.rawLen * sizeof(uint16_t)) == 0);
+    }
+}
+
+ESPIR_BENCH(device_import)
+{
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    IRManager &ir = firmwareFixture().irManager;
+    LittleFS.format();
+    writer->begin();
+
+    // Codes come back as they were encoded, and are persisted as such
+    std::vector<uint16_t> timings = arenaTimings(0);
+    IRCode nec = necCommand("", 0x20DF10EF).code, raw = rawCommand("", timings).code;
+    std::string encoded = ir.encodeIRCode(raw).c_str();
+    IRCode expected = ir.decodeIRCode(encoded.c_str());
+    std::string library = importDocument({{"tv", importCommand("power", ir, nec) + "," + importCommand("learned", ir, raw)}});
+    IRCode power, learned;
+    bench.check(writer->importDevices(library.c_str(), ir) && writer->getCommand("tv", "power", power) &&
+                    writer->getCommand("tv", "learned", learned) && sameCode(power, nec) && sameCode(learned, expected),
+                "imported commands keep their codes");
+    writer->compactStorage();
+    reader->begin();
+    bench.check(reader->getCommand("tv", "power", power) && reader->getCommand("tv", "learned", learned) &&
+                    sameCode(power, nec) && sameCode(learned, expected),
+                "imported codes are persisted");
+
+    // An export imports back to the same codes, A/C state bytes included
+    std::vector<uint16_t> words((kDaikinStateLength + 1) / 2);
+    for (uint16_t b = 0; b < kDaikinStateLength; b++)
+        ((uint8_t *)words.data())[b] = (uint8_t)(0x11 * b + 0x05);
+    IRCommand ac = necCommand("ac", 0);
+    ac.code.protocol = DAIKIN;
+    ac.code.bits = kDaikinStateLength * 8;
+    ac.code.rawData = words.data();
+    ac.code.rawLen = words.size();
+    writer->addCommand("tv", ac);
+    String exported = writer->exportDevices();
+    IRCode sentPower, sentLearned, sentAc, state;
+    bool complete = writer->getCommand("tv", "power", sentPower) && writer->getCommand("tv", "learned", sentLearned) &&
+                    writer->getCommand("tv", "ac", sentAc);
+    bench.check(complete && reader->importDevices(exported, ir) && reader->getCommand("tv", "power", power) &&
+                    reader->getCommand("tv", "learned", learned) && reader->getCommand("tv", "ac", state) &&
+                    sameCode(power, sentPower) && sameCode(learned, sentLearned) && sameCode(state, sentAc) &&
+                    strstr(exported.c_str(), "\"rawz\"") && strstr(exported.c_str(), "\"state\""),
+                "an export imports back to the same codes");
+    bench.report("export, 3 commands", exported.length(), "bytes");
+
+    // More timings than the arena holds: the import stops with an error
+    // rather than storing commands that cannot be sent
+    std::vector<std::pair<std::string, std::string>> devices;
+    for (int d = 0; d < 6; d++)
+    {
+        std::string commands;
+        for (int c = 0; c < 10; c++)
+        {
+            std::vector<uint16_t> button = arenaTimings(d * 10 + c);
+            commands += (c ? "," : "") + importCommand(("cmd-" + String(c)).c_str(), ir, rawCommand("", button).code);
+        }
+        devices.push_back(std::make_pair("raw-" + std::to_string(d), commands));
+    }
+    bool imported = writer->importDevices(importDocument(devices).c_str(), ir);
+    int kept = 0, empty = 0;
+    for (int d = 0; d < 6; d++)
+    {
+        for (int c = 0; c < 10; c++)
+        {
+            IRCode code;
+            if (writer->getCommand("raw-" + String(d), "cmd-" + String(c), code))
+            {
+                kept++;
+                empty += code.rawLen == 0;
+            }
+        }
+    }
+    bench.check(!imported && kept > 0 && kept < 60 && empty == 0, "an import past the raw arena fails without empty codes");
+
+    // Strings past the pool: no device is kept without its name
+    devices.clear();
+    for (int d = 0; d < MAX_DEVICES; d++)
+    {
+        std::string json = "{\"name\":\"dev-" + std::to_string(d) + "\",\"type\":\"TV\",\"manufacturer\":\"Bench\",\"model\":\"" +
+                           std::string(200, 'a' + d % 26) + std::to_string(d) + "\",\"commands\":[]}";
+        devices.push_back(std::make_pair(std::string(), json));
+    }
+    std::string strings = "{\"devices\":[";
+    for (size_t d = 0; d < devices.size(); d++)
+        strings += (d ? "," : "") + devices[d].second;
+    strings += "]}";
+    imported = writer->importDevices(strings.c_str(), ir);
+    DynamicJsonDocument list(16384);
+    deserializeJson(list, writer->getDeviceList());
+    bool named = true;
+    for (JsonObject device : list["devices"].as<JsonArray>())
+        named = named && String(device["name"].as<const char *>()).length() > 0;
+    bench.check(!imported && writer->getDeviceCount() > 0 && writer->getDeviceCount() < MAX_DEVICES && named,
+                "an import past the string pool fails without unnamed devices");
+    writer->reset();
+}
+
+ESPIR_BENCH(device_storage)
+{
+    DeviceManager &dm = firmwareFixture().deviceManager;
+    populateDevices(dm, 50, 20);
+
+    // One learned raw code so timings take the round trip too
+    uint16_t timings[100];
+    for (int i = 0; i < 100; i++)
+        timings[i] = i % 2 ? 560 : 1690;
+    IRCommand learned;
+    learned.name = "learned";
+    learned.description = "Raw capture";
+    learned.code.protocol = UNKNOWN;
+    learned.code.data = 0;
+    learned.code.bits = 0;
+    learned.code.rawData = timings;
+    learned.code.rawLen = 100;
+    dm.removeCommand("device-3", "cmd-0");
+    bench.check(dm.addCommand("device-3", learned), "raw command is stored");
+    bench.report("record store size (50x20)", LittleFS.usedBytes(), "bytes");
+
+    // "Reboot": a second manager over the same files, after a compaction
+    // so the log holds nothing to replay
+    static DeviceManager *rebooted = new DeviceManager();
+    bench.check(dm.compactStorage(), "log folds into the device records");
+    LittleFS.resetCounters();
+    bench.check(rebooted->begin(), "manager boots from LittleFS");
+    bench.check(LittleFS.getFilesOpened() == 2, "boot reads only the manifest and the log (no macros stored)");
+    bench.report("bytes read at boot (50x20)", LittleFS.getBytesRead(), "bytes");
+    bench.check(rebooted->getDeviceCount() == 50, "every device is listed after boot");
+
+    Device device;
+    bench.check(rebooted->getDevice("device-49", device) && device.commandCount == 20 && device.model == "M49",
+                "metadata and command counts survive without loading commands");
+    bench.check(LittleFS.getFilesOpened() == 2, "listing a device does not load its commands");
+
+    IRCode code;
+    LittleFS.resetCounters();
+    bench.check(rebooted->getCommand("device-49", "cmd-19", code) && code.protocol == NEC && code.bits == 32 &&
+                    code.data == (0x20DF0000ULL | (49 << 8) | 19),
+                "NEC code survives a reboot");
+    bench.check(LittleFS.getFilesOpened() == 1, "first use loads exactly one device record");
+    rebooted->getCommand("device-49", "cmd-0", code);
+    bench.check(LittleFS.getFilesOpened() == 1, "a loaded device is not read again");
+
+    uint8_t deviceId, commandId;
+    bench.check(rebooted->findCommandId("device-3", "learned", deviceId, commandId) &&
+                    rebooted->getCommand(deviceId, commandId, code) && code.rawLen == 100 &&
+                    memcmp(code.rawData, timings, sizeof(timings)) == 0,
+                "raw timings survive a reboot");
+    bench.check(!rebooted->getCommand("device-3", "cmd-0", code), "removed command stays removed");
+
+    // A logged change reaches the rebooted manager through replay alone
+    dm.removeCommand("device-12", "cmd-4");
+    LittleFS.resetCounters();
+    rebooted->begin();
+    bench.check(!rebooted->getCommand("device-12", "cmd-4", code) && rebooted->getCommand("device-12", "cmd-3", code),
+                "a logged removal is replayed at boot");
+    dm.compactStorage();
+
+    // Boot cost: manifest only, against loading every record up front
+    bench.measure("boot, manifest only (50x20)", 50, [&]
+                  { rebooted->begin(); });
+    bench.measure("boot + load all records (50x20)", 50, [&]
+                  {
+                      rebooted->begin();
+                      for (int d = 0; d < 50; d++)
+                          rebooted->getCommand("device-" + String(d), "cmd-19", code); });
+}
+
+ESPIR_BENCH(device_lookup)
+{
+    DeviceManager &dm = firmwareFixture().deviceManager;
+    populateDevices(dm, 50, 20);
+
+    const String firstDevice = "device-0", firstCommand = "cmd-0";
+    const String lastDevice = "device-49", lastCommand = "cmd-19";
+    const String missing = "missing";
+
+    IRCode code;
+    bool hit = false;
+    bench.measure("getCommand first slot", 20000, [&]
+                  { hit = dm.getCommand(firstDevice, firstCommand, code); benchKeep(hit); });
+    bench.measure("getCommand last slot (50x20)", 20000, [&]
+                  { hit = dm.getCommand(lastDevice, lastCommand, code); benchKeep(hit); });
+    bench.check(hit && code.data == (0x20DF0000ULL | (49 << 8) | 19), "last command is found");
+    bench.measure("getCommand miss", 20000, [&]
+                  { hit = dm.getCommand(missing, missing, code); benchKeep(hit); });
+
+    uint8_t deviceId = 0, commandId = 0;
+    bench.check(dm.findCommandId(lastDevice, lastCommand, deviceId, commandId), "last command has ids");
+    bench.measure("getCommand by id (50x20)", 20000, [&]
+                  { hit = dm.getCommand(deviceId, commandId, code); benchKeep(hit); });
+    bench.check(hit && code.data == (0x20DF0000ULL | (49 << 8) | 19), "id and name lookups agree");
+
+    // Removal frees store slots for reuse; ids and lookups must survive
+    Device device;
+    bench.check(dm.removeDevice("device-0") && dm.removeCommand(lastDevice, "cmd-0"), "removals succeed");
+    bench.check(dm.getCommand(deviceId, commandId, code) && code.data == (0x20DF0000ULL | (49 << 8) | 19),
+                "ids are stable across removals");
+    bench.check(!dm.getDevice("device-0", device) && !dm.getCommand(lastDevice, "cmd-0", code), "removed entries are gone");
+    bench.check(dm.getDevice(lastDevice, device) && device.commandCount == 19 && device.model == "M49", "device metadata survives removals");
+
+    int found = 0;
+    for (int d = 1; d < 50; d++)
+    {
+        for (int c = 0; c < 20; c++)
+            found += dm.getCommand("device-" + String(d), "cmd-" + String(c), code);
+    }
+    bench.check(found == 49 * 20 - 1, "every remaining command is still indexed");
+}
+
+ESPIR_BENCH(device_store)
+{
+    DeviceManager &dm = firmwareFixture().deviceManager;
+    populateDevices(dm, 50, 20);
+
+    DynamicJsonDocument status(1024);
+    deserializeJson(status, dm.getStatus());
+    JsonObject memory = status["memory"];
+    bench.report("store + index size", memory["storeBytes"].as<long>(), "bytes");
+    bench.report("String-based layout (static part)", memory["legacyBytes"].as<long>(), "bytes");
+    bench.report("DRAM saved", memory["savedBytes"].as<long>(), "bytes");
+    bench.report("string pool in use (50x20)", memory["stringBytes"].as<long>(), "bytes");
+    bench.report("interned strings (50x20)", memory["strings"].as<long>(), "strings");
+    bench.check(memory["savedBytes"].as<long>() > 0, "store is smaller than the String-based layout");
+    bench.check(memory["commands"].as<long>() == 50 * 20, "every command lives in the slab");
+
+    // Shared descriptions and types are stored once
+    bench.check(memory["strings"].as<long>() < 50 * 4 + 50 * 20, "repeated strings are interned");
+
+    uint8_t deviceId, commandId;
+    IRCode code;
+    dm.findCommandId("device-49", "cmd-19", deviceId, commandId);
+    uint64_t allocations = benchAllocationCount();
+    for (int i = 0; i < 100; i++)
+        dm.getCommand(deviceId, commandId, code);
+    bench.check(benchAllocationCount() == allocations, "getCommand by id does not allocate");
+
+    // Churn: freed device, command and string slots must be reused
+    Device device;
+    IRCommand command;
+    uint16_t timings[64];
+    for (int i = 0; i < 64; i++)
+        timings[i] = 300 * (1 + i % 8); // Far enough apart that the raw codec keeps them exact
+    command.description = "Churn";
+    command.code.protocol = UNKNOWN;
+    command.code.data = 0;
+    command.code.bits = 0;
+    command.code.rawData = timings;
+    command.code.rawLen = 64;
+
+    bool churned = true;
+    for (int round = 0; round < 200 && churned; round++)
+    {
+        device.name = "churn-" + String(round);
+        device.type = "Temp";
+        churned = dm.removeDevice("device-" + String(round % 50)) && dm.addDevice(device);
+        for (int c = 0; c < 20 && churned; c++)
+        {
+            command.name = "raw-" + String(round) + "-" + String(c);
+            command.code.rawLen = 64 - c; // Distinct codes, so each takes its own arena record
+            churned = dm.addCommand(device.name, command);
+        }
+        churned = churned && dm.removeDevice(device.name);
+
+        device.name = "device-" + String(round % 50);
+        device.type = "TV";
+        churned = churned && dm.addDevice(device);
+    }
+    bench.check(churned, "200 rounds of add/remove fit in the fixed tables");
+
+    // The table is full again; make room for the raw test device
+    dm.removeDevice("device-0");
+    device.name = "raw-device";
+    dm.addDevice(device);
+    command.name = "raw";
+    command.code.rawLen = 64;
+    bench.check(dm.addCommand("raw-device", command) && dm.getCommand("raw-device", "raw", code) && code.rawLen == 64 &&
+                    memcmp(code.rawData, timings, sizeof(timings)) == 0,
+                "raw timings survive arena compaction");
+    dm.removeDevice("raw-device");
+
+    bench.measure("add + remove device with 20 raw commands", 200, [&]
+                  {
+                      device.name = "bench-churn";
+                      dm.addDevice(device);
+                      for (int c = 0; c < 20; c++)
+                      {
+                          command.name = "cmd-" + String(c);
+                          command.code.rawLen = 64 - c;
+                          dm.addCommand(device.name, command);
+                      }
+                      dm.removeDevice(device.name); });
+    bench.check(dm.getDeviceCount() == MAX_DEVICES - 1, "measured churn leaves nothing behind");
+}
+
+namespace
+{
+    // Index over plain std::string names, sized like DeviceManager's
+    template <size_t Devices, size_t Commands>
+    struct IndexedStore
+    {
+        std::vector<std::string> deviceNames;
+        std::vector<std::vector<std::string>> commandNames;
+        CommandIndex<indexCapacityFor(Devices * (Commands + 1))> index;
+
+        IndexedStore()
+        {
+            for (size_t d = 0; d < Devices; d++)
+            {
+                deviceNames.push_back("device-" + std::to_string(d));
+                commandNames.emplace_back();
+                for (size_t c = 0; c < Commands; c++)
+                {
+                    commandNames[d].push_back("cmd-" + std::to_string(c));
+                    const std::string &dev = deviceNames[d], &cmd = commandNames[d][c];
+                    index.insert(indexHash(dev.data(), dev.size(), cmd.data(), cmd.size()), d * Commands + c);
+                }
+            }
+        }
+
+        bool lookup(const std::string &device, const std::string &command)
+        {
+            uint16_t slot;
+            return index.find(
+                indexHash(device.data(), device.size(), command.data(), command.size()),
+                [&](uint16_t s)
+                { return commandNames[s / Commands][s % Commands] == command && deviceNames[s / Commands] == device; },
+                slot);
+        }
+
+        bool scan(const std::string &device, const std::string &command)
+        {
+            for (size_t d = 0; d < Devices; d++)
+            {
+                if (deviceNames[d] != device)
+                    continue;
+                for (size_t c = 0; c < Commands; c++)
+                {
+                    if (commandNames[d][c] == command)
+                        return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    template <size_t Devices, size_t Commands>
+    void measureIndex(BenchRunner &bench)
+    {
+        static IndexedStore<Devices, Commands> store;
+        const std::string device = "device-" + std::to_string(Devices - 1);
+        const std::string command = "cmd-" + std::to_string(Commands - 1);
+        bool hit = false;
+        char label[64];
+
+        snprintf(label, sizeof(label), "linear scan last slot (%zux%zu)", Devices, Commands);
+        bench.measure(label, 5000, [&]
+                      { hit = store.scan(device, command); benchKeep(hit); });
+        snprintf(label, sizeof(label), "hashed index last slot (%zux%zu)", Devices, Commands);
+        bench.measure(label, 5000, [&]
+                      { hit = store.lookup(device, command); benchKeep(hit); });
+        bench.check(hit, "index finds the last command");
+        snprintf(label, sizeof(label), "index table size (%zux%zu)", Devices, Commands);
+        bench.report(label, sizeof(store.index), "bytes");
+    }
+}
+
+ESPIR_BENCH(command_index_scaling)
+{
+    measureIndex<MAX_DEVICES, MAX_COMMANDS>(bench);
+    measureIndex<120, 40>(bench);
+    measureIndex<250, 100>(bench);
+}
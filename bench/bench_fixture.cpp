@@ -0,0 +1,119 @@
+/**
+ * Host Benchmark Fixture Implementation
+ */
+
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <algorithm>
+
+FirmwareFixture::FirmwareFixture() : notificationCount(0)
+{
+    irManager.begin();
+    bleManager.begin();
+    deviceManager.begin();
+    cmdProcessor.begin(&irManager, &bleManager, &deviceManager);
+
+    bleManager.setCommandCallback([this](const char *json, size_t length)
+                                  { cmdProcessor.processCommand(json, length); });
+    bleManager.setBinaryCallback([this](const uint8_t *data, size_t length)
+                                 { cmdProcessor.processBinary(data, length); });
+
+    captureNotifications();
+    halBleConnect(247);
+}
+
+void FirmwareFixture::captureNotifications()
+{
+    halSetNotifyHook([this](const uint8_t *data, size_t length)
+                     {
+                         if (assembler.add(data, length, lastNotification))
+                             notificationCount++; });
+}
+
+bool NotificationAssembler::add(const uint8_t *data, size_t length, std::string &message)
+{
+    if (!isBleFragment(data, length))
+    {
+        message.assign((const char *)data, length);
+        return true;
+    }
+    if (reassembler.add(data, length) != BLE_REASSEMBLY_COMPLETE)
+        return false;
+    message.assign((const char *)reassembler.data(), reassembler.size());
+    return true;
+}
+
+FirmwareFixture &firmwareFixture()
+{
+    static FirmwareFixture *fixture = new FirmwareFixture();
+    return *fixture;
+}
+
+void populateDevices(DeviceManager &manager, int deviceCount, int commandsPerDevice)
+{
+    manager.reset();
+    for (int d = 0; d < deviceCount; d++)
+    {
+        Device device;
+        device.name = "device-" + String(d);
+        device.type = "TV";
+        device.manufacturer = "Bench";
+        device.model = "M" + String(d);
+        device.commandCount = 0;
+        if (!manager.addDevice(device))
+            break;
+
+        for (int c = 0; c < commandsPerDevice; c++)
+        {
+            IRCommand command;
+            command.name = "cmd-" + String(c);
+            command.description = "Benchmark command";
+            command.code.protocol = NEC;
+            command.code.data = 0x20DF0000ULL | (uint64_t)(d << 8) | (uint64_t)c;
+            command.code.bits = 32;
+            command.code.rawData = nullptr;
+            command.code.rawLen = 0;
+            manager.addCommand(device.name, command);
+        }
+    }
+}
+
+uint32_t irSendCount()
+{
+    return IRsend::log().sendCount + halRmtLog().writeCount;
+}
+
+void resetIRSends()
+{
+    IRsend::resetLog();
+    halRmtResetLog();
+}
+
+bool lastIRSendWas(decode_type_t protocol, uint64_t data, uint16_t bits)
+{
+    // Only waveform protocols go through the RMT; IRsend encodes the rest
+    const IRProtocolInfo *info = irProtocolInfo(protocol);
+    if (!firmwareFixture().irManager.isRmtEnabled() || !info || !(info->flags & IR_PROTO_WAVEFORM))
+        return IRsend::log().lastProtocol == protocol && IRsend::log().lastData == data && IRsend::log().lastBits == bits;
+
+    static IRWaveform expected;
+    if (!compileWaveform(protocol, data, bits, nullptr, 0, expected))
+        return false;
+    const std::vector<uint32_t> &items = halRmtLog().lastItems;
+    return items.size() == expected.count && std::equal(items.begin(), items.end(), expected.items);
+}
+
+uint32_t injectIRCode(decode_type_t protocol, uint64_t data, uint16_t bits)
+{
+    static IRWaveform wave;
+    static uint32_t edges[IR_WAVE_MAX_ITEMS * 2];
+    if (!compileWaveform(protocol, data, bits, nullptr, 0, wave))
+        return 0;
+    return halInjectIREdges(edges, waveformTimings(wave, edges, IR_WAVE_MAX_ITEMS * 2));
+}
+
+uint32_t injectIRTimings(const uint16_t *timings, uint16_t count)
+{
+    std::vector<uint32_t> edges(timings, timings + count);
+    return halInjectIREdges(edges.data(), edges.size());
+}
@@ -0,0 +1,66 @@
+/**
+ * Host Benchmark Fixture
+ *
+ * Wires the real managers together the same way main.cpp does, on top of
+ * the native HAL stand-ins, with a simulated BLE central connected.
+ */
+
+#ifndef ESPIR_BENCH_FIXTURE_H
+#define ESPIR_BENCH_FIXTURE_H
+
+#include <string>
+#include <vector>
+#include "ir_manager.h"
+#include "ble_manager.h"
+#include "device_manager.h"
+#include "command_processor.h"
+
+// Joins fragmented notifications the way a central does
+struct NotificationAssembler
+{
+    std::vector<uint8_t> buffer;
+    BleReassembler reassembler;
+
+    // Streamed replies can pass 64 KB
+    NotificationAssembler() : buffer(1 << 20), reassembler(buffer.data(), buffer.size()) {}
+
+    // True when the packet completes a message, which is left in `message`
+    bool add(const uint8_t *data, size_t length, std::string &message);
+};
+
+struct FirmwareFixture
+{
+    IRManager irManager;
+    BLEManager bleManager;
+    DeviceManager deviceManager;
+    CommandProcessor cmdProcessor;
+
+    NotificationAssembler assembler;
+    std::string lastNotification; // Last whole message
+    uint32_t notificationCount;
+
+    FirmwareFixture();
+
+    // (Re)installs the notification hook feeding lastNotification
+    void captureNotifications();
+};
+
+// Lazily constructed, shared by all benchmark cases
+FirmwareFixture &firmwareFixture();
+
+// IR sends through either backend (RMT writes and IRsend calls) since the
+// last reset, and whether the last one put the given code on the air
+uint32_t irSendCount();
+void resetIRSends();
+bool lastIRSendWas(decode_type_t protocol, uint64_t data, uint16_t bits);
+
+// Puts a code on the RMT receiver's input as the edges a remote would
+// send (the compiled waveform's marks and spaces), or raw timings in
+// microseconds starting with a mark. Returns the frames queued
+uint32_t injectIRCode(decode_type_t protocol, uint64_t data, uint16_t bits);
+uint32_t injectIRTimings(const uint16_t *timings, uint16_t count);
+
+// Fills the device manager with "device-N"/"cmd-M" entries holding NEC codes
+void populateDevices(DeviceManager &manager, int deviceCount, int commandsPerDevice);
+
+#endif // ESPIR_BENCH_FIXTURE_H
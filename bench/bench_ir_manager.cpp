@@ -0,0 +1,64 @@
+/**
+ * IR Manager Benchmarks
+ *
+ * Cost of the IRCode JSON codec (encodeIRCode()/decodeIRCode()) for
+ * protocol codes and raw captures of increasing length.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <vector>
+
+static void benchRawCodec(BenchRunner &bench, IRManager &ir, uint16_t rawLen)
+{
+    std::vector<uint16_t> raw(rawLen);
+    for (uint16_t i = 0; i < rawLen; i++)
+        raw[i] = (i % 2 == 0) ? 560 : ((i % 5 == 0) ? 1690 : 560);
+
+    IRCode code = IRCode();
+    code.protocol = UNKNOWN;
+    code.rawData = raw.data();
+    code.rawLen = rawLen;
+
+    char label[64];
+    String encoded;
+    snprintf(label, sizeof(label), "encodeIRCode(raw %u)", rawLen);
+    bench.measure(label, 2000, [&]
+                  { encoded = ir.encodeIRCode(code); });
+    snprintf(label, sizeof(label), "encoded size raw %u", rawLen);
+    bench.report(label, encoded.length(), "bytes");
+
+    IRCode decoded;
+    snprintf(label, sizeof(label), "decodeIRCode(raw %u)", rawLen);
+    bench.measure(label, 2000, [&]
+                  { decoded = ir.decodeIRCode(encoded); });
+
+    decoded = ir.decodeIRCode(encoded);
+    bench.check(decoded.rawLen == rawLen && decoded.rawData &&
+                    memcmp(decoded.rawData, raw.data(), rawLen * sizeof(uint16_t)) == 0,
+                "raw code survives an encode/decode round trip");
+}
+
+ESPIR_BENCH(ir_codec)
+{
+    IRManager &ir = firmwareFixture().irManager;
+
+    IRCode nec = IRCode();
+    nec.protocol = NEC;
+    nec.data = 0x20DF10EF;
+    nec.bits = 32;
+    nec.description = "Power";
+
+    String encoded;
+    bench.measure("encodeIRCode(NEC)", 10000, [&]
+                  { encoded = ir.encodeIRCode(nec); });
+
+    IRCode decoded;
+    bench.measure("decodeIRCode(NEC)", 10000, [&]
+                  { decoded = ir.decodeIRCode(encoded); });
+    bench.check(decoded.protocol == NEC && decoded.data == nec.data && decoded.bits == 32,
+                "NEC code survives an encode/decode round trip");
+
+    benchRawCodec(bench, ir, 100);
+    benchRawCodec(bench, ir, MAX_IR_CODE_SIZE);
+}
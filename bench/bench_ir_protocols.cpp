@@ -0,0 +1,275 @@
+/**
+ * IR Protocol Table Benchmarks
+ *
+ * Walks the protocol table and sends every protocol it marks as sendable
+ * through transmitCode(), at the protocol's default size, checking the
+ * code reaches the right encoder (the RMT for compiled waveforms, IRsend
+ * for the rest) and that unsupported protocols are refused. ir_state_codes
+ * covers A/C state codes end to end: JSON, the device store across a
+ * reboot, and batches, with their size against the same frame kept raw.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <LittleFS.h>
+#include <hal_native.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // State bytes in the raw words the way a learned code holds them
+    std::vector<uint16_t> stateWords(const uint8_t *bytes, uint16_t count)
+    {
+        std::vector<uint16_t> words((count + 1) / 2, 0);
+        memcpy(words.data(), bytes, count);
+        return words;
+    }
+
+    bool lastStateWas(decode_type_t protocol, const uint8_t *bytes, uint16_t count)
+    {
+        const NativeIRSendLog &log = IRsend::log();
+        return log.lastProtocol == protocol && log.lastState.size() == count &&
+               memcmp(log.lastState.data(), bytes, count) == 0;
+    }
+
+    IRCode stateCode(decode_type_t protocol, std::vector<uint16_t> &words, uint16_t bytes)
+    {
+        IRCode code = IRCode();
+        code.protocol = protocol;
+        code.bits = bytes * 8;
+        code.rawData = words.data();
+        code.rawLen = words.size();
+        return code;
+    }
+}
+
+ESPIR_BENCH(ir_protocols)
+{
+    IRManager &ir = firmwareFixture().irManager;
+
+    uint16_t decode = 0, send = 0, state = 0, waveform = 0;
+    for (uint16_t i = 0; i < irProtocolCount(); i++)
+    {
+        const IRProtocolInfo &info = irProtocolAt(i);
+        decode += (info.flags & IR_PROTO_DECODE) != 0;
+        send += (info.flags & IR_PROTO_SEND) != 0;
+        state += (info.flags & IR_PROTO_STATE) != 0;
+        waveform += (info.flags & IR_PROTO_WAVEFORM) != 0;
+    }
+    bench.report("protocols in the table", irProtocolCount(), "types");
+    bench.report("  decoded by the receiver", decode, "types");
+    bench.report("  sent by transmitCode()", send, "types");
+    bench.report("  of which A/C state codes", state, "types");
+    bench.report("  of which compiled for the RMT", waveform, "types");
+    for (uint16_t i = 0; i < irProtocolCount(); i++)
+    {
+        const IRProtocolInfo &info = irProtocolAt(i);
+        if (!(info.flags & IR_PROTO_SEND))
+            printf("  not sent: %s\n", typeToString(info.protocol).c_str());
+    }
+
+    uint16_t stateMismatch = 0;
+    for (uint16_t i = 0; i < irProtocolCount(); i++)
+    {
+        const IRProtocolInfo &info = irProtocolAt(i);
+        stateMismatch += ((info.flags & IR_PROTO_STATE) != 0) != hasACState(info.protocol);
+    }
+    bench.check(stateMismatch == 0, "the table's state flag matches the library's hasACState()");
+    bench.check(irProtocolInfo(UNKNOWN) == nullptr && irProtocolInfo((decode_type_t)(irProtocolCount() + 5)) == nullptr,
+                "types outside the table have no entry");
+
+    // Every sendable protocol, with the bits left to the table's default
+    uint16_t sent = 0, missed = 0;
+    for (uint16_t i = 0; i < irProtocolCount(); i++)
+    {
+        const IRProtocolInfo &info = irProtocolAt(i);
+        if (!(info.flags & IR_PROTO_SEND))
+            continue;
+
+        resetIRSends();
+        bool ok;
+        if (info.flags & IR_PROTO_STATE)
+        {
+            uint16_t bytes = info.defaultBits / 8;
+            std::vector<uint8_t> expected(bytes);
+            for (uint16_t b = 0; b < bytes; b++)
+                expected[b] = (uint8_t)(b * 37 + info.protocol);
+            std::vector<uint16_t> words = stateWords(expected.data(), bytes);
+            IRCode code = stateCode(info.protocol, words, bytes);
+            ok = ir.transmitCode(code) && irSendCount() == 1 && lastStateWas(info.protocol, expected.data(), bytes);
+        }
+        else
+        {
+            IRCode code = IRCode();
+            code.protocol = info.protocol;
+            code.data = 1;
+            ok = ir.transmitCode(code) && irSendCount() == 1 && lastIRSendWas(info.protocol, 1, info.defaultBits);
+        }
+        if (ok)
+        {
+            sent++;
+        }
+        else
+        {
+            missed++;
+            printf("  failed to send: %s\n", typeToString(info.protocol).c_str());
+        }
+    }
+    bench.report("protocols sent at their default size", sent, "types");
+    bench.check(missed == 0 && sent == send, "every protocol the table marks sendable reaches its encoder");
+
+    uint16_t accepted = 0;
+    for (uint16_t i = 0; i < irProtocolCount(); i++)
+    {
+        const IRProtocolInfo &info = irProtocolAt(i);
+        if (info.flags & IR_PROTO_SEND)
+            continue;
+        IRCode code = IRCode();
+        code.protocol = info.protocol;
+        code.data = 1;
+        resetIRSends();
+        accepted += ir.transmitCode(code) || irSendCount() != 0;
+    }
+    IRCode unknown = IRCode();
+    unknown.protocol = UNKNOWN;
+    unknown.data = 1;
+    unknown.bits = 32;
+    resetIRSends();
+    accepted += ir.transmitCode(unknown) || irSendCount() != 0;
+    bench.check(accepted == 0, "protocols without an encoder are refused, nothing is sent");
+
+    uint16_t timings[] = {9000, 4500, 560, 1690, 560, 560, 560};
+    IRCode raw = IRCode();
+    raw.protocol = SANYO; // Decoded, never encoded: the timings still go out
+    raw.rawData = timings;
+    raw.rawLen = sizeof(timings) / sizeof(timings[0]);
+    resetIRSends();
+    bench.check(ir.transmitCode(raw) && irSendCount() == 1, "raw timings are sent whatever their protocol");
+
+    IRCode samsung = IRCode();
+    samsung.protocol = SAMSUNG;
+    samsung.data = 0xE0E040BF;
+    samsung.bits = 32;
+    bench.measure("transmitCode(SAMSUNG) via IRsend", 20000, [&]
+                  { ir.transmitCode(samsung); });
+
+    IRCode nec = IRCode();
+    nec.protocol = NEC;
+    nec.data = 0x20DF10EF;
+    nec.bits = 32;
+    bench.measure("transmitCode(NEC) via the RMT", 20000, [&]
+                  { ir.transmitCode(nec); });
+
+    uint8_t daikin[kDaikinStateLength];
+    for (uint16_t b = 0; b < kDaikinStateLength; b++)
+        daikin[b] = b;
+    std::vector<uint16_t> words = stateWords(daikin, kDaikinStateLength);
+    IRCode ac = stateCode(DAIKIN, words, kDaikinStateLength);
+    bench.measure("transmitCode(DAIKIN state) via IRsend", 20000, [&]
+                  { ir.transmitCode(ac); });
+
+    volatile uint16_t sink = 0;
+    bench.measure("irProtocolInfo() over the whole table", 2000, [&]
+                  {
+                      for (uint16_t i = 0; i < irProtocolCount(); i++)
+                          sink += irProtocolInfo((decode_type_t)i) != nullptr;
+                  });
+}
+
+ESPIR_BENCH(ir_state_codes)
+{
+    IRManager &ir = firmwareFixture().irManager;
+
+    uint8_t bytes[kDaikinStateLength];
+    for (uint16_t b = 0; b < kDaikinStateLength; b++)
+        bytes[b] = (uint8_t)(0x11 * b + 0x05);
+    std::vector<uint16_t> words = stateWords(bytes, kDaikinStateLength);
+    IRCode ac = stateCode(DAIKIN, words, kDaikinStateLength);
+
+    // The same frame as a raw capture: header, 8 pulse-distance bits a byte, footer
+    std::vector<uint16_t> capture = {3650, 1623};
+    for (uint16_t b = 0; b < kDaikinStateLength; b++)
+    {
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            capture.push_back(428);
+            capture.push_back((bytes[b] >> bit) & 1 ? 1280 : 428);
+        }
+    }
+    capture.push_back(428);
+    IRCode rawAc = IRCode();
+    rawAc.protocol = UNKNOWN;
+    rawAc.rawData = capture.data();
+    rawAc.rawLen = capture.size();
+
+    String encoded = ir.encodeIRCode(ac);
+    String encodedRaw = ir.encodeIRCode(rawAc);
+    bench.report("DAIKIN as state bytes, JSON", encoded.length(), "bytes");
+    bench.report("DAIKIN as raw timings, JSON", encodedRaw.length(), "bytes");
+    bench.report("DAIKIN state in RAM", words.size() * sizeof(uint16_t), "bytes");
+    bench.report("DAIKIN timings in RAM", capture.size() * sizeof(uint16_t), "bytes");
+    bench.check(encoded.length() < encodedRaw.length(), "state codes are smaller than their raw capture");
+
+    IRCode decoded = ir.decodeIRCode(encoded);
+    bench.check(decoded.protocol == DAIKIN && decoded.bits == kDaikinStateLength * 8 && decoded.rawData &&
+                    decoded.rawLen == words.size() && memcmp(decoded.rawData, bytes, kDaikinStateLength) == 0,
+                "state bytes survive an encode/decode round trip");
+
+    uint8_t odd[kMitsubishiHeavy88StateLength];
+    for (uint16_t b = 0; b < kMitsubishiHeavy88StateLength; b++)
+        odd[b] = (uint8_t)(0xF0 - b);
+    std::vector<uint16_t> oddWords = stateWords(odd, kMitsubishiHeavy88StateLength);
+    IRCode heavy88 = stateCode(MITSUBISHI_HEAVY_88, oddWords, kMitsubishiHeavy88StateLength);
+    decoded = ir.decodeIRCode(ir.encodeIRCode(heavy88));
+    resetIRSends();
+    bench.check(decoded.bits == kMitsubishiHeavy88StateLength * 8 && ir.transmitCode(decoded) &&
+                    lastStateWas(MITSUBISHI_HEAVY_88, odd, kMitsubishiHeavy88StateLength),
+                "an odd-length state decodes and transmits byte for byte");
+
+    IRCode truncated = ac;
+    truncated.rawLen = words.size() - 1;
+    resetIRSends();
+    bench.check(!ir.transmitCode(truncated) && irSendCount() == 0, "a state shorter than its bits is refused");
+
+    // Stored, reloaded at boot, then sent
+    static DeviceManager *writer = new DeviceManager();
+    static DeviceManager *reader = new DeviceManager();
+    LittleFS.format();
+    writer->begin();
+    Device device;
+    device.name = "ac";
+    device.type = "AC";
+    device.manufacturer = "Bench";
+    device.model = "D1";
+    device.commandCount = 0;
+    IRCommand command;
+    command.name = "cool";
+    command.description = "State code";
+    command.code = ac;
+    bool stored = writer->addDevice(device) && writer->addCommand("ac", command);
+    reader->begin();
+    IRCode loaded;
+    bool found = reader->getCommand("ac", "cool", loaded);
+    bench.check(stored && found && loaded.protocol == DAIKIN && loaded.bits == kDaikinStateLength * 8 &&
+                    loaded.rawLen == words.size() && memcmp(loaded.rawData, bytes, kDaikinStateLength) == 0,
+                "the device store keeps state bytes exact across a reboot");
+    resetIRSends();
+    bench.check(found && ir.transmitCode(loaded) && lastStateWas(DAIKIN, bytes, kDaikinStateLength),
+                "a reloaded state code transmits");
+
+    static IRPlan plan;
+    plan.clear();
+    bool planned = ir.addPlanStep(plan, ac, 2, 0) && ir.addPlanStep(plan, heavy88, 1, 0);
+    bench.report("batch bytes for two state steps", plan.rawUsed, "bytes");
+    resetIRSends();
+    bool ran = planned && ir.queuePlan(plan, nullptr, nullptr);
+    bench.check(ran && plan.sends == 3 && lastStateWas(MITSUBISHI_HEAVY_88, odd, kMitsubishiHeavy88StateLength),
+                "batched state codes are sent byte for byte");
+
+    bench.measure("encodeIRCode(DAIKIN state)", 5000, [&]
+                  { encoded = ir.encodeIRCode(ac); });
+    bench.measure("decodeIRCode(DAIKIN state)", 5000, [&]
+                  { decoded = ir.decodeIRCode(encoded); });
+}
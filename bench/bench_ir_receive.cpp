@@ -0,0 +1,793 @@
+/**
+ * IR Receive Benchmarks
+ *
+ * Replays recorded edge streams, shaped the way a demodulating receiver
+ * distorts them (marks stretched, spaces shortened, jitter on every edge),
+ * into the decoder and through the whole receive path: the RMT receiver,
+ * the capture ring and update(). Covers decoding of each sent protocol,
+ * NEC repeat codes and held-button repeats, unknown frames kept raw,
+ * continuous capture outside learning, and the IRrecv fallback.
+ * ir_canonical folds held-button captures of an undecoded remote into one
+ * canonical frame and checks that separate captures fingerprint alike.
+ * ir_learn_captures learns buttons over several noisy presses through
+ * LEARN, checks agreement, scoring and mismatch reports, and measures how
+ * many presses and how long learning takes to converge as noise grows.
+ * ir_monitor sniffs a stream of presses and held buttons with MONITOR on
+ * and checks that each press is named once, and what a sighting costs.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // A remote as a receiver module reports it: marks come out long and
+    // spaces short by about 60 us, every edge off by up to +-40 us (or
+    // +-spread/2). Deterministic, so a failure replays the same stream
+    struct Recording
+    {
+        std::vector<uint32_t> edges;
+        uint32_t seed = 12345;
+        uint32_t spread = 81;
+
+        uint32_t jitter()
+        {
+            seed = seed * 1103515245 + 12345;
+            return (seed >> 16) % spread;
+        }
+
+        void add(uint32_t duration)
+        {
+            bool mark = edges.size() % 2 == 0;
+            int32_t skew = (mark ? 60 : -60) + (int32_t)jitter() - (int32_t)(spread / 2);
+            int32_t us = (int32_t)duration + skew;
+            edges.push_back(us > 50 ? us : 50);
+        }
+
+        void addCode(decode_type_t protocol, uint64_t data, uint16_t bits)
+        {
+            static IRWaveform wave;
+            static uint32_t timings[IR_WAVE_MAX_ITEMS * 2];
+            if (!compileWaveform(protocol, data, bits, nullptr, 0, wave))
+                return;
+            uint16_t count = waveformTimings(wave, timings, IR_WAVE_MAX_ITEMS * 2);
+            for (uint16_t i = 0; i < count; i++)
+                add(timings[i]);
+            if (count % 2)
+                add(IR_RMT_RX_IDLE_US * 2); // Silence before whatever follows
+        }
+
+        void addNecRepeat()
+        {
+            add(8960);
+            add(2240);
+            add(560);
+            add(96000); // Out to the 108 ms repeat period
+        }
+
+        // Header and 48 pulse-distance bits that no decoder claims, like
+        // an A/C remote's state frame
+        void addUnknown(uint64_t value = 0x5A3C96E1F00Full)
+        {
+            add(3400);
+            add(1700);
+            for (int bit = 0; bit < 48; bit++)
+            {
+                add(430);
+                add((value >> bit) & 1 ? 1290 : 430);
+            }
+            add(430);
+            add(IR_RMT_RX_IDLE_US * 2);
+        }
+
+        uint32_t replay() const { return halInjectIREdges(edges.data(), edges.size()); }
+    };
+
+    // The frames a stream splits into at the receiver's idle threshold,
+    // trailing space dropped
+    std::vector<std::vector<uint16_t>> frames(const Recording &recording)
+    {
+        std::vector<std::vector<uint16_t>> out(1);
+        for (size_t i = 0; i < recording.edges.size(); i++)
+        {
+            if (i % 2 && recording.edges[i] >= IR_RMT_RX_IDLE_US)
+            {
+                out.emplace_back();
+                continue;
+            }
+            out.back().push_back(recording.edges[i]);
+        }
+        if (out.back().empty())
+            out.pop_back();
+        return out;
+    }
+
+    bool decodesAs(const std::vector<uint16_t> &frame, decode_type_t protocol, uint64_t data, uint16_t bits)
+    {
+        IRDecoded code;
+        return decodeTimings(frame.data(), frame.size(), code) && code.protocol == protocol && code.data == data &&
+               code.bits == bits && !code.repeatCode;
+    }
+
+    bool decodesCode(decode_type_t protocol, uint64_t data, uint16_t bits, uint32_t seed)
+    {
+        Recording recording;
+        recording.seed = seed;
+        recording.addCode(protocol, data, bits);
+        std::vector<std::vector<uint16_t>> split = frames(recording);
+        bool all = !split.empty();
+        for (const std::vector<uint16_t> &frame : split)
+            all &= decodesAs(frame, protocol, data, bits);
+        return all;
+    }
+
+    struct Counters
+    {
+        uint32_t captured, decoded, repeated;
+    };
+
+    Counters counters(IRManager &ir)
+    {
+        DynamicJsonDocument doc(1024);
+        deserializeJson(doc, ir.getStatus());
+        return {doc["framesCaptured"].as<uint32_t>(), doc["framesDecoded"].as<uint32_t>(), doc["framesRepeated"].as<uint32_t>()};
+    }
+
+    void runDecoderChecks(BenchRunner &bench)
+    {
+        bool nec = true, sony = true, rc5 = true, rc6 = true;
+        for (uint32_t seed = 1; seed <= 50; seed++)
+        {
+            nec &= decodesCode(NEC, 0x20DF10EF, 32, seed) && decodesCode(NEC, seed * 0x01010101u, 32, seed);
+            sony &= decodesCode(SONY, 0xA90, 12, seed) && decodesCode(SONY, 0x5A5A, 15, seed) && decodesCode(SONY, 0xFFFFF, 20, seed);
+            rc5 &= decodesCode(RC5, 0x175, 12, seed) && decodesCode(RC5, 0x1C3F, 13, seed);
+            rc6 &= decodesCode(RC6, 0xC80F, 20, seed) && decodesCode(RC6, 0xC800F740CULL, 36, seed);
+        }
+        bench.check(nec, "NEC frames decode despite receiver skew and jitter");
+        bench.check(sony, "Sony 12/15/20-bit frames decode, every repeat frame included");
+        bench.check(rc5, "RC5 and RC5X frames decode");
+        bench.check(rc6, "RC6 frames decode, double-width toggle bit included");
+
+        Recording repeat;
+        repeat.addNecRepeat();
+        IRDecoded code;
+        std::vector<uint16_t> repeatFrame = frames(repeat)[0];
+        bench.check(decodeTimings(repeatFrame.data(), repeatFrame.size(), code) && code.protocol == NEC && code.repeatCode,
+                    "an NEC repeat code is recognized as one");
+
+        Recording unknown;
+        unknown.addUnknown();
+        std::vector<uint16_t> unknownFrame = frames(unknown)[0];
+        bench.check(!decodeTimings(unknownFrame.data(), unknownFrame.size(), code) && code.protocol == UNKNOWN,
+                    "an unknown frame is left undecoded");
+
+        Recording cut;
+        cut.addCode(NEC, 0x20DF10EF, 32);
+        std::vector<uint16_t> truncated = frames(cut)[0];
+        truncated.resize(40);
+        bench.check(!decodeTimings(truncated.data(), truncated.size(), code), "a truncated frame is not decoded");
+
+        Recording necRecording, rc6Recording;
+        necRecording.addCode(NEC, 0x20DF10EF, 32);
+        rc6Recording.addCode(RC6, 0xC800F740CULL, 36);
+        std::vector<uint16_t> necFrame = frames(necRecording)[0], rc6Frame = frames(rc6Recording)[0];
+        bench.measure("decodeTimings (NEC frame)", 100000, [&]
+                      { decodeTimings(necFrame.data(), necFrame.size(), code); });
+        bench.measure("decodeTimings (RC6 36-bit frame)", 100000, [&]
+                      { decodeTimings(rc6Frame.data(), rc6Frame.size(), code); });
+        bench.measure("decodeTimings (unknown 48-bit frame)", 100000, [&]
+                      { decodeTimings(unknownFrame.data(), unknownFrame.size(), code); });
+    }
+
+    void runPipelineChecks(BenchRunner &bench)
+    {
+        IRManager &ir = firmwareFixture().irManager;
+        ir.stopLearning();
+        ir.update();
+        bench.check(ir.isRmtReceiving() && std::string(ir.getStatus().c_str()).find("\"rxBackend\":\"rmt\"") != std::string::npos,
+                    "the RMT receiver is the default backend");
+
+        // Outside learning, frames are still captured, decoded and checked
+        // for repeats: a held NEC button is one frame then repeat codes
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        Counters before = counters(ir);
+        Recording held;
+        held.addCode(NEC, 0x20DF10EF, 32);
+        for (int i = 0; i < 3; i++)
+            held.addNecRepeat();
+        bench.check(held.replay() == 4, "the receiver cuts a held button into frames");
+        ir.update();
+        Counters after = counters(ir);
+        bench.check(after.captured == before.captured + 4 && after.decoded == before.decoded + 4, "frames are decoded while not learning");
+        bench.check(after.repeated == before.repeated + 3, "NEC repeat codes count as repeats");
+
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        before = after;
+        Recording sony;
+        sony.addCode(SONY, 0xA90, 12);
+        sony.replay();
+        ir.update();
+        after = counters(ir);
+        bench.check(after.captured == before.captured + 3 && after.repeated == before.repeated + 2,
+                    "Sony's repeated frames count as one press");
+
+        // The ring is full before update() runs: the rest wait in the driver
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        before = after;
+        Recording burst;
+        for (int i = 0; i < IR_CAPTURE_RING_FRAMES + 4; i++)
+            burst.addCode(NEC, 0x20DF0000u + i, 32);
+        burst.replay();
+        uint32_t dropped = halRmtRxDropped();
+        ir.update();
+        Counters first = counters(ir);
+        ir.update();
+        after = counters(ir);
+        bench.check(first.captured == before.captured + IR_CAPTURE_RING_FRAMES && after.captured == before.captured + IR_CAPTURE_RING_FRAMES + 4 &&
+                        halRmtRxDropped() == dropped,
+                    "frames wait in the driver while the ring is full");
+
+        // Learning: a repeat code alone does not end the job, the next
+        // full frame does and keeps the timings as received, canonicalized
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        bench.check(ir.startLearning(1000) != 0, "learning starts");
+        Recording repeatOnly;
+        repeatOnly.addNecRepeat();
+        repeatOnly.replay();
+        ir.update();
+        bench.check(ir.isLearning(), "a repeat code does not end learning");
+
+        Recording press;
+        press.seed = 777;
+        press.addCode(NEC, 0x20DF10EF, 32);
+        press.replay();
+        ir.update();
+        IRCode learned = ir.getLearnedCode();
+        std::vector<uint16_t> pressFrame = frames(press)[0];
+        static IRCanonicalizer canonicalizer;
+        pressFrame.resize(canonicalizer.canonicalize(pressFrame.data(), pressFrame.size()));
+        bench.check(!ir.isLearning() && learned.protocol == NEC && learned.data == 0x20DF10EF && learned.bits == 32,
+                    "learning decodes the captured frame");
+        bench.check(learned.rawData && learned.rawLen == pressFrame.size() &&
+                        std::equal(pressFrame.begin(), pressFrame.end(), learned.rawData),
+                    "learned raw timings are the frame as received, in microseconds, snapped to the grid");
+
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        ir.startLearning(1000);
+        Recording ac;
+        ac.addUnknown();
+        ac.replay();
+        ir.update();
+        learned = ir.getLearnedCode();
+        std::vector<uint16_t> acFrame = frames(ac)[0];
+        bench.check(learned.protocol == UNKNOWN && learned.rawLen == acFrame.size() &&
+                        std::equal(acFrame.begin(), acFrame.end(), learned.rawData),
+                    "an unknown frame is learned raw");
+        learned = IRCode();
+
+        // Capture to decoded, one frame per update()
+        Recording single;
+        single.addCode(NEC, 0x20DF10EF, 32);
+        uint32_t captured = counters(ir).captured;
+        const uint32_t iterations = 20000;
+        bench.measure("edge stream -> decoded frame (NEC)", iterations, [&]
+                      {
+                          single.replay();
+                          ir.update(); });
+        bench.check(counters(ir).captured == captured + iterations, "every replayed frame is captured");
+        bench.report("capture ring RAM", IR_CAPTURE_RING_FRAMES * sizeof(IRCaptureFrame), "bytes");
+    }
+
+    void runFallbackChecks(BenchRunner &bench)
+    {
+        // Without the RMT, IRrecv is polled into the same ring
+        halRmtSetAvailable(false);
+        IRManager fallback;
+        bool began = fallback.begin();
+        halRmtSetAvailable(true);
+        bench.check(began && !fallback.isRmtReceiving() && fallback.isReady() &&
+                        std::string(fallback.getStatus().c_str()).find("\"rxBackend\":\"irrecv\"") != std::string::npos,
+                    "IRrecv receives when the RMT is unavailable");
+
+        std::vector<uint16_t> raw = {9000, 4500, 560, 1690, 560, 560, 560};
+        halClearIRFrames();
+        fallback.startLearning(1000);
+        halInjectIRFrame(NEC, 0x20DF10EF, 32, raw.data(), raw.size());
+        fallback.update();
+        IRCode learned = fallback.getLearnedCode();
+        bench.check(learned.protocol == NEC && learned.data == 0x20DF10EF && learned.rawLen == raw.size() &&
+                        std::equal(raw.begin(), raw.end(), learned.rawData),
+                    "IRrecv captures are learned with raw timings in microseconds");
+    }
+}
+
+ESPIR_BENCH(ir_receive)
+{
+    runDecoderChecks(bench);
+    runPipelineChecks(bench);
+    runFallbackChecks(bench);
+}
+
+namespace
+{
+    // The stream as one capture, gaps included, the way IRrecv or a learn
+    // job joining frames holds it
+    std::vector<uint16_t> capture(const Recording &recording)
+    {
+        std::vector<uint16_t> timings;
+        for (uint32_t us : recording.edges)
+            timings.push_back(us < 0xFFFF ? us : 0xFFFF);
+        return timings;
+    }
+
+    IRCode rawCode(std::vector<uint16_t> &timings)
+    {
+        IRCode code = IRCode();
+        code.protocol = UNKNOWN;
+        code.rawData = timings.data();
+        code.rawLen = timings.size();
+        return code;
+    }
+
+    size_t distinctDurations(const std::vector<uint16_t> &timings, size_t length)
+    {
+        std::vector<uint16_t> sorted(timings.begin(), timings.begin() + length);
+        std::sort(sorted.begin(), sorted.end());
+        return std::unique(sorted.begin(), sorted.end()) - sorted.begin();
+    }
+}
+
+ESPIR_BENCH(ir_canonical)
+{
+    static IRCanonicalizer canonicalizer;
+
+    // One undecoded button held for four frames, captured twice
+    Recording first, second, single;
+    first.seed = 11;
+    second.seed = 29;
+    for (int i = 0; i < 4; i++)
+    {
+        first.addUnknown();
+        second.addUnknown();
+    }
+    single.addUnknown();
+    std::vector<uint16_t> frame = frames(single)[0];
+    std::vector<uint16_t> a = capture(first), b = capture(second);
+    size_t capturedLength = a.size();
+
+    a.resize(canonicalizer.canonicalize(a.data(), a.size()));
+    b.resize(canonicalizer.canonicalize(b.data(), b.size()));
+    bench.report("held-button capture", capturedLength, "timings");
+    bench.report("  canonicalized", a.size(), "timings");
+    bench.report("distinct durations in one raw frame", distinctDurations(frame, frame.size()), "values");
+    bench.report("  canonicalized", distinctDurations(a, a.size()), "values");
+    bench.check(a.size() == frame.size() && b.size() == frame.size(), "repeated frames fold into one");
+
+    // Header mark and space, the bit mark, and the two bit spaces
+    bool onGrid = true;
+    for (uint16_t us : a)
+        onGrid &= us % IR_CANON_GRID_US == 0;
+    bench.check(onGrid && distinctDurations(a, a.size()) == 5, "durations snap to one grid value each");
+
+    IRCode codeA = rawCode(a), codeB = rawCode(b);
+    bench.check(canonicalizer.fingerprint(codeA) == canonicalizer.fingerprint(codeB) && irCodesMatch(codeA, codeB),
+                "two captures of one button fingerprint and match alike");
+
+    Recording other;
+    other.addCode(NEC, 0x20DF906F, 32);
+    std::vector<uint16_t> otherFrame = frames(other)[0];
+    IRCode otherCode = rawCode(otherFrame);
+    Recording necRecording;
+    necRecording.addCode(NEC, 0x20DF10EF, 32);
+    std::vector<uint16_t> necFrame = frames(necRecording)[0];
+    IRCode necCode = rawCode(necFrame);
+    bench.check(canonicalizer.fingerprint(otherCode) != canonicalizer.fingerprint(necCode) && !irCodesMatch(otherCode, necCode),
+                "buttons differing in one bit fingerprint apart");
+
+    Recording withRepeat;
+    withRepeat.addUnknown();
+    withRepeat.addNecRepeat();
+    withRepeat.addNecRepeat();
+    std::vector<uint16_t> repeated = capture(withRepeat);
+    bench.check(canonicalizer.canonicalize(repeated.data(), repeated.size()) == frame.size(), "trailing repeat codes are stripped");
+
+    // A two-frame code sent twice keeps both frames, once each
+    Recording twoPart;
+    for (int i = 0; i < 2; i++)
+    {
+        twoPart.addUnknown();
+        twoPart.addCode(NEC, 0x20DF10EF, 32);
+    }
+    std::vector<uint16_t> parts = capture(twoPart);
+    parts.resize(canonicalizer.canonicalize(parts.data(), parts.size()));
+    bench.check(parts.size() == frame.size() + 1 + necFrame.size() && parts[frame.size()] >= IR_CANON_FRAME_GAP_US,
+                "distinct frames are kept in order, joined by their gap");
+
+    // Learning collects the repeats, then canonicalizes them
+    IRManager &ir = firmwareFixture().irManager;
+    delay(IR_REPEAT_WINDOW_MS + 1);
+    Recording held;
+    held.seed = 47;
+    for (int i = 0; i < 3; i++)
+        held.addUnknown();
+    ir.startLearning(1000);
+    held.replay();
+    ir.update();
+    bool waited = ir.isLearning();
+    delay(IR_REPEAT_WINDOW_MS + 1);
+    ir.update();
+    IRCode learned = ir.getLearnedCode();
+    bench.check(waited && !ir.isLearning() && learned.protocol == UNKNOWN && learned.rawLen == frame.size() &&
+                    canonicalizer.fingerprint(learned) == canonicalizer.fingerprint(codeA),
+                "a learned undecoded code waits for its repeats and comes out canonical");
+
+    Recording longHold;
+    for (int i = 0; i < IR_LEARN_MAX_FRAMES + 2; i++)
+        longHold.addUnknown();
+    delay(IR_REPEAT_WINDOW_MS + 1);
+    ir.startLearning(1000);
+    longHold.replay();
+    ir.update();
+    bench.check(!ir.isLearning() && ir.getLearnedCode().rawLen == frame.size(), "learning ends after IR_LEARN_MAX_FRAMES repeats");
+    ir.update();
+
+    std::vector<uint16_t> original = capture(first), work(original.size());
+    bench.measure("canonicalize (4 frames of 99 timings)", 20000, [&]
+                  {
+                      std::copy(original.begin(), original.end(), work.begin());
+                      canonicalizer.canonicalize(work.data(), work.size());
+                  });
+    volatile uint32_t sink = 0;
+    bench.measure("fingerprint (99 timings)", 20000, [&]
+                  { sink += canonicalizer.fingerprint(codeA); });
+}
+
+namespace
+{
+    // One press of a button: its frames, then the quiet that ends it
+    void press(IRManager &ir, const Recording &recording)
+    {
+        recording.replay();
+        ir.update();
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        ir.update();
+    }
+
+    void pressCode(IRManager &ir, decode_type_t protocol, uint64_t data, uint16_t bits)
+    {
+        injectIRCode(protocol, data, bits);
+        ir.update();
+        delay(IR_REPEAT_WINDOW_MS + 1);
+        ir.update();
+    }
+
+    Recording undecodedPress(uint32_t seed, uint32_t spread = 81, uint64_t value = 0x5A3C96E1F00Full)
+    {
+        Recording recording;
+        recording.seed = seed;
+        recording.spread = spread;
+        recording.addUnknown(value);
+        return recording;
+    }
+
+    bool has(const std::string &text, const char *part) { return text.find(part) != std::string::npos; }
+}
+
+ESPIR_BENCH(ir_learn_captures)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    IRManager &ir = fw.irManager;
+    static IRCanonicalizer canonicalizer;
+    static IRLearnReport report;
+    delay(IR_REPEAT_WINDOW_MS + 1);
+    uint8_t poolBefore = ir.getCapturePool().getUsed();
+
+    // Three presses of an undecoded button, each with its own jitter
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":3}}");
+    bench.check(has(fw.lastNotification, "\"captures\":3"), "LEARN takes a capture count");
+    press(ir, undecodedPress(101));
+    press(ir, undecodedPress(202));
+    bool waited = ir.isLearning();
+    press(ir, undecodedPress(303));
+    ir.getLearnReport(report);
+    IRCode learned = ir.getLearnedCode();
+    Recording single = undecodedPress(404);
+    std::vector<uint16_t> frame = frames(single)[0];
+    frame.resize(canonicalizer.canonicalize(frame.data(), frame.size()));
+    IRCode reference = rawCode(frame);
+    bench.check(waited && !ir.isLearning() && report.status == LEARN_AGREED && report.taken == 3 && report.agreeing == 3,
+                "learning waits for every press, then commits when they agree");
+    bench.check(irCodesMatch(learned, reference) && canonicalizer.fingerprint(learned) == canonicalizer.fingerprint(reference),
+                "the committed code is the button's canonical frame");
+    bench.report("confidence, 3 clean presses", report.confidence, "%");
+    bench.check(report.confidence >= 90 && has(fw.lastNotification, "LEARN_RESULT") && has(fw.lastNotification, "\"confidence\""),
+                "clean presses score high and LEARN_RESULT carries the score");
+    bench.check(ir.getCapturePool().getUsed() <= poolBefore + 1, "only the committed code keeps a pool buffer");
+
+    // One press with a flipped bit is left out and named
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":3}}");
+    press(ir, undecodedPress(505));
+    press(ir, undecodedPress(606, 81, 0x5A3C96E1F00Full ^ (1ull << 20)));
+    press(ir, undecodedPress(707));
+    ir.getLearnReport(report);
+    bench.check(report.status == LEARN_AGREED && report.agreeing == 2 && report.captures[1].mismatch == MISMATCH_TIMING &&
+                    report.captures[1].mismatchAt == 3 + 2 * 20,
+                "a press that disagrees is reported with the first timing that differs");
+    bench.report("confidence, 2 of 3 presses agree", report.confidence, "%");
+    bench.check(has(fw.lastNotification, "\"reason\":\"timing\"") && has(fw.lastNotification, "\"at\":43") &&
+                    report.confidence < 70,
+                "LEARN_RESULT lists the mismatch and the score drops");
+
+    // Two buttons, one each: a third press settles it
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":2}}");
+    pressCode(ir, NEC, 0x20DF10EF, 32);
+    pressCode(ir, NEC, 0x20DF906F, 32);
+    bool undecided = ir.isLearning();
+    pressCode(ir, NEC, 0x20DF10EF, 32);
+    learned = ir.getLearnedCode();
+    bench.check(undecided && !ir.isLearning() && learned.protocol == NEC && learned.data == 0x20DF10EF &&
+                    has(fw.lastNotification, "\"reason\":\"value\"") && has(fw.lastNotification, "20df906f"),
+                "presses that split evenly wait for one more, and the other button is named");
+
+    // A held button is one press
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":2}}");
+    pressCode(ir, SONY, 0x7A, 12);
+    ir.getLearnReport(report);
+    bench.check(ir.isLearning() && report.taken == 1, "the repeats of a held button count once");
+    pressCode(ir, SONY, 0x7A, 12);
+    bench.check(!ir.isLearning() && ir.getLearnedCode().data == 0x7A, "the second press commits it");
+
+    // Never agreeing ends as a mismatch, with nothing learned or held
+    learned = IRCode();
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":2}}");
+    for (int i = 0; i < IR_LEARN_MAX_CAPTURES; i++)
+        pressCode(ir, NEC, 0x20DF0000 + i, 32);
+    ir.getLearnReport(report);
+    bench.check(!ir.isLearning() && report.status == LEARN_DISAGREED && report.taken == IR_LEARN_MAX_CAPTURES &&
+                    !ir.hasLearnedCode() && has(fw.lastNotification, "MISMATCH"),
+                "presses that never agree end the job as MISMATCH");
+    bench.check(ir.getCapturePool().getUsed() <= poolBefore, "a failed job gives its buffers back");
+
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":500,\"captures\":3}}");
+    press(ir, undecodedPress(808));
+    delay(500);
+    ir.update();
+    bench.check(!ir.isLearning() && has(fw.lastNotification, "TIMEOUT") && has(fw.lastNotification, "\"captures\":1"),
+                "a timeout reports the presses taken so far");
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"captures\":9}}");
+    bench.check(has(fw.lastNotification, "INVALID_CAPTURES") && !ir.isLearning(), "capture counts over the limit are refused");
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":-1}}");
+    bool negativeRefused = has(fw.lastNotification, "INVALID_TIMEOUT") && !ir.isLearning();
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":0}}");
+    bool zeroRefused = has(fw.lastNotification, "INVALID_TIMEOUT") && !ir.isLearning();
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":60001}}");
+    bench.check(negativeRefused && zeroRefused && has(fw.lastNotification, "INVALID_TIMEOUT") && !ir.isLearning(),
+                "timeouts outside 1 to 60000 ms are refused");
+
+    // With the raw arena full an undecoded button cannot be stored, and
+    // learning it says so until commands are deleted
+    fw.deviceManager.reset();
+    Device full;
+    full.type = "TV";
+    // Long codes until one is refused, then short ones to take the rest
+    bool filled = false, topped = false;
+    std::vector<uint16_t> timings;
+    for (int n = 0; !topped; n++)
+    {
+        if (n % MAX_COMMANDS == 0)
+        {
+            full.name = "full-" + String(n / MAX_COMMANDS);
+            fw.deviceManager.addDevice(full);
+        }
+        timings.assign(filled ? 60 - n % 20 : 300 - n, 0);
+        for (size_t i = 0; i < timings.size(); i++)
+            timings[i] = 500 * (1 + i % 4);
+        IRCommand command;
+        command.name = "raw-" + String(n);
+        command.code = rawCode(timings);
+        bool added = fw.deviceManager.addCommand(full.name, command);
+        topped = filled && !added;
+        filled = filled || !added;
+    }
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":1}}");
+    press(ir, undecodedPress(909));
+    bench.check(has(fw.lastNotification, "LEARN_RESULT") && has(fw.lastNotification, "\"error\":\"RAW_STORAGE_FULL\""),
+                "an undecoded button is refused with RAW_STORAGE_FULL once raw storage is full");
+    fw.deviceManager.removeDevice("full-0");
+    fw.cmdProcessor.processCommand("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000,\"captures\":1}}");
+    press(ir, undecodedPress(909));
+    bench.check(has(fw.lastNotification, "IR code learned successfully"), "the same button is learned once a device is deleted");
+    fw.deviceManager.reset();
+
+    // Convergence as receiver noise grows: presses needed, simulated time
+    // to the result, and the score, over 20 jobs of 3 captures each
+    for (uint32_t spread : {81u, 161u, 241u, 321u})
+    {
+        uint32_t agreed = 0, presses = 0, elapsed = 0, confidence = 0;
+        for (uint32_t job = 0; job < 20; job++)
+        {
+            ir.startLearning(60000, 3);
+            for (uint32_t p = 0; ir.isLearning() && p < IR_LEARN_MAX_CAPTURES; p++)
+            {
+                press(ir, undecodedPress(1000 * spread + 10 * job + p, spread));
+                delay(400); // The user lifts a finger and presses again
+            }
+            ir.getLearnReport(report);
+            if (report.status != LEARN_AGREED)
+                continue;
+            agreed++;
+            presses += report.taken;
+            elapsed += report.elapsedMs;
+            confidence += report.confidence;
+        }
+        String label = "jitter +-" + String(spread / 2) + " us";
+        bench.report((label + ": jobs agreed").c_str(), agreed * 5, "%");
+        if (agreed)
+        {
+            bench.report("  presses to agree", (double)presses / agreed, "presses");
+            bench.report("  time to agree", (double)elapsed / agreed, "ms");
+            bench.report("  confidence", (double)confidence / agreed, "%");
+        }
+        if (spread == 81)
+            bench.check(agreed == 20 && presses == 60, "with normal receiver jitter every job agrees in 3 presses");
+    }
+
+    // The session alone, on presses already in pool buffers
+    static IRLearnSession session;
+    std::vector<std::vector<uint16_t>> presses;
+    for (uint32_t p = 0; p < 3; p++)
+    {
+        Recording recording = undecodedPress(900 + p);
+        presses.push_back(frames(recording)[0]);
+        presses.back().resize(canonicalizer.canonicalize(presses.back().data(), presses.back().size()));
+    }
+    bench.measure("IRLearnSession, 3 presses of 99 timings", 20000, [&]
+                  {
+                      session.begin(1, 3);
+                      for (std::vector<uint16_t> &timings : presses)
+                      {
+                          IRCode capture = rawCode(timings);
+                          capture.buffer = ir.getCapturePool().acquire();
+                          std::copy(timings.begin(), timings.end(), capture.buffer.data());
+                          capture.rawData = capture.buffer.data();
+                          session.add(capture);
+                      }
+                      session.end(LEARN_CANCELLED);
+                  });
+}
+
+namespace
+{
+    uint32_t sightings(FirmwareFixture &fw, uint32_t since)
+    {
+        return fw.notificationCount - since;
+    }
+}
+
+ESPIR_BENCH(ir_monitor)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    IRManager &ir = fw.irManager;
+    static IRCanonicalizer canonicalizer;
+    ir.stopLearning();
+    populateDevices(fw.deviceManager, 8, 4);
+    delay(IR_REPEAT_WINDOW_MS + 1);
+    ir.update();
+
+    // An undecoded button stored the way LEARN keeps it
+    std::vector<std::vector<uint16_t>> learnedFrames = frames(undecodedPress(111));
+    std::vector<uint16_t> &stored = learnedFrames[0];
+    stored.resize(canonicalizer.canonicalize(stored.data(), stored.size()));
+    IRCommand raw;
+    raw.name = "HEAT";
+    raw.description = "Undecoded";
+    raw.code = rawCode(stored);
+    fw.deviceManager.addCommand("device-7", raw);
+
+    fw.cmdProcessor.processCommand("{\"command\":\"MONITOR\",\"parameters\":{}}");
+    bench.check(has(fw.lastNotification, "MISSING_PARAMETERS") && !ir.isMonitoring(), "MONITOR needs enabled");
+    fw.cmdProcessor.processCommand("{\"command\":\"MONITOR\",\"parameters\":{\"enabled\":true}}");
+    bench.check(ir.isMonitoring() && has(fw.lastNotification, "\"enabled\":true"), "MONITOR starts the monitor");
+
+    // A press of a stored NEC button
+    uint32_t before = fw.notificationCount;
+    pressCode(ir, NEC, 0x20DF0302, 32);
+    bench.check(sightings(fw, before) == 1 && has(fw.lastNotification, "CODE_SEEN") &&
+                    has(fw.lastNotification, "device-3/cmd-2 seen") && has(fw.lastNotification, "\"value\":\"20df0302\""),
+                "a stored button is named when it is seen");
+
+    // Held: one frame then repeat codes, a Sony frame sent three times, and
+    // an undecoded remote repeating its whole frame, each seen once
+    before = fw.notificationCount;
+    Recording held;
+    held.addCode(NEC, 0x20DF0101, 32);
+    for (int i = 0; i < 5; i++)
+        held.addNecRepeat();
+    press(ir, held);
+    bench.check(sightings(fw, before) == 1 && has(fw.lastNotification, "device-1/cmd-1 seen"),
+                "a held NEC button is seen once, not per repeat code");
+
+    populateDevices(fw.deviceManager, 8, 4);
+    IRCommand sony;
+    sony.name = "VOL_UP";
+    sony.description = "Sony";
+    sony.code = IRCode();
+    sony.code.protocol = SONY;
+    sony.code.data = 0x490;
+    sony.code.bits = 12;
+    fw.deviceManager.addCommand("device-5", sony);
+    fw.deviceManager.addCommand("device-7", raw);
+    before = fw.notificationCount;
+    pressCode(ir, SONY, 0x490, 12);
+    bench.check(sightings(fw, before) == 1 && has(fw.lastNotification, "device-5/VOL_UP seen"),
+                "a Sony press, sent as three frames, is seen once");
+
+    before = fw.notificationCount;
+    Recording heldRaw = undecodedPress(222);
+    Recording again = undecodedPress(333);
+    heldRaw.edges.insert(heldRaw.edges.end(), again.edges.begin(), again.edges.end());
+    press(ir, heldRaw);
+    bench.check(sightings(fw, before) == 1 && has(fw.lastNotification, "device-7/HEAT seen") &&
+                    !has(fw.lastNotification, "\"value\""),
+                "an undecoded button matches its stored timings once while held");
+
+    // Codes not in the library are counted, not notified
+    before = fw.notificationCount;
+    pressCode(ir, NEC, 0x10EF00FF, 32);
+    press(ir, undecodedPress(444, 81, 0x123456789ABCull));
+    fw.cmdProcessor.processCommand("{\"command\":\"GET_STATUS\",\"parameters\":{}}");
+    bench.check(sightings(fw, before) == 1 && has(fw.lastNotification, "\"unmatched\":2") &&
+                    has(fw.lastNotification, "\"monitoring\":true"),
+                "unknown codes only show in the status counters");
+
+    // A stream of distinct presses, repeats between them, as fast as a
+    // user can mash buttons: every press is named and nothing is missed
+    static const int kPresses = 40;
+    before = fw.notificationCount;
+    uint32_t named = 0;
+    for (int p = 0; p < kPresses; p++)
+    {
+        Recording burst;
+        burst.seed = 500 + p;
+        burst.addCode(NEC, 0x20DF0000 | ((p % 8) << 8) | (p / 8 % 4), 32);
+        burst.addNecRepeat();
+        burst.replay();
+        ir.update();
+        named += has(fw.lastNotification, ("device-" + std::to_string(p % 8) + "/cmd-" + std::to_string(p / 8 % 4)).c_str());
+        delay(50);
+    }
+    bench.check(sightings(fw, before) == kPresses && named == kPresses, "20 presses a second are each seen once");
+
+    // Cost of one sighting through update(), matching included
+    std::vector<uint32_t> edges;
+    {
+        Recording frame;
+        frame.addCode(NEC, 0x20DF0403, 32);
+        edges = frame.edges;
+    }
+    BenchResult necCost = bench.measure("update() + match, NEC sighting", 2000, [&]
+                                        {
+                                            halInjectIREdges(edges.data(), edges.size());
+                                            ir.update();
+                                            delay(IR_REPEAT_WINDOW_MS + 1);
+                                        });
+    Recording undecoded = undecodedPress(555);
+    BenchResult rawCost = bench.measure("update() + match, undecoded sighting", 2000, [&]
+                                        {
+                                            undecoded.replay();
+                                            ir.update();
+                                            delay(IR_REPEAT_WINDOW_MS + 1);
+                                        });
+    bench.report("sightings per second, undecoded", 1e9 / rawCost.meanNs, "frames/s");
+    bench.check(necCost.p99Ns < 1e6 && rawCost.p99Ns < 1e6, "a sighting costs well under a millisecond");
+
+    fw.cmdProcessor.processCommand("{\"command\":\"MONITOR\",\"parameters\":{\"enabled\":false}}");
+    before = fw.notificationCount;
+    pressCode(ir, NEC, 0x20DF0302, 32);
+    bench.check(!ir.isMonitoring() && sightings(fw, before) == 0, "MONITOR off stops the events");
+}
@@ -0,0 +1,311 @@
+/**
+ * IR Waveform Benchmarks
+ *
+ * The waveform compiler against timings written out from the protocol
+ * definitions (mark/space sequences, carriers, gaps and long durations
+ * split over items), the compiled-waveform cache, and the RMT transmit
+ * path: what reaches the peripheral, and how much CPU a send takes
+ * compared with bit-banging through IRsend.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+    // Expected on-air sequence: alternating mark/space durations starting
+    // with a mark, adjacent same-level periods merged
+    struct Timings
+    {
+        std::vector<uint32_t> us;
+        bool lastMark = false;
+
+        void add(bool mark, uint32_t duration)
+        {
+            if (duration == 0 || (us.empty() && !mark))
+                return;
+            if (!us.empty() && mark == lastMark)
+                us.back() += duration;
+            else
+                us.push_back(duration);
+            lastMark = mark;
+        }
+
+        uint32_t total() const
+        {
+            uint32_t sum = 0;
+            for (uint32_t d : us)
+                sum += d;
+            return sum;
+        }
+    };
+
+    std::vector<uint32_t> flatten(const IRWaveform &wave)
+    {
+        std::vector<uint32_t> out(2 * IR_WAVE_MAX_ITEMS);
+        out.resize(waveformTimings(wave, out.data(), out.size()));
+        return out;
+    }
+
+    bool itemsWellFormed(const IRWaveform &wave)
+    {
+        // Starts with a mark; no zero-length half before the end
+        if (wave.count == 0 || !(wave.items[0] & 0x8000))
+            return false;
+        for (uint16_t i = 0; i < wave.count; i++)
+        {
+            bool last = i + 1 == wave.count;
+            if ((wave.items[i] & 0x7FFF) == 0 || (!last && ((wave.items[i] >> 16) & 0x7FFF) == 0))
+                return false;
+        }
+        return true;
+    }
+
+    Timings necTimings(uint32_t data)
+    {
+        Timings t;
+        t.add(true, 8960);
+        t.add(false, 4480);
+        for (int bit = 31; bit >= 0; bit--)
+        {
+            t.add(true, 560);
+            t.add(false, ((data >> bit) & 1) ? 1680 : 560);
+        }
+        t.add(true, 560);
+        uint32_t frame = t.total();
+        t.add(false, frame < 108080 - 22400 ? 108080 - frame : 22400);
+        return t;
+    }
+
+    Timings sonyTimings(uint32_t data, int bits)
+    {
+        Timings t;
+        for (int frame = 0; frame < 3; frame++)
+        {
+            uint32_t start = t.total();
+            t.add(true, 2400);
+            t.add(false, 600);
+            for (int bit = bits - 1; bit >= 0; bit--)
+            {
+                t.add(true, ((data >> bit) & 1) ? 1200 : 600);
+                t.add(false, 600);
+            }
+            uint32_t elapsed = t.total() - start;
+            t.add(false, elapsed < 45000 - 10000 ? 45000 - elapsed : 10000);
+        }
+        return t;
+    }
+
+    // RC5 as half-bit levels: each bit is two 889 us halves, 1 = low-high
+    Timings rc5Timings(uint32_t data)
+    {
+        std::vector<bool> halves = {false, true}; // Start bit
+        bool field = !((data >> 12) & 1);
+        halves.push_back(!field);
+        halves.push_back(field);
+        for (int bit = 11; bit >= 0; bit--)
+        {
+            bool one = (data >> bit) & 1;
+            halves.push_back(!one);
+            halves.push_back(one);
+        }
+        Timings t;
+        for (bool level : halves)
+            t.add(level, 889);
+        t.add(false, 88886);
+        return t;
+    }
+
+    // RC6 mode 0: header, start bit, then 1 = high-low, the 4th bit doubled
+    Timings rc6Timings(uint32_t data, int bits)
+    {
+        Timings t;
+        t.add(true, 2664);
+        t.add(false, 888);
+        t.add(true, 444);
+        t.add(false, 444);
+        for (int bit = bits - 1, n = 1; bit >= 0; bit--, n++)
+        {
+            bool one = (data >> bit) & 1;
+            uint32_t half = n == 4 ? 888 : 444;
+            t.add(one, half);
+            t.add(!one, half);
+        }
+        t.add(false, 83000);
+        return t;
+    }
+
+    bool compilesTo(decode_type_t protocol, uint64_t data, uint16_t bits, const Timings &expected, uint16_t carrierHz)
+    {
+        static IRWaveform wave;
+        return compileWaveform(protocol, data, bits, nullptr, 0, wave) && itemsWellFormed(wave) &&
+               wave.carrierHz == carrierHz && flatten(wave) == expected.us &&
+               waveformDurationUs(wave) == expected.total();
+    }
+
+    double threadCpuMs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+    }
+
+    void runCompilerChecks(BenchRunner &bench)
+    {
+        bench.check(compilesTo(NEC, 0x20DF10EF, 32, necTimings(0x20DF10EF), 38000), "NEC compiles to the NEC frame");
+        bench.check(compilesTo(NEC, 0xFFFFFFFF, 32, necTimings(0xFFFFFFFF), 38000), "a long NEC frame keeps the minimum gap");
+        bench.check(compilesTo(SONY, 0xA90, 12, sonyTimings(0xA90, 12), 40000), "Sony compiles to three padded frames");
+        bench.check(compilesTo(RC5, 0x175C, 13, rc5Timings(0x175C), 36000) &&
+                        compilesTo(RC5, 0x0C0C, 13, rc5Timings(0x0C0C), 36000),
+                    "RC5 compiles to its bi-phase halves, field bit included");
+        bench.check(compilesTo(RC6, 0x0C0C, 20, rc6Timings(0x0C0C, 20), 36000), "RC6 compiles with the double-width toggle bit");
+
+        static IRWaveform wave;
+        const uint16_t raw[] = {9000, 4500, 560, 65000, 560, 40000, 0, 1690, 560};
+        Timings expected;
+        for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++)
+            expected.add(i % 2 == 0, raw[i]);
+        bench.check(compileWaveform(UNKNOWN, 0, 0, raw, sizeof(raw) / sizeof(raw[0]), wave) && itemsWellFormed(wave) &&
+                        wave.carrierHz == IR_FREQUENCY && flatten(wave) == expected.us,
+                    "raw timings compile to the same sequence at the default carrier");
+        bool split = true;
+        for (uint16_t i = 0; i < wave.count; i++)
+            split &= (wave.items[i] & 0x7FFF) <= IR_WAVE_MAX_DURATION && ((wave.items[i] >> 16) & 0x7FFF) <= IR_WAVE_MAX_DURATION;
+        bench.check(split && wave.count == 5, "durations past one item half are split");
+
+        std::vector<uint16_t> huge(MAX_IR_CODE_SIZE, 40000);
+        bench.check(!compileWaveform(UNKNOWN, 0, 0, huge.data(), huge.size(), wave), "a stream past the item buffer is refused");
+        bench.check(!compileWaveform(SAMSUNG, 0xE0E040BF, 32, nullptr, 0, wave) && !compileWaveform(NEC, 0, 0, nullptr, 0, wave),
+                    "unsupported protocols and empty codes are refused");
+
+        bench.measure("compileWaveform(NEC)", 20000, [&]
+                      { compileWaveform(NEC, 0x20DF10EF, 32, nullptr, 0, wave); });
+        std::vector<uint16_t> capture(200);
+        for (size_t i = 0; i < capture.size(); i++)
+            capture[i] = i % 2 == 0 ? 560 : (i % 3 == 0 ? 1690 : 560);
+        bench.measure("compileWaveform(raw 200)", 20000, [&]
+                      { compileWaveform(UNKNOWN, 0, 0, capture.data(), capture.size(), wave); });
+        bench.report("waveform size (largest stream)", sizeof(IRWaveform), "bytes");
+    }
+
+    void runCacheChecks(BenchRunner &bench)
+    {
+        IRWaveformCache cache;
+        bench.check(cache.begin(), "waveform cache allocates");
+
+        const IRWaveform *first = cache.get(NEC, 0x20DF10EF, 32, nullptr, 0);
+        const IRWaveform *again = cache.get(NEC, 0x20DF10EF, 32, nullptr, 0);
+        bench.check(first && first == again && cache.getHits() == 1 && cache.getMisses() == 1, "a code sent again is not recompiled");
+        bench.check(cache.get(NEC, 0x20DF10EF, 24, nullptr, 0) != first || cache.getMisses() == 2, "codes differing in bits do not share");
+
+        // Least recently used goes first: the NEC code stays warm
+        for (uint32_t i = 0; i < IR_WAVE_CACHE_ENTRIES; i++)
+        {
+            cache.get(NEC, 0x20DF0000 + i, 32, nullptr, 0);
+            cache.get(NEC, 0x20DF10EF, 32, nullptr, 0);
+        }
+        uint32_t misses = cache.getMisses();
+        cache.get(NEC, 0x20DF10EF, 32, nullptr, 0);
+        bool warmKept = cache.getMisses() == misses;
+        cache.get(NEC, 0x20DF0000, 32, nullptr, 0);
+        bench.check(warmKept && cache.getMisses() == misses + 1, "the least recently used waveform is evicted");
+
+        uint16_t raw[] = {9000, 4500, 560, 560, 560};
+        cache.get(UNKNOWN, 0, 0, raw, 5);
+        raw[3] = 1690;
+        misses = cache.getMisses();
+        const IRWaveform *changed = cache.get(UNKNOWN, 0, 0, raw, 5);
+        bench.check(changed && cache.getMisses() == misses + 1 && flatten(*changed)[3] == 1690, "raw codes are keyed by their timings");
+
+        bench.measure("waveform cache hit (NEC)", 200000, [&]
+                      { cache.get(NEC, 0x20DF10EF, 32, nullptr, 0); });
+        bench.report("waveform cache RAM", IR_WAVE_CACHE_ENTRIES * sizeof(IRWaveform), "bytes");
+    }
+
+    void runTransmitChecks(BenchRunner &bench)
+    {
+        IRManager &ir = firmwareFixture().irManager;
+        bench.check(ir.isRmtEnabled() && std::string(ir.getStatus().c_str()).find("\"txBackend\":\"rmt\"") != std::string::npos, "the RMT transmitter is the default backend");
+
+        IRCode sony = IRCode();
+        sony.protocol = SONY;
+        sony.data = 0xA90;
+        sony.bits = 12;
+        resetIRSends();
+        bench.check(ir.transmitCode(sony) && lastIRSendWas(SONY, 0xA90, 12) && IRsend::log().sendCount == 0,
+                    "a protocol code goes out through the RMT");
+        bench.check(halRmtLog().carrierHz > 39900 && halRmtLog().carrierHz < 40100 && halRmtLog().dutyPercent == IR_DUTY_CYCLE,
+                    "the carrier follows the protocol");
+
+        uint16_t raw[] = {3400, 1700, 430, 430, 430, 1290, 430, 40000, 430};
+        IRCode captured = IRCode();
+        captured.protocol = UNKNOWN;
+        captured.rawData = raw;
+        captured.rawLen = sizeof(raw) / sizeof(raw[0]);
+        bench.check(ir.transmitCode(captured), "a raw code is sent");
+        IRWaveform sent;
+        sent.count = halRmtLog().lastItems.size();
+        std::copy(halRmtLog().lastItems.begin(), halRmtLog().lastItems.end(), sent.items);
+        std::vector<uint32_t> expected(raw, raw + captured.rawLen);
+        bench.check(flatten(sent) == expected && halRmtLog().carrierHz > 37900 && halRmtLog().carrierHz < 38100,
+                    "the peripheral receives the raw timings as captured");
+
+        // CPU held by a send: bit-banging spins for the frame, the RMT sleeps
+        IRCode nec = IRCode();
+        nec.protocol = NEC;
+        nec.data = 0x20DF10EF;
+        nec.bits = 32;
+        const int frames = 5;
+        halSetIRAirtimeSimulation(true);
+        double cpuMs[2], wallMs[2];
+        for (int backend = 0; backend < 2; backend++)
+        {
+            ir.setRmtEnabled(backend == 1);
+            double cpu0 = threadCpuMs();
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < frames; i++)
+                ir.transmitCode(nec);
+            wallMs[backend] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            cpuMs[backend] = threadCpuMs() - cpu0;
+        }
+        halSetIRAirtimeSimulation(false);
+        bench.report("NEC frame: CPU held, IRsend", cpuMs[0] / frames, "ms");
+        bench.report("NEC frame: CPU held, RMT", cpuMs[1] / frames, "ms");
+        bench.report("NEC frame: wall time, IRsend", wallMs[0] / frames, "ms");
+        bench.report("NEC frame: wall time, RMT", wallMs[1] / frames, "ms");
+        bench.check(cpuMs[1] * 10 < cpuMs[0], "an RMT send leaves the CPU free for the frame");
+        bench.check(wallMs[1] >= frames * 100, "the sender still waits for the frame to finish");
+
+        resetIRSends();
+        bench.check(ir.setRmtEnabled(false) && ir.transmitCode(nec) && IRsend::log().sendCount == 1 && halRmtLog().writeCount == 0,
+                    "IRsend takes over when the RMT is switched off");
+        ir.setRmtEnabled(true);
+
+        // A board where the RMT cannot be set up falls back at begin()
+        halRmtSetAvailable(false);
+        IRManager fallback;
+        bool began = fallback.begin();
+        halRmtSetAvailable(true);
+        resetIRSends();
+        bench.check(began && !fallback.isRmtEnabled() && fallback.transmitCode(nec) && IRsend::log().sendCount == 1,
+                    "IRsend is used when the RMT is unavailable");
+
+        resetIRSends();
+        bench.measure("transmitCode(NEC) via RMT, cached", 20000, [&]
+                      { ir.transmitCode(nec); });
+        ir.setRmtEnabled(false);
+        bench.measure("transmitCode(NEC) via IRsend stand-in", 20000, [&]
+                      { ir.transmitCode(nec); });
+        ir.setRmtEnabled(true);
+    }
+}
+
+ESPIR_BENCH(ir_waveform)
+{
+    runCompilerChecks(bench);
+    runCacheChecks(bench);
+    runTransmitChecks(bench);
+}
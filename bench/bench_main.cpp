@@ -0,0 +1,85 @@
+/**
+ * Host Benchmark Runner
+ *
+ * Usage: .pio/build/native/program [filter]
+ */
+
+#include "bench.h"
+#include <cstring>
+#include <hal_native.h>
+
+std::vector<BenchCase> &benchRegistry()
+{
+    static std::vector<BenchCase> cases;
+    return cases;
+}
+
+void BenchRunner::printDuration(double ns)
+{
+    if (ns >= 1e6)
+        printf("%9.2f ms", ns / 1e6);
+    else if (ns >= 1e3)
+        printf("%9.2f us", ns / 1e3);
+    else
+        printf("%9.1f ns", ns);
+}
+
+BenchResult BenchRunner::finish(const char *label, double totalNs)
+{
+    BenchResult result = {0, 0, 0, 0};
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double s : samples)
+            sum += s;
+        result.meanNs = sum / samples.size();
+        result.p50Ns = samples[samples.size() / 2];
+        result.p99Ns = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        result.opsPerSec = totalNs > 0 ? samples.size() * 1e9 / totalNs : 0;
+    }
+
+    printf("  %-44s mean", label);
+    printDuration(result.meanNs);
+    printf("  p50");
+    printDuration(result.p50Ns);
+    printf("  p99");
+    printDuration(result.p99Ns);
+    printf("  %12.0f ops/s\n", result.opsPerSec);
+    return result;
+}
+
+void BenchRunner::report(const char *label, double value, const char *unit)
+{
+    printf("  %-44s %12.2f %s\n", label, value, unit);
+}
+
+bool BenchRunner::check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("  FAILED: %s\n", what);
+        failureCount++;
+    }
+    return condition;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+    halSetSerialOutput(false);
+
+    BenchRunner runner;
+    int ran = 0;
+    for (const BenchCase &c : benchRegistry())
+    {
+        if (filter && !strstr(c.name, filter))
+            continue;
+        printf("[%s]\n", c.name);
+        c.fn(runner);
+        ran++;
+    }
+
+    printf("\n%d benchmark(s) run, %d check(s) failed\n", ran, runner.failures());
+    return runner.failures() == 0 ? 0 : 1;
+}
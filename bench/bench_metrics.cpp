@@ -0,0 +1,172 @@
+/**
+ * Metrics Registry Benchmarks
+ *
+ * Counters move where the work happens (IR transmits and learn outcomes,
+ * commands, BLE connections, flash commits), GET_STATUS keeps the fields
+ * it reported before next to the registry's, and the binary METRICS
+ * snapshot matches the registry without allocating. Measures both reads.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "binary_protocol.h"
+#include "metrics.h"
+#include <hal_native.h>
+#include <ArduinoJson.h>
+
+namespace
+{
+    std::string metricsFrame(uint8_t opcode, uint16_t requestId, std::initializer_list<uint8_t> tlvs)
+    {
+        std::string f = {(char)BIN_MAGIC, (char)BIN_VERSION, (char)opcode, (char)(requestId & 0xFF), (char)(requestId >> 8), 0};
+        for (uint8_t b : tlvs)
+            f.push_back((char)b);
+        return f;
+    }
+
+    uint32_t readU32(const uint8_t *p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    // Every value and histogram in a METRICS reply against the registry
+    bool snapshotMatches(const std::string &reply)
+    {
+        BinaryFrame frame;
+        if (!parseBinaryFrame((const uint8_t *)reply.data(), reply.size(), frame) || frame.status != BIN_STATUS_OK)
+            return false;
+
+        const uint8_t *values;
+        uint8_t length;
+        if (!findBinaryTlv(frame, BIN_TAG_METRIC_VALUES, values, length) || length != METRIC_COUNT * 4)
+            return false;
+        for (uint8_t id = 0; id < METRIC_COUNT; id++)
+        {
+            if (readU32(values + id * 4) != metrics.get((MetricId)id))
+                return false;
+        }
+
+        uint8_t histograms = 0;
+        for (size_t pos = 0; pos < frame.payloadLength; pos += 2 + frame.payload[pos + 1])
+        {
+            const uint8_t *tlv = frame.payload + pos;
+            if (tlv[0] != BIN_TAG_HISTOGRAM)
+                continue;
+            if (tlv[1] != 25 || tlv[2] >= METRIC_HIST_COUNT)
+                return false;
+            MetricHistogramSummary summary;
+            metrics.summarize((MetricHistogramId)tlv[2], summary);
+            const uint32_t expected[] = {summary.count, summary.sum, summary.max, summary.p50, summary.p95, summary.p99};
+            for (uint8_t f = 0; f < 6; f++)
+            {
+                if (readU32(tlv + 3 + f * 4) != expected[f])
+                    return false;
+            }
+            histograms++;
+        }
+        return histograms == METRIC_HIST_COUNT;
+    }
+}
+
+ESPIR_BENCH(metrics)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 20, 10);
+    halBleConnect(185);
+    bench.check(metrics.get(METRIC_BLE_MTU) == 185, "the MTU gauge follows the connection");
+
+    // Histogram percentiles are bucket bounds, capped at the largest sample
+    MetricsRegistry local;
+    for (uint32_t sample = 1; sample <= 100; sample++)
+        local.observe(METRIC_HIST_IR_TRANSMIT_US, sample);
+    MetricHistogramSummary summary;
+    local.summarize(METRIC_HIST_IR_TRANSMIT_US, summary);
+    bench.check(summary.count == 100 && summary.sum == 5050 && summary.max == 100, "a histogram keeps count, sum and max");
+    bench.check(summary.p50 == 63 && summary.p95 == 100 && summary.p99 == 100, "percentiles report their bucket's upper bound");
+
+    // Counters move in place
+    const String transmit = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\",\"command\":\"cmd-4\"}}";
+    const String unknown = "{\"command\":\"NOPE\",\"parameters\":{}}";
+    uint32_t transmits = metrics.get(METRIC_IR_TRANSMITS);
+    metrics.summarize(METRIC_HIST_IR_TRANSMIT_US, summary);
+    uint32_t timed = summary.count;
+    uint32_t processed = metrics.get(METRIC_COMMANDS_PROCESSED);
+    uint32_t failed = metrics.get(METRIC_COMMANDS_FAILED);
+    for (int i = 0; i < 10; i++)
+        fw.cmdProcessor.processCommand(transmit);
+    for (int i = 0; i < 5; i++)
+        fw.cmdProcessor.processCommand(unknown);
+    metrics.summarize(METRIC_HIST_IR_TRANSMIT_US, summary);
+    bench.check(metrics.get(METRIC_IR_TRANSMITS) - transmits == 10 && summary.count - timed == 10, "every transmit is counted and timed");
+    bench.check(metrics.get(METRIC_COMMANDS_PROCESSED) - processed == 15 && metrics.get(METRIC_COMMANDS_FAILED) - failed == 5,
+                "commands are counted, and the ones that fail");
+
+    uint32_t learned = metrics.get(METRIC_IR_LEARNED);
+    fw.irManager.startLearning();
+    injectIRCode(NEC, 0x20DF10EF, 32);
+    fw.irManager.update();
+    uint32_t cancelled = metrics.get(METRIC_IR_LEARN_CANCELLED);
+    fw.irManager.startLearning();
+    fw.irManager.stopLearning();
+    uint32_t timeouts = metrics.get(METRIC_IR_LEARN_TIMEOUTS);
+    fw.irManager.startLearning(1);
+    delay(5);
+    fw.irManager.update();
+    bench.check(metrics.get(METRIC_IR_LEARNED) - learned == 1 && metrics.get(METRIC_IR_LEARN_CANCELLED) - cancelled == 1 &&
+                    metrics.get(METRIC_IR_LEARN_TIMEOUTS) - timeouts == 1,
+                "learn outcomes are counted");
+
+    uint32_t commits = metrics.get(METRIC_FLASH_COMMITS);
+    Device device;
+    device.name = "metrics-tv";
+    device.type = "TV";
+    fw.deviceManager.addDevice(device);
+    fw.deviceManager.removeDevice("metrics-tv");
+    bench.check(metrics.get(METRIC_FLASH_COMMITS) - commits == 2, "each persisted mutation is a commit");
+
+    uint32_t connects = metrics.get(METRIC_BLE_CONNECTS), disconnects = metrics.get(METRIC_BLE_DISCONNECTS);
+    halBleDisconnect();
+    halBleConnect(247);
+    bench.check(metrics.get(METRIC_BLE_CONNECTS) - connects == 1 && metrics.get(METRIC_BLE_DISCONNECTS) - disconnects == 1,
+                "connections are counted");
+
+    // GET_STATUS: the fields it always had, and the registry's next to them
+    const String getStatus = "{\"command\":\"GET_STATUS\",\"parameters\":{}}";
+    fw.cmdProcessor.processCommand(getStatus);
+    DynamicJsonDocument doc(8192);
+    bench.check(!deserializeJson(doc, fw.lastNotification), "GET_STATUS reply parses");
+    JsonObject data = doc["data"];
+    bench.check(!data["ir"]["ready"].isNull() && !data["ir"]["framesCaptured"].isNull() && !data["ble"]["connected"].isNull() &&
+                    !data["ble"]["txQueue"]["queued"].isNull() && !data["devices"]["storage"]["usedBytes"].isNull() &&
+                    !data["tasks"]["irStackFree"].isNull() && !data["monitor"]["enabled"].isNull() && !data["freeHeap"].isNull(),
+                "GET_STATUS keeps its existing fields");
+    bench.check(data["ir"]["transmits"].as<uint32_t>() == metrics.get(METRIC_IR_TRANSMITS) &&
+                    data["ble"]["mtu"].as<uint32_t>() == 247 &&
+                    data["ble"]["txQueue"]["retries"].as<uint32_t>() == metrics.get(METRIC_BLE_NOTIFY_RETRIES) &&
+                    data["devices"]["storage"]["commits"].as<uint32_t>() == metrics.get(METRIC_FLASH_COMMITS) &&
+                    data["tasks"]["dropped"].as<uint32_t>() == metrics.get(METRIC_COMMANDS_DROPPED) &&
+                    data["monitor"]["matched"].as<uint32_t>() == metrics.get(METRIC_MONITOR_MATCHED) &&
+                    data["commands"]["processed"].as<uint32_t>() == metrics.get(METRIC_COMMANDS_PROCESSED),
+                "GET_STATUS renders each metric into its group");
+    bench.check(data["ir"]["transmitUs"]["count"].as<uint32_t>() > 0 && !data["ir"]["transmitUs"]["p99"].isNull() &&
+                    !data["devices"]["storage"]["commitUs"]["p95"].isNull(),
+                "GET_STATUS summarizes the histograms");
+    bench.report("GET_STATUS reply size", fw.lastNotification.size(), "bytes");
+
+    // Binary snapshot
+    halBleWrite(metricsFrame(BIN_OP_HELLO, 1, {BIN_TAG_VERSION, 1, BIN_VERSION}));
+    const std::string snapshot = metricsFrame(BIN_OP_METRICS, 2, {});
+    halBleWrite(snapshot);
+    bench.check(snapshotMatches(fw.lastNotification), "the METRICS snapshot matches the registry");
+    bench.report("METRICS reply size", fw.lastNotification.size(), "bytes");
+
+    uint64_t allocations = benchAllocationCount();
+    for (int i = 0; i < 100; i++)
+        halBleWrite(snapshot);
+    bench.check(benchAllocationCount() == allocations, "the METRICS snapshot does not allocate");
+
+    bench.measure("processCommand(GET_STATUS) with metrics", 2000, [&]
+                  { fw.cmdProcessor.processCommand(getStatus); });
+    bench.measure("binary METRICS round trip", 5000, [&]
+                  { halBleWrite(snapshot); });
+}
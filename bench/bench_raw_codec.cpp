@@ -0,0 +1,253 @@
+/**
+ * Raw Codec Benchmarks
+ *
+ * Round trips raw captures through the timing codec. The captures follow
+ * each protocol's published timings with the distortion a demodulating
+ * receiver adds (marks stretched, spaces shortened, a few ticks of noise).
+ * Reports encoded size against plain uint16_t words and against the JSON
+ * integer array encodeIRCode() used to emit, and decode speed.
+ */
+
+#include "bench.h"
+#include "raw_codec.h"
+#include "bench_fixture.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Capture
+    {
+        const char *name;
+        std::vector<uint16_t> timings;
+    };
+
+    // Receiver distortion: deterministic so runs compare
+    struct Receiver
+    {
+        uint32_t seed = 12345;
+        std::vector<uint16_t> timings;
+
+        int noise()
+        {
+            seed = seed * 1103515245u + 12345u;
+            return (int)((seed >> 16) % 61) - 30;
+        }
+        void mark(int us) { timings.push_back(us + 60 + noise()); }
+        void space(int us) { timings.push_back(us - 60 + noise()); }
+    };
+
+    Capture nec()
+    {
+        Receiver rx;
+        uint32_t code = 0x20DF10EF; // LG power
+        rx.mark(9000);
+        rx.space(4500);
+        for (int bit = 31; bit >= 0; bit--)
+        {
+            rx.mark(560);
+            rx.space((code >> bit) & 1 ? 1690 : 560);
+        }
+        rx.mark(560);
+        // One repeat frame
+        rx.space(40000);
+        rx.mark(9000);
+        rx.space(2250);
+        rx.mark(560);
+        return {"NEC + repeat", rx.timings};
+    }
+
+    Capture sony()
+    {
+        Receiver rx;
+        uint16_t code = 0xA90; // 12-bit power
+        for (int frame = 0; frame < 3; frame++)
+        {
+            rx.mark(2400);
+            rx.space(600);
+            for (int bit = 0; bit < 12; bit++)
+            {
+                rx.mark((code >> bit) & 1 ? 1200 : 600);
+                rx.space(bit == 11 ? (frame == 2 ? 600 : 25800) : 600);
+            }
+        }
+        rx.timings.pop_back();
+        return {"Sony SIRC x3", rx.timings};
+    }
+
+    Capture rc5()
+    {
+        // Manchester halves merged into 889/1778 us marks and spaces
+        uint16_t frame = 0x3000 | (0 << 6) | 12; // start bits, address 0, command 12
+        std::vector<bool> halves;
+        for (int bit = 13; bit >= 0; bit--)
+        {
+            bool one = (frame >> bit) & 1;
+            halves.push_back(!one);
+            halves.push_back(one);
+        }
+        Receiver rx;
+        size_t i = 0;
+        while (i < halves.size() && !halves[i])
+            i++;
+        while (i < halves.size())
+        {
+            size_t run = 1;
+            while (i + run < halves.size() && halves[i + run] == halves[i])
+                run++;
+            if (halves[i])
+                rx.mark(889 * run);
+            else
+                rx.space(889 * run);
+            i += run;
+        }
+        return {"RC5", rx.timings};
+    }
+
+    Capture samsung()
+    {
+        Receiver rx;
+        uint32_t code = 0xE0E040BF;
+        rx.mark(4500);
+        rx.space(4500);
+        for (int bit = 31; bit >= 0; bit--)
+        {
+            rx.mark(560);
+            rx.space((code >> bit) & 1 ? 1690 : 560);
+        }
+        rx.mark(560);
+        return {"Samsung", rx.timings};
+    }
+
+    Capture mitsubishiAc()
+    {
+        // 18-byte state: fixed header bytes, then mostly zero settings
+        const uint8_t state[18] = {0x23, 0xCB, 0x26, 0x01, 0x00, 0x20, 0x08, 0x06, 0x30,
+                                   0x45, 0x67, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F};
+        Receiver rx;
+        rx.mark(3400);
+        rx.space(1750);
+        for (uint8_t byte : state)
+        {
+            for (int bit = 0; bit < 8; bit++)
+            {
+                rx.mark(450);
+                rx.space((byte >> bit) & 1 ? 1300 : 420);
+            }
+        }
+        rx.mark(440);
+        return {"Mitsubishi AC (144 bits)", rx.timings};
+    }
+
+    size_t jsonArraySize(const std::vector<uint16_t> &timings)
+    {
+        size_t size = 2 + timings.size() - 1;
+        for (uint16_t t : timings)
+            size += std::to_string(t).size();
+        return size;
+    }
+}
+
+ESPIR_BENCH(raw_codec)
+{
+    static RawTimingEncoder encoder;
+    uint8_t encoded[RAW_CODEC_MAX_SIZE], reencoded[RAW_CODEC_MAX_SIZE];
+    uint16_t decoded[MAX_IR_CODE_SIZE];
+    char label[96];
+
+    const Capture captures[] = {nec(), sony(), rc5(), samsung(), mitsubishiAc()};
+    bool allExact = true, allStable = true, allWithin = true;
+    double worstError = 0;
+
+    for (const Capture &capture : captures)
+    {
+        const std::vector<uint16_t> &timings = capture.timings;
+        size_t size = encoder.encode(timings.data(), timings.size(), encoded, sizeof(encoded));
+        snprintf(label, sizeof(label), "%s: encodes", capture.name);
+        if (!bench.check(size > 0, label))
+            continue;
+
+        allExact &= rawTimingCount(encoded, size) == timings.size() &&
+                    decodeRawTimings(encoded, size, decoded, MAX_IR_CODE_SIZE);
+        for (size_t i = 0; i < timings.size(); i++)
+        {
+            double error = (double)abs((int)decoded[i] - (int)timings[i]) / timings[i];
+            worstError = std::max(worstError, error);
+            allWithin &= error * 100 <= RAW_CODEC_TOLERANCE_PERCENT || abs((int)decoded[i] - (int)timings[i]) <= RAW_CODEC_TICK_US;
+        }
+        size_t again = encoder.encode(decoded, timings.size(), reencoded, sizeof(reencoded));
+        allStable &= again == size && memcmp(encoded, reencoded, size) == 0;
+
+        size_t plain = 2 * timings.size(), json = jsonArraySize(timings), base64 = (size + 2) / 3 * 4 + 2;
+        snprintf(label, sizeof(label), "%s: %u timings, plain words", capture.name, (unsigned)timings.size());
+        bench.report(label, plain, "bytes");
+        snprintf(label, sizeof(label), "%s: encoded", capture.name);
+        bench.report(label, size, "bytes");
+        snprintf(label, sizeof(label), "%s: storage ratio", capture.name);
+        bench.report(label, (double)plain / size, "x");
+        snprintf(label, sizeof(label), "%s: BLE ratio (JSON array vs base64)", capture.name);
+        bench.report(label, (double)json / base64, "x");
+        snprintf(label, sizeof(label), "%s: at least 2x smaller over BLE", capture.name);
+        bench.check((double)json / base64 >= 2, label);
+    }
+    bench.report("worst timing error", worstError * 100, "%");
+    bench.check(allExact, "every capture decodes to its full length");
+    bench.check(allWithin, "decoded timings stay within the tolerance");
+    bench.check(allStable, "re-encoding a decoded capture gives the same bytes");
+
+    const Capture ac = mitsubishiAc();
+    size_t acSize = encoder.encode(ac.timings.data(), ac.timings.size(), encoded, sizeof(encoded));
+    // Short frames pay for the dictionary; the 4x target is for long captures
+    bench.check(2.0 * ac.timings.size() / acSize >= 4, "AC frame stores at least 4x smaller");
+    bench.check((double)jsonArraySize(ac.timings) / ((acSize + 2) / 3 * 4 + 2) >= 4, "AC frame is at least 4x smaller over BLE");
+
+    // Speed, on the longest capture
+    bench.measure("encode Mitsubishi AC frame", 2000, [&]
+                  { encoder.encode(ac.timings.data(), ac.timings.size(), encoded, sizeof(encoded)); });
+    BenchResult decode = bench.measure("decode Mitsubishi AC frame", 5000, [&]
+                                       { decodeRawTimings(encoded, acSize, decoded, MAX_IR_CODE_SIZE); });
+    bench.report("decode throughput", decode.opsPerSec * ac.timings.size() / 1e6, "M timings/s");
+
+    // Captures the dictionary cannot help
+    std::vector<uint16_t> sweep;
+    for (int repeat = 0; repeat < 4; repeat++)
+        for (int i = 0; i < 60; i++)
+            sweep.push_back(400 + 6 * i);
+    size_t sweepSize = encoder.encode(sweep.data(), sweep.size(), encoded, sizeof(encoded));
+    bool sweepExact = sweepSize && decodeRawTimings(encoded, sweepSize, decoded, MAX_IR_CODE_SIZE);
+    for (size_t i = 0; sweepExact && i < sweep.size(); i++)
+        sweepExact = abs((int)decoded[i] - (int)sweep[i]) <= RAW_CODEC_TICK_US / 2;
+    bench.check(sweepExact, "a chain of close durations keeps exact durations");
+
+    std::vector<uint16_t> noise;
+    for (int i = 0; i < 300; i++)
+        noise.push_back(300 + 37 * i);
+    bench.check(encoder.encode(noise.data(), noise.size(), encoded, sizeof(encoded)) == 0,
+                "a capture with too many distinct durations is left to plain words");
+
+    // Malformed input
+    const Capture necCapture = nec();
+    size_t necSize = encoder.encode(necCapture.timings.data(), necCapture.timings.size(), encoded, sizeof(encoded));
+    bool truncatedRejected = true;
+    for (size_t cut = 0; cut < necSize; cut++)
+        truncatedRejected &= !decodeRawTimings(encoded, cut, decoded, MAX_IR_CODE_SIZE);
+    bench.check(truncatedRejected, "every truncation of an encoding is rejected");
+    bench.check(!decodeRawTimings(encoded, necSize, decoded, necCapture.timings.size() - 1), "decoding into a short buffer is rejected");
+    encoded[0] = RAW_CODEC_VERSION + 1;
+    bench.check(!decodeRawTimings(encoded, necSize, decoded, MAX_IR_CODE_SIZE), "another codec version is rejected");
+
+    // The JSON form carries the codec as base64
+    IRManager &irManager = firmwareFixture().irManager;
+    IRCode code = IRCode();
+    code.protocol = UNKNOWN;
+    code.rawData = const_cast<uint16_t *>(ac.timings.data());
+    code.rawLen = ac.timings.size();
+    String json = irManager.encodeIRCode(code);
+    IRCode parsed = irManager.decodeIRCode(json);
+    bool jsonRoundTrip = parsed.rawLen == ac.timings.size() && parsed.rawData;
+    for (size_t i = 0; jsonRoundTrip && i < ac.timings.size(); i++)
+        jsonRoundTrip = abs((int)parsed.rawData[i] - (int)ac.timings[i]) * 100 <= RAW_CODEC_TOLERANCE_PERCENT * ac.timings[i];
+    bench.report("encodeIRCode size, AC frame", json.length(), "bytes");
+    bench.check(jsonRoundTrip, "encodeIRCode/decodeIRCode round trip raw timings");
+    bench.check(json.length() < 1024, "an AC frame fits the 1 KB JSON document");
+}
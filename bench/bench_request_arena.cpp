@@ -0,0 +1,121 @@
+/**
+ * Request Arena Benchmarks
+ *
+ * Once warm, the read, transmit and error commands go from the received
+ * bytes to the notification without touching the heap, and GET_STATUS
+ * reports how much of the arena they needed. The BLE stack's own copy of
+ * a write is left out; the timings include it. Then the arena on its own:
+ * newest-first freeing, scopes, growing in place and spilling to the heap.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "metrics.h"
+#include "request_arena.h"
+#include <hal_native.h>
+#include <ArduinoJson.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    void runArenaChecks(BenchRunner &bench)
+    {
+        size_t start = requestArena.getUsed();
+
+        // The newest block goes straight back; older ones wait for the scope
+        void *first = requestArena.allocate(100);
+        void *second = requestArena.allocate(100);
+        size_t both = requestArena.getUsed();
+        requestArena.deallocate(first);
+        bench.check(requestArena.getUsed() == both, "freeing an older block keeps it until the scope ends");
+        requestArena.deallocate(second);
+        bench.check(requestArena.getUsed() < both && requestArena.owns(first), "freeing the newest block returns it");
+        {
+            ArenaScope scope;
+            requestArena.format("%s-%d", "device", 7);
+            requestArena.copy("cmd-4", 5);
+        }
+        requestArena.deallocate(first);
+        bench.check(requestArena.getUsed() == start, "a scope releases everything allocated inside it");
+
+        // The newest block grows where it is
+        char *text = static_cast<char *>(requestArena.allocate(16));
+        strcpy(text, "kept");
+        char *grown = static_cast<char *>(requestArena.reallocate(text, 4096));
+        bench.check(grown == text && strcmp(grown, "kept") == 0, "the newest block grows in place");
+        requestArena.deallocate(grown);
+
+        // Past the end: the heap for allocations, nothing for scratch strings
+        uint32_t overflows = metrics.get(METRIC_ARENA_OVERFLOWS);
+        void *large = requestArena.allocate(requestArena.getCapacity());
+        bool spilled = large && !requestArena.owns(large);
+        requestArena.deallocate(large);
+        const char *dropped = "";
+        {
+            ArenaScope scope;
+            requestArena.allocate(requestArena.getCapacity() - requestArena.getUsed() - 16);
+            dropped = requestArena.format("%0128d", 1);
+        }
+        bench.check(spilled && *dropped == '\0' && metrics.get(METRIC_ARENA_OVERFLOWS) == overflows + 2,
+                    "what does not fit spills to the heap or comes back empty, and is counted");
+        bench.check(requestArena.getUsed() == start, "the arena is empty again");
+    }
+}
+
+ESPIR_BENCH(request_arena)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 20, 10);
+    halBleConnect(247);
+
+    // Built up front: the strings themselves are the bench's, not the firmware's
+    const std::vector<std::pair<const char *, std::string>> requests = {
+        {"TRANSMIT", "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\",\"command\":\"cmd-4\"}}"},
+        {"COMMAND_NOT_FOUND", "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\",\"command\":\"missing\"}}"},
+        {"missing parameters", "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\"}}"},
+        {"unknown command", "{\"command\":\"FROBNICATE\",\"parameters\":{}}"},
+        {"invalid JSON", "{\"command\":"},
+        {"BATCH", "{\"command\":\"BATCH\",\"parameters\":{\"commands\":[{\"device\":\"device-1\",\"command\":\"cmd-1\"},"
+                  "{\"device\":\"device-2\",\"command\":\"cmd-2\"}]}}"},
+        {"LIST_DEVICES", "{\"command\":\"LIST_DEVICES\",\"parameters\":{}}"},
+        {"LIST_MACROS", "{\"command\":\"LIST_MACROS\",\"parameters\":{}}"},
+        {"GET_STATUS", "{\"command\":\"GET_STATUS\",\"parameters\":{}}"},
+    };
+
+    for (const auto &request : requests)
+    {
+        const char *json = request.second.c_str();
+        size_t length = request.second.size();
+        halBleWrite(request.second);
+        halBleWrite(request.second);
+        uint64_t allocations = benchAllocationCount();
+        for (int i = 0; i < 50; i++)
+            fw.cmdProcessor.processCommand(json, length);
+        uint64_t spent = benchAllocationCount() - allocations;
+        std::string label = std::string(request.first) + " allocates nothing";
+        bench.check(spent == 0, label.c_str());
+        if (spent)
+            bench.report(request.first, spent / 50.0, "allocations per request");
+    }
+    bench.check(requestArena.getUsed() == 0, "the arena is empty between requests");
+
+    // GET_STATUS reports the arena
+    DynamicJsonDocument doc(8192);
+    bench.check(!deserializeJson(doc, fw.lastNotification), "GET_STATUS reply parses");
+    JsonObject commands = doc["data"]["commands"];
+    size_t peak = commands["arenaPeak"].as<size_t>();
+    bench.check(commands["arenaBytes"].as<size_t>() == REQUEST_ARENA_SIZE && peak > 0 && peak <= REQUEST_ARENA_SIZE &&
+                    !commands["arenaOverflows"].isNull(),
+                "GET_STATUS reports the arena size, its peak and overflows");
+    bench.report("Arena peak", peak, "bytes");
+
+    const std::string &transmit = requests[0].second;
+    bench.measure("TRANSMIT from the BLE write", 20000, [&]
+                  { halBleWrite(transmit); });
+    const std::string &status = requests.back().second;
+    bench.measure("GET_STATUS from the BLE write", 5000, [&]
+                  { halBleWrite(status); });
+
+    runArenaChecks(bench);
+}
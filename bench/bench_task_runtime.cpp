@@ -0,0 +1,662 @@
+/**
+ * Task Runtime Benchmarks
+ *
+ * Replays a burst of BLE writes against the firmware twice: once with the
+ * old inline model (onWrite -> processCommand on the BLE task) and once
+ * with the ir/command/persist tasks running on the FreeRTOS stand-ins.
+ * IR sends block for their on-air time and flash commits for a simulated
+ * flash write, so the reported reply latencies show queueing under load.
+ *
+ * The learn case checks that a LEARN job leaves other commands responsive
+ * and measures how quickly LEARN_RESULT follows a captured frame.
+ *
+ * The pipeline case sends commands tagged with a requestId without waiting
+ * for replies and matches the replies, which may complete out of order,
+ * back by their requestId.
+ *
+ * The batch case plays a five-code scene as separate TRANSMITs, one per
+ * round trip, and as one BATCH, and checks validation, repeats, delays
+ * and stored macros.
+ *
+ * The monitor case floods the receiver with presses while the monitor is
+ * on and checks that commands are still answered promptly.
+ *
+ * Scenarios run in a forked child because the started tasks never exit.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include <hal_native.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    enum BurstKind
+    {
+        KIND_TRANSMIT,
+        KIND_STATUS,
+        KIND_ADD,
+        KIND_COUNT
+    };
+
+    const char *const kindNames[KIND_COUNT] = {"TRANSMIT", "GET_STATUS", "ADD_DEVICE"};
+
+    struct BurstCommand
+    {
+        BurstKind kind;
+        std::string key;
+        std::string json;
+        Clock::time_point arrival;
+        double latencyMs;
+    };
+
+    std::mutex replyMutex;
+    std::vector<std::pair<Clock::time_point, std::string>> replies;
+    std::atomic<int> packetDelayUs(0); // A slow central
+
+    std::string extractDevice(const std::string &reply)
+    {
+        size_t pos = reply.find("\"device\":\"");
+        if (pos == std::string::npos)
+            return "";
+        pos += 10;
+        return reply.substr(pos, reply.find('"', pos) - pos);
+    }
+
+    std::vector<BurstCommand> makeBurst(int count, int round)
+    {
+        std::vector<BurstCommand> burst;
+        for (int i = 0; i < count; i++)
+        {
+            BurstCommand c;
+            c.latencyMs = -1;
+            switch (i % 4)
+            {
+            case 0:
+            case 2:
+                c.kind = KIND_TRANSMIT;
+                c.key = "device-" + std::to_string(i % 20);
+                c.json = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"" + c.key + "\",\"command\":\"cmd-0\"}}";
+                break;
+            case 1:
+                c.kind = KIND_STATUS;
+                c.json = "{\"command\":\"GET_STATUS\",\"parameters\":{}}";
+                break;
+            default:
+                c.kind = KIND_ADD;
+                c.key = "burst-" + std::to_string(round) + "-" + std::to_string(i);
+                c.json = "{\"command\":\"ADD_DEVICE\",\"parameters\":{\"name\":\"" + c.key + "\",\"type\":\"TV\"}}";
+                break;
+            }
+            burst.push_back(c);
+        }
+        return burst;
+    }
+
+    // Sends the burst at a fixed spacing and matches replies back to commands
+    void runBurst(BenchRunner &bench, const char *mode, int spacingMs, int round)
+    {
+        std::vector<BurstCommand> burst = makeBurst(24, round);
+        {
+            std::lock_guard<std::mutex> lock(replyMutex);
+            replies.clear();
+        }
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < burst.size(); i++)
+        {
+            burst[i].arrival = start + std::chrono::milliseconds(spacingMs * i);
+            std::this_thread::sleep_until(burst[i].arrival);
+            halBleWrite(burst[i].json);
+        }
+
+        // Wait for every command to be answered
+        Clock::time_point deadline = Clock::now() + std::chrono::seconds(10);
+        while (Clock::now() < deadline)
+        {
+            {
+                std::lock_guard<std::mutex> lock(replyMutex);
+                if (replies.size() >= burst.size())
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        int busy = 0;
+        size_t nextStatus = 0;
+        std::lock_guard<std::mutex> lock(replyMutex);
+        for (const auto &reply : replies)
+        {
+            const std::string &body = reply.second;
+            BurstKind kind;
+            std::string key;
+            if (body.find("\"BUSY\"") != std::string::npos)
+            {
+                busy++;
+                continue;
+            }
+            if (body.find("\"firmware\"") != std::string::npos)
+                kind = KIND_STATUS;
+            else if (body.find("\"type\"") != std::string::npos)
+                kind = KIND_ADD, key = extractDevice(body);
+            else
+                kind = KIND_TRANSMIT, key = extractDevice(body);
+
+            for (size_t i = (kind == KIND_STATUS ? nextStatus : 0); i < burst.size(); i++)
+            {
+                BurstCommand &c = burst[i];
+                if (c.kind == kind && c.latencyMs < 0 && c.key == key)
+                {
+                    c.latencyMs = std::chrono::duration<double, std::milli>(reply.first - c.arrival).count();
+                    if (kind == KIND_STATUS)
+                        nextStatus = i + 1;
+                    break;
+                }
+            }
+        }
+
+        char label[96];
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            double sum = 0, worst = 0;
+            int n = 0;
+            for (const BurstCommand &c : burst)
+            {
+                if (c.kind == k && c.latencyMs >= 0)
+                {
+                    sum += c.latencyMs;
+                    worst = std::max(worst, c.latencyMs);
+                    n++;
+                }
+            }
+            snprintf(label, sizeof(label), "%s %dms spacing: %s mean reply", mode, spacingMs, kindNames[k]);
+            bench.report(label, n ? sum / n : 0, "ms");
+            snprintf(label, sizeof(label), "%s %dms spacing: %s worst reply", mode, spacingMs, kindNames[k]);
+            bench.report(label, worst, "ms");
+        }
+        snprintf(label, sizeof(label), "%s %dms spacing: rejected BUSY", mode, spacingMs);
+        bench.report(label, busy, "commands");
+        bench.check(replies.size() == burst.size(), "every burst command is answered");
+    }
+
+    void startTasks(FirmwareFixture &fw)
+    {
+        fw.irManager.startTask();
+        fw.deviceManager.startPersistTask();
+        fw.bleManager.startTask();
+        fw.cmdProcessor.startTask();
+        fw.bleManager.setCommandCallback([&fw](const char *json, size_t length)
+                                         { fw.cmdProcessor.enqueueCommand(json, length); });
+        fw.bleManager.setBinaryCallback([&fw](const uint8_t *data, size_t length)
+                                        { fw.cmdProcessor.enqueueBinary(data, length); });
+    }
+
+    void captureReplies()
+    {
+        static NotificationAssembler assembler;
+        halSetNotifyHook([](const uint8_t *data, size_t length)
+                         {
+                             if (packetDelayUs)
+                                 std::this_thread::sleep_for(std::chrono::microseconds(packetDelayUs));
+                             std::lock_guard<std::mutex> lock(replyMutex);
+                             std::string message;
+                             if (assembler.add(data, length, message))
+                                 replies.emplace_back(Clock::now(), message); });
+    }
+
+    // Waits for a notification containing every needle; returns its body or "" on timeout
+    std::string waitForReply(std::initializer_list<const char *> needles, int timeoutMs, Clock::time_point *when = nullptr)
+    {
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        size_t seen = 0;
+        while (Clock::now() < deadline)
+        {
+            {
+                std::lock_guard<std::mutex> lock(replyMutex);
+                for (; seen < replies.size(); seen++)
+                {
+                    bool match = true;
+                    for (const char *needle : needles)
+                        match = match && replies[seen].second.find(needle) != std::string::npos;
+                    if (match)
+                    {
+                        if (when)
+                            *when = replies[seen].first;
+                        return replies[seen].second;
+                    }
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return "";
+    }
+
+    void clearReplies()
+    {
+        std::lock_guard<std::mutex> lock(replyMutex);
+        replies.clear();
+    }
+
+    long droppedReplies(FirmwareFixture &fw)
+    {
+        DynamicJsonDocument status(2048);
+        deserializeJson(status, fw.bleManager.getStatus());
+        return status["txQueue"]["droppedReplies"].as<long>();
+    }
+
+    void runBurstScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        populateDevices(fw.deviceManager, 20, 1);
+
+        captureReplies();
+        halSetIRAirtimeSimulation(true);
+        halSetFlashCommitLatency(30);
+
+        // Inline: the BLE callback runs every command to completion
+        runBurst(bench, "inline", 20, 0);
+        runBurst(bench, "inline", 2, 1);
+
+        startTasks(fw);
+
+        runBurst(bench, "tasks", 20, 2);
+        runBurst(bench, "tasks", 2, 3);
+
+        // The persist task debounces, so a burst of mutations lands as one append
+        std::this_thread::sleep_for(std::chrono::milliseconds(2 * PERSIST_DEBOUNCE_MS + 100));
+        Device device;
+        fw.deviceManager.getDevice("device-0", device);
+        LittleFS.resetCounters();
+        for (int i = 0; i < 20; i++)
+            fw.deviceManager.updateDevice(device);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2 * PERSIST_DEBOUNCE_MS + 100));
+        bench.report("tasks: log commits for 20 updateDevice calls", LittleFS.getFilesWritten(), "commits");
+        bench.check(LittleFS.getFilesWritten() >= 1 && LittleFS.getFilesWritten() <= 2, "persist task coalesces a burst into one log append");
+    }
+
+    void runLearnScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        populateDevices(fw.deviceManager, 4, 1);
+        captureReplies();
+        halClearIRFrames();
+        startTasks(fw);
+
+        // Other commands are served while a job is learning
+        halBleWrite("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":5000}}");
+        std::string started = waitForReply({"\"learning\""}, 1000);
+        bench.check(!started.empty(), "LEARN replies immediately with a job");
+        bench.check(waitForReply({"LEARN_BUSY"}, 0).empty(), "first LEARN is accepted");
+
+        halBleWrite("{\"command\":\"LEARN\",\"parameters\":{}}");
+        bench.check(!waitForReply({"LEARN_BUSY"}, 1000).empty(), "second LEARN while learning is rejected");
+
+        double worst = 0;
+        for (int i = 0; i < 10; i++)
+        {
+            clearReplies();
+            Clock::time_point sent = Clock::now(), answered;
+            halBleWrite("{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-1\",\"command\":\"cmd-0\"}}");
+            bool ok = !waitForReply({"\"device-1\""}, 1000, &answered).empty();
+            bench.check(ok, "TRANSMIT is answered while learning");
+            if (ok)
+                worst = std::max(worst, std::chrono::duration<double, std::milli>(answered - sent).count());
+        }
+        bench.report("TRANSMIT worst reply while learning", worst, "ms");
+
+        // Capture: time from the frame arriving to the LEARN_RESULT notification
+        clearReplies();
+        Clock::time_point injected = Clock::now(), resulted;
+        injectIRCode(NEC, 0x20DF10EF, 32);
+        std::string result = waitForReply({"LEARN_RESULT", "20df10ef"}, 1000, &resulted);
+        bench.check(!result.empty(), "captured frame produces LEARN_RESULT");
+        bench.report("frame -> LEARN_RESULT", std::chrono::duration<double, std::milli>(resulted - injected).count(), "ms");
+        bench.check(!fw.irManager.isLearning(), "learning ends after a capture");
+
+        // Timeout: LEARN_RESULT with TIMEOUT and no stale learned code
+        clearReplies();
+        Clock::time_point requested = Clock::now(), timedOut;
+        halBleWrite("{\"command\":\"LEARN\",\"parameters\":{\"timeout\":100}}");
+        bench.check(!waitForReply({"LEARN_RESULT", "TIMEOUT"}, 2000, &timedOut).empty(), "timeout produces LEARN_RESULT");
+        bench.report("LEARN timeout 100ms -> LEARN_RESULT", std::chrono::duration<double, std::milli>(timedOut - requested).count(), "ms");
+        bench.check(!fw.irManager.hasLearnedCode(), "no learned code after a timeout");
+
+        // Cancel
+        clearReplies();
+        halBleWrite("{\"command\":\"LEARN\",\"parameters\":{}}");
+        waitForReply({"\"learning\""}, 1000);
+        halBleWrite("{\"command\":\"STOP_LEARN\",\"parameters\":{}}");
+        bench.check(!waitForReply({"LEARN_RESULT", "CANCELLED"}, 1000).empty(), "STOP_LEARN cancels the job");
+        bench.check(!fw.irManager.isLearning(), "learning ends after STOP_LEARN");
+    }
+
+    std::string tagged(const std::string &requestId, const std::string &command, const std::string &parameters = "{}")
+    {
+        return "{\"command\":\"" + command + "\",\"parameters\":" + parameters + ",\"requestId\":\"" + requestId + "\"}";
+    }
+
+    std::string transmitTo(int device)
+    {
+        return "{\"device\":\"device-" + std::to_string(device) + "\",\"command\":\"cmd-0\"}";
+    }
+
+    // Replies seen so far, keyed by the requestId they echo
+    std::map<std::string, std::vector<std::string>> repliesById()
+    {
+        std::map<std::string, std::vector<std::string>> byId;
+        std::lock_guard<std::mutex> lock(replyMutex);
+        for (const auto &reply : replies)
+        {
+            size_t pos = reply.second.find("\"requestId\":\"");
+            if (pos == std::string::npos)
+                continue;
+            pos += 13;
+            byId[reply.second.substr(pos, reply.second.find('"', pos) - pos)].push_back(reply.second);
+        }
+        return byId;
+    }
+
+    void runPipelineScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        populateDevices(fw.deviceManager, 4, 1);
+        captureReplies();
+        halClearIRFrames();
+        halSetIRAirtimeSimulation(true);
+        startTasks(fw);
+
+        // A LEARN stays pending while the commands behind it complete
+        clearReplies();
+        std::vector<std::string> ids;
+        halBleWrite(tagged("learn-1", "LEARN", "{\"timeout\":5000}"));
+        for (int i = 0; i < 6; i++)
+        {
+            ids.push_back("cmd-" + std::to_string(i));
+            halBleWrite(i % 2 ? tagged(ids.back(), "GET_STATUS") : tagged(ids.back(), "TRANSMIT", transmitTo(i / 2)));
+        }
+        bool answered = false;
+        for (int waited = 0; waited < 2000 && !answered; waited++)
+        {
+            std::map<std::string, std::vector<std::string>> byId = repliesById();
+            answered = byId.count("learn-1") > 0;
+            for (const std::string &id : ids)
+                answered &= byId.count(id) > 0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::map<std::string, std::vector<std::string>> byId = repliesById();
+        bool once = byId["learn-1"].size() == 1, ok = true;
+        for (const std::string &id : ids)
+        {
+            once &= byId[id].size() == 1;
+            ok &= byId[id].size() == 1 && byId[id][0].find("\"status\":\"OK\"") != std::string::npos;
+        }
+        bench.check(answered && once, "every pipelined command is answered once under its requestId");
+        bench.check(ok, "pipelined commands succeed without BUSY");
+        bench.check(fw.irManager.isLearning() && byId["learn-1"][0].find("LEARN_RESULT") == std::string::npos,
+                    "TRANSMIT replies complete while the LEARN is pending");
+
+        injectIRCode(NEC, 0x20DF10EF, 32);
+        std::string result = waitForReply({"LEARN_RESULT", "\"requestId\":\"learn-1\""}, 1000);
+        bench.check(!result.empty(), "LEARN_RESULT carries the requestId of its LEARN");
+
+        // Numeric ids are echoed as numbers, bad ones rejected
+        halBleWrite("{\"command\":\"GET_STATUS\",\"parameters\":{},\"requestId\":42}");
+        bench.check(!waitForReply({"\"requestId\":42", "System status"}, 1000).empty(), "a numeric requestId is echoed as a number");
+        halBleWrite("{\"command\":\"GET_STATUS\",\"parameters\":{},\"requestId\":{\"a\":1}}");
+        bench.check(!waitForReply({"INVALID_REQUEST_ID"}, 1000).empty(), "an object requestId is rejected");
+
+        // A flood from a central slower than the replies: the command queue
+        // backs up, and rejected commands still say which one they were.
+        // Rejections that find the reply queue full are dropped, not waited
+        // for on the BLE host, and counted
+        clearReplies();
+        long dropped = droppedReplies(fw);
+        packetDelayUs = 1000;
+        const int flood = 40;
+        for (int i = 0; i < flood; i++)
+            halBleWrite(tagged("flood-" + std::to_string(i), "LIST_DEVICES"));
+        for (int waited = 0; waited < 2000 && repliesById().size() + droppedReplies(fw) - dropped < (size_t)flood; waited++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        byId = repliesById();
+        dropped = droppedReplies(fw) - dropped;
+        int busy = 0;
+        for (const auto &entry : byId)
+            busy += entry.second[0].find("\"BUSY\"") != std::string::npos;
+        packetDelayUs = 0;
+        bench.report("flood of 40: rejected BUSY", busy, "commands");
+        bench.report("flood of 40: rejections dropped, reply queue full", dropped, "commands");
+        bench.check(busy > 0 && byId.size() + dropped == (size_t)flood, "every flooded command is answered under its requestId or counted as dropped");
+
+        // A central with a 15 ms round trip: one command per round trip versus a pipelined batch
+        const int batch = 8;
+        const auto roundTrip = std::chrono::milliseconds(15);
+        char label[96];
+        for (int pipelined = 0; pipelined < 2; pipelined++)
+        {
+            clearReplies();
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < batch; i++)
+            {
+                std::string id = std::string(pipelined ? "pipe-" : "serial-") + std::to_string(i);
+                if (!pipelined || i == 0)
+                    std::this_thread::sleep_for(roundTrip / 2);
+                halBleWrite(i % 4 == 0 ? tagged(id, "TRANSMIT", transmitTo(i / 4)) : tagged(id, "GET_STATUS"));
+                if (!pipelined)
+                {
+                    waitForReply({("\"requestId\":\"" + id + "\"").c_str()}, 2000);
+                    std::this_thread::sleep_for(roundTrip / 2);
+                }
+            }
+            for (int waited = 0; waited < 2000 && repliesById().size() < (size_t)batch; waited++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::this_thread::sleep_for(roundTrip / 2);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            snprintf(label, sizeof(label), "%d commands, 15 ms round trip: %s", batch, pipelined ? "pipelined" : "one at a time");
+            bench.report(label, ms, "ms");
+            bench.check(repliesById().size() == (size_t)batch, "the batch is answered");
+        }
+    }
+
+    std::string sceneSteps(int count, const std::string &extra = "")
+    {
+        std::string steps = "[";
+        for (int i = 0; i < count; i++)
+            steps += std::string(i ? "," : "") + "{\"device\":\"device-" + std::to_string(i) + "\",\"command\":\"cmd-0\"" + extra + "}";
+        return steps + "]";
+    }
+
+    void runBatchScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        populateDevices(fw.deviceManager, 6, 2);
+        captureReplies();
+        halSetIRAirtimeSimulation(true);
+        startTasks(fw);
+
+        // A scene of five codes from a central with a 15 ms round trip
+        const int scene = 5;
+        const auto roundTrip = std::chrono::milliseconds(15);
+        char label[96];
+        double separateMs = 0, batchMs = 0;
+        for (int batched = 0; batched < 2; batched++)
+        {
+            clearReplies();
+            resetIRSends();
+            Clock::time_point start = Clock::now();
+            bool answered = true;
+            for (int i = 0; i < (batched ? 1 : scene); i++)
+            {
+                std::string id = std::string(batched ? "batch-" : "single-") + std::to_string(i);
+                std::this_thread::sleep_for(roundTrip / 2);
+                halBleWrite(batched ? tagged(id, "BATCH", "{\"steps\":" + sceneSteps(scene) + "}") : tagged(id, "TRANSMIT", transmitTo(i)));
+                answered &= !waitForReply({("\"requestId\":\"" + id + "\"").c_str(), "\"OK\""}, 2000).empty();
+                std::this_thread::sleep_for(roundTrip / 2);
+            }
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            (batched ? batchMs : separateMs) = ms;
+            snprintf(label, sizeof(label), "%d-code scene, 15 ms round trip: %s", scene, batched ? "one BATCH" : "separate TRANSMITs");
+            bench.report(label, ms, "ms");
+            bench.check(answered && irSendCount() == scene, "every code of the scene is sent and answered");
+        }
+        bench.check(batchMs < separateMs, "a BATCH plays the scene faster than separate TRANSMITs");
+
+        // One aggregate reply, carrying the repeats and the pauses between steps
+        clearReplies();
+        resetIRSends();
+        halBleWrite(tagged("repeat", "BATCH", "{\"steps\":" + sceneSteps(2, ",\"repeat\":3,\"delay\":50") + "}"));
+        std::string reply = waitForReply({"\"requestId\":\"repeat\""}, 2000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        long duration = -1;
+        size_t at = reply.find("\"durationMs\":");
+        if (at != std::string::npos)
+            duration = atol(reply.c_str() + at + 13);
+        bench.check(reply.find("\"sends\":6") != std::string::npos && irSendCount() == 6 && repliesById().size() == 1,
+                    "repeats are sent and answered once");
+        bench.check(duration >= 4 * BATCH_REPEAT_GAP_MS + 50, "repeat gaps and step delays are kept");
+
+        // Validation happens before anything is sent
+        resetIRSends();
+        std::string steps = sceneSteps(3);
+        steps.insert(steps.rfind("cmd-0"), "no-");
+        halBleWrite(tagged("bad-command", "BATCH", "{\"steps\":" + steps + "}"));
+        bench.check(!waitForReply({"\"bad-command\"", "COMMAND_NOT_FOUND", "Step 2"}, 1000).empty(), "an unknown command names its step");
+        halBleWrite(tagged("bad-repeat", "BATCH", "{\"steps\":" + sceneSteps(2, ",\"repeat\":0") + "}"));
+        bench.check(!waitForReply({"\"bad-repeat\"", "INVALID_STEP"}, 1000).empty(), "an out-of-range repeat is rejected");
+        halBleWrite(tagged("too-long", "BATCH", "{\"steps\":" + sceneSteps(BATCH_MAX_STEPS + 1) + "}"));
+        bench.check(!waitForReply({"\"too-long\"", "INVALID_STEPS"}, 1000).empty(), "a batch over the step limit is rejected");
+        bench.check(irSendCount() == 0, "a rejected batch sends nothing");
+
+        // Stored macros run the same plan by name
+        resetIRSends();
+        halBleWrite(tagged("add", "ADD_MACRO", "{\"name\":\"movie\",\"steps\":" + sceneSteps(4) + "}"));
+        bench.check(!waitForReply({"\"add\"", "\"OK\""}, 1000).empty(), "ADD_MACRO stores the steps");
+        halBleWrite(tagged("run", "RUN_MACRO", "{\"name\":\"movie\"}"));
+        bench.check(!waitForReply({"\"run\"", "\"macro\":\"movie\"", "\"sends\":4"}, 2000).empty() && irSendCount() == 4,
+                    "RUN_MACRO sends the stored scene");
+        halBleWrite(tagged("list", "LIST_MACROS"));
+        bench.check(!waitForReply({"\"list\"", "\"name\":\"movie\"", "\"steps\":4"}, 1000).empty(), "LIST_MACROS names the macro");
+
+        // A macro whose command has gone fails at that step; nothing before it is skipped
+        fw.deviceManager.removeCommand("device-2", "cmd-0");
+        resetIRSends();
+        halBleWrite(tagged("stale", "RUN_MACRO", "{\"name\":\"movie\"}"));
+        bench.check(!waitForReply({"\"stale\"", "COMMAND_NOT_FOUND", "Step 2"}, 1000).empty() && irSendCount() == 0,
+                    "a macro step whose command was deleted is reported before sending");
+        halBleWrite(tagged("delete", "DELETE_MACRO", "{\"name\":\"movie\"}"));
+        halBleWrite(tagged("gone", "RUN_MACRO", "{\"name\":\"movie\"}"));
+        bench.check(!waitForReply({"\"gone\"", "MACRO_NOT_FOUND"}, 1000).empty(), "a deleted macro is gone");
+    }
+
+    // Remote buttons mashed at 30 frames a second, each followed by a repeat
+    // code, with the monitor on while a central keeps sending commands
+    void runMonitorScenario(BenchRunner &bench)
+    {
+        FirmwareFixture &fw = firmwareFixture();
+        populateDevices(fw.deviceManager, 8, 4);
+        captureReplies();
+        halClearIRFrames();
+        startTasks(fw);
+
+        halBleWrite("{\"command\":\"MONITOR\",\"parameters\":{\"enabled\":true}}");
+        bench.check(!waitForReply({"\"enabled\":true"}, 1000).empty(), "MONITOR is accepted");
+        clearReplies();
+
+        static const int kFrames = 60;
+        std::atomic<bool> flooding(true);
+        std::thread remote([&]
+                           {
+                               for (int i = 0; i < kFrames; i++)
+                               {
+                                   injectIRCode(NEC, 0x20DF0000 | ((i % 8) << 8) | (i / 8 % 4), 32);
+                                   std::this_thread::sleep_for(std::chrono::milliseconds(33));
+                               }
+                               flooding = false; });
+
+        double worst = 0;
+        int answered = 0, sent = 0;
+        while (flooding)
+        {
+            Clock::time_point start = Clock::now(), replied;
+            std::string device = "device-" + std::to_string(sent % 8);
+            halBleWrite("{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"" + device + "\",\"command\":\"cmd-0\"}}");
+            sent++;
+            if (!waitForReply({"IR command transmitted", ("\"" + device + "\"").c_str()}, 1000, &replied).empty())
+            {
+                answered++;
+                worst = std::max(worst, std::chrono::duration<double, std::milli>(replied - start).count());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        remote.join();
+        bench.check(answered == sent, "every TRANSMIT is answered during the flood");
+        bench.report("TRANSMIT worst reply while monitoring 30 frames/s", worst, "ms");
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int seen = 0;
+        {
+            std::lock_guard<std::mutex> lock(replyMutex);
+            for (const auto &reply : replies)
+                seen += reply.second.find("CODE_SEEN") != std::string::npos;
+        }
+        halBleWrite("{\"command\":\"GET_STATUS\",\"parameters\":{}}");
+        DynamicJsonDocument status(4096);
+        deserializeJson(status, waitForReply({"\"monitor\""}, 1000));
+        bench.report("CODE_SEEN events", seen, "events");
+        bench.check(seen == kFrames && status["data"]["monitor"]["dropped"] == 0,
+                    "every press is named while commands are served");
+    }
+
+    void runForked(BenchRunner &bench, void (*scenario)(BenchRunner &), const char *what)
+    {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            BenchRunner childBench;
+            scenario(childBench);
+            fflush(stdout);
+            _exit(childBench.failures() == 0 ? 0 : 1);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        bench.check(child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0, what);
+    }
+}
+
+ESPIR_BENCH(task_runtime_burst)
+{
+    runForked(bench, runBurstScenario, "task runtime scenario completed");
+}
+
+ESPIR_BENCH(task_runtime_learn)
+{
+    runForked(bench, runLearnScenario, "learn scenario completed");
+}
+
+ESPIR_BENCH(task_runtime_pipeline)
+{
+    runForked(bench, runPipelineScenario, "pipeline scenario completed");
+}
+
+ESPIR_BENCH(task_runtime_batch)
+{
+    runForked(bench, runBatchScenario, "batch scenario completed");
+}
+
+ESPIR_BENCH(task_runtime_monitor)
+{
+    runForked(bench, runMonitorScenario, "monitor scenario completed");
+}
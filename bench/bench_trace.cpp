@@ -0,0 +1,128 @@
+/**
+ * Request Tracer Benchmarks
+ *
+ * Requests are counted against their command, their stages land where
+ * the work is done and add up to no more than the request, and TRACE
+ * returns the histograms and the recent ring over BLE. Measures a probe
+ * and the dump.
+ */
+
+#include "bench.h"
+#include "bench_fixture.h"
+#include "binary_protocol.h"
+#include "trace.h"
+#include <hal_native.h>
+#include <ArduinoJson.h>
+
+#if TRACE_ENABLED
+
+namespace
+{
+    std::string traceFrame(uint8_t opcode, uint16_t requestId, std::initializer_list<uint8_t> tlvs)
+    {
+        std::string f = {(char)BIN_MAGIC, (char)BIN_VERSION, (char)opcode, (char)(requestId & 0xFF), (char)(requestId >> 8), 0};
+        for (uint8_t b : tlvs)
+            f.push_back((char)b);
+        return f;
+    }
+
+    uint32_t commandCount(TraceCommand command)
+    {
+        MetricHistogramSummary summary;
+        tracer.summarizeCommand(command, summary);
+        return summary.count;
+    }
+
+    TraceRecord lastRecord()
+    {
+        TraceRecord record;
+        memset(&record, 0, sizeof(record));
+        tracer.getRecent(&record, 1);
+        return record;
+    }
+
+    bool stagesFit(const TraceRecord &record)
+    {
+        uint64_t sum = 0;
+        for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+            sum += record.stageCycles[stage];
+        return sum <= record.totalCycles;
+    }
+}
+
+ESPIR_BENCH(request_trace)
+{
+    FirmwareFixture &fw = firmwareFixture();
+    populateDevices(fw.deviceManager, 20, 10);
+    halBleConnect(247);
+    tracer.reset();
+
+    // JSON TRANSMIT from the BLE write: every stage it passes through
+    const std::string transmit = "{\"command\":\"TRANSMIT\",\"parameters\":{\"device\":\"device-3\",\"command\":\"cmd-4\"}}";
+    for (int i = 0; i < 10; i++)
+        halBleWrite(transmit);
+    TraceRecord record = lastRecord();
+    bench.check(commandCount(TRACE_CMD_TRANSMIT) == 10 && record.command == TRACE_CMD_TRANSMIT, "each TRANSMIT is traced as one");
+    bench.check(record.stageCycles[TRACE_PARSE] && record.stageCycles[TRACE_DISPATCH] && record.stageCycles[TRACE_LOOKUP] &&
+                    record.stageCycles[TRACE_TRANSMIT] && record.stageCycles[TRACE_SERIALIZE] && !record.stageCycles[TRACE_PERSIST],
+                "TRANSMIT passes through parse, dispatch, lookup, transmit and serialize");
+    bench.check(stagesFit(record), "stages are exclusive and add up to no more than the request");
+
+    // Persistence shows up under the request that caused it
+    halBleWrite("{\"command\":\"ADD_DEVICE\",\"parameters\":{\"name\":\"trace-tv\",\"type\":\"TV\"}}");
+    record = lastRecord();
+    bench.check(record.command == TRACE_CMD_ADD_DEVICE && record.stageCycles[TRACE_PERSIST] && stagesFit(record),
+                "ADD_DEVICE spends time persisting");
+
+    // Binary requests are traced by opcode
+    halBleWrite(traceFrame(BIN_OP_HELLO, 1, {BIN_TAG_VERSION, 1, BIN_VERSION}));
+    std::string resolve = traceFrame(BIN_OP_RESOLVE, 2, {});
+    resolve += std::string("\x12\x08" "device-3" "\x13\x05" "cmd-4", 17);
+    halBleWrite(resolve);
+    uint8_t deviceId = fw.lastNotification[8], commandId = fw.lastNotification[11];
+    halBleWrite(traceFrame(BIN_OP_TRANSMIT, 3, {BIN_TAG_DEVICE_ID, 1, deviceId, BIN_TAG_COMMAND_ID, 1, commandId}));
+    record = lastRecord();
+    bench.check(commandCount(TRACE_CMD_BIN_HELLO) == 1 && commandCount(TRACE_CMD_BIN_RESOLVE) == 1 &&
+                    record.command == TRACE_CMD_BIN_TRANSMIT && record.stageCycles[TRACE_TRANSMIT],
+                "binary opcodes are traced as their own commands");
+
+    // Probes outside a request record nothing
+    uint32_t finished = tracer.getFinished();
+    fw.deviceManager.removeDevice("trace-tv");
+    bench.check(tracer.getFinished() == finished, "work outside a request is not traced");
+
+    // TRACE over BLE
+    const String trace = "{\"command\":\"TRACE\",\"parameters\":{}}";
+    fw.cmdProcessor.processCommand(trace);
+    DynamicJsonDocument doc(16384);
+    bench.check(!deserializeJson(doc, fw.lastNotification), "TRACE reply parses");
+    JsonObject data = doc["data"];
+    bench.check(data["requests"].as<uint32_t>() == finished && data["commands"]["TRANSMIT"]["count"].as<uint32_t>() == 10 &&
+                    !data["commands"]["TRANSMIT"]["p99Ns"].isNull() && !data["stages"]["persist"]["p95Ns"].isNull(),
+                "TRACE returns the command and stage histograms");
+    JsonArray recent = data["recent"];
+    bench.check(recent.size() == (finished < TRACE_RING_ENTRIES ? finished : TRACE_RING_ENTRIES) &&
+                    recent[recent.size() - 1]["command"].as<String>() == "BIN_TRANSMIT" &&
+                    !recent[recent.size() - 1]["stagesNs"]["transmit"].isNull(),
+                "TRACE returns the recent requests, newest last");
+    MetricHistogramSummary summary;
+    tracer.summarizeCommand(TRACE_CMD_TRANSMIT, summary);
+    bench.report("TRANSMIT p50 from the BLE write", summary.p50, "ns");
+    bench.report("TRACE reply size", fw.lastNotification.size(), "bytes");
+
+    fw.cmdProcessor.processCommand("{\"command\":\"TRACE\",\"parameters\":{\"clear\":true}}");
+    bench.check(tracer.getFinished() == 1 && lastRecord().command == TRACE_CMD_TRACE, "TRACE clear starts over from itself");
+
+    // Cost of the instrumentation
+    tracer.begin();
+    bench.measure("TraceScope with a request open", 200000, []
+                  { TRACE_SCOPE(TRACE_LOOKUP); });
+    tracer.end();
+    bench.measure("TraceScope with no request open", 200000, []
+                  { TRACE_SCOPE(TRACE_LOOKUP); });
+    bench.measure("processCommand(TRACE)", 2000, [&]
+                  { fw.cmdProcessor.processCommand(trace); });
+    tracer.reset();
+}
+
+#endif // TRACE_ENABLED
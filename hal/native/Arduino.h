@@ -0,0 +1,293 @@
+/**
+ * Native HAL - Arduino core stand-in for host builds
+ *
+ * Provides just enough of the Arduino API (String, Serial, millis(),
+ * delay(), GPIO and the ESP object) for the firmware managers to compile
+ * and run on a Linux host under the `native` PlatformIO environment.
+ */
+
+#ifndef ESPIR_NATIVE_ARDUINO_H
+#define ESPIR_NATIVE_ARDUINO_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <algorithm>
+
+#define HEX 16
+#define DEC 10
+#define OUTPUT 0x03
+#define INPUT 0x01
+#define LOW 0x0
+#define HIGH 0x1
+
+class StringSumHelper;
+
+// Arduino-compatible String. Like the real WString an all-zero object is a
+// valid empty string, so structs holding Strings may be memset() to zero.
+class String
+{
+private:
+    char *buffer;
+    unsigned int capacity;
+    unsigned int len;
+
+    bool grow(unsigned int size);
+    void assign(const char *cstr, unsigned int length);
+    void append(const char *cstr, unsigned int length);
+    void formatUnsigned(unsigned long long value, unsigned char base);
+    void formatSigned(long long value, unsigned char base);
+
+public:
+    String() : buffer(nullptr), capacity(0), len(0) {}
+    String(const char *cstr) : String() { assign(cstr, cstr ? strlen(cstr) : 0); }
+    String(const char *cstr, unsigned int length) : String() { assign(cstr, length); }
+    String(const String &other) : String() { assign(other.buffer, other.len); }
+    String(String &&other) : buffer(other.buffer), capacity(other.capacity), len(other.len)
+    {
+        other.buffer = nullptr;
+        other.capacity = 0;
+        other.len = 0;
+    }
+    explicit String(char c) : String() { append(&c, 1); }
+    explicit String(unsigned char value, unsigned char base = 10) : String() { formatUnsigned(value, base); }
+    explicit String(int value, unsigned char base = 10) : String() { formatSigned(value, base); }
+    explicit String(unsigned int value, unsigned char base = 10) : String() { formatUnsigned(value, base); }
+    explicit String(long value, unsigned char base = 10) : String() { formatSigned(value, base); }
+    explicit String(unsigned long value, unsigned char base = 10) : String() { formatUnsigned(value, base); }
+    explicit String(long long value, unsigned char base = 10) : String() { formatSigned(value, base); }
+    explicit String(unsigned long long value, unsigned char base = 10) : String() { formatUnsigned(value, base); }
+    explicit String(float value, unsigned char decimals = 2);
+    explicit String(double value, unsigned char decimals = 2);
+    ~String() { free(buffer); }
+
+    String &operator=(const String &other)
+    {
+        if (this != &other)
+            assign(other.buffer, other.len);
+        return *this;
+    }
+    String &operator=(String &&other)
+    {
+        if (this != &other)
+        {
+            free(buffer);
+            buffer = other.buffer;
+            capacity = other.capacity;
+            len = other.len;
+            other.buffer = nullptr;
+            other.capacity = 0;
+            other.len = 0;
+        }
+        return *this;
+    }
+    String &operator=(const char *cstr)
+    {
+        assign(cstr, cstr ? strlen(cstr) : 0);
+        return *this;
+    }
+
+    const char *c_str() const { return buffer ? buffer : ""; }
+    unsigned int length() const { return len; }
+    bool isEmpty() const { return len == 0; }
+    bool reserve(unsigned int size) { return grow(size); }
+
+    char charAt(unsigned int index) const { return index < len ? buffer[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return buffer[index]; }
+
+    bool concat(const String &str)
+    {
+        append(str.buffer, str.len);
+        return true;
+    }
+    bool concat(const char *cstr)
+    {
+        if (cstr)
+            append(cstr, strlen(cstr));
+        return true;
+    }
+    bool concat(const char *cstr, unsigned int length)
+    {
+        append(cstr, length);
+        return true;
+    }
+    bool concat(char c)
+    {
+        append(&c, 1);
+        return true;
+    }
+    template <typename T>
+    bool concat(T value)
+    {
+        return concat(String(value));
+    }
+
+    String &operator+=(const String &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+    String &operator+=(const char *rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+    String &operator+=(char rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+
+    bool equals(const char *cstr, unsigned int length) const { return len == length && (len == 0 || memcmp(buffer, cstr, len) == 0); }
+    bool equals(const String &other) const { return equals(other.c_str(), other.len); }
+    bool equals(const char *cstr) const { return cstr ? equals(cstr, strlen(cstr)) : len == 0; }
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *rhs) const { return equals(rhs); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *rhs) const { return !equals(rhs); }
+    bool operator<(const String &rhs) const { return strcmp(c_str(), rhs.c_str()) < 0; }
+
+    bool startsWith(const String &prefix) const { return prefix.len <= len && memcmp(c_str(), prefix.c_str(), prefix.len) == 0; }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        for (unsigned int i = from; i < len; i++)
+        {
+            if (buffer[i] == c)
+                return (int)i;
+        }
+        return -1;
+    }
+    String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const
+    {
+        if (to > len)
+            to = len;
+        if (from >= to)
+            return String();
+        return String(buffer + from, to - from);
+    }
+    long toInt() const { return strtol(c_str(), nullptr, 10); }
+};
+
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char *p) : String(p) {}
+};
+
+inline StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+inline StringSumHelper &operator+(const StringSumHelper &lhs, const char *rhs)
+{
+    StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+inline StringSumHelper operator+(const String &lhs, const String &rhs)
+{
+    StringSumHelper a(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+inline StringSumHelper operator+(const String &lhs, const char *rhs)
+{
+    StringSumHelper a(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+inline StringSumHelper operator+(const char *lhs, const String &rhs)
+{
+    StringSumHelper a(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+// newlib (ESP32) provides strlcpy; older glibc does not
+#if defined(__GLIBC__) && __GLIBC__ == 2 && __GLIBC_MINOR__ < 38
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t length = strlen(src);
+    if (size > 0)
+    {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+#endif
+
+// Serial console stand-in; output goes to stdout unless silenced by the host harness
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    operator bool() const { return true; }
+
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(const char *s) { return write(s); }
+    size_t print(char c)
+    {
+        char buf[2] = {c, 0};
+        return write(buf);
+    }
+    template <typename T>
+    size_t print(T value) { return print(String(value)); }
+
+    size_t write(const uint8_t *data, size_t length);
+
+    size_t println() { return write("\n"); }
+    template <typename T>
+    size_t println(T value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+
+private:
+    size_t write(const char *s);
+};
+
+extern HardwareSerial Serial;
+
+// ESP object stand-in
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; } // The rate getCycleCount() emulates
+    void restart();
+};
+
+extern EspClass ESP;
+
+// PSRAM: hosts have none, so ps_malloc() is plain malloc()
+inline bool psramFound() { return false; }
+inline void *ps_malloc(size_t size) { return malloc(size); }
+
+// Timing - millis()/micros() follow the host monotonic clock plus any
+// simulated time added by delay() or halAdvanceMillis()
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// GPIO
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#endif // ESPIR_NATIVE_ARDUINO_H
@@ -0,0 +1,59 @@
+/**
+ * Native HAL - EEPROM stand-in for host builds
+ *
+ * Backs the emulated EEPROM region with host memory and counts byte
+ * writes and commits so persistence cost can be measured off-device.
+ * halSetFlashCommitLatency() makes commit() block like a flash write.
+ */
+
+#ifndef ESPIR_NATIVE_EEPROM_H
+#define ESPIR_NATIVE_EEPROM_H
+
+#include <Arduino.h>
+#include <vector>
+
+class EEPROMClass
+{
+private:
+    std::vector<uint8_t> data;
+    uint32_t writeCount;
+    uint32_t commitCount;
+
+public:
+    EEPROMClass() : writeCount(0), commitCount(0) {}
+
+    bool begin(size_t size)
+    {
+        if (data.size() != size)
+            data.assign(size, 0xFF);
+        return true;
+    }
+    void end() {}
+
+    uint8_t read(int address) const { return (address >= 0 && (size_t)address < data.size()) ? data[address] : 0xFF; }
+    void write(int address, uint8_t value)
+    {
+        if (address >= 0 && (size_t)address < data.size())
+        {
+            data[address] = value;
+            writeCount++;
+        }
+    }
+    bool commit();
+    size_t length() const { return data.size(); }
+
+    // Host-only instrumentation
+    uint8_t *getDataPtr() { return data.data(); }
+    uint32_t getWriteCount() const { return writeCount; }
+    uint32_t getCommitCount() const { return commitCount; }
+    void resetCounters()
+    {
+        writeCount = 0;
+        commitCount = 0;
+    }
+    void countCommit() { commitCount++; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // ESPIR_NATIVE_EEPROM_H
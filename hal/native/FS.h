@@ -0,0 +1,78 @@
+/**
+ * Native HAL - Arduino FS stand-in for host builds
+ *
+ * Mirrors the subset of fs::FS / fs::File used by the firmware. Files live
+ * in host memory; like LittleFS, data written through a handle becomes
+ * visible only once the handle is flushed or closed.
+ */
+
+#ifndef ESPIR_NATIVE_FS_H
+#define ESPIR_NATIVE_FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    class File
+    {
+    public:
+        struct Handle;
+
+        File() {}
+        explicit File(std::shared_ptr<Handle> h) : handle(h) {}
+
+        size_t write(uint8_t value) { return write(&value, 1); }
+        size_t write(const uint8_t *buf, size_t size);
+        int read();
+        size_t read(uint8_t *buf, size_t size);
+        int available();
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        size_t position() const;
+        size_t size() const;
+        void flush();
+        void close();
+        operator bool() const;
+
+        const char *path() const;
+        const char *name() const;
+        bool isDirectory() const;
+        File openNextFile(const char *mode = "r");
+        void rewindDirectory();
+
+    private:
+        std::shared_ptr<Handle> handle;
+    };
+
+    class FS
+    {
+    public:
+        File open(const char *path, const char *mode = "r", bool create = false);
+        File open(const String &path, const char *mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+        bool exists(const char *path);
+        bool exists(const String &path) { return exists(path.c_str()); }
+        bool remove(const char *path);
+        bool remove(const String &path) { return remove(path.c_str()); }
+        bool rename(const char *pathFrom, const char *pathTo);
+        bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+        bool mkdir(const char *path);
+        bool mkdir(const String &path) { return mkdir(path.c_str()); }
+        bool rmdir(const char *path);
+    };
+}
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // ESPIR_NATIVE_FS_H
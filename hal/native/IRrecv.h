@@ -0,0 +1,49 @@
+/**
+ * Native HAL - IRrecv stand-in for host builds
+ *
+ * decode() returns frames queued by the host harness through
+ * halInjectIRFrame() instead of sampling a GPIO. rawbuf is laid out as the
+ * library's ISR leaves it: the gap before the frame, then the timings in
+ * kRawTick units.
+ */
+
+#ifndef ESPIR_NATIVE_IRRECV_H
+#define ESPIR_NATIVE_IRRECV_H
+
+#include <IRremoteESP8266.h>
+
+struct decode_results
+{
+    decode_type_t decode_type;
+    uint64_t value;
+    uint32_t address;
+    uint32_t command;
+    uint16_t bits;
+    volatile uint16_t *rawbuf;
+    uint16_t rawlen;
+    bool overflow;
+    bool repeat;
+    uint8_t state[kStateSizeMax];
+};
+
+class IRrecv
+{
+private:
+    uint16_t pin;
+    uint16_t bufferSize;
+    uint16_t *captureBuffer;
+    bool enabled;
+
+public:
+    explicit IRrecv(uint16_t recvpin, uint16_t bufsize = kRawBuf, uint8_t timeout = kTimeoutMs, bool save_buffer = false);
+    ~IRrecv();
+
+    void enableIRIn(bool pullup = false);
+    void disableIRIn();
+    void resume();
+    bool decode(decode_results *results);
+    void setUnknownThreshold(uint16_t length) { (void)length; }
+    uint16_t getBufSize() { return bufferSize; }
+};
+
+#endif // ESPIR_NATIVE_IRRECV_H
@@ -0,0 +1,56 @@
+/**
+ * Native HAL - IRremoteESP8266 stand-in for host builds
+ *
+ * Mirrors the protocol enumeration and constants of the real library so
+ * stored codes and protocol names round-trip identically on the host.
+ */
+
+#ifndef ESPIR_NATIVE_IRREMOTEESP8266_H
+#define ESPIR_NATIVE_IRREMOTEESP8266_H
+
+#include <Arduino.h>
+
+#define IR_PROTOCOL_LIST(X)                                                       \
+    X(UNUSED) X(RC5) X(RC6) X(NEC) X(SONY) X(PANASONIC) X(JVC) X(SAMSUNG)          \
+    X(WHYNTER) X(AIWA_RC_T501) X(LG) X(SANYO) X(MITSUBISHI) X(DISH) X(SHARP)       \
+    X(COOLIX) X(DAIKIN) X(DENON) X(KELVINATOR) X(SHERWOOD) X(MITSUBISHI_AC)        \
+    X(RCMM) X(SANYO_LC7461) X(RC5X) X(GREE) X(PRONTO) X(NEC_LIKE) X(ARGO)          \
+    X(TROTEC) X(NIKAI) X(RAW) X(GLOBALCACHE) X(TOSHIBA_AC) X(FUJITSU_AC)           \
+    X(MIDEA) X(MAGIQUEST) X(LASERTAG) X(CARRIER_AC) X(HAIER_AC) X(MITSUBISHI2)     \
+    X(HITACHI_AC) X(HITACHI_AC1) X(HITACHI_AC2) X(GICABLE) X(HAIER_AC_YRW02)       \
+    X(WHIRLPOOL_AC) X(SAMSUNG_AC) X(LUTRON) X(ELECTRA_AC) X(PANASONIC_AC)          \
+    X(PIONEER) X(LG2) X(MWM) X(DAIKIN2) X(VESTEL_AC) X(TECO) X(SAMSUNG36)          \
+    X(TCL112AC) X(LEGOPF) X(MITSUBISHI_HEAVY_88) X(MITSUBISHI_HEAVY_152)           \
+    X(DAIKIN216) X(SHARP_AC) X(GOODWEATHER) X(INAX) X(DAIKIN160) X(NEOCLIMA)       \
+    X(DAIKIN176) X(DAIKIN128) X(AMCOR) X(DAIKIN152) X(MITSUBISHI136)               \
+    X(MITSUBISHI112) X(HITACHI_AC424) X(SONY_38K) X(EPSON) X(SYMPHONY)             \
+    X(HITACHI_AC3) X(DAIKIN64) X(AIRWELL) X(DELONGHI_AC) X(DOSHISHA)               \
+    X(MULTIBRACKETS) X(CARRIER_AC40) X(CARRIER_AC64) X(HITACHI_AC344)              \
+    X(CORONA_AC) X(MIDEA24) X(ZEPEAL) X(SANYO_AC) X(VOLTAS) X(METZ) X(TRANSCOLD)   \
+    X(TECHNIBEL_AC) X(MIRAGE) X(ELITESCREENS) X(PANASONIC_AC32) X(MILESTAG2)       \
+    X(ECOCLIM) X(XMP) X(TRUMA) X(HAIER_AC176) X(TEKNOPOINT) X(KELON) X(TROTEC_3550) \
+    X(SANYO_AC88) X(BOSE) X(ARRIS) X(RHOSS) X(AIRTON) X(COOLIX48) X(HITACHI_AC264) \
+    X(KELON168) X(HITACHI_AC296) X(DAIKIN200) X(HAIER_AC160) X(CARRIER_AC128)      \
+    X(TOTO) X(CLIMABUTLER) X(TCL96AC) X(BOSCH144) X(SANYO_AC152) X(DAIKIN312)      \
+    X(GORENJE) X(WOWWEE) X(CARRIER_AC84) X(YORK)
+
+#define IR_PROTOCOL_ENUM(name) name,
+
+enum decode_type_t
+{
+    UNKNOWN = -1,
+    IR_PROTOCOL_LIST(IR_PROTOCOL_ENUM)
+    kLastDecodeType = YORK
+};
+
+#undef IR_PROTOCOL_ENUM
+
+const uint16_t kRawTick = 2;         // Receiver tick in microseconds
+const uint16_t kRawBuf = 100;        // Default capture buffer length
+const uint8_t kTimeoutMs = 15;       // Default end-of-frame gap
+const uint16_t kStateSizeMax = 53;   // Largest A/C state array in bytes
+const uint16_t kNoRepeat = 0;
+const uint16_t kDaikinStateLength = 35;
+const uint16_t kMitsubishiHeavy88StateLength = 11;
+
+#endif // ESPIR_NATIVE_IRREMOTEESP8266_H
@@ -0,0 +1,57 @@
+/**
+ * Native HAL - IRsend stand-in for host builds
+ *
+ * Records what would have been transmitted instead of driving a GPIO.
+ * With halSetIRAirtimeSimulation(true) each send also busy-waits for the
+ * frame's on-air duration, like the bit-banged sender on the device.
+ */
+
+#ifndef ESPIR_NATIVE_IRSEND_H
+#define ESPIR_NATIVE_IRSEND_H
+
+#include <IRremoteESP8266.h>
+#include <vector>
+
+struct NativeIRSendLog
+{
+    uint32_t sendCount;
+    decode_type_t lastProtocol;
+    uint64_t lastData;
+    uint16_t lastBits;
+    uint16_t lastRawLen;
+    std::vector<uint8_t> lastState; // State protocols
+};
+
+class IRsend
+{
+private:
+    uint16_t pin;
+
+    void record(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t rawLen, uint32_t airtimeUs);
+
+public:
+    explicit IRsend(uint16_t IRsendPin, bool inverted = false, bool use_modulation = true) : pin(IRsendPin)
+    {
+        (void)inverted;
+        (void)use_modulation;
+    }
+
+    void begin() {}
+
+    void sendNEC(uint64_t data, uint16_t nbits = 32, uint16_t repeat = kNoRepeat);
+    void sendSony(uint64_t data, uint16_t nbits = 12, uint16_t repeat = 2);
+    void sendRC5(uint64_t data, uint16_t nbits = 13, uint16_t repeat = kNoRepeat);
+    void sendRC6(uint64_t data, uint16_t nbits = 20, uint16_t repeat = kNoRepeat);
+    void sendRaw(const uint16_t buf[], uint16_t len, uint16_t hz);
+
+    // Generic senders mirroring the library's dispatch entry points: each
+    // refuses the protocols the real one has no case for, state protocols
+    // included only in the state overload
+    bool send(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat = kNoRepeat);
+    bool send(decode_type_t type, const uint8_t *state, uint16_t nbytes);
+
+    static const NativeIRSendLog &log();
+    static void resetLog();
+};
+
+#endif // ESPIR_NATIVE_IRSEND_H
@@ -0,0 +1,14 @@
+/**
+ * Native HAL - IRutils stand-in for host builds
+ */
+
+#ifndef ESPIR_NATIVE_IRUTILS_H
+#define ESPIR_NATIVE_IRUTILS_H
+
+#include <IRremoteESP8266.h>
+
+String typeToString(const decode_type_t protocol, const bool isRepeat = false);
+decode_type_t strToDecodeType(const char *str);
+bool hasACState(const decode_type_t protocol);
+
+#endif // ESPIR_NATIVE_IRUTILS_H
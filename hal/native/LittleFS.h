@@ -0,0 +1,38 @@
+/**
+ * Native HAL - LittleFS stand-in for host builds
+ *
+ * A single in-memory volume that outlives any DeviceManager instance, so a
+ * benchmark can "reboot" by constructing a new manager over the same
+ * files. Counts bytes and files written/read so storage cost can be
+ * measured off-device; halSetFlashCommitLatency() makes closing a written
+ * file block like a flash program.
+ */
+
+#ifndef ESPIR_NATIVE_LITTLEFS_H
+#define ESPIR_NATIVE_LITTLEFS_H
+
+#include <FS.h>
+
+namespace fs
+{
+    class LittleFSFS : public FS
+    {
+    public:
+        bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs");
+        void end() {}
+        bool format();
+        size_t totalBytes();
+        size_t usedBytes();
+
+        // Host-only instrumentation
+        uint32_t getBytesWritten();
+        uint32_t getBytesRead();
+        uint32_t getFilesWritten(); // Write handles committed by flush()/close()
+        uint32_t getFilesOpened();  // Successful open() calls for reading
+        void resetCounters();
+    };
+}
+
+extern fs::LittleFSFS LittleFS;
+
+#endif // ESPIR_NATIVE_LITTLEFS_H
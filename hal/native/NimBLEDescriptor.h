@@ -0,0 +1,10 @@
+/**
+ * Native HAL - NimBLEDescriptor stand-in; everything lives in NimBLEDevice.h
+ */
+
+#ifndef ESPIR_NATIVE_NIMBLEDESCRIPTOR_H
+#define ESPIR_NATIVE_NIMBLEDESCRIPTOR_H
+
+#include <NimBLEDevice.h>
+
+#endif // ESPIR_NATIVE_NIMBLEDESCRIPTOR_H
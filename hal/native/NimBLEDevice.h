@@ -0,0 +1,196 @@
+/**
+ * Native HAL - NimBLE-Arduino stand-in for host builds
+ *
+ * A single-server, single-characteristic model of the NimBLE GATT API.
+ * Writes are injected with halBleWrite() and notifications are handed to
+ * the hook installed with halSetNotifyHook() (see hal_native.h).
+ */
+
+#ifndef ESPIR_NATIVE_NIMBLEDEVICE_H
+#define ESPIR_NATIVE_NIMBLEDEVICE_H
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+#define BLE_ATT_MTU_DFLT 23
+#define BLE_ATT_MTU_MAX 527
+#define BLE_HS_ENOMEM 6
+
+namespace NIMBLE_PROPERTY
+{
+    enum
+    {
+        BROADCAST = 0x0001,
+        READ = 0x0002,
+        WRITE_NR = 0x0004,
+        WRITE = 0x0008,
+        NOTIFY = 0x0010,
+        INDICATE = 0x0020,
+    };
+}
+
+struct ble_gap_conn_desc
+{
+    uint16_t conn_handle;
+};
+
+class NimBLEServer;
+class NimBLECharacteristic;
+
+class NimBLEAddress
+{
+public:
+    std::string toString() const { return "00:00:00:00:00:00"; }
+};
+
+class NimBLEServerCallbacks
+{
+public:
+    virtual ~NimBLEServerCallbacks() {}
+    virtual void onConnect(NimBLEServer *pServer) { (void)pServer; }
+    virtual void onDisconnect(NimBLEServer *pServer) { (void)pServer; }
+    virtual void onMTUChange(uint16_t MTU, ble_gap_conn_desc *desc)
+    {
+        (void)MTU;
+        (void)desc;
+    }
+};
+
+class NimBLECharacteristicCallbacks
+{
+public:
+    typedef enum
+    {
+        SUCCESS_INDICATE,
+        SUCCESS_NOTIFY,
+        ERROR_INDICATE_DISABLED,
+        ERROR_NOTIFY_DISABLED,
+        ERROR_GATT,
+        ERROR_NO_CLIENT,
+        ERROR_INDICATE_TIMEOUT,
+        ERROR_INDICATE_FAILURE
+    } Status;
+
+    virtual ~NimBLECharacteristicCallbacks() {}
+    virtual void onWrite(NimBLECharacteristic *pCharacteristic) { (void)pCharacteristic; }
+    virtual void onStatus(NimBLECharacteristic *pCharacteristic, Status s, int code)
+    {
+        (void)pCharacteristic;
+        (void)s;
+        (void)code;
+    }
+};
+
+class NimBLECharacteristic
+{
+private:
+    std::string uuid;
+    uint32_t properties;
+    std::string value;
+    NimBLECharacteristicCallbacks *callbacks;
+
+public:
+    NimBLECharacteristic(const char *uuid, uint32_t properties) : uuid(uuid), properties(properties), callbacks(nullptr) {}
+
+    void setCallbacks(NimBLECharacteristicCallbacks *pCallbacks) { callbacks = pCallbacks; }
+    NimBLECharacteristicCallbacks *getCallbacks() { return callbacks; }
+
+    void setValue(const uint8_t *data, size_t length) { value.assign((const char *)data, length); }
+    void setValue(const std::string &str) { value = str; }
+    void setValue(const char *str) { value = str ? str : ""; }
+    std::string getValue() const { return value; }
+
+    void notify(bool is_notification = true);
+    void notify(const uint8_t *data, size_t length, bool is_notification = true);
+};
+
+class NimBLEService
+{
+private:
+    std::string uuid;
+    std::vector<NimBLECharacteristic *> characteristics;
+
+public:
+    explicit NimBLEService(const char *uuid) : uuid(uuid) {}
+    ~NimBLEService();
+
+    NimBLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties = NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE);
+    bool start() { return true; }
+};
+
+class NimBLEAdvertising
+{
+private:
+    bool advertising;
+
+public:
+    NimBLEAdvertising() : advertising(false) {}
+
+    void addServiceUUID(const char *uuid) { (void)uuid; }
+    void setScanResponse(bool enabled) { (void)enabled; }
+    void setMinPreferred(uint16_t interval) { (void)interval; }
+    bool start()
+    {
+        advertising = true;
+        return true;
+    }
+    bool stop()
+    {
+        advertising = false;
+        return true;
+    }
+    bool isAdvertising() { return advertising; }
+};
+
+class NimBLEServer
+{
+private:
+    NimBLEServerCallbacks *callbacks;
+    NimBLEAdvertising advertising;
+    std::vector<NimBLEService *> services;
+    uint16_t connectedCount;
+    uint16_t peerMTU;
+
+public:
+    NimBLEServer() : callbacks(nullptr), connectedCount(0), peerMTU(BLE_ATT_MTU_DFLT) {}
+    ~NimBLEServer();
+
+    void setCallbacks(NimBLEServerCallbacks *pCallbacks, bool deleteCallbacks = true)
+    {
+        (void)deleteCallbacks;
+        callbacks = pCallbacks;
+    }
+    NimBLEServerCallbacks *getCallbacks() { return callbacks; }
+
+    NimBLEService *createService(const char *uuid);
+    NimBLEAdvertising *getAdvertising() { return &advertising; }
+    bool startAdvertising() { return advertising.start(); }
+    bool stopAdvertising() { return advertising.stop(); }
+
+    int disconnect(uint16_t connId, uint8_t reason = 0x13);
+    uint16_t getConnectedCount() { return connectedCount; }
+    uint16_t getPeerMTU(uint16_t connId)
+    {
+        (void)connId;
+        return peerMTU;
+    }
+
+    // Host-only: driven by hal_native.cpp
+    void simulateConnect(uint16_t mtu);
+    void simulateDisconnect();
+};
+
+class NimBLEDevice
+{
+public:
+    static void init(const std::string &deviceName);
+    static void deinit(bool clearAll = false);
+    static NimBLEServer *createServer();
+    static NimBLEServer *getServer();
+    static NimBLEAddress getAddress() { return NimBLEAddress(); }
+    static int setMTU(uint16_t mtu);
+    static uint16_t getMTU();
+};
+
+#endif // ESPIR_NATIVE_NIMBLEDEVICE_H
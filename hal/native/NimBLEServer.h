@@ -0,0 +1,10 @@
+/**
+ * Native HAL - NimBLEServer stand-in; everything lives in NimBLEDevice.h
+ */
+
+#ifndef ESPIR_NATIVE_NIMBLESERVER_H
+#define ESPIR_NATIVE_NIMBLESERVER_H
+
+#include <NimBLEDevice.h>
+
+#endif // ESPIR_NATIVE_NIMBLESERVER_H
@@ -0,0 +1,10 @@
+/**
+ * Native HAL - NimBLEUtils stand-in; everything lives in NimBLEDevice.h
+ */
+
+#ifndef ESPIR_NATIVE_NIMBLEUTILS_H
+#define ESPIR_NATIVE_NIMBLEUTILS_H
+
+#include <NimBLEDevice.h>
+
+#endif // ESPIR_NATIVE_NIMBLEUTILS_H
@@ -0,0 +1,38 @@
+/**
+ * Native HAL - FreeRTOS stand-in for host builds
+ *
+ * Tasks are std::threads, queues and mutexes are std::mutex/condvar
+ * based. Core affinity and priorities are accepted and ignored, and stack
+ * high-water marks report the configured depth since host threads do not
+ * track stack usage.
+ */
+
+#ifndef ESPIR_NATIVE_FREERTOS_H
+#define ESPIR_NATIVE_FREERTOS_H
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+struct NativeTask;
+struct NativeQueue;
+struct NativeSemaphore;
+typedef NativeTask *TaskHandle_t;
+typedef NativeQueue *QueueHandle_t;
+typedef NativeSemaphore *SemaphoreHandle_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE ((BaseType_t)1)
+#define pdFALSE ((BaseType_t)0)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL ((BaseType_t)0)
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+#endif // ESPIR_NATIVE_FREERTOS_H
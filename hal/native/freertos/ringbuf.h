@@ -0,0 +1,27 @@
+/**
+ * Native HAL - ESP-IDF ring buffer stand-in (no-split items only)
+ */
+
+#ifndef ESPIR_NATIVE_FREERTOS_RINGBUF_H
+#define ESPIR_NATIVE_FREERTOS_RINGBUF_H
+
+#include "FreeRTOS.h"
+#include <cstddef>
+
+struct NativeRingbuf;
+typedef NativeRingbuf *RingbufHandle_t;
+
+typedef enum
+{
+    RINGBUF_TYPE_NOSPLIT,
+    RINGBUF_TYPE_ALLOWSPLIT,
+    RINGBUF_TYPE_BYTEBUF
+} RingbufferType_t;
+
+RingbufHandle_t xRingbufferCreate(size_t xBufferSize, RingbufferType_t xBufferType);
+void vRingbufferDelete(RingbufHandle_t xRingbuffer);
+BaseType_t xRingbufferSend(RingbufHandle_t xRingbuffer, const void *pvItem, size_t xItemSize, TickType_t xTicksToWait);
+void *xRingbufferReceive(RingbufHandle_t xRingbuffer, size_t *pxItemSize, TickType_t xTicksToWait);
+void vRingbufferReturnItem(RingbufHandle_t xRingbuffer, void *pvItem);
+
+#endif // ESPIR_NATIVE_FREERTOS_RINGBUF_H
@@ -0,0 +1,288 @@
+/**
+ * Native HAL - FreeRTOS stand-in implementation
+ */
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/ringbuf.h>
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct NativeTask
+{
+    const char *name;
+    uint32_t stackDepth;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notifyValue = 0;
+};
+
+struct NativeQueue
+{
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+// Items are copied in whole; one received item at a time keeps its space
+// until it is returned
+struct NativeRingbuf
+{
+    size_t capacity;
+    size_t used;
+    std::deque<std::vector<uint8_t>> items;
+    std::vector<uint8_t> held;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+};
+
+struct NativeSemaphore
+{
+    std::recursive_timed_mutex mutex;
+};
+
+namespace
+{
+    thread_local NativeTask *currentTask = nullptr;
+
+    template <typename Lock, typename Pred>
+    bool waitFor(std::condition_variable &cv, Lock &lock, TickType_t ticks, Pred pred)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            cv.wait(lock, pred);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(ticks), pred);
+    }
+
+    BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait, bool front)
+    {
+        if (!queue)
+            return errQUEUE_FULL;
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        if (!waitFor(queue->notFull, lock, ticksToWait, [queue]
+                     { return queue->items.size() < queue->length; }))
+            return errQUEUE_FULL;
+        std::vector<uint8_t> copy((const uint8_t *)item, (const uint8_t *)item + queue->itemSize);
+        if (front)
+            queue->items.push_front(std::move(copy));
+        else
+            queue->items.push_back(std::move(copy));
+        queue->notEmpty.notify_one();
+        return pdPASS;
+    }
+}
+
+// Tasks
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth,
+                                   void *parameters, UBaseType_t priority, TaskHandle_t *createdTask,
+                                   BaseType_t coreId)
+{
+    (void)priority;
+    (void)coreId;
+    NativeTask *task = new NativeTask();
+    task->name = name;
+    task->stackDepth = stackDepth;
+    if (createdTask)
+        *createdTask = task;
+
+    std::thread([function, parameters, task]
+                {
+                    currentTask = task;
+                    function(parameters); })
+        .detach();
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (!currentTask)
+    {
+        // Threads not created through xTaskCreatePinnedToCore (e.g. main)
+        currentTask = new NativeTask();
+        currentTask->name = "native";
+        currentTask->stackDepth = 0;
+    }
+    return currentTask;
+}
+
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+
+TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (!task)
+        task = xTaskGetCurrentTaskHandle();
+    return task->stackDepth;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    if (!task)
+        return pdFAIL;
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifyValue++;
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    NativeTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitFor(task->cv, lock, ticksToWait, [task]
+            { return task->notifyValue > 0; });
+    uint32_t value = task->notifyValue;
+    if (value > 0)
+        task->notifyValue = clearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+// Queues
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    NativeQueue *queue = new NativeQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait)
+{
+    if (!queue)
+        return pdFALSE;
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(queue->notEmpty, lock, ticksToWait, [queue]
+                 { return !queue->items.empty(); }))
+        return pdFALSE;
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return (UBaseType_t)queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - (UBaseType_t)queue->items.size();
+}
+
+// Ring buffers
+namespace
+{
+    // IDF stores each item behind an 8-byte header, rounded to 4 bytes
+    size_t ringbufFootprint(size_t size) { return 8 + ((size + 3) & ~(size_t)3); }
+}
+
+RingbufHandle_t xRingbufferCreate(size_t xBufferSize, RingbufferType_t xBufferType)
+{
+    (void)xBufferType;
+    NativeRingbuf *ring = new NativeRingbuf();
+    ring->capacity = xBufferSize;
+    ring->used = 0;
+    return ring;
+}
+
+void vRingbufferDelete(RingbufHandle_t xRingbuffer) { delete xRingbuffer; }
+
+BaseType_t xRingbufferSend(RingbufHandle_t xRingbuffer, const void *pvItem, size_t xItemSize, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    if (!xRingbuffer)
+        return pdFALSE;
+    std::lock_guard<std::mutex> lock(xRingbuffer->mutex);
+    size_t footprint = ringbufFootprint(xItemSize);
+    if (xRingbuffer->used + footprint > xRingbuffer->capacity)
+        return pdFALSE;
+    xRingbuffer->items.emplace_back((const uint8_t *)pvItem, (const uint8_t *)pvItem + xItemSize);
+    xRingbuffer->used += footprint;
+    xRingbuffer->notEmpty.notify_one();
+    return pdTRUE;
+}
+
+void *xRingbufferReceive(RingbufHandle_t xRingbuffer, size_t *pxItemSize, TickType_t xTicksToWait)
+{
+    if (!xRingbuffer)
+        return nullptr;
+    std::unique_lock<std::mutex> lock(xRingbuffer->mutex);
+    if (!xRingbuffer->held.empty() || !waitFor(xRingbuffer->notEmpty, lock, xTicksToWait, [xRingbuffer]
+                                                { return !xRingbuffer->items.empty(); }))
+        return nullptr;
+    xRingbuffer->held.swap(xRingbuffer->items.front());
+    xRingbuffer->items.pop_front();
+    if (pxItemSize)
+        *pxItemSize = xRingbuffer->held.size();
+    return xRingbuffer->held.data();
+}
+
+void vRingbufferReturnItem(RingbufHandle_t xRingbuffer, void *pvItem)
+{
+    if (!xRingbuffer)
+        return;
+    std::lock_guard<std::mutex> lock(xRingbuffer->mutex);
+    if (pvItem != xRingbuffer->held.data())
+        return;
+    xRingbuffer->used -= ringbufFootprint(xRingbuffer->held.size());
+    xRingbuffer->held.clear();
+}
+
+// Mutexes
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new NativeSemaphore(); }
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new NativeSemaphore(); }
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    if (ticksToWait == portMAX_DELAY)
+    {
+        semaphore->mutex.lock();
+        return pdTRUE;
+    }
+    return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->mutex.unlock();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    return xSemaphoreTake(semaphore, ticksToWait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) { return xSemaphoreGive(semaphore); }
@@ -0,0 +1,408 @@
+/**
+ * Native HAL - LittleFS stand-in implementation
+ */
+
+#include <FS.h>
+#include <LittleFS.h>
+#include "hal_native.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+fs::LittleFSFS LittleFS;
+
+namespace
+{
+    const size_t volumeBlockSize = 4096;
+    const size_t volumeTotalBytes = 0x160000; // Default "spiffs" partition
+
+    typedef std::shared_ptr<const std::vector<uint8_t>> Contents;
+
+    struct NativeVolume
+    {
+        std::mutex mutex;
+        std::map<std::string, Contents> files;
+        std::set<std::string> dirs = {"/"};
+        std::atomic<uint32_t> bytesWritten{0};
+        std::atomic<uint32_t> bytesRead{0};
+        std::atomic<uint32_t> filesWritten{0};
+        std::atomic<uint32_t> filesOpened{0};
+
+        // Power loss simulation; budget < 0 means unlimited
+        std::atomic<int64_t> powerBudget{-1};
+        std::atomic<bool> poweredOff{false};
+
+        std::string failWrites; // Path prefix whose opens for writing fail
+    };
+    NativeVolume volume;
+
+    std::string normalize(const char *path)
+    {
+        std::string p = path ? path : "";
+        if (p.empty() || p[0] != '/')
+            p.insert(0, "/");
+        while (p.size() > 1 && p.back() == '/')
+            p.pop_back();
+        return p;
+    }
+
+    // How many of `size` bytes reach flash before the power budget runs out
+    size_t acceptWrite(size_t size)
+    {
+        if (volume.poweredOff)
+            return 0;
+        int64_t budget = volume.powerBudget;
+        if (budget < 0 || (int64_t)size <= budget)
+        {
+            if (budget >= 0)
+                volume.powerBudget = budget - size;
+            return size;
+        }
+        volume.powerBudget = 0;
+        volume.poweredOff = true;
+        return budget;
+    }
+
+    std::string parentOf(const std::string &path)
+    {
+        size_t slash = path.rfind('/');
+        return slash == 0 ? "/" : path.substr(0, slash);
+    }
+}
+
+struct fs::File::Handle
+{
+    std::string path;
+    std::string name;
+    bool open = true;
+    bool directory = false;
+    bool writable = false;
+    bool dirty = false;
+    bool dead = false; // Opened after a power cut
+    size_t pos = 0;
+    Contents committed;           // Snapshot seen by readers
+    std::vector<uint8_t> pending; // Uncommitted contents of a write handle
+    std::vector<std::string> entries;
+    size_t nextEntry = 0;
+
+    const std::vector<uint8_t> &contents() const { return writable ? pending : *committed; }
+};
+
+// File
+
+size_t fs::File::write(const uint8_t *buf, size_t size)
+{
+    if (!handle || !handle->open || !handle->writable)
+        return 0;
+
+    // After a power cut the firmware keeps running, but nothing it writes lands
+    size_t accepted = handle->dead ? 0 : acceptWrite(size);
+    std::vector<uint8_t> &data = handle->pending;
+    if (handle->pos > data.size())
+        data.resize(handle->pos);
+    if (handle->pos + accepted > data.size())
+        data.resize(handle->pos + accepted);
+    std::copy(buf, buf + accepted, data.begin() + handle->pos);
+    handle->pos += size;
+    handle->dirty |= accepted > 0;
+    volume.bytesWritten += accepted;
+    return size;
+}
+
+int fs::File::read()
+{
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+size_t fs::File::read(uint8_t *buf, size_t size)
+{
+    if (!handle || !handle->open || handle->directory)
+        return 0;
+
+    const std::vector<uint8_t> &data = handle->contents();
+    size_t count = handle->pos < data.size() ? std::min(size, data.size() - handle->pos) : 0;
+    std::copy(data.begin() + handle->pos, data.begin() + handle->pos + count, buf);
+    handle->pos += count;
+    volume.bytesRead += count;
+    return count;
+}
+
+int fs::File::available()
+{
+    if (!handle || !handle->open || handle->directory)
+        return 0;
+    size_t length = handle->contents().size();
+    return handle->pos < length ? length - handle->pos : 0;
+}
+
+bool fs::File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!handle || !handle->open || handle->directory)
+        return false;
+
+    long base = mode == SeekSet ? 0 : mode == SeekCur ? handle->pos : handle->contents().size();
+    long target = base + (long)pos;
+    if (target < 0 || (size_t)target > handle->contents().size())
+        return false;
+    handle->pos = target;
+    return true;
+}
+
+size_t fs::File::position() const { return handle ? handle->pos : 0; }
+
+size_t fs::File::size() const { return handle && handle->open && !handle->directory ? handle->contents().size() : 0; }
+
+void fs::File::flush()
+{
+    if (!handle || !handle->open || !handle->dirty || handle->dead)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(volume.mutex);
+        volume.files[handle->path] = std::make_shared<const std::vector<uint8_t>>(handle->pending);
+    }
+    handle->dirty = false;
+    volume.filesWritten++;
+
+    if (halGetFlashCommitLatency())
+        std::this_thread::sleep_for(std::chrono::milliseconds(halGetFlashCommitLatency()));
+}
+
+void fs::File::close()
+{
+    if (!handle)
+        return;
+    flush();
+    handle->open = false;
+    handle->committed.reset();
+    handle->pending.clear();
+}
+
+fs::File::operator bool() const { return handle && handle->open; }
+
+const char *fs::File::path() const { return handle ? handle->path.c_str() : nullptr; }
+
+const char *fs::File::name() const { return handle ? handle->name.c_str() : nullptr; }
+
+bool fs::File::isDirectory() const { return handle && handle->open && handle->directory; }
+
+fs::File fs::File::openNextFile(const char *mode)
+{
+    if (!isDirectory() || handle->nextEntry >= handle->entries.size())
+        return File();
+    return LittleFS.open(handle->entries[handle->nextEntry++].c_str(), mode);
+}
+
+void fs::File::rewindDirectory()
+{
+    if (handle)
+        handle->nextEntry = 0;
+}
+
+// FS
+
+fs::File fs::FS::open(const char *path, const char *mode, bool create)
+{
+    std::string p = normalize(path);
+    bool writable = mode && (mode[0] == 'w' || mode[0] == 'a' || strchr(mode, '+'));
+
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    auto handle = std::make_shared<File::Handle>();
+    handle->path = p;
+    handle->name = p == "/" ? "/" : p.substr(p.rfind('/') + 1);
+
+    if (volume.dirs.count(p))
+    {
+        if (writable)
+            return File();
+        handle->directory = true;
+        for (const auto &dir : volume.dirs)
+        {
+            if (dir != "/" && parentOf(dir) == p)
+                handle->entries.push_back(dir);
+        }
+        for (const auto &file : volume.files)
+        {
+            if (parentOf(file.first) == p)
+                handle->entries.push_back(file.first);
+        }
+        return File(handle);
+    }
+
+    auto existing = volume.files.find(p);
+    if (!writable)
+    {
+        if (existing == volume.files.end())
+            return File();
+        handle->committed = existing->second;
+        volume.filesOpened++;
+        return File(handle);
+    }
+
+    if (!volume.failWrites.empty() && p.compare(0, volume.failWrites.size(), volume.failWrites) == 0)
+        return File();
+
+    if (!volume.dirs.count(parentOf(p)))
+    {
+        if (!create)
+            return File();
+        for (std::string dir = parentOf(p); dir != "/"; dir = parentOf(dir))
+            volume.dirs.insert(dir);
+    }
+
+    // Creating a file is visible immediately; truncation and data only
+    // once the handle is committed
+    handle->writable = true;
+    handle->dead = volume.poweredOff;
+    if (handle->dead)
+        return File(handle);
+    if (existing == volume.files.end())
+        volume.files[p] = std::make_shared<const std::vector<uint8_t>>();
+    else if (mode[0] != 'w')
+        handle->pending = *existing->second;
+    if (mode[0] == 'w')
+        handle->dirty = true;
+    if (mode[0] == 'a')
+        handle->pos = handle->pending.size();
+    return File(handle);
+}
+
+bool fs::FS::exists(const char *path)
+{
+    std::string p = normalize(path);
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    return volume.files.count(p) || volume.dirs.count(p);
+}
+
+bool fs::FS::remove(const char *path)
+{
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    if (volume.poweredOff)
+        return true;
+    return volume.files.erase(normalize(path)) > 0;
+}
+
+bool fs::FS::rename(const char *pathFrom, const char *pathTo)
+{
+    std::string from = normalize(pathFrom), to = normalize(pathTo);
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    if (volume.poweredOff)
+        return true;
+
+    auto source = volume.files.find(from);
+    if (source == volume.files.end() || !volume.dirs.count(parentOf(to)) || volume.dirs.count(to))
+        return false;
+
+    // Replaces an existing destination atomically, as littlefs does
+    Contents contents = source->second;
+    volume.files.erase(source);
+    volume.files[to] = contents;
+    return true;
+}
+
+bool fs::FS::mkdir(const char *path)
+{
+    std::string p = normalize(path);
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    if (volume.poweredOff)
+        return true;
+    if (volume.dirs.count(p) || volume.files.count(p) || !volume.dirs.count(parentOf(p)))
+        return false;
+    volume.dirs.insert(p);
+    return true;
+}
+
+bool fs::FS::rmdir(const char *path)
+{
+    std::string p = normalize(path);
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    if (p == "/" || !volume.dirs.count(p))
+        return false;
+    for (const auto &file : volume.files)
+    {
+        if (parentOf(file.first) == p)
+            return false;
+    }
+    for (const auto &dir : volume.dirs)
+    {
+        if (dir != p && parentOf(dir) == p)
+            return false;
+    }
+    volume.dirs.erase(p);
+    return true;
+}
+
+// LittleFS
+
+bool fs::LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+    (void)formatOnFail;
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    return true;
+}
+
+bool fs::LittleFSFS::format()
+{
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    volume.files.clear();
+    volume.dirs = {"/"};
+    return true;
+}
+
+size_t fs::LittleFSFS::totalBytes() { return volumeTotalBytes; }
+
+size_t fs::LittleFSFS::usedBytes()
+{
+    // Two superblocks, then at least one block per file and directory
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    size_t blocks = 2 + volume.dirs.size() - 1;
+    for (const auto &file : volume.files)
+        blocks += std::max<size_t>(1, (file.second->size() + volumeBlockSize - 1) / volumeBlockSize);
+    return blocks * volumeBlockSize;
+}
+
+uint32_t fs::LittleFSFS::getBytesWritten() { return volume.bytesWritten; }
+
+uint32_t fs::LittleFSFS::getBytesRead() { return volume.bytesRead; }
+
+uint32_t fs::LittleFSFS::getFilesWritten() { return volume.filesWritten; }
+
+uint32_t fs::LittleFSFS::getFilesOpened() { return volume.filesOpened; }
+
+void fs::LittleFSFS::resetCounters()
+{
+    volume.bytesWritten = 0;
+    volume.bytesRead = 0;
+    volume.filesWritten = 0;
+    volume.filesOpened = 0;
+}
+
+// Harness controls
+
+void halFsCutPowerAfter(uint32_t bytes)
+{
+    volume.poweredOff = false;
+    volume.powerBudget = bytes;
+}
+
+void halFsRestorePower()
+{
+    volume.powerBudget = -1;
+    volume.poweredOff = false;
+}
+
+bool halFsPoweredOff() { return volume.poweredOff; }
+
+void halFsFailWrites(const char *prefix)
+{
+    std::lock_guard<std::mutex> lock(volume.mutex);
+    volume.failWrites = prefix ? normalize(prefix) : "";
+}
@@ -0,0 +1,917 @@
+/**
+ * Native HAL Implementation
+ */
+
+#include "hal_native.h"
+#include <EEPROM.h>
+#include <IRsend.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include <NimBLEDevice.h>
+#include <driver/rmt.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+
+namespace
+{
+    bool serialOutput = true;
+    std::atomic<unsigned long> simulatedMillis(0);
+    bool irAirtimeSimulation = false;
+    unsigned long flashCommitLatencyMs = 0;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    struct InjectedFrame
+    {
+        decode_type_t protocol;
+        uint64_t value;
+        uint16_t bits;
+        std::vector<uint16_t> raw;
+    };
+    std::deque<InjectedFrame> irFrames;
+    std::mutex irFramesMutex; // frames are injected by the harness and drained by the IR task
+    NativeIRSendLog sendLog = {0, UNKNOWN, 0, 0, 0, {}};
+
+    struct RmtChannel
+    {
+        bool configured;
+        bool installed;
+        rmt_mode_t mode;
+        uint8_t clkDiv;
+        std::chrono::steady_clock::time_point busyUntil;
+        uint16_t idleTicks;
+        uint8_t filterCycles;
+        RingbufHandle_t ring;
+        bool receiving;
+    };
+    RmtChannel rmtChannels[RMT_CHANNEL_MAX] = {};
+    bool rmtAvailable = true;
+    NativeRmtLog rmtLog;
+    std::atomic<uint32_t> rmtRxDropped(0);
+
+    // Appends a level/duration half to an RX frame's items
+    void appendRxHalf(std::vector<rmt_item32_t> &items, size_t &halves, uint8_t level, uint32_t ticks)
+    {
+        ticks = std::min<uint32_t>(ticks, 32767);
+        if (halves % 2 == 0)
+        {
+            items.emplace_back();
+            items.back().val = 0;
+            items.back().duration0 = ticks;
+            items.back().level0 = level;
+        }
+        else
+        {
+            items.back().duration1 = ticks;
+            items.back().level1 = level;
+        }
+        halves++;
+    }
+
+    // Pulse-distance frame duration: header, then a mark plus a one/zero space per bit, then a trailing mark
+    uint32_t pulseDistanceAirtime(uint64_t data, uint16_t bits, uint32_t header, uint32_t mark, uint32_t one, uint32_t zero)
+    {
+        uint32_t us = header + mark;
+        for (uint16_t i = 0; i < bits; i++)
+            us += mark + (((data >> i) & 1) ? one : zero);
+        return us;
+    }
+
+    NimBLEServer *bleServer = nullptr;
+    NimBLECharacteristic *bleCharacteristic = nullptr;
+    uint16_t localMTU = BLE_ATT_MTU_MAX;
+    std::function<void(const uint8_t *, size_t)> notifyHook;
+    std::atomic<uint32_t> notifyCount(0);
+
+    // Link model: notifications fill connection events of linkPacketsPerEvent
+    uint32_t linkIntervalUs = 7500;
+    uint8_t linkPacketsPerEvent = 4;
+    uint8_t linkEventPackets = 0;
+    uint64_t linkAirtimeUs = 0;
+    std::atomic<uint32_t> failingNotifies(0);
+
+    const char *const protocolNames[] = {
+#define IR_PROTOCOL_NAME(name) #name,
+        IR_PROTOCOL_LIST(IR_PROTOCOL_NAME)
+#undef IR_PROTOCOL_NAME
+    };
+}
+
+// String
+bool String::grow(unsigned int size)
+{
+    if (size + 1 <= capacity)
+        return true;
+    char *grown = (char *)realloc(buffer, size + 1);
+    if (!grown)
+        return false;
+    if (!buffer)
+        grown[0] = '\0';
+    buffer = grown;
+    capacity = size + 1;
+    return true;
+}
+
+void String::assign(const char *cstr, unsigned int length)
+{
+    if (!cstr || !grow(length))
+    {
+        len = 0;
+        if (buffer)
+            buffer[0] = '\0';
+        return;
+    }
+    memmove(buffer, cstr, length);
+    buffer[length] = '\0';
+    len = length;
+}
+
+void String::append(const char *cstr, unsigned int length)
+{
+    if (!cstr || length == 0 || !grow(len + length))
+        return;
+    memmove(buffer + len, cstr, length);
+    len += length;
+    buffer[len] = '\0';
+}
+
+void String::formatUnsigned(unsigned long long value, unsigned char base)
+{
+    if (base < 2 || base > 36)
+        base = 10;
+    char buf[66];
+    char *p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    do
+    {
+        unsigned digit = value % base;
+        *--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value);
+    assign(p, (unsigned int)(buf + sizeof(buf) - 1 - p));
+}
+
+void String::formatSigned(long long value, unsigned char base)
+{
+    if (value < 0 && base == 10)
+    {
+        formatUnsigned(0ULL - (unsigned long long)value, base);
+        String digits(*this);
+        assign("-", 1);
+        concat(digits);
+        return;
+    }
+    formatUnsigned((unsigned long long)value, base);
+}
+
+String::String(float value, unsigned char decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned char decimals) : String()
+{
+    char buf[48];
+    int n = snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    assign(buf, n > 0 ? (unsigned int)n : 0);
+}
+
+// Serial
+size_t HardwareSerial::write(const char *s)
+{
+    if (!serialOutput || !s)
+        return 0;
+    return fputs(s, stdout) >= 0 ? strlen(s) : 0;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length)
+{
+    if (!serialOutput || !data)
+        return 0;
+    return fwrite(data, 1, length, stdout);
+}
+
+// ESP
+uint32_t EspClass::getFreeHeap() { return 300000; }
+
+uint32_t EspClass::getCycleCount()
+{
+    // Emulate a 240 MHz CCOUNT register from the host clock
+    return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - startTime)
+                          .count() *
+                      240 / 1000);
+}
+
+void EspClass::restart()
+{
+    if (serialOutput)
+        puts("[native] ESP.restart() requested");
+}
+
+// Timing
+unsigned long millis()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - startTime)
+               .count() +
+           simulatedMillis;
+}
+
+unsigned long micros()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - startTime)
+               .count() +
+           simulatedMillis * 1000UL;
+}
+
+// Delays advance simulated time instead of sleeping so benchmarks stay fast
+void delay(unsigned long ms) { simulatedMillis += ms; }
+void delayMicroseconds(unsigned int us) { (void)us; }
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    (void)pin;
+    (void)value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    (void)pin;
+    return LOW;
+}
+
+// IRsend
+void IRsend::record(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t rawLen, uint32_t airtimeUs)
+{
+    (void)pin;
+    sendLog.sendCount++;
+    sendLog.lastProtocol = protocol;
+    sendLog.lastData = data;
+    sendLog.lastBits = bits;
+    sendLog.lastRawLen = rawLen;
+    sendLog.lastState.clear();
+    if (irAirtimeSimulation)
+    {
+        // Bit-banging keeps the CPU busy for the whole frame
+        auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(airtimeUs);
+        while (std::chrono::steady_clock::now() < end)
+        {
+        }
+    }
+}
+
+void IRsend::sendNEC(uint64_t data, uint16_t nbits, uint16_t repeat)
+{
+    record(NEC, data, nbits, 0, pulseDistanceAirtime(data, nbits, 13500, 560, 1690, 560) + repeat * 110000);
+}
+
+void IRsend::sendSony(uint64_t data, uint16_t nbits, uint16_t repeat)
+{
+    record(SONY, data, nbits, 0, (repeat + 1) * 45000);
+}
+
+void IRsend::sendRC5(uint64_t data, uint16_t nbits, uint16_t repeat)
+{
+    record(RC5, data, nbits, 0, (repeat + 1) * (nbits + 1) * 1778);
+}
+
+void IRsend::sendRC6(uint64_t data, uint16_t nbits, uint16_t repeat)
+{
+    record(RC6, data, nbits, 0, (repeat + 1) * (4000 + nbits * 889));
+}
+
+void IRsend::sendRaw(const uint16_t buf[], uint16_t len, uint16_t hz)
+{
+    (void)hz;
+    uint32_t us = 0;
+    for (uint16_t i = 0; buf && i < len; i++)
+        us += buf[i];
+    record(RAW, 0, 0, len, us);
+}
+
+bool IRsend::send(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat)
+{
+    switch (type)
+    {
+    case NEC:
+        sendNEC(data, nbits, repeat);
+        return true;
+    case SONY:
+        sendSony(data, nbits, std::max<uint16_t>(repeat, 2));
+        return true;
+    case RC5:
+    case RC5X:
+        sendRC5(data, nbits, repeat);
+        return true;
+    case RC6:
+        sendRC6(data, nbits, repeat);
+        return true;
+    case UNUSED:
+    case SANYO:
+    case NEC_LIKE:
+    case MWM:
+    case PRONTO:
+    case RAW:
+    case GLOBALCACHE:
+        return false;
+    default:
+        break;
+    }
+    if (type < UNUSED || type > kLastDecodeType || hasACState(type))
+        return false;
+    record(type, data, nbits, 0, (repeat + 1) * pulseDistanceAirtime(data, nbits, 13500, 560, 1690, 560));
+    return true;
+}
+
+bool IRsend::send(decode_type_t type, const uint8_t *state, uint16_t nbytes)
+{
+    if (!hasACState(type) || !state)
+        return false;
+    record(type, 0, nbytes * 8, 0, pulseDistanceAirtime(0x5555555555555555ULL, 64, 4500, 450, 1300, 450) * ((nbytes + 7) / 8));
+    sendLog.lastState.assign(state, state + nbytes);
+    return true;
+}
+
+const NativeIRSendLog &IRsend::log() { return sendLog; }
+
+void IRsend::resetLog() { sendLog = {0, UNKNOWN, 0, 0, 0, {}}; }
+
+// RMT
+esp_err_t rmt_config(const rmt_config_t *config)
+{
+    if (!config || config->channel >= RMT_CHANNEL_MAX || config->clk_div == 0)
+        return ESP_ERR_INVALID_ARG;
+    if (!rmtAvailable)
+        return ESP_FAIL;
+    RmtChannel &channel = rmtChannels[config->channel];
+    channel.configured = true;
+    channel.mode = config->rmt_mode;
+    channel.clkDiv = config->clk_div;
+    if (config->rmt_mode == RMT_MODE_RX)
+    {
+        channel.idleTicks = config->rx_config.idle_threshold;
+        channel.filterCycles = config->rx_config.filter_en ? config->rx_config.filter_ticks_thresh : 0;
+        return ESP_OK;
+    }
+    if (config->tx_config.carrier_en && config->tx_config.carrier_freq_hz)
+    {
+        rmtLog.carrierHz = config->tx_config.carrier_freq_hz;
+        rmtLog.dutyPercent = config->tx_config.carrier_duty_percent;
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags)
+{
+    (void)rx_buf_size;
+    (void)intr_alloc_flags;
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].configured)
+        return ESP_ERR_INVALID_STATE;
+    if (rmtChannels[channel].installed)
+        return ESP_FAIL; // The driver refuses a second install
+    if (rmtChannels[channel].mode == RMT_MODE_RX)
+    {
+        if (rx_buf_size == 0)
+            return ESP_ERR_INVALID_ARG;
+        rmtChannels[channel].ring = xRingbufferCreate(rx_buf_size, RINGBUF_TYPE_NOSPLIT);
+    }
+    rmtChannels[channel].installed = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_set_gpio(rmt_channel_t channel, rmt_mode_t mode, gpio_num_t gpio_num, bool invert_signal)
+{
+    (void)gpio_num;
+    (void)invert_signal;
+    if (channel >= RMT_CHANNEL_MAX || mode != rmtChannels[channel].mode)
+        return ESP_ERR_INVALID_ARG;
+    return rmtChannels[channel].configured ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t rmt_set_tx_carrier(rmt_channel_t channel, bool carrier_en, uint16_t high_level, uint16_t low_level,
+                             rmt_carrier_level_t carrier_level)
+{
+    (void)carrier_level;
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].configured)
+        return ESP_ERR_INVALID_STATE;
+    uint32_t period = high_level + low_level;
+    rmtLog.carrierHz = carrier_en && period ? 80000000 / period : 0;
+    rmtLog.dutyPercent = carrier_en && period ? (high_level * 100 + period / 2) / period : 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t *rmt_item, int item_num, bool wait_tx_done)
+{
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].installed || rmtChannels[channel].mode != RMT_MODE_TX)
+        return ESP_ERR_INVALID_STATE;
+    if (!rmt_item || item_num <= 0)
+        return ESP_ERR_INVALID_ARG;
+
+    // A write waits for the previous stream, as the driver does
+    rmt_wait_tx_done(channel, portMAX_DELAY);
+
+    uint64_t ticks = 0;
+    rmtLog.lastItems.assign(item_num, 0);
+    for (int i = 0; i < item_num; i++)
+    {
+        rmtLog.lastItems[i] = rmt_item[i].val;
+        ticks += rmt_item[i].duration0 + rmt_item[i].duration1;
+    }
+    uint64_t airtimeUs = ticks * rmtChannels[channel].clkDiv / 80;
+    rmtLog.writeCount++;
+    rmtLog.airtimeUs += airtimeUs;
+
+    rmtChannels[channel].busyUntil = std::chrono::steady_clock::now() +
+                                     std::chrono::microseconds(irAirtimeSimulation ? airtimeUs : 0);
+    if (wait_tx_done)
+        rmt_wait_tx_done(channel, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t wait_time)
+{
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].installed)
+        return ESP_ERR_INVALID_STATE;
+
+    auto now = std::chrono::steady_clock::now();
+    auto busyUntil = rmtChannels[channel].busyUntil;
+    if (busyUntil <= now)
+        return ESP_OK;
+    if (wait_time != portMAX_DELAY && now + std::chrono::milliseconds(wait_time) < busyUntil)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait_time));
+        return ESP_ERR_TIMEOUT;
+    }
+    std::this_thread::sleep_until(busyUntil);
+    return ESP_OK;
+}
+
+esp_err_t rmt_get_ringbuf_handle(rmt_channel_t channel, RingbufHandle_t *buf_handle)
+{
+    if (channel >= RMT_CHANNEL_MAX || !buf_handle)
+        return ESP_ERR_INVALID_ARG;
+    if (!rmtChannels[channel].ring)
+        return ESP_ERR_INVALID_STATE;
+    *buf_handle = rmtChannels[channel].ring;
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_start(rmt_channel_t channel, bool rx_idx_rst)
+{
+    (void)rx_idx_rst;
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].ring)
+        return ESP_ERR_INVALID_STATE;
+    rmtChannels[channel].receiving = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_rx_stop(rmt_channel_t channel)
+{
+    if (channel >= RMT_CHANNEL_MAX || !rmtChannels[channel].ring)
+        return ESP_ERR_INVALID_STATE;
+    rmtChannels[channel].receiving = false;
+    return ESP_OK;
+}
+
+// EEPROM
+bool EEPROMClass::commit()
+{
+    countCommit();
+    if (flashCommitLatencyMs)
+        std::this_thread::sleep_for(std::chrono::milliseconds(flashCommitLatencyMs));
+    return true;
+}
+
+// IRrecv
+IRrecv::IRrecv(uint16_t recvpin, uint16_t bufsize, uint8_t timeout, bool save_buffer)
+    : pin(recvpin), bufferSize(bufsize), captureBuffer(new uint16_t[bufsize]), enabled(false)
+{
+    (void)timeout;
+    (void)save_buffer;
+    (void)pin;
+}
+
+IRrecv::~IRrecv() { delete[] captureBuffer; }
+
+void IRrecv::enableIRIn(bool pullup)
+{
+    (void)pullup;
+    enabled = true;
+}
+
+void IRrecv::disableIRIn() { enabled = false; }
+
+void IRrecv::resume() {}
+
+bool IRrecv::decode(decode_results *results)
+{
+    std::lock_guard<std::mutex> lock(irFramesMutex);
+    if (!enabled || irFrames.empty() || !results)
+        return false;
+
+    const InjectedFrame &frame = irFrames.front();
+    results->decode_type = frame.protocol;
+    results->value = frame.value;
+    results->bits = frame.bits;
+    results->address = 0;
+    results->command = 0;
+    results->overflow = frame.raw.size() + 1 > bufferSize;
+    results->repeat = false;
+
+    // Like the ISR: the gap before the frame first, then the frame in ticks
+    results->rawlen = (uint16_t)std::min<size_t>(frame.raw.size() + 1, bufferSize);
+    captureBuffer[0] = kTimeoutMs * 1000 / kRawTick;
+    for (uint16_t i = 1; i < results->rawlen; i++)
+        captureBuffer[i] = (frame.raw[i - 1] + kRawTick / 2) / kRawTick;
+    results->rawbuf = captureBuffer;
+    irFrames.pop_front();
+    return true;
+}
+
+// IRutils
+String typeToString(const decode_type_t protocol, const bool isRepeat)
+{
+    String name = (protocol > UNKNOWN && protocol <= kLastDecodeType) ? protocolNames[protocol] : "UNKNOWN";
+    if (isRepeat)
+        name += " (Repeat)";
+    return name;
+}
+
+decode_type_t strToDecodeType(const char *str)
+{
+    if (!str)
+        return UNKNOWN;
+    for (int i = 0; i <= kLastDecodeType; i++)
+    {
+        if (strcmp(str, protocolNames[i]) == 0)
+            return (decode_type_t)i;
+    }
+    return UNKNOWN;
+}
+
+bool hasACState(const decode_type_t protocol)
+{
+    switch (protocol)
+    {
+    case DAIKIN:
+    case KELVINATOR:
+    case MITSUBISHI_AC:
+    case GREE:
+    case ARGO:
+    case TROTEC:
+    case TOSHIBA_AC:
+    case FUJITSU_AC:
+    case HAIER_AC:
+    case HITACHI_AC:
+    case HITACHI_AC1:
+    case HITACHI_AC2:
+    case HAIER_AC_YRW02:
+    case WHIRLPOOL_AC:
+    case SAMSUNG_AC:
+    case ELECTRA_AC:
+    case PANASONIC_AC:
+    case DAIKIN2:
+    case TCL112AC:
+    case MITSUBISHI_HEAVY_88:
+    case MITSUBISHI_HEAVY_152:
+    case DAIKIN216:
+    case SHARP_AC:
+    case DAIKIN160:
+    case NEOCLIMA:
+    case DAIKIN176:
+    case DAIKIN128:
+    case AMCOR:
+    case DAIKIN152:
+    case MITSUBISHI136:
+    case MITSUBISHI112:
+    case HITACHI_AC424:
+    case HITACHI_AC3:
+    case HITACHI_AC344:
+    case CORONA_AC:
+    case SANYO_AC:
+    case VOLTAS:
+    case MIRAGE:
+    case HAIER_AC176:
+    case TEKNOPOINT:
+    case TROTEC_3550:
+    case SANYO_AC88:
+    case RHOSS:
+    case HITACHI_AC264:
+    case KELON168:
+    case HITACHI_AC296:
+    case DAIKIN200:
+    case HAIER_AC160:
+    case CARRIER_AC128:
+    case TCL96AC:
+    case BOSCH144:
+    case SANYO_AC152:
+    case DAIKIN312:
+    case CARRIER_AC84:
+    case YORK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// NimBLE
+void NimBLECharacteristic::notify(bool is_notification)
+{
+    (void)is_notification;
+    notify((const uint8_t *)value.data(), value.size(), is_notification);
+}
+
+void NimBLECharacteristic::notify(const uint8_t *data, size_t length, bool is_notification)
+{
+    (void)is_notification;
+    (void)properties;
+
+    // Like the real stack, a notification carries at most MTU - 3 bytes
+    if (bleServer)
+        length = std::min<size_t>(length, std::min(bleServer->getPeerMTU(0), localMTU) - 3);
+
+    // The real stack reports a notification it has no buffer for through onStatus
+    uint32_t failing = failingNotifies;
+    while (failing > 0 && !failingNotifies.compare_exchange_weak(failing, failing - 1))
+    {
+    }
+    if (failing > 0)
+    {
+        if (callbacks)
+            callbacks->onStatus(this, NimBLECharacteristicCallbacks::ERROR_GATT, BLE_HS_ENOMEM);
+        return;
+    }
+
+    if (linkEventPackets == 0)
+        linkAirtimeUs += linkIntervalUs;
+    linkEventPackets = (linkEventPackets + 1) % linkPacketsPerEvent;
+
+    notifyCount++;
+    if (notifyHook)
+        notifyHook(data, length);
+    if (callbacks)
+        callbacks->onStatus(this, NimBLECharacteristicCallbacks::SUCCESS_NOTIFY, 0);
+}
+
+NimBLEService::~NimBLEService()
+{
+    for (NimBLECharacteristic *c : characteristics)
+        delete c;
+}
+
+NimBLECharacteristic *NimBLEService::createCharacteristic(const char *uuid, uint32_t properties)
+{
+    NimBLECharacteristic *characteristic = new NimBLECharacteristic(uuid, properties);
+    characteristics.push_back(characteristic);
+    bleCharacteristic = characteristic;
+    return characteristic;
+}
+
+NimBLEServer::~NimBLEServer()
+{
+    for (NimBLEService *s : services)
+        delete s;
+}
+
+NimBLEService *NimBLEServer::createService(const char *uuid)
+{
+    NimBLEService *service = new NimBLEService(uuid);
+    services.push_back(service);
+    return service;
+}
+
+int NimBLEServer::disconnect(uint16_t connId, uint8_t reason)
+{
+    (void)connId;
+    (void)reason;
+    simulateDisconnect();
+    return 0;
+}
+
+void NimBLEServer::simulateConnect(uint16_t mtu)
+{
+    connectedCount = 1;
+    peerMTU = mtu;
+    advertising.stop();
+    if (callbacks)
+    {
+        ble_gap_conn_desc desc = {0};
+        callbacks->onConnect(this);
+        callbacks->onMTUChange(std::min(mtu, localMTU), &desc);
+    }
+}
+
+void NimBLEServer::simulateDisconnect()
+{
+    if (connectedCount == 0)
+        return;
+    connectedCount = 0;
+    if (callbacks)
+        callbacks->onDisconnect(this);
+}
+
+void NimBLEDevice::init(const std::string &deviceName) { (void)deviceName; }
+
+void NimBLEDevice::deinit(bool clearAll)
+{
+    (void)clearAll;
+    delete bleServer;
+    bleServer = nullptr;
+    bleCharacteristic = nullptr;
+}
+
+NimBLEServer *NimBLEDevice::createServer()
+{
+    if (!bleServer)
+        bleServer = new NimBLEServer();
+    return bleServer;
+}
+
+NimBLEServer *NimBLEDevice::getServer() { return bleServer; }
+
+int NimBLEDevice::setMTU(uint16_t mtu)
+{
+    localMTU = mtu;
+    return 0;
+}
+
+uint16_t NimBLEDevice::getMTU() { return localMTU; }
+
+// Harness controls
+void halAdvanceMillis(unsigned long ms) { simulatedMillis += ms; }
+
+void halSetIRAirtimeSimulation(bool enabled) { irAirtimeSimulation = enabled; }
+
+void halRmtSetAvailable(bool available) { rmtAvailable = available; }
+
+uint32_t halInjectIREdges(const uint32_t *durations, size_t count)
+{
+    const RmtChannel *rx = nullptr;
+    for (const RmtChannel &channel : rmtChannels)
+        if (channel.installed && channel.mode == RMT_MODE_RX && channel.receiving)
+            rx = &channel;
+    if (!rx || !durations)
+        return 0;
+
+    // The receiver module's output idles high and is pulled low for a
+    // burst, so marks are level 0. Glitches under the filter are dropped
+    // and a space of idle_threshold ticks or more ends the frame
+    uint32_t frames = 0;
+    uint32_t filterUs = rx->filterCycles / 80;
+    std::vector<rmt_item32_t> items;
+    size_t halves = 0;
+    auto flush = [&]()
+    {
+        if (items.empty())
+            return;
+        if (halves % 2 == 0)
+        {
+            items.emplace_back();
+            items.back().val = 0;
+        }
+        items.back().duration1 = 0; // End marker
+        if (xRingbufferSend(rx->ring, items.data(), items.size() * sizeof(rmt_item32_t), 0) == pdTRUE)
+            frames++;
+        else
+            rmtRxDropped++;
+        items.clear();
+        halves = 0;
+    };
+
+    uint32_t pendingTicks = 0;
+    uint8_t pendingLevel = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        bool mark = i % 2 == 0;
+        uint32_t ticks = durations[i] * 80 / rx->clkDiv;
+        if (!mark && ticks >= rx->idleTicks)
+        {
+            if (pendingTicks && pendingLevel == 0)
+                appendRxHalf(items, halves, pendingLevel, pendingTicks);
+            pendingTicks = 0;
+            flush();
+            continue;
+        }
+        if ((ticks == 0 || durations[i] <= filterUs) && pendingTicks)
+        {
+            pendingTicks += ticks; // Swallowed into the surrounding level
+            continue;
+        }
+        if (!pendingTicks && items.empty() && !mark)
+            continue; // A frame starts with a mark
+
+        uint8_t level = mark ? 0 : 1;
+        if (pendingTicks && level != pendingLevel)
+        {
+            appendRxHalf(items, halves, pendingLevel, pendingTicks);
+            pendingTicks = 0;
+        }
+        pendingLevel = level;
+        pendingTicks += ticks;
+    }
+    if (pendingTicks && pendingLevel == 0)
+        appendRxHalf(items, halves, pendingLevel, pendingTicks);
+    flush();
+    return frames;
+}
+
+uint32_t halRmtRxDropped() { return rmtRxDropped; }
+
+void halRmtReset()
+{
+    for (RmtChannel &channel : rmtChannels)
+    {
+        if (channel.ring)
+            vRingbufferDelete(channel.ring);
+        channel = RmtChannel();
+    }
+}
+
+const NativeRmtLog &halRmtLog() { return rmtLog; }
+
+void halRmtResetLog()
+{
+    rmtLog.writeCount = 0;
+    rmtLog.airtimeUs = 0;
+    rmtLog.lastItems.clear();
+}
+
+void halSetFlashCommitLatency(unsigned long ms) { flashCommitLatencyMs = ms; }
+
+unsigned long halGetFlashCommitLatency() { return flashCommitLatencyMs; }
+
+void halSetSerialOutput(bool enabled) { serialOutput = enabled; }
+
+void halInjectIRFrame(decode_type_t protocol, uint64_t value, uint16_t bits, const uint16_t *raw, uint16_t rawLen)
+{
+    InjectedFrame frame;
+    frame.protocol = protocol;
+    frame.value = value;
+    frame.bits = bits;
+    if (raw && rawLen > 0)
+        frame.raw.assign(raw, raw + rawLen);
+    std::lock_guard<std::mutex> lock(irFramesMutex);
+    irFrames.push_back(frame);
+}
+
+void halClearIRFrames()
+{
+    std::lock_guard<std::mutex> lock(irFramesMutex);
+    irFrames.clear();
+}
+
+void halBleConnect(uint16_t mtu)
+{
+    if (bleServer)
+        bleServer->simulateConnect(mtu);
+}
+
+void halBleDisconnect()
+{
+    if (bleServer)
+        bleServer->simulateDisconnect();
+}
+
+bool halBleWrite(const std::string &value)
+{
+    if (!bleCharacteristic || !bleCharacteristic->getCallbacks())
+        return false;
+    bleCharacteristic->setValue(value);
+    bleCharacteristic->getCallbacks()->onWrite(bleCharacteristic);
+    return true;
+}
+
+void halSetNotifyHook(std::function<void(const uint8_t *data, size_t length)> hook) { notifyHook = hook; }
+
+uint32_t halGetNotifyCount() { return notifyCount; }
+
+void halBleFailNotifies(uint32_t count) { failingNotifies = count; }
+
+void halBleSetLink(uint32_t intervalUs, uint8_t packetsPerEvent)
+{
+    linkIntervalUs = intervalUs;
+    linkPacketsPerEvent = packetsPerEvent ? packetsPerEvent : 1;
+    halBleResetAirtime();
+}
+
+void halBleResetAirtime()
+{
+    linkEventPackets = 0;
+    linkAirtimeUs = 0;
+}
+
+uint64_t halBleAirtimeUs() { return linkAirtimeUs; }
@@ -0,0 +1,92 @@
+/**
+ * Native HAL - host harness controls
+ *
+ * Hooks used by host benchmarks to drive the stand-ins: simulated time,
+ * IR frame injection, BLE connection/write injection and notification
+ * capture. Only available in the `native` environment.
+ */
+
+#ifndef ESPIR_HAL_NATIVE_H
+#define ESPIR_HAL_NATIVE_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Time
+void halAdvanceMillis(unsigned long ms);
+
+// Peripheral timing: make IR sends block for their on-air duration and
+// EEPROM commits / LittleFS file commits for the given flash write latency
+// (both off by default)
+void halSetIRAirtimeSimulation(bool enabled);
+void halSetFlashCommitLatency(unsigned long ms);
+unsigned long halGetFlashCommitLatency();
+
+// RMT transmitter: every stream written since the last reset, and the
+// carrier last set. halRmtSetAvailable(false) makes channel setup fail,
+// as on a board with every RMT channel taken
+struct NativeRmtLog
+{
+    uint32_t writeCount;
+    uint64_t airtimeUs;
+    uint32_t carrierHz;
+    uint8_t dutyPercent;
+    std::vector<uint32_t> lastItems;
+};
+void halRmtSetAvailable(bool available);
+const NativeRmtLog &halRmtLog();
+void halRmtResetLog();
+
+// Forgets every channel's setup, as after a reboot, so a freshly built
+// IRManager (e.g. in a forked child) can claim the channels again
+void halRmtReset();
+
+// RMT receiver: feed an edge stream (alternating mark/space durations in
+// microseconds, starting with a mark) to the running RX channel. It is cut
+// into frames at the channel's idle threshold; returns the frames queued.
+// Frames that do not fit the driver's ring buffer are dropped and counted
+uint32_t halInjectIREdges(const uint32_t *durations, size_t count);
+uint32_t halRmtRxDropped();
+
+// Flash power loss: the LittleFS stand-in accepts `bytes` more bytes of
+// writes, keeps whatever reached a file before the cut (a torn write) and
+// ignores every later change until power is restored
+void halFsCutPowerAfter(uint32_t bytes);
+void halFsRestorePower();
+bool halFsPoweredOff();
+
+// Opening a file whose path starts with `prefix` for writing fails, as on
+// a worn or full volume, until called again with nullptr
+void halFsFailWrites(const char *prefix);
+
+// Console
+void halSetSerialOutput(bool enabled);
+
+// IR receiver: queue a frame for the next IRrecv::decode(); raw timings
+// are microseconds starting with a mark
+void halInjectIRFrame(decode_type_t protocol, uint64_t value, uint16_t bits,
+                      const uint16_t *raw = nullptr, uint16_t rawLen = 0);
+void halClearIRFrames();
+
+// BLE: connect/disconnect a simulated central and write to the characteristic
+void halBleConnect(uint16_t mtu = 23);
+void halBleDisconnect();
+bool halBleWrite(const std::string &value);
+void halSetNotifyHook(std::function<void(const uint8_t *data, size_t length)> hook);
+uint32_t halGetNotifyCount();
+
+// The next `count` notifications fail as if the host were out of buffers
+void halBleFailNotifies(uint32_t count);
+
+// BLE link model: notifications are truncated to the negotiated MTU and
+// packed into connection events of `packetsPerEvent` packets every
+// `intervalUs` (7.5 ms and 4 by default); halBleAirtimeUs() is the link
+// time the notifications since the last reset took
+void halBleSetLink(uint32_t intervalUs, uint8_t packetsPerEvent);
+void halBleResetAirtime();
+uint64_t halBleAirtimeUs();
+
+#endif // ESPIR_HAL_NATIVE_H
@@ -0,0 +1,113 @@
+/**
+ * Binary Protocol - Compact framing for the BLE command channel
+ *
+ * Frame layout (little endian):
+ *   [0] BIN_MAGIC  [1] version  [2] opcode (| BIN_RESPONSE_FLAG in replies)
+ *   [3..4] request id  [5] status (0 in requests)
+ *   [6..]  TLV parameters: tag (1 byte), length (1 byte), value
+ *
+ * JSON commands always start with '{' or whitespace, so the first byte is
+ * enough to tell the two protocols apart. A connection must send HELLO
+ * before any other binary opcode is accepted.
+ */
+
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BIN_MAGIC 0xE5
+#define BIN_VERSION 1
+#define BIN_HEADER_SIZE 6
+#define BIN_RESPONSE_FLAG 0x80
+#define BIN_MAX_FRAME 64 // Largest reply the firmware builds, but for METRICS
+#define BIN_METRICS_MAX_FRAME 192
+
+enum BinaryOpcode : uint8_t
+{
+    BIN_OP_HELLO = 0x01,    // TAG_VERSION -> TAG_VERSION, TAG_MAX_FRAME
+    BIN_OP_RESOLVE = 0x02,  // TAG_DEVICE_NAME, TAG_COMMAND_NAME -> TAG_DEVICE_ID, TAG_COMMAND_ID
+    BIN_OP_TRANSMIT = 0x03, // TAG_DEVICE_ID, TAG_COMMAND_ID -> status only
+    BIN_OP_PING = 0x04,     // -> TAG_UPTIME
+    BIN_OP_METRICS = 0x05   // -> TAG_UPTIME, TAG_METRIC_VALUES, TAG_HISTOGRAM per histogram
+};
+
+enum BinaryTag : uint8_t
+{
+    BIN_TAG_VERSION = 0x01,
+    BIN_TAG_MAX_FRAME = 0x02,
+    BIN_TAG_UPTIME = 0x03,
+    BIN_TAG_DEVICE_ID = 0x10,
+    BIN_TAG_COMMAND_ID = 0x11,
+    BIN_TAG_DEVICE_NAME = 0x12,
+    BIN_TAG_COMMAND_NAME = 0x13,
+    BIN_TAG_METRIC_VALUES = 0x20, // u32 per MetricId, in id order (metrics.h)
+    BIN_TAG_HISTOGRAM = 0x21      // MetricHistogramId, then u32 count, sum, max, p50, p95, p99
+};
+
+enum BinaryStatus : uint8_t
+{
+    BIN_STATUS_OK = 0,
+    BIN_STATUS_MALFORMED = 1,
+    BIN_STATUS_UNSUPPORTED_VERSION = 2,
+    BIN_STATUS_UNKNOWN_OPCODE = 3,
+    BIN_STATUS_NOT_NEGOTIATED = 4,
+    BIN_STATUS_MISSING_PARAMETER = 5,
+    BIN_STATUS_NOT_FOUND = 6,
+    BIN_STATUS_BUSY = 7,
+    BIN_STATUS_TRANSMIT_ERROR = 8,
+    BIN_STATUS_TOO_LARGE = 9
+};
+
+// A parsed frame; payload points into the caller's buffer
+struct BinaryFrame
+{
+    uint8_t version;
+    uint8_t opcode;
+    uint8_t status;
+    uint16_t requestId;
+    const uint8_t *payload;
+    uint16_t payloadLength;
+};
+
+inline bool isBinaryFrame(const uint8_t *data, size_t length)
+{
+    return length > 0 && data[0] == BIN_MAGIC;
+}
+
+// Validates the header and that the TLVs exactly fill the payload
+bool parseBinaryFrame(const uint8_t *data, size_t length, BinaryFrame &frame);
+
+// Finds the first TLV with the given tag
+bool findBinaryTlv(const BinaryFrame &frame, uint8_t tag, const uint8_t *&value, uint8_t &length);
+bool readBinaryU8(const BinaryFrame &frame, uint8_t tag, uint8_t &value);
+
+void writeBinaryU32(uint8_t *out, uint32_t value);
+
+// Builds a frame into a caller-provided buffer
+class BinaryWriter
+{
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    void put(uint8_t tag, const uint8_t *value, uint8_t valueLength);
+
+public:
+    BinaryWriter(uint8_t *buf, size_t size) : buffer(buf), capacity(size), length(0), overflow(false) {}
+
+    void begin(uint8_t opcode, uint16_t requestId, uint8_t status);
+    void addU8(uint8_t tag, uint8_t value) { put(tag, &value, 1); }
+    void addU16(uint8_t tag, uint16_t value);
+    void addU32(uint8_t tag, uint32_t value);
+    void addBytes(uint8_t tag, const uint8_t *value, uint8_t valueLength) { put(tag, value, valueLength); }
+
+    const uint8_t *data() const { return buffer; }
+    size_t size() const { return length; }
+    bool ok() const { return !overflow; }
+};
+
+#endif // BINARY_PROTOCOL_H
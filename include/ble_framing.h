@@ -0,0 +1,108 @@
+/**
+ * BLE Framing - Messages larger than one ATT payload
+ *
+ * A message that fits the negotiated MTU (MTU - 3 bytes of ATT payload) is
+ * written or notified as is. Longer ones are split into fragments:
+ *   [0] BLE_FRAGMENT_MAGIC  [1] sequence  [2] flags  [3..] payload
+ * The first fragment (BLE_FRAG_FIRST) puts the total message length
+ * (2 bytes, little endian) in front of its payload, and every fragment but
+ * the last has BLE_FRAG_MORE set. A message longer than
+ * BLE_FRAG_MAX_MESSAGE also sets BLE_FRAG_LONG and gives its length in 4
+ * bytes, so streamed replies are not limited by the length field. The sequence number counts fragments per
+ * direction and connection, so a lost fragment breaks the chain and the
+ * message is dropped instead of being delivered spliced.
+ *
+ * Flow control is credit based and opt-in: once a central writes a
+ * credit frame ([magic][0][BLE_FRAG_CREDIT][credits]) every notification
+ * costs one credit, and a message stalls until more are granted.
+ */
+
+#ifndef BLE_FRAMING_H
+#define BLE_FRAMING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLE_FRAGMENT_MAGIC 0xE6 // Next to BIN_MAGIC; JSON starts with '{'
+#define BLE_ATT_OVERHEAD 3      // ATT opcode and handle in every notification/write
+#define BLE_FRAG_HEADER_SIZE 3
+#define BLE_FRAG_LENGTH_SIZE 2 // Total length in the first fragment
+#define BLE_FRAG_LONG_LENGTH_SIZE 4
+#define BLE_FRAG_MAX_MESSAGE 0xFFFF // Longest length in 2 bytes
+
+enum BleFragmentFlags : uint8_t
+{
+    BLE_FRAG_FIRST = 0x01,
+    BLE_FRAG_MORE = 0x02,
+    BLE_FRAG_CREDIT = 0x04, // Control frame: payload[0] is the number of fragments granted
+    BLE_FRAG_LONG = 0x08    // First fragment: the length takes BLE_FRAG_LONG_LENGTH_SIZE bytes
+};
+
+enum BleReassembly : uint8_t
+{
+    BLE_REASSEMBLY_PENDING,
+    BLE_REASSEMBLY_COMPLETE,
+    BLE_REASSEMBLY_ERROR // The partial message was dropped
+};
+
+inline bool isBleFragment(const uint8_t *data, size_t length)
+{
+    return length >= BLE_FRAG_HEADER_SIZE && data[0] == BLE_FRAGMENT_MAGIC;
+}
+
+// Bytes of the length field in a message's first fragment
+inline size_t bleLengthSize(size_t length)
+{
+    return length > BLE_FRAG_MAX_MESSAGE ? BLE_FRAG_LONG_LENGTH_SIZE : BLE_FRAG_LENGTH_SIZE;
+}
+
+// Writes the first fragment's length field; returns its size
+size_t bleWriteLength(uint8_t *out, size_t length);
+
+// Splits one message into writes of at most `packetSize` bytes
+class BleFragmenter
+{
+private:
+    const uint8_t *data;
+    size_t length;
+    size_t offset;
+    uint16_t packetSize;
+    uint8_t &sequence;
+
+public:
+    BleFragmenter(const uint8_t *data, size_t length, uint16_t packetSize, uint8_t &sequence);
+
+    // False when the message goes out in one packet without a header
+    bool fragmented() const { return length > packetSize; }
+    bool done() const { return offset >= length; }
+    size_t fragmentCount() const;
+
+    // Writes the next packet into out (packetSize bytes) and returns its length
+    size_t next(uint8_t *out);
+};
+
+// Rebuilds fragmented messages in a caller-owned buffer
+class BleReassembler
+{
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    size_t expected;
+    uint8_t nextSequence;
+    bool active;
+    uint32_t dropped;
+
+    BleReassembly fail();
+
+public:
+    BleReassembler(uint8_t *buffer, size_t capacity);
+
+    void reset();
+    BleReassembly add(const uint8_t *fragment, size_t fragmentLength);
+    const uint8_t *data() const { return buffer; }
+    size_t size() const { return length; }
+    uint32_t getDropped() const { return dropped; } // Messages lost to gaps, overruns or bad headers
+};
+
+#endif // BLE_FRAMING_H
@@ -6,11 +6,22 @@
 #define BLE_MANAGER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <NimBLEDevice.h>
 #include <NimBLEServer.h>
 #include <NimBLEUtils.h>
 #include <NimBLEDescriptor.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <atomic>
 #include "config.h"
+#include "ble_framing.h"
+#include "ble_tx_queue.h"
+#include "json_stream.h"
+
+// Writes a streamed message into the sink; called once per send
+typedef void (*BleStreamProducer)(JsonSink &sink, void *context);
 
 class BLEManager
 {
@@ -20,7 +31,44 @@ private:
     NimBLECharacteristic *pCharacteristic;
     bool deviceConnected;
     bool oldDeviceConnected;
-    std::function<void(const String &)> commandCallback;
+    uint8_t protocolVersion; // Binary protocol version negotiated on this connection, 0 = JSON only
+    char address[18];        // Own address, fixed once the stack is up
+    std::function<void(const char *, size_t)> commandCallback;
+    std::function<void(const uint8_t *, size_t)> binaryCallback;
+
+    // Transfer layer (ble_framing.h). Sends hold sendMutex so the fragments
+    // of two messages never interleave; receive state lives on the BLE host.
+    // onConnect() only bumps the generation: a sender restarts its framing
+    // for a new connection and abandons a message begun on an older one
+    volatile uint16_t mtu; // Negotiated ATT MTU of this connection
+    std::atomic<uint32_t> connectionGeneration;
+    uint32_t txGeneration; // Connection the current message is framed for
+    uint8_t txSequence;
+    uint8_t txPacket[BLE_MAX_MTU - BLE_ATT_OVERHEAD];
+    SemaphoreHandle_t sendMutex;
+    volatile bool flowControl; // The central grants credits
+    std::atomic<int32_t> credits;
+    uint8_t rxMessage[CMD_MAX_SIZE];
+    BleReassembler rxAssembler;
+    bool takeCredit();
+    void beginMessage(); // Under sendMutex, before the first packet
+    bool transmit(const uint8_t *data, size_t length);
+    bool sendPacket(size_t length); // txPacket, once a credit is granted
+    class StreamSink;
+    void dispatchWrite(const uint8_t *data, size_t length);
+
+    // Outbound queue (ble_tx_queue.h) drained by the BLE task; senders
+    // only copy into it under queueMutex
+    uint8_t txReplyBuffer[BLE_TX_REPLY_QUEUE_BYTES];
+    uint8_t txEventBuffer[BLE_TX_EVENT_QUEUE_BYTES];
+    BleTxQueue txQueue;
+    SemaphoreHandle_t queueMutex;
+    TaskHandle_t txTask;
+    volatile bool notifyFailed; // Set by onStatus when the host rejects a notification
+    TaskHandle_t volatile hostTask; // Set while a write is dispatched: replies sent from it must not wait
+    static void taskLoop(void *parameter);
+    bool enqueue(BleTxLane lane, const uint8_t *data, size_t length, uint8_t key, uint32_t waitMs);
+    bool waitForReplies(); // Until the BLE task has sent every queued reply
 
     class ServerCallbacks : public NimBLEServerCallbacks
     {
@@ -30,6 +78,7 @@ private:
         ServerCallbacks(BLEManager *mgr) : manager(mgr) {}
         void onConnect(NimBLEServer *pServer);
         void onDisconnect(NimBLEServer *pServer);
+        void onMTUChange(uint16_t MTU, ble_gap_conn_desc *desc);
     };
 
     class CharacteristicCallbacks : public NimBLECharacteristicCallbacks
@@ -39,6 +88,7 @@ private:
     public:
         CharacteristicCallbacks(BLEManager *mgr) : manager(mgr) {}
         void onWrite(NimBLECharacteristic *pCharacteristic);
+        void onStatus(NimBLECharacteristic *pCharacteristic, Status s, int code);
     };
 
     ServerCallbacks *serverCallbacks;
@@ -51,17 +101,44 @@ public:
     bool begin();
     void update();
 
+    // Sends from a dedicated task fed by the outbound queue; without it
+    // messages are sent inline by the caller
+    bool startTask();
+    uint32_t getStackHighWaterMark();
+
     // Connection management
     bool isConnected() { return deviceConnected; }
     void disconnect();
     String getDeviceAddress();
 
-    // Communication methods
+    // Communication methods; messages longer than one packet are fragmented.
+    // Replies are queued ahead of notifications, which replace any unsent
+    // notification with the same coalesce key. False if the message was
+    // dropped: the queue is full or, when sent inline, not connected. A
+    // reply waits for room in the queue, except from the write callback,
+    // where waiting would stall the BLE host the queue is waiting on
     bool sendResponse(const String &response);
-    bool sendNotification(const String &notification);
-    void setCommandCallback(std::function<void(const String &)> callback);
+    bool sendResponse(const uint8_t *data, size_t length);
+    bool sendNotification(const String &notification, uint8_t coalesceKey = BLE_TX_NO_COALESCE);
+    bool sendNotification(const uint8_t *data, size_t length, uint8_t coalesceKey = BLE_TX_NO_COALESCE);
+
+    // Sends a reply of `length` bytes as `produce` writes it, packet by
+    // packet on the caller's task, so it is never held whole or queued.
+    // Replies already queued are sent first; the caller waits for them.
+    // Bytes past `length` are cut and a short reply is padded with spaces.
+    // A stream that fails is counted as a dropped reply, not resent
+    bool sendStream(size_t length, BleStreamProducer produce, void *context);
+    uint16_t getMTU() { return mtu; }
+    // JSON writes, as received: not NUL-terminated
+    void setCommandCallback(std::function<void(const char *, size_t)> callback);
+
+    // Writes starting with BIN_MAGIC go to the binary callback untouched
+    void setBinaryCallback(std::function<void(const uint8_t *, size_t)> callback);
+    uint8_t getProtocolVersion() { return protocolVersion; }
+    void setProtocolVersion(uint8_t version) { protocolVersion = version; }
 
     // Status methods
+    void getStatus(JsonObject status); // State only; its metrics render separately
     String getStatus();
     void startAdvertising();
     void stopAdvertising();
@@ -0,0 +1,98 @@
+/**
+ * BLE Transmit Queue - Outbound messages waiting for the connection
+ *
+ * Two lanes of fixed byte rings: command replies are always sent before
+ * event notifications. Each message is stored whole and contiguous
+ *   [0..1] length (little endian)  [2] coalesce key  [3] state  [4..] data
+ * so the BLE task can fragment it straight out of the ring. An event
+ * queued with a coalesce key replaces any unsent event with the same key;
+ * the replaced entry becomes a tombstone that is skipped when it reaches
+ * the front. Not thread safe: BLEManager serializes access.
+ */
+
+#ifndef BLE_TX_QUEUE_H
+#define BLE_TX_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLE_TX_ENTRY_HEADER 4
+#define BLE_TX_NO_COALESCE 0 // Key for messages that are never replaced
+
+enum BleTxLane : uint8_t
+{
+    BLE_LANE_REPLY, // Answers to commands, drained first
+    BLE_LANE_EVENT, // Unsolicited notifications
+    BLE_LANE_COUNT
+};
+
+struct BleTxMessage
+{
+    const uint8_t *data;
+    size_t length;
+    BleTxLane lane;
+};
+
+class BleTxRing
+{
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t head; // Oldest entry
+    size_t tail; // Next write
+    size_t used; // Bytes between head and tail, including skipped space at the end
+    uint16_t count; // Entries including replaced ones not yet skipped
+    uint16_t live;
+    bool inFlight; // The head entry is being sent and must not move
+
+    size_t wrap(size_t offset) const;
+    size_t entryLength(size_t offset) const;
+    void skipDead();
+
+public:
+    BleTxRing(uint8_t *buffer, size_t capacity);
+
+    void clear();
+    bool push(const uint8_t *data, size_t length, uint8_t key, uint16_t &replaced);
+    bool front(const uint8_t *&data, size_t &length);
+    void pop();
+    void release() { inFlight = false; }
+
+    bool empty() const { return live == 0; }
+    uint16_t size() const { return live; }
+    size_t bytesUsed() const { return used; }
+};
+
+class BleTxQueue
+{
+private:
+    BleTxRing lanes[BLE_LANE_COUNT];
+    size_t peakBytes;
+    uint32_t queued;
+    uint32_t dropped[BLE_LANE_COUNT];
+    uint32_t coalesced;
+
+public:
+    BleTxQueue(uint8_t *replyBuffer, size_t replySize, uint8_t *eventBuffer, size_t eventSize);
+
+    // False when the lane has no room for the message; a sender that gives
+    // up on it reports that with countDropped()
+    bool push(BleTxLane lane, const uint8_t *data, size_t length, uint8_t key = BLE_TX_NO_COALESCE);
+    void countDropped(BleTxLane lane) { dropped[lane]++; }
+
+    // Oldest message of the highest-priority lane; it stays queued, and is
+    // never coalesced away, until pop() or requeue()
+    bool front(BleTxMessage &message);
+    void pop(BleTxLane lane);
+    void requeue(BleTxLane lane); // Leave the message at the front for another attempt
+
+    bool empty(BleTxLane lane) const { return lanes[lane].empty(); } // Popped, not just taken by front()
+    uint16_t getQueued() const;
+    size_t getBytesUsed() const;
+    size_t getPeakBytes() const { return peakBytes; }
+    uint32_t getTotalQueued() const { return queued; }
+    uint32_t getDropped(BleTxLane lane) const { return dropped[lane]; }
+    uint32_t getCoalesced() const { return coalesced; }
+};
+
+#endif // BLE_TX_QUEUE_H
@@ -0,0 +1,87 @@
+/**
+ * Capture Pool - Fixed set of raw timing buffers
+ *
+ * Learned captures, decoded IR code JSON and queued raw transmissions keep
+ * their timings in CAPTURE_POOL_BUFFERS buffers of MAX_IR_CODE_SIZE words,
+ * allocated once by begin() (from PSRAM when the board has it). A RawBuffer
+ * is a reference-counted handle: copies share the same timings and the
+ * buffer goes back to the pool with the last handle, so a capture is never
+ * copied on its way to the caller or the transmitter and nothing is
+ * allocated per capture.
+ */
+
+#ifndef CAPTURE_POOL_H
+#define CAPTURE_POOL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+#define CAPTURE_NONE 0xFF // Buffer index of an empty handle
+
+static_assert(CAPTURE_POOL_BUFFERS < CAPTURE_NONE, "buffer indexes must fit a byte");
+
+class CapturePool;
+
+class RawBuffer
+{
+private:
+    CapturePool *pool;
+    uint8_t index;
+
+    friend class CapturePool;
+    RawBuffer(CapturePool *p, uint8_t i) : pool(p), index(i) {}
+
+public:
+    RawBuffer() : pool(nullptr), index(CAPTURE_NONE) {}
+    RawBuffer(const RawBuffer &other);
+    RawBuffer(RawBuffer &&other) : pool(other.pool), index(other.index) { other.pool = nullptr; }
+    RawBuffer &operator=(const RawBuffer &other);
+    RawBuffer &operator=(RawBuffer &&other);
+    ~RawBuffer() { reset(); }
+
+    explicit operator bool() const { return pool != nullptr; }
+    uint16_t *data() const;
+    void reset();
+
+    // Plain-data form for FreeRTOS queues: detach() hands the reference to
+    // the returned index, CapturePool::adopt() takes it back
+    uint8_t detach();
+};
+
+class CapturePool
+{
+private:
+    uint16_t *storage;
+    bool psram;
+    std::atomic<uint8_t> refs[CAPTURE_POOL_BUFFERS];
+    std::atomic<uint8_t> used;
+    std::atomic<uint8_t> peak;
+    std::atomic<uint32_t> acquisitions;
+    std::atomic<uint32_t> failures;
+
+    friend class RawBuffer;
+    void retain(uint8_t index) { refs[index].fetch_add(1); }
+    void release(uint8_t index);
+
+public:
+    CapturePool();
+    ~CapturePool();
+
+    bool begin();
+
+    // An empty handle when every buffer is referenced
+    RawBuffer acquire();
+    RawBuffer adopt(uint8_t index);
+    uint16_t *buffer(uint8_t index) { return storage + (size_t)index * MAX_IR_CODE_SIZE; }
+
+    // Status
+    uint8_t getCapacity() const { return CAPTURE_POOL_BUFFERS; }
+    uint8_t getUsed() const { return used; }
+    uint8_t getPeakUsed() const { return peak; }
+    uint32_t getAcquisitions() const { return acquisitions; }
+    uint32_t getFailures() const { return failures; }
+    bool inPsram() const { return psram; }
+};
+
+#endif // CAPTURE_POOL_H
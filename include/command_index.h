@@ -0,0 +1,139 @@
+/**
+ * Command Index - Hashed lookup of devices and commands by name
+ *
+ * Open-addressing table (linear probing, tombstone deletion) mapping a
+ * name hash to a 16-bit storage slot. Device entries carry
+ * INDEX_DEVICE_ENTRY in the slot so one table serves both kinds of key.
+ * The table only stores a 16-bit tag of each hash, so callers confirm a
+ * candidate by comparing names in the match callback. Entries are 4 bytes;
+ * Capacity must be a power of two.
+ */
+
+#ifndef COMMAND_INDEX_H
+#define COMMAND_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define INDEX_NONE 0xFF
+#define INDEX_DEVICE_ENTRY 0x8000 // Flag on device entries; command slots stay below it
+
+// FNV-1a; command keys continue the device hash after a 0 separator
+inline uint32_t indexHash(const char *data, size_t length, uint32_t hash = 2166136261u)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t indexHash(const char *device, size_t deviceLength, const char *command, size_t commandLength)
+{
+    uint32_t hash = indexHash(device, deviceLength);
+    hash = (hash ^ 0) * 16777619u;
+    return indexHash(command, commandLength, hash);
+}
+
+// Smallest power of two holding `entries` at no more than two-thirds load
+constexpr size_t indexCapacityFor(size_t entries, size_t capacity = 16)
+{
+    return capacity * 2 >= entries * 3 ? capacity : indexCapacityFor(entries, capacity * 2);
+}
+
+template <size_t Capacity>
+class CommandIndex
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    static const uint16_t EMPTY = 0xFFFF;
+    static const uint16_t TOMBSTONE = 0xFFFE;
+
+    struct Entry
+    {
+        uint16_t tag;
+        uint16_t slot;
+    };
+
+    Entry entries[Capacity];
+    size_t used;
+    size_t tombstones;
+
+    static uint16_t tagOf(uint32_t hash) { return hash >> 16; }
+
+public:
+    CommandIndex() { clear(); }
+
+    void clear()
+    {
+        memset(entries, 0xFF, sizeof(entries));
+        used = 0;
+        tombstones = 0;
+    }
+
+    // Calls match(slot) for each candidate with a matching tag
+    template <typename Match>
+    bool find(uint32_t hash, Match match, uint16_t &slot) const
+    {
+        for (size_t i = 0, pos = hash & (Capacity - 1); i < Capacity; i++, pos = (pos + 1) & (Capacity - 1))
+        {
+            const Entry &entry = entries[pos];
+            if (entry.slot == EMPTY)
+                return false;
+            if (entry.slot != TOMBSTONE && entry.tag == tagOf(hash) && match(entry.slot))
+            {
+                slot = entry.slot;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool insert(uint32_t hash, uint16_t slot)
+    {
+        if (used + tombstones + 1 >= Capacity)
+            return false;
+
+        for (size_t pos = hash & (Capacity - 1);; pos = (pos + 1) & (Capacity - 1))
+        {
+            Entry &entry = entries[pos];
+            if (entry.slot == EMPTY || entry.slot == TOMBSTONE)
+            {
+                if (entry.slot == TOMBSTONE)
+                    tombstones--;
+                entry.tag = tagOf(hash);
+                entry.slot = slot;
+                used++;
+                return true;
+            }
+        }
+    }
+
+    bool remove(uint32_t hash, uint16_t slot)
+    {
+        for (size_t i = 0, pos = hash & (Capacity - 1); i < Capacity; i++, pos = (pos + 1) & (Capacity - 1))
+        {
+            Entry &entry = entries[pos];
+            if (entry.slot == EMPTY)
+                return false;
+            if (entry.slot == slot && entry.tag == tagOf(hash))
+            {
+                entry.slot = TOMBSTONE;
+                used--;
+                tombstones++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Probe chains degrade as tombstones build up; the owner rebuilds when this is set
+    bool needsRebuild() const { return tombstones > Capacity / 4; }
+    size_t size() const { return used; }
+    static size_t capacity() { return Capacity; }
+};
+
+#endif // COMMAND_INDEX_H
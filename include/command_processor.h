@@ -7,10 +7,17 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
 #include "config.h"
 #include "ir_manager.h"
 #include "ble_manager.h"
 #include "device_manager.h"
+#include "binary_protocol.h"
+#include "command_table.h"
+#include "trace.h"
 
 class CommandProcessor
 {
@@ -19,21 +26,165 @@ private:
     BLEManager *bleManager;
     DeviceManager *deviceManager;
 
-    // Command handlers
+    // Command task input: raw BLE commands, plus completions posted back by the IR task
+    enum MessageType : uint8_t
+    {
+        MSG_COMMAND,
+        MSG_BINARY,
+        MSG_TRANSMIT_DONE,
+        MSG_BATCH_DONE,
+        MSG_LEARN_DONE,
+        MSG_CODE_SEEN,
+        MSG_TRACE_DUMP
+    };
+
+    struct CommandMessage
+    {
+        MessageType type;
+        uint8_t slot;
+        bool success;
+        uint32_t jobId;
+        decode_type_t protocol;
+        uint64_t value;
+        uint16_t bits;
+        uint16_t length;
+#if TRACE_ENABLED
+        uint32_t postedCycles; // For the queue stage of the request trace
+#endif
+        alignas(uint16_t) char data[CMD_MAX_SIZE]; // Also the timings of a sighting
+    };
+
+    // A TRANSMIT waiting for the IR task; holds what the reply needs
+    struct PendingTransmit
+    {
+        CommandProcessor *owner;
+        bool inUse;
+        bool success;
+        bool binary;
+        uint16_t requestId;
+        char replyTo[REQUEST_ID_MAX_SIZE + 1];
+        char device[MAX_DEVICE_NAME + 1];
+        char command[MAX_DEVICE_NAME + 1];
+#if TRACE_ENABLED
+        TraceRecord trace; // The request, parked until the IR task is done
+#endif
+    };
+
+    // A BATCH or RUN_MACRO: its plan is compiled here and sent by the IR
+    // task as one job, then answered with one aggregate reply
+    struct PendingBatch
+    {
+        CommandProcessor *owner;
+        bool inUse;
+        bool success;
+        unsigned long startedAt;
+        char replyTo[REQUEST_ID_MAX_SIZE + 1];
+        char macro[MAX_DEVICE_NAME + 1]; // Empty for BATCH
+        IRPlan plan;
+#if TRACE_ENABLED
+        TraceRecord trace;
+#endif
+    };
+
+    TaskHandle_t commandTask;
+    QueueHandle_t commandQueue;
+    PendingTransmit pendingTransmits[IR_QUEUE_LENGTH];
+    PendingBatch pendingBatches[BATCH_MAX_PENDING];
+
+    // requestId of the JSON command being handled, kept serialized so it is
+    // echoed verbatim; empty when the command had none. Replies that
+    // complete later (TRANSMIT, LEARN_RESULT) keep their own copy
+    char replyTo[REQUEST_ID_MAX_SIZE + 1];
+    char learnReplyTo[REQUEST_ID_MAX_SIZE + 1];
+    uint32_t learnJobId;
+
+    // Monitor sightings in the command queue; what became of them is
+    // counted in the metrics registry
+    std::atomic<uint8_t> pendingSightings;
+    static bool readRequestId(JsonVariantConst id, char *out);
+    static void peekRequestId(const char *json, size_t length, char *out);
+
+    static void taskLoop(void *parameter);
+    bool postCommand(MessageType type, const char *data, size_t length);
+    PendingTransmit *claimPendingTransmit();
+    static void onTransmitComplete(void *context, bool success);
+    void finishTransmit(PendingTransmit &pending);
+    bool parseSteps(JsonVariantConst steps, MacroStep *out, uint8_t &count);
+    void runSteps(const MacroStep *steps, uint8_t count, const char *macro);
+    static void onBatchComplete(void *context, bool success);
+    void finishBatch(PendingBatch &pending);
+    static void onLearnComplete(void *context, uint32_t jobId, const IRCode *code);
+    void finishLearn(uint32_t jobId, const IRCode *code);
+    static void onCodeSeen(void *context, const IRCode &code);
+    void finishCodeSeen(const IRCode &code);
+    static void describeLearnReport(const IRLearnReport &report, JsonDocument &data);
+
+    // Command handlers, reached through the command table
+    void dispatchCommand(const JsonDocument &cmd);
     void handleLearnCommand(const JsonDocument &cmd);
+    void handleStopLearnCommand(const JsonDocument &cmd);
     void handleTransmitCommand(const JsonDocument &cmd);
     void handleListDevicesCommand(const JsonDocument &cmd);
+    void handleExportDevicesCommand(const JsonDocument &cmd);
     void handleAddDeviceCommand(const JsonDocument &cmd);
     void handleDeleteDeviceCommand(const JsonDocument &cmd);
+    void handleBatchCommand(const JsonDocument &cmd);
+    void handleAddMacroCommand(const JsonDocument &cmd);
+    void handleRunMacroCommand(const JsonDocument &cmd);
+    void handleDeleteMacroCommand(const JsonDocument &cmd);
+    void handleListMacrosCommand(const JsonDocument &cmd);
+    void handleMonitorCommand(const JsonDocument &cmd);
+    void handleTraceCommand(const JsonDocument &cmd);
     void handleGetStatusCommand(const JsonDocument &cmd);
     void handleResetCommand(const JsonDocument &cmd);
 
-    // Response helpers
-    void sendResponse(const String &status, const String &message = "", DynamicJsonDocument *data = nullptr);
-    void sendError(const String &error, const String &details = "");
+    // Binary protocol handlers
+    void handleBinaryHello(const BinaryFrame &frame);
+    void handleBinaryResolve(const BinaryFrame &frame);
+    void handleBinaryTransmit(const BinaryFrame &frame);
+    void handleBinaryPing(const BinaryFrame &frame);
+    void handleBinaryMetrics(const BinaryFrame &frame);
+    void sendBinary(const BinaryWriter &writer);
+    void sendBinaryStatus(uint8_t opcode, uint16_t requestId, uint8_t status);
 
-    // Validation helpers
-    bool validateCommand(const JsonDocument &cmd, const String requiredFields[], int fieldCount);
+    // Response helpers; requestId defaults to the command being handled.
+    // Documents and the serialized reply come from the request arena
+    // (request_arena.h), so these run on the command task only
+    void sendResponse(const char *status, const char *message = "", JsonDocument *data = nullptr, const char *event = nullptr, const char *requestId = nullptr);
+    void sendError(const char *error, const char *details = "", const char *requestId = nullptr);
+    void sendRejection(const char *error, const char *details, const char *requestId); // From the BLE task
+
+    // Replies whose data is written from the device store straight into
+    // the BLE packets (json_stream.h); the body runs twice, to measure and
+    // to send, so it must not depend on anything that changes in between
+    typedef void (*StreamBody)(DeviceManager &devices, JsonStreamWriter &writer, uint32_t timestamp);
+    struct StreamReply
+    {
+        CommandProcessor *processor;
+        const char *message;
+        StreamBody body;
+        uint32_t timestamp;
+    };
+    static void writeStreamReply(JsonSink &sink, void *context);
+    void sendStreamResponse(const char *message, StreamBody body);
+
+public:
+    // The JSON command set (command_table.h): one entry per command, found
+    // through a perfect hash of the names built at compile time. Its
+    // parameters are checked against the entry before the handler runs
+    typedef void (CommandProcessor::*CommandHandler)(const JsonDocument &cmd);
+    struct CommandSpec
+    {
+        const char *name;
+        CommandHandler handler;
+        TraceCommand trace;
+        const char *missing; // MISSING_PARAMETERS details; nullptr when the parameters object is optional
+        CommandParam params[COMMAND_MAX_PARAMS];
+    };
+    static const CommandSpec *findCommand(const char *name);
+
+private:
+    static const CommandSpec commands[];
 
 public:
     CommandProcessor();
@@ -42,8 +193,23 @@ public:
     void begin(IRManager *ir, BLEManager *ble, DeviceManager *device);
     void update();
 
+    // Processes commands on a dedicated task fed by a bounded queue
+    bool startTask();
+    uint32_t getStackHighWaterMark();
+
+    // Entry point for the BLE write callback: queues the command, or
+    // processes it inline when the command task is not running
+    bool enqueueCommand(const char *json, size_t length);
+    bool enqueueCommand(const String &commandJson) { return enqueueCommand(commandJson.c_str(), commandJson.length()); }
+    bool enqueueBinary(const uint8_t *data, size_t length);
+
     // Main command processing
-    void processCommand(const String &commandJson);
+    void processCommand(const char *json, size_t length);
+    void processCommand(const String &commandJson) { processCommand(commandJson.c_str(), commandJson.length()); }
+    void processBinary(const uint8_t *data, size_t length);
+
+    // Prints the request trace to Serial, from the command task
+    void dumpTrace();
 
     // Status methods
     String getStatus();
@@ -0,0 +1,149 @@
+/**
+ * Command Table - Compile-time dispatch and parameter schema for JSON commands
+ *
+ * The command set is one constexpr array of entries, each with a `name` and
+ * the parameters it takes. From it, CommandHash finds a seed at compile
+ * time for which the FNV-1a hash of every name lands in its own slot,
+ * and lays the slots out in flash. A lookup is one hash, one slot read and
+ * one strcmp to turn away names that are not commands. checkParameters()
+ * then holds the command's parameters against their declared types before
+ * the handler runs.
+ *
+ * Written as C++11 constexpr (recursion, no loops) for the ESP32 toolchain.
+ * Callers static_assert found(): no seed below MAX_SEED may fit a table.
+ */
+
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+#define COMMAND_MAX_PARAMS 4
+#define COMMAND_SLOT_EMPTY 0xFF
+
+enum CommandParamType : uint8_t
+{
+    PARAM_STRING,
+    PARAM_INTEGER,
+    PARAM_BOOLEAN,
+    PARAM_ARRAY,
+    PARAM_OBJECT
+};
+
+// Unused trailing entries have a null name
+struct CommandParam
+{
+    const char *name;
+    CommandParamType type;
+    bool required;
+};
+
+enum CommandParamCheck : uint8_t
+{
+    PARAMS_OK,
+    PARAMS_MISSING,   // No parameters object where one is needed, or a required one absent
+    PARAMS_WRONG_TYPE // `failed` has the wrong type
+};
+
+// needsObject: the command takes no request without a parameters object
+CommandParamCheck checkParameters(JsonVariantConst parameters, const CommandParam *params, bool needsObject, const CommandParam *&failed);
+const char *commandParamTypeName(CommandParamType type);
+
+// FNV-1a as indexHash() (command_index.h) computes it, at compile time and in lookups
+constexpr uint32_t commandNameHash(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name ? commandNameHash(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+constexpr size_t commandSlot(uint32_t hash, uint32_t seed, size_t slots)
+{
+    return ((hash ^ seed) * 2654435761u >> 16) & (slots - 1);
+}
+
+// Smallest power of two at least four times `entries`, so a seed turns up early
+constexpr size_t commandSlotsFor(size_t entries, size_t slots = 8)
+{
+    return slots >= entries * 4 ? slots : commandSlotsFor(entries, slots * 2);
+}
+
+template <size_t... Slot>
+struct CommandSlotList
+{
+};
+
+template <size_t Count, size_t... Slot>
+struct MakeCommandSlots : MakeCommandSlots<Count - 1, Count - 1, Slot...>
+{
+};
+
+template <size_t... Slot>
+struct MakeCommandSlots<0, Slot...>
+{
+    typedef CommandSlotList<Slot...> type;
+};
+
+template <typename Entry, size_t Count>
+class CommandHash
+{
+public:
+    static const size_t SLOTS = commandSlotsFor(Count);
+    static const uint32_t MAX_SEED = 256;
+
+    static_assert(Count < COMMAND_SLOT_EMPTY, "entry numbers fit a slot");
+
+    uint32_t seed;
+    uint8_t slots[SLOTS];
+
+    static constexpr CommandHash build(const Entry (&table)[Count])
+    {
+        return layout(table, findSeed(table, 0), typename MakeCommandSlots<SLOTS>::type());
+    }
+
+    constexpr bool found() const { return seed < MAX_SEED; }
+
+    // The entry named `name`, or nullptr
+    const Entry *find(const Entry (&table)[Count], const char *name) const
+    {
+        uint8_t entry = slots[commandSlot(commandNameHash(name), seed, SLOTS)];
+        return entry != COMMAND_SLOT_EMPTY && strcmp(table[entry].name, name) == 0 ? &table[entry] : nullptr;
+    }
+
+private:
+    static constexpr size_t slotOf(const Entry (&table)[Count], size_t entry, uint32_t seed)
+    {
+        return commandSlot(commandNameHash(table[entry].name), seed, SLOTS);
+    }
+
+    static constexpr bool clashes(const Entry (&table)[Count], uint32_t seed, size_t entry, size_t other)
+    {
+        return other < entry && (slotOf(table, entry, seed) == slotOf(table, other, seed) || clashes(table, seed, entry, other + 1));
+    }
+
+    static constexpr bool perfect(const Entry (&table)[Count], uint32_t seed, size_t entry = 0)
+    {
+        return entry >= Count || (!clashes(table, seed, entry, 0) && perfect(table, seed, entry + 1));
+    }
+
+    // MAX_SEED when there is none
+    static constexpr uint32_t findSeed(const Entry (&table)[Count], uint32_t seed)
+    {
+        return seed >= MAX_SEED || perfect(table, seed) ? seed : findSeed(table, seed + 1);
+    }
+
+    static constexpr uint8_t entryAt(const Entry (&table)[Count], uint32_t seed, size_t slot, size_t entry = 0)
+    {
+        return entry >= Count ? COMMAND_SLOT_EMPTY : slotOf(table, entry, seed) == slot ? entry
+                                                                                         : entryAt(table, seed, slot, entry + 1);
+    }
+
+    template <size_t... Slot>
+    static constexpr CommandHash layout(const Entry (&table)[Count], uint32_t seed, CommandSlotList<Slot...>)
+    {
+        return CommandHash{seed, {entryAt(table, seed, Slot)...}};
+    }
+};
+
+#endif // COMMAND_TABLE_H
@@ -19,23 +19,110 @@
 #define IR_FREQUENCY 38000   // 38 kHz carrier frequency
 #define IR_DUTY_CYCLE 33     // 33% duty cycle
 #define IR_TIMEOUT_MS 15000  // 15 second timeout for learning
+#define IR_LEARN_MAX_TIMEOUT_MS 60000 // Longest timeout LEARN accepts
 #define MAX_IR_CODE_SIZE 512 // Maximum IR code length
+#define CAPTURE_POOL_BUFFERS 8 // Raw timing buffers shared by captures and queued transmits
+#define RAW_CODEC_TICK_US 2              // Raw timings are quantized to the receiver tick (kRawTick)
+#define RAW_CODEC_TOLERANCE_PERCENT 10   // Durations this close to a neighbour share a dictionary entry
+#define RAW_CODEC_MAX_SPREAD_PERCENT 40  // Widest entry before falling back to exact durations
+#define IR_TX_RMT 1                // Transmit through the RMT peripheral; 0 bit-bangs with IRsend
+#define IR_RMT_CHANNEL 0
+#define IR_RMT_CLK_DIV 80          // 1 us RMT ticks from the 80 MHz APB clock
+#define IR_RMT_MEM_BLOCKS 2        // 64-item RMT memory blocks; longer streams are refilled by the driver
+#define IR_RMT_TX_TIMEOUT_MS 1000  // Wait past a waveform's own duration before the send fails
+#define IR_WAVE_CACHE_ENTRIES 8    // Compiled waveforms kept for codes sent again
+#define IR_RX_RMT 1                // Receive through the RMT peripheral; 0 polls IRrecv
+#define IR_RMT_RX_CHANNEL 2        // After the transmitter's memory blocks
+#define IR_RMT_RX_MEM_BLOCKS 4     // 256 items: a MAX_IR_CODE_SIZE capture in one frame
+#define IR_RMT_RX_IDLE_US 8000     // Silence that ends a frame; under Sony's 10 ms repeat gap
+#define IR_RMT_RX_FILTER_CYCLES 200 // APB cycles (2.5 us); shorter glitches are ignored
+#define IR_RMT_RX_BUFFER_BYTES 4096 // Driver ring buffer between the RX interrupt and the IR task
+#define IR_CAPTURE_RING_FRAMES 8   // Captured frames waiting to be decoded
+#define IR_REPEAT_WINDOW_MS 150    // The same code again this soon is a held button, not a new press
+#define IR_LEARN_MAX_FRAMES 4      // Repeats of an undecoded frame averaged into one learned code
+#define IR_CANON_FRAME_GAP_US 8000 // Spaces this long separate the frames of a capture
+#define IR_CANON_TOLERANCE_PERCENT 25 // Durations this close are one duration; frames this close are repeats
+#define IR_CANON_GRID_US 10        // Canonical durations are multiples of this
+#define IR_CANON_REPEAT_TIMINGS 4  // Frames this short after the first are repeat codes
+#define IR_LEARN_MAX_CAPTURES 8    // Presses a learn job takes before giving up on agreement
+#define IR_LEARN_MAX_GROUPS 3      // Distinct codes a learn job keeps timings for
+#define IR_LEARN_AGREE_PERCENT 60  // Share of the presses that must agree on one code
 
 // BLE Configuration
 #define DEVICE_NAME "ESPIR-Device"
 #define SERVICE_UUID "12345678-1234-1234-1234-123456789abc"
 #define CHARACTERISTIC_UUID "87654321-4321-4321-4321-cba987654321"
-#define BLE_TIMEOUT_MS 30000 // 30 second BLE timeout
+#define BLE_TIMEOUT_MS 30000          // 30 second BLE timeout
+#define BLE_MAX_MTU 517               // Requested at init; the central settles the connection's MTU
+#define BLE_FLOW_TIMEOUT_MS 1000      // Longest wait for a flow-control credit before a message is abandoned
+#define BLE_TX_REPLY_QUEUE_BYTES 4096 // Outbound ring for command replies
+#define BLE_TX_EVENT_QUEUE_BYTES 2048 // Outbound ring for event notifications, drained after replies
+#define BLE_TX_QUEUE_WAIT_MS 50       // How long a reply waits for ring space before it is dropped
+#define BLE_TX_RETRY_MS 5             // Back-off when the host is out of notification buffers
+#define BLE_TX_MAX_RETRIES 20         // Attempts per packet before the message is abandoned
 
 // Device Management
 #define MAX_DEVICES 50     // Maximum number of stored devices
 #define MAX_DEVICE_NAME 32 // Maximum device name length
 #define MAX_COMMANDS 20    // Maximum commands per device
+#define MAX_MACROS 16      // Stored BATCH sequences
+
+// Batches (BATCH / RUN_MACRO)
+#define BATCH_MAX_STEPS 16        // Device/command pairs in one batch or macro
+#define BATCH_MAX_REPEAT 10       // Sends of one step
+#define BATCH_MAX_DELAY_MS 10000  // Longest pause after a step
+#define BATCH_REPEAT_GAP_MS 40    // Between repeated sends of one step
+#define BATCH_PLAN_RAW_BYTES 1024 // Encoded raw timings held by one compiled plan
+#define BATCH_MAX_PENDING 2       // Batches queued or running at once
+
+// Device Store (fixed-capacity tables shared by all devices)
+#define STORE_MAX_COMMANDS (MAX_DEVICES * MAX_COMMANDS) // Command slab size
+#define STORE_MAX_STRINGS 1024                          // Interned name/description handles
+#define STORE_STRING_POOL_SIZE 8192                     // String arena bytes
+#define STORE_RAW_ARENA_SIZE 8192                       // Raw timing words (uint16_t), 16 KB
+#define STORE_RAW_SPARE (MAX_IR_CODE_SIZE + 2)          // Words new commands leave free for loads to copy into
 
 // Memory Configuration
-#define EEPROM_SIZE 4096 // EEPROM size for device storage
+#define EEPROM_SIZE 4096 // Legacy device storage, migrated to LittleFS at boot
 #define CONFIG_ADDR 0    // Configuration start address
 
+// Flash Storage (LittleFS)
+#define STORAGE_DIR "/espir"                          // Device record directory
+#define STORAGE_MANIFEST STORAGE_DIR "/devices.bin"   // Device metadata, read at boot
+#define STORAGE_LOG STORAGE_DIR "/wal.bin"             // Mutations since the manifest was written
+#define STORAGE_MACROS STORAGE_DIR "/macros.bin"      // Stored macros, rewritten with the manifest
+#define STORAGE_FORMAT_VERSION 3                      // Record layout version
+#define STORAGE_LOG_BUFFER_SIZE 2048                  // RAM log buffer; two are kept, one filling, one flushing
+#define STORAGE_LOG_COMPACT_BYTES 16384               // Fold the log into new records past this size
+
+// Task Configuration (ESP32: NimBLE host runs on core 0, Arduino loop on core 1)
+#define IR_TASK_CORE 1              // IR capture and transmit, away from the BLE stack
+#define IR_TASK_PRIORITY 5
+#define IR_TASK_STACK_SIZE 4096
+#define IR_TASK_POLL_MS 5           // Receiver poll interval while idle
+#define IR_QUEUE_LENGTH 4           // Pending transmissions
+#define CMD_TASK_CORE 0
+#define CMD_TASK_PRIORITY 3
+#define CMD_TASK_STACK_SIZE 8192
+#define CMD_QUEUE_LENGTH 8          // Pending BLE commands
+#define IR_MONITOR_MAX_PENDING 2    // Queue slots monitor sightings may hold; the rest stay free for commands
+#define CMD_MAX_SIZE 1024           // Largest accepted command payload in bytes; a full BATCH fits
+#define REQUEST_ID_MAX_SIZE 40      // Longest echoed requestId, serialized (string quotes included)
+#define REQUEST_ARENA_SIZE 12288    // Per-command JSON documents and scratch strings (request_arena.h)
+#define PERSIST_TASK_CORE 0
+#define PERSIST_TASK_PRIORITY 1
+#define PERSIST_TASK_STACK_SIZE 4096
+#define PERSIST_DEBOUNCE_MS 250     // Coalesce bursts of mutations into one commit
+#define BLE_TASK_CORE 0             // Drains the outbound BLE queue
+#define BLE_TASK_PRIORITY 4
+#define BLE_TASK_STACK_SIZE 4096
+
+// Request Tracing (trace.h); build with -DTRACE_ENABLED=0 to compile the probes out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+#define TRACE_RING_ENTRIES 16       // Last requests kept with their stage times, ~48 bytes each
+
 // Debug Configuration
 #ifdef DEBUG
 #define DEBUG_PRINT(x) Serial.print(x)
@@ -47,12 +134,21 @@
 
 // Protocol Commands
 #define CMD_LEARN "LEARN"
+#define CMD_STOP_LEARN "STOP_LEARN"
 #define CMD_TRANSMIT "TRANSMIT"
 #define CMD_LIST_DEVICES "LIST_DEVICES"
+#define CMD_EXPORT_DEVICES "EXPORT_DEVICES"
 #define CMD_ADD_DEVICE "ADD_DEVICE"
 #define CMD_DELETE_DEVICE "DELETE_DEVICE"
 #define CMD_GET_STATUS "GET_STATUS"
 #define CMD_RESET "RESET"
+#define CMD_BATCH "BATCH"
+#define CMD_ADD_MACRO "ADD_MACRO"
+#define CMD_RUN_MACRO "RUN_MACRO"
+#define CMD_DELETE_MACRO "DELETE_MACRO"
+#define CMD_LIST_MACROS "LIST_MACROS"
+#define CMD_MONITOR "MONITOR"
+#define CMD_TRACE "TRACE"
 
 // Response Codes
 #define RESP_OK "OK"
@@ -60,5 +156,11 @@
 #define RESP_TIMEOUT "TIMEOUT"
 #define RESP_NOT_FOUND "NOT_FOUND"
 #define RESP_INVALID "INVALID"
+#define RESP_CANCELLED "CANCELLED"
+#define RESP_MISMATCH "MISMATCH"
+
+// Notifications pushed without a matching command
+#define EVENT_LEARN_RESULT "LEARN_RESULT"
+#define EVENT_CODE_SEEN "CODE_SEEN"
 
 #endif // CONFIG_H
\ No newline at end of file
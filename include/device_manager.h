@@ -1,5 +1,12 @@
 /**
  * Device Manager - Handles device profiles and IR code storage
+ *
+ * Devices persist on LittleFS as a manifest of device metadata plus one
+ * record file per device holding its commands and raw timings. Mutations
+ * are appended to a write-ahead log instead of rewriting those records;
+ * the log is replayed at boot and folded back into the records once it
+ * grows. Only the manifest and the log are read at boot; a device's
+ * commands are loaded the first time they are needed.
  */
 
 #ifndef DEVICE_MANAGER_H
@@ -8,11 +15,23 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 #include "config.h"
 #include "ir_manager.h"
+#include "command_index.h"
+#include "device_store.h"
+#include "raw_codec.h"
+#include "ir_canonical.h"
+#include "json_stream.h"
 
+// Value types for passing devices and commands in and out; storage lives
+// in DeviceStore and holds no Strings
 struct IRCommand
 {
+    uint8_t id; // Stable within its device, assigned by addCommand()
     String name;
     String description;
     IRCode code;
@@ -20,23 +39,136 @@ struct IRCommand
 
 struct Device
 {
+    uint8_t id; // Stable while the device exists, assigned by addDevice()
     String name;
     String type;
     String manufacturer;
     String model;
-    IRCommand commands[MAX_COMMANDS];
     uint8_t commandCount;
 };
 
+// One step of a stored macro, by the stable ids of its device and command
+struct MacroStep
+{
+    uint8_t deviceId;
+    uint8_t commandId;
+    uint8_t repeat;
+    uint16_t delayMs; // Pause before the next step
+};
+
 class DeviceManager
 {
 private:
-    Device devices[MAX_DEVICES];
-    uint8_t deviceCount;
+    DeviceStore store;
     bool dataLoaded;
 
-    // EEPROM management
-    void saveToEEPROM();
+    // Name hash -> store slot, plus stable id -> slot for devices. Store
+    // slots do not move while an entry exists
+    CommandIndex<indexCapacityFor(MAX_DEVICES + STORE_MAX_COMMANDS)> index;
+    uint8_t deviceSlots[256];
+    uint8_t nextDeviceId;
+
+    // Code fingerprint -> command slot, over loaded commands. A command
+    // whose code is already stored shares that command's raw record
+    CommandIndex<indexCapacityFor(STORE_MAX_COMMANDS)> codeIndex;
+    IRCanonicalizer canonicalizer;
+    uint16_t findCodeSlot(const IRCode &code, uint16_t except);
+    uint16_t findRawHolder(const IRCode &code, uint16_t except, bool exact);
+    void shareCode(uint16_t command);
+
+    void rebuildIndex();
+    void indexDevice(uint8_t slot);
+    void indexCommand(uint16_t command);
+    void unindexCommand(uint16_t command);
+    uint32_t commandHash(uint16_t command);
+    uint8_t findDeviceSlot(const char *deviceName);
+    uint16_t findCommandSlot(const char *deviceName, const char *commandName);
+    uint16_t lookupCommandSlot(const char *deviceName, const char *commandName);
+    uint8_t allocateDeviceId();
+    uint8_t allocateCommandId(uint8_t slot);
+    uint16_t commandSlotById(uint8_t slot, uint8_t commandId);
+    bool storeString(uint16_t &handle, const String &value);
+    bool storeRaw(uint16_t command, decode_type_t protocol, const uint16_t *timings, uint16_t length);
+    void removeDeviceAt(uint8_t slot);
+    void removeCommandAt(uint16_t command);
+    void readCommand(uint16_t command, IRCode &code);
+    void writeCode(JsonStreamWriter &writer, uint16_t command);
+    Device describeDevice(uint8_t slot);
+
+    // Lazy loading: a device's commands stay on flash until first use
+    bool commandsLoaded[MAX_DEVICES];
+    bool loadFailed[MAX_DEVICES]; // Record file unreadable: read-only until the next boot
+    uint8_t storedCommandCounts[MAX_DEVICES];
+    bool ensureCommandsLoaded(uint8_t slot);
+    void loadAllCommands();
+    uint8_t commandCountOf(uint8_t slot);
+
+    // Persistence task: mutations hold dataMutex and append to the RAM log,
+    // flash access holds flashMutex. Lazy loads only read files the persist
+    // task is not rewriting, so they need dataMutex alone
+    TaskHandle_t persistTask;
+    SemaphoreHandle_t dataMutex;
+    SemaphoreHandle_t flashMutex;
+    static void persistLoop(void *parameter);
+    void schedulePersist();
+    void markDirty(uint8_t slot);
+
+    // Record store: compaction rewrites only dirty devices and the manifest
+    bool deviceDirty[MAX_DEVICES]; // RAM is newer than the device's record file
+    uint8_t staleFiles[32];        // Bitmap of device ids whose record file must be deleted
+    bool saveToStorage();
+    bool loadManifest();
+    bool saveManifest(uint32_t generation);
+    bool loadDeviceFile(uint8_t slot);
+    bool saveDeviceFile(uint8_t slot);
+    void clearStorage();
+
+    // Write-ahead log. Mutations encode a record into the active RAM buffer;
+    // saveToStorage() swaps buffers and appends the full one to the log file.
+    // The log names the manifest generation it applies to, so a log left
+    // over from before a compaction is never replayed
+    uint8_t logBuffers[2][STORAGE_LOG_BUFFER_SIZE];
+    uint16_t logLengths[2];
+    uint8_t activeLog;
+    bool logOverflow;      // A record was dropped; only a compaction covers it
+    bool compactRequested; // The log file cannot be appended to until compaction
+    uint32_t storageGeneration;
+    uint32_t logFileBytes;
+
+    // Raw timings are stored through the codec; used under dataMutex
+    RawTimingEncoder rawEncoder;
+    uint8_t rawScratch[RAW_CODEC_MAX_SIZE];
+    template <typename Fill>
+    void logRecord(uint8_t type, Fill fill);
+    void logDevice(uint8_t type, uint8_t slot);
+    void logCommand(uint16_t command);
+    void logRemoval(uint8_t type, uint8_t deviceId, uint8_t commandId);
+    bool appendLogFile(const uint8_t *data, size_t length);
+    bool resetLogFile(uint32_t generation);
+    bool replayLog();
+    void applyLogRecord(uint8_t type, const uint8_t *payload, uint16_t length);
+
+    // Macros: named step lists kept by id, so running one needs no name
+    // lookups. Ids are not reused until they wrap, so a step whose command
+    // was deleted fails when the macro runs instead of sending another code.
+    // The table is rewritten to its own file when the log is compacted
+    struct Macro
+    {
+        char name[MAX_DEVICE_NAME + 1];
+        uint8_t stepCount; // 0 for a free entry
+        MacroStep steps[BATCH_MAX_STEPS];
+    };
+    Macro macros[MAX_MACROS];
+    bool macrosDirty;
+    uint8_t findMacro(const char *name, size_t length);
+    bool storeMacro(const char *name, size_t length, const MacroStep *steps, uint8_t count);
+    void clearMacros();
+    void logMacro(uint8_t type, const char *name, size_t length, const MacroStep *steps, uint8_t count);
+    void applyMacroRecord(uint8_t type, const uint8_t *payload, uint16_t length);
+    bool loadMacros();
+    bool saveMacros();
+
+    // Legacy EEPROM layout, read once at boot and migrated to LittleFS
     bool loadFromEEPROM();
     void clearEEPROM();
 
@@ -51,25 +183,68 @@ public:
     bool begin();
     void update();
 
+    // Moves flash writes onto a low-priority task; mutations then return
+    // immediately and bursts are coalesced into a single commit
+    bool startPersistTask();
+    uint32_t getStackHighWaterMark();
+
+    // Folds the log into fresh device records and manifest, then starts an
+    // empty log. Runs on its own once the log passes STORAGE_LOG_COMPACT_BYTES
+    bool compactStorage();
+
     // Device management
     bool addDevice(const Device &device);
     bool removeDevice(const String &deviceName);
-    bool updateDevice(const Device &device);
-    Device *getDevice(const String &deviceName);
+    bool updateDevice(const Device &device); // Type, manufacturer and model; commands are untouched
+    bool getDevice(const String &deviceName, Device &device);
 
-    // Command management
+    // Command management; getCommand() fills the code without allocating,
+    // rawData points into the store
     bool addCommand(const String &deviceName, const IRCommand &command);
     bool removeCommand(const String &deviceName, const String &commandName);
-    IRCommand *getCommand(const String &deviceName, const String &commandName);
+    bool getCommand(const char *deviceName, const char *commandName, IRCode &code);
+    bool getCommand(const String &deviceName, const String &commandName, IRCode &code) { return getCommand(deviceName.c_str(), commandName.c_str(), code); }
 
-    // Listing methods
+    // Lookup by the stable ids reported in LIST_DEVICES / command lists
+    bool getCommand(uint8_t deviceId, uint8_t commandId, IRCode &code);
+    bool findCommandId(const char *deviceName, const char *commandName, uint8_t &deviceId, uint8_t &commandId);
+    bool findCommandId(const String &deviceName, const String &commandName, uint8_t &deviceId, uint8_t &commandId)
+    {
+        return findCommandId(deviceName.c_str(), commandName.c_str(), deviceId, commandId);
+    }
+
+    // A stored command sending the same code (see irCodesMatch()), through
+    // the fingerprint index; loads every device's commands first. The names
+    // are copied into buffers of MAX_DEVICE_NAME + 1 by the char * form
+    bool findDuplicate(const IRCode &code, String &deviceName, String &commandName);
+    bool findDuplicate(const IRCode &code, char *deviceName, char *commandName);
+
+    // Whether a command with this code can be added: it has no timings,
+    // shares stored ones, or a copy fits while STORE_RAW_SPARE stays free
+    // for lazy loads and replay, which copy timings before sharing them.
+    // Checked against every device, so it loads them all first
+    bool hasRawSpace(const IRCode &code);
+
+    // Listing methods. The write* forms stream straight from the store and
+    // write the same bytes each time while nothing changes in between
+    void writeDeviceList(JsonStreamWriter &writer);
     String getDeviceList();
     String getCommandList(const String &deviceName);
-    uint8_t getDeviceCount() { return deviceCount; }
+    uint8_t getDeviceCount() { return store.getDeviceCount(); }
+
+    // Macros: a stored BATCH, added or replaced by name
+    bool setMacro(const char *name, const MacroStep *steps, uint8_t count);
+    bool removeMacro(const char *name);
+    bool getMacro(const char *name, MacroStep *steps, uint8_t &count);
+    void writeMacroList(JsonStreamWriter &writer);
+    String getMacroList();
 
-    // Import/Export
+    // Import/Export. Codes are read with the IR manager's decodeIRCode();
+    // an import replaces the library and stops at the first entry that
+    // does not fit, keeping what was added before it
+    void writeExport(JsonStreamWriter &writer, uint32_t exported);
     String exportDevices();
-    bool importDevices(const String &jsonData);
+    bool importDevices(const String &jsonData, IRManager &codec);
 
     // Utility methods
     bool deviceExists(const String &deviceName);
@@ -77,6 +252,7 @@ public:
     void printDeviceInfo(const Device &device);
 
     // Status methods
+    void getStatus(JsonObject status); // State only; its metrics render separately
     String getStatus();
     void reset();
 };
@@ -0,0 +1,155 @@
+/**
+ * Device Store - Fixed-capacity storage for devices and commands
+ *
+ * Struct-of-arrays layout with no String members:
+ * - StringPool: interned, reference-counted names in one byte arena
+ * - device table: string handles plus the head/tail of a command list
+ * - command slab shared by all devices, linked per device, free list reuse
+ * - raw timings in a separate uint16_t arena, reference counted so
+ *   commands sending the same code share one record
+ * Slots and handles are 16-bit; STORE_NONE marks "no entry".
+ */
+
+#ifndef DEVICE_STORE_H
+#define DEVICE_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#define STORE_NONE 0xFFFF
+
+// Interned strings, addressed by handle. Records in the arena are
+// [handle:2][length:1][chars][NUL] so compaction can walk them in order.
+class StringPool
+{
+private:
+    char arena[STORE_STRING_POOL_SIZE];
+    uint16_t offsets[STORE_MAX_STRINGS]; // chars offset; next free handle while unused
+    uint8_t lengths[STORE_MAX_STRINGS];
+    uint16_t refs[STORE_MAX_STRINGS];
+    uint16_t handleCount;
+    uint16_t freeHandle;
+    uint16_t top;
+    uint16_t liveBytes;
+
+    void compact();
+
+public:
+    StringPool() { clear(); }
+
+    void clear();
+
+    // Returns a handle holding one reference; STORE_NONE for "" or when full
+    uint16_t intern(const char *str, size_t length);
+    uint16_t retain(uint16_t handle);
+    void release(uint16_t handle);
+
+    const char *get(uint16_t handle) const { return handle == STORE_NONE ? "" : arena + offsets[handle]; }
+    uint8_t length(uint16_t handle) const { return handle == STORE_NONE ? 0 : lengths[handle]; }
+    bool equals(uint16_t handle, const char *str, size_t length) const;
+
+    uint16_t stringsUsed() const;
+    uint16_t bytesUsed() const { return liveBytes; }
+};
+
+class DeviceStore
+{
+private:
+    // Devices
+    uint16_t deviceNames[MAX_DEVICES];
+    uint16_t deviceTypes[MAX_DEVICES];
+    uint16_t deviceManufacturers[MAX_DEVICES];
+    uint16_t deviceModels[MAX_DEVICES];
+    uint16_t firstCommands[MAX_DEVICES];
+    uint16_t lastCommands[MAX_DEVICES];
+    uint8_t deviceIds[MAX_DEVICES];
+    uint8_t nextCommandIds[MAX_DEVICES];
+    uint8_t commandCounts[MAX_DEVICES];
+    uint8_t deviceNext[MAX_DEVICES]; // free list link, 0xFF ends it
+    bool deviceUsed[MAX_DEVICES];
+    uint8_t freeDeviceHead;
+    uint8_t deviceCount;
+
+    // Commands
+    uint64_t commandData[STORE_MAX_COMMANDS];
+    uint16_t commandNames[STORE_MAX_COMMANDS];
+    uint16_t commandDescriptions[STORE_MAX_COMMANDS];
+    int16_t commandProtocols[STORE_MAX_COMMANDS];
+    uint16_t commandBits[STORE_MAX_COMMANDS];
+    uint16_t commandRaw[STORE_MAX_COMMANDS]; // Raw record handle, STORE_NONE for none
+    uint16_t commandPrev[STORE_MAX_COMMANDS];
+    uint16_t commandNext[STORE_MAX_COMMANDS]; // device list link, or free list link
+    uint8_t commandIds[STORE_MAX_COMMANDS];
+    uint8_t commandDevices[STORE_MAX_COMMANDS];
+    uint16_t freeCommandHead;
+    uint16_t commandCount;
+
+    // Raw timings: records are [handle:1 word][length:1 word][timings],
+    // addressed by handle like the string pool's
+    uint16_t rawArena[STORE_RAW_ARENA_SIZE];
+    uint16_t rawOffsets[STORE_MAX_COMMANDS]; // Timings offset; next free handle while unused
+    uint16_t rawLengths[STORE_MAX_COMMANDS];
+    uint8_t rawRefs[STORE_MAX_COMMANDS];
+    uint16_t freeRawHandle;
+    uint16_t rawTop;
+    uint16_t rawLive;
+    uint16_t rawShared; // Commands using a record another command holds too
+
+    void compactRaw();
+    void releaseRaw(uint16_t command);
+
+public:
+    StringPool strings;
+
+    DeviceStore() { clear(); }
+
+    void clear();
+
+    // Devices; slots are stable for the device's lifetime
+    uint8_t allocDevice(uint8_t id);
+    void freeDevice(uint8_t slot);
+    bool isDevice(uint8_t slot) const { return slot < MAX_DEVICES && deviceUsed[slot]; }
+    uint8_t getDeviceCount() const { return deviceCount; }
+
+    uint16_t &name(uint8_t slot) { return deviceNames[slot]; }
+    uint16_t &type(uint8_t slot) { return deviceTypes[slot]; }
+    uint16_t &manufacturer(uint8_t slot) { return deviceManufacturers[slot]; }
+    uint16_t &model(uint8_t slot) { return deviceModels[slot]; }
+    uint8_t deviceId(uint8_t slot) const { return deviceIds[slot]; }
+    uint8_t &nextCommandId(uint8_t slot) { return nextCommandIds[slot]; }
+    uint8_t getCommandCount(uint8_t slot) const { return commandCounts[slot]; }
+
+    // Commands; appended to the device's list, unlinked in O(1)
+    uint16_t allocCommand(uint8_t deviceSlot, uint8_t id);
+    void freeCommand(uint16_t command);
+    uint16_t firstCommand(uint8_t deviceSlot) const { return firstCommands[deviceSlot]; }
+    uint16_t nextCommand(uint16_t command) const { return commandNext[command]; }
+
+    uint16_t &commandName(uint16_t command) { return commandNames[command]; }
+    uint16_t &commandDescription(uint16_t command) { return commandDescriptions[command]; }
+    uint8_t commandId(uint16_t command) const { return commandIds[command]; }
+    uint8_t commandDevice(uint16_t command) const { return commandDevices[command]; }
+
+    void setCode(uint16_t command, int16_t protocol, uint64_t data, uint16_t bits);
+    int16_t protocol(uint16_t command) const { return commandProtocols[command]; }
+    uint64_t data(uint16_t command) const { return commandData[command]; }
+    uint16_t bits(uint16_t command) const { return commandBits[command]; }
+
+    // Raw timings; the pointer stays valid until the next setRaw() on any
+    // command. A shared record is read-only: setting a command's timings
+    // gives it a record of its own
+    bool setRaw(uint16_t command, const uint16_t *timings, uint16_t length);
+    uint16_t *reserveRaw(uint16_t command, uint16_t length); // Caller fills the returned words
+    bool shareRaw(uint16_t command, uint16_t from);         // false if `from` has no timings or too many sharers
+    bool rawFits(uint16_t length, uint16_t spare) const;    // A new record of `length` timings leaves `spare` words free
+    uint16_t *raw(uint16_t command) { return commandRaw[command] != STORE_NONE ? rawArena + rawOffsets[commandRaw[command]] : nullptr; }
+    uint16_t rawLength(uint16_t command) const { return commandRaw[command] != STORE_NONE ? rawLengths[commandRaw[command]] : 0; }
+
+    // Usage
+    uint16_t getStoredCommands() const { return commandCount; }
+    uint16_t getRawUsed() const { return rawLive; }
+    uint16_t getRawShared() const { return rawShared; }
+};
+
+#endif // DEVICE_STORE_H
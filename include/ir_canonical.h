@@ -0,0 +1,79 @@
+/**
+ * IR Canonicalizer - Cleans up learned raw timings and fingerprints codes
+ *
+ * canonicalize() takes a capture of one or more frames, separated by
+ * spaces of at least IR_CANON_FRAME_GAP_US, and in place:
+ * - averages every frame that repeats an earlier one (same timing count,
+ *   each timing within IR_CANON_TOLERANCE_PERCENT) into it and drops it
+ * - drops repeat codes, frames of IR_CANON_REPEAT_TIMINGS or fewer
+ *   timings after the first frame
+ * - snaps durations: sorted marks, and sorted spaces, form clusters split
+ *   where one is over half the tolerance longer than the last, and each
+ *   cluster shares its mean, rounded to IR_CANON_GRID_US
+ * - ends on the last mark, as sendRaw() expects
+ *
+ * fingerprint() hashes what two captures of one button have in common:
+ * the decoded value, the A/C state, or for undecoded codes the timing
+ * count and the rank of each duration among the distinct marks or spaces.
+ * Equal fingerprints are confirmed with irCodesMatch().
+ */
+
+#ifndef IR_CANONICAL_H
+#define IR_CANONICAL_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+#include "config.h"
+
+struct IRCode;
+
+// True when the code carries something to send
+bool irHasCode(const IRCode &code);
+
+// Same length, every timing within IR_CANON_TOLERANCE_PERCENT
+bool irTimingsMatch(const uint16_t *a, uint16_t aLength, const uint16_t *b, uint16_t bLength);
+
+// Decoded codes by value, A/C codes by their state bytes, undecoded codes
+// by their timings
+bool irCodesMatch(const IRCode &a, const IRCode &b);
+
+// Working tables for one capture; keep it off small task stacks
+class IRCanonicalizer
+{
+private:
+    static const uint8_t kMaxFrames = 16;
+    static const uint8_t kMaxClusters = 64;
+
+    struct Frame
+    {
+        uint16_t offset;
+        uint16_t length;
+        uint16_t gap;   // Space after the frame, 0 for the last
+        uint8_t count;  // Frames averaged into this one
+    };
+
+    struct Cluster
+    {
+        uint16_t min;
+        uint16_t max;
+        uint32_t sum;
+        uint16_t count;
+        bool space;
+    };
+
+    Frame frames[kMaxFrames];
+    Cluster clusters[kMaxClusters];
+    uint16_t order[MAX_IR_CODE_SIZE];    // Timing indices, sorted for clustering
+    uint8_t clusterOf[MAX_IR_CODE_SIZE]; // kMaxClusters: left as captured
+    uint8_t clusterCount;
+
+    void cluster(const uint16_t *timings, uint16_t length);
+
+public:
+    // Returns the new length; 0 only for an empty capture
+    uint16_t canonicalize(uint16_t *timings, uint16_t length);
+
+    uint32_t fingerprint(const IRCode &code);
+};
+
+#endif // IR_CANONICAL_H
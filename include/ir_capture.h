@@ -0,0 +1,60 @@
+/**
+ * IR Capture Ring - Received frames waiting to be decoded
+ *
+ * The receiver fills frames as whole edge captures arrive and the IR task
+ * takes them in order, so decoding, learning and repeat detection happen
+ * off the capture path. One producer and one consumer; frames are
+ * written in place, nothing is copied or allocated per frame. Storage is
+ * allocated once by begin() (from PSRAM when the board has it).
+ */
+
+#ifndef IR_CAPTURE_H
+#define IR_CAPTURE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "ir_decoder.h"
+
+struct IRCaptureFrame
+{
+    uint32_t timestampMs; // When the frame was taken from the receiver
+    uint16_t length;      // Timings used
+    bool overflow;        // Longer than MAX_IR_CODE_SIZE; the tail was cut
+    bool decoded;         // `code` is already filled in (IRrecv frames)
+    IRDecoded code;
+    uint8_t state[kStateSizeMax]; // State protocols decoded by IRrecv
+    uint16_t timings[MAX_IR_CODE_SIZE]; // Mark/space in microseconds, starting with a mark
+};
+
+class IRCaptureRing
+{
+private:
+    IRCaptureFrame *frames;
+    bool psram;
+    std::atomic<uint32_t> head; // Frames committed
+    std::atomic<uint32_t> tail; // Frames released
+    std::atomic<uint32_t> captured;
+
+public:
+    IRCaptureRing();
+    ~IRCaptureRing();
+
+    bool begin();
+
+    // Producer: the slot for the next frame, or nullptr when the ring is
+    // full; commit() publishes it
+    IRCaptureFrame *reserve();
+    void commit();
+
+    // Consumer: the oldest frame, or nullptr when empty; release() frees it
+    IRCaptureFrame *front();
+    void release();
+
+    uint16_t size() const { return head - tail; }
+    uint16_t getCapacity() const { return IR_CAPTURE_RING_FRAMES; }
+    uint32_t getCaptured() const { return captured; }
+    bool inPsram() const { return psram; }
+};
+
+#endif // IR_CAPTURE_H
@@ -0,0 +1,28 @@
+/**
+ * IR Decoder - Protocol decoding of captured timings
+ *
+ * Works on alternating mark/space durations in microseconds, starting with
+ * a mark, as the RMT receiver delivers them. Recognizes the protocols the
+ * waveform compiler sends (NEC, Sony, RC5, RC6), allowing for receiver
+ * jitter and the receiver stretching marks at the expense of spaces, so a
+ * decoded code goes back out as the frame that was captured.
+ */
+
+#ifndef IR_DECODER_H
+#define IR_DECODER_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+struct IRDecoded
+{
+    decode_type_t protocol;
+    uint64_t data;
+    uint16_t bits;
+    bool repeatCode; // A repeat marker carrying no data of its own (NEC)
+};
+
+// False, with protocol UNKNOWN, when no protocol matches
+bool decodeTimings(const uint16_t *timings, uint16_t count, IRDecoded &result);
+
+#endif // IR_DECODER_H
@@ -0,0 +1,121 @@
+/**
+ * IR Learn Session - Agreement between several captures of one button
+ *
+ * A learn job asking for more than one capture feeds each press, already
+ * canonicalized, to add(). Captures that match (irCodesMatch()) form a
+ * group; raw timings of a group are kept as their running mean in the
+ * pool buffer of its first capture, so at most IR_LEARN_MAX_GROUPS
+ * buffers are held whatever the number of presses. The job is agreed
+ * once the target number of presses is taken and the largest group holds
+ * IR_LEARN_AGREE_PERCENT of them (and at least two when more than one
+ * was asked for), and disagreed after IR_LEARN_MAX_CAPTURES presses.
+ *
+ * The report is plain data for the command task: each capture, the group
+ * it joined, how far its timings were from the group's mean, and why it
+ * differs from the leading group. Confidence is the leading group's share
+ * of the presses, reduced by up to half as its worst deviation
+ * approaches IR_CANON_TOLERANCE_PERCENT.
+ */
+
+#ifndef IR_LEARN_H
+#define IR_LEARN_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+#include "config.h"
+#include "capture_pool.h"
+
+struct IRCode;
+
+enum IRLearnStatus : uint8_t
+{
+    LEARN_PENDING,
+    LEARN_AGREED,
+    LEARN_DISAGREED,
+    LEARN_TIMED_OUT,
+    LEARN_CANCELLED
+};
+
+// How a capture differs from the leading group
+enum IRLearnMismatch : uint8_t
+{
+    MISMATCH_NONE,
+    MISMATCH_PROTOCOL,
+    MISMATCH_VALUE,  // Decoded value, bits or A/C state
+    MISMATCH_LENGTH, // Number of raw timings
+    MISMATCH_TIMING  // A raw timing outside the tolerance, at mismatchAt
+};
+
+struct IRLearnCapture
+{
+    decode_type_t protocol;
+    uint64_t data;
+    uint16_t bits;
+    uint16_t rawLen;
+    uint8_t group;       // IR_LEARN_MAX_GROUPS when no group could take it
+    uint8_t deviation;   // Worst timing against its group's mean, percent
+    uint8_t mismatch;    // IRLearnMismatch
+    uint16_t mismatchAt; // Timing index for MISMATCH_TIMING
+};
+
+struct IRLearnReport
+{
+    uint32_t jobId;
+    uint8_t status; // IRLearnStatus
+    uint8_t target; // Captures asked for
+    uint8_t taken;
+    uint8_t agreeing;   // Captures in the leading group
+    uint8_t deviation;  // Worst of the leading group, percent
+    uint8_t confidence; // 0-100
+    uint32_t elapsedMs; // From the start of the job to its end
+    IRLearnCapture captures[IR_LEARN_MAX_CAPTURES];
+};
+
+class IRLearnSession
+{
+private:
+    struct Group
+    {
+        decode_type_t protocol;
+        uint64_t data;
+        uint16_t bits;
+        uint16_t rawLen;
+        RawBuffer buffer; // Mean timings, or the A/C state
+        uint8_t count;
+        uint8_t deviation;
+    };
+
+    Group groups[IR_LEARN_MAX_GROUPS];
+    uint8_t groupCount;
+    IRLearnReport report;
+    uint32_t startMs;
+
+    void view(const Group &group, IRCode &code) const;
+    uint8_t fold(Group &group, const IRCode &capture);
+    uint8_t leader() const;
+    void decide();
+    void conclude(uint8_t status);
+    static uint8_t compare(const IRCode &a, const IRCode &b, uint16_t &at);
+
+public:
+    IRLearnSession();
+
+    void begin(uint32_t jobId, uint8_t target);
+
+    // Takes one press; returns the job's status after it
+    uint8_t add(const IRCode &capture);
+
+    // The leading group's code, sharing its buffer; false without captures
+    bool result(IRCode &code) const;
+
+    // Ends the job with `status` unless add() already has, and lets go of
+    // the groups' buffers; take the result() first. The report is kept
+    void end(uint8_t status);
+
+    uint8_t getTaken() const { return report.taken; }
+    const IRLearnReport &getReport() const { return report; }
+};
+
+const char *irLearnMismatchName(uint8_t mismatch);
+
+#endif // IR_LEARN_H
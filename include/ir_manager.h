@@ -6,20 +6,98 @@
 #define IR_MANAGER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <IRremoteESP8266.h>
 #include <IRsend.h>
 #include <IRrecv.h>
 #include <IRutils.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include "config.h"
+#include "raw_codec.h"
+#include "capture_pool.h"
+#include "ir_waveform.h"
+#include "ir_rmt.h"
+#include "ir_capture.h"
+#include "ir_decoder.h"
+#include "ir_protocols.h"
+#include "ir_canonical.h"
+#include "ir_learn.h"
 
 struct IRCode
 {
     decode_type_t protocol;
     uint64_t data; // Changed from 'value' to 'data' for consistency
     uint16_t bits;
-    uint16_t *rawData;
+    uint16_t *rawData; // Raw timings, or the state bytes of a state protocol
     uint16_t rawLen;
     String description;
+    RawBuffer buffer; // Holds rawData when it lives in the capture pool
+};
+
+// Completion callback for queued transmissions; runs on the IR task
+typedef void (*IRTransmitCallback)(void *context, bool success);
+
+// Learn job completion callback; runs on the IR task with the captured
+// code, or with nullptr when the job times out
+typedef void (*IRLearnCallback)(void *context, uint32_t jobId, const IRCode *code);
+
+// Monitor callback: a new press seen on the receiver. Runs on the IR task
+// with the manager's state locked, so it must not call into the manager
+// and must not block; the code's timings are only valid during the call
+typedef void (*IRMonitorCallback)(void *context, const IRCode &code);
+
+// One step of a compiled batch: the code to send, how many times, and the
+// pause before the next step. Raw timings are kept encoded in the plan
+struct IRPlanStep
+{
+    decode_type_t protocol;
+    uint64_t data;
+    uint16_t bits;
+    uint16_t rawLen;
+    uint16_t rawOffset; // Into IRPlan::raw
+    uint16_t rawSize;   // Encoded bytes, 0 for protocol codes
+    bool rawPlain;      // Stored as plain words; the codec could not shrink them
+    uint8_t repeat;
+    uint16_t delayMs;
+};
+
+// A batch resolved and encoded up front, so the IR task sends it back to
+// back without lookups. The IR task fills in the result fields before the
+// completion callback runs
+struct IRPlan
+{
+    uint8_t stepCount;
+    uint16_t rawUsed;
+    IRPlanStep steps[BATCH_MAX_STEPS];
+    uint8_t raw[BATCH_PLAN_RAW_BYTES];
+
+    uint8_t completedSteps;
+    uint16_t sends;
+
+    void clear()
+    {
+        stepCount = 0;
+        rawUsed = 0;
+        completedSteps = 0;
+        sends = 0;
+    }
+};
+
+// Queue item for the IR task; plain data so FreeRTOS can copy it
+struct IRTransmitJob
+{
+    decode_type_t protocol;
+    uint64_t data;
+    uint16_t bits;
+    uint16_t *rawData;
+    uint16_t rawLen;
+    uint8_t rawBuffer; // Capture pool reference owned by the job, or CAPTURE_NONE
+    IRPlan *plan;      // Set for a batch; the other code fields are unused
+    IRTransmitCallback callback;
+    void *context;
 };
 
 class IRManager
@@ -28,28 +106,125 @@ private:
     IRsend *irSend;
     IRrecv *irRecv;
     decode_results results;
-    bool learning;
+    volatile bool learning;
     unsigned long learnStartTime;
+    unsigned long learnTimeout;
+    uint32_t learnJobId;
+    uint32_t nextLearnJobId;
+    IRLearnCallback learnCallback;
+    void *learnContext;
     IRCode lastLearned;
 
+    // Task runtime
+    TaskHandle_t irTask;
+    QueueHandle_t transmitQueue;
+    SemaphoreHandle_t stateMutex;
+
+    // Raw timings of captures, decoded codes and queued transmissions
+    CapturePool capturePool;
+
+    // Raw timing codec state for encodeIRCode()/decodeIRCode()
+    SemaphoreHandle_t codecMutex;
+    RawTimingEncoder rawEncoder;
+    uint8_t rawScratch[RAW_CODEC_MAX_SIZE];
+
+    // Hardware transmit path; IRsend bit-bangs when it is off or unavailable.
+    // Only the sending task touches the cache
+    IRRmtTransmitter rmt;
+    IRWaveformCache waveCache;
+    bool rmtEnabled;
+
+    // Receive path: the RMT receiver (or IRrecv, polled, when the RMT is
+    // unavailable) fills the ring; update() decodes what it holds
+    IRRmtReceiver rmtRx;
+    IRCaptureRing captureRing;
+    IRDecoded lastFrame; // Last code received, for repeat detection
+    uint32_t lastFrameMs;
+
+    // An undecoded frame is learned with the repeats that follow it within
+    // IR_REPEAT_WINDOW_MS, joined in lastLearned, then canonicalized
+    IRCanonicalizer canonicalizer;
+    uint8_t learnFrames;
+    uint32_t learnFrameMs; // Arrival of the last frame collected
+
+    // Each press is one capture; the job ends once enough of them agree
+    IRLearnSession learnSession;
+
+    // Monitor mode: every new press goes to the callback, canonicalized.
+    // Undecoded frames repeat when their fingerprint comes back within
+    // IR_REPEAT_WINDOW_MS, as decoded ones do when classifyFrame() says so
+    volatile bool monitoring;
+    IRMonitorCallback monitorCallback;
+    void *monitorContext;
+    uint32_t monitorPrint;
+    uint32_t monitorMs;
+    uint16_t monitorState[(kStateSizeMax + 1) / 2];
+
+    static void taskLoop(void *parameter);
+    bool sendCode(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t *rawData, uint16_t rawLen);
+    bool emitCode(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t *rawData, uint16_t rawLen);
+    bool runPlan(IRPlan &plan, uint16_t *timings);
+    void pollReceiver();
+    bool classifyFrame(IRCaptureFrame &frame);
+    void learnFrame(const IRCaptureFrame &frame);
+    bool collectFrame(const IRCaptureFrame &frame);
+    uint8_t completeLearn();
+    void monitorFrame(IRCaptureFrame &frame, bool repeated);
+    void pause(uint32_t ms);
+
 public:
     IRManager();
     ~IRManager();
 
     bool begin();
+
+    // Moves received frames into the capture ring and decodes them: every
+    // frame is counted and checked for repeats, learning takes the first
+    // that carries a code. Call often; the IR task runs it between jobs
     void update();
 
+    // Runs update() and all queued transmissions on a dedicated task pinned to IR_TASK_CORE
+    bool startTask();
+    bool isTaskRunning() { return irTask != nullptr; }
+    uint32_t getStackHighWaterMark();
+
     // Transmission methods
     bool transmitCode(const IRCode &code);
+    bool queueTransmit(const IRCode &code, IRTransmitCallback callback, void *context);
     bool transmitRaw(uint16_t *rawData, uint16_t length);
     bool transmitProtocol(decode_type_t protocol, uint64_t value, uint16_t bits);
 
-    // Reception methods
-    bool startLearning();
-    bool stopLearning();
+    // Switches between the RMT transmitter and IRsend; false if the RMT
+    // channel could not be set up. Call while no transmission is running
+    bool setRmtEnabled(bool enabled);
+    bool isRmtEnabled() { return rmtEnabled; }
+
+    // Batches: addPlanStep() copies the code into the plan (false when it
+    // holds BATCH_MAX_STEPS steps or the timings do not fit); queuePlan()
+    // sends every step as one IR job. The plan must stay untouched until
+    // the callback runs
+    bool addPlanStep(IRPlan &plan, const IRCode &code, uint8_t repeat, uint16_t delayMs);
+    bool queuePlan(IRPlan &plan, IRTransmitCallback callback, void *context);
+
+    // Reception methods; learning is driven by update() and reported
+    // through the learn callback. startLearning() returns the job id, or 0
+    // if a job is already running. With more than one capture the button
+    // is pressed that many times and the job succeeds once the presses
+    // agree; getLearnReport() says how well they did
+    void setLearnCallback(IRLearnCallback callback, void *context);
+    uint32_t startLearning(unsigned long timeoutMs = IR_TIMEOUT_MS, uint8_t captures = 1);
+    uint32_t stopLearning();
     bool isLearning() { return learning; }
+    uint32_t getLearnJobId() { return learnJobId; }
     bool hasLearnedCode();
     IRCode getLearnedCode();
+    void getLearnReport(IRLearnReport &report);
+
+    // Monitor mode: frames are captured all the time; while it is on, each
+    // new press (not its repeats) is handed to the monitor callback
+    void setMonitorCallback(IRMonitorCallback callback, void *context);
+    void setMonitoring(bool enabled);
+    bool isMonitoring() { return monitoring; }
 
     // Utility methods
     String encodeIRCode(const IRCode &code);
@@ -58,6 +233,9 @@ public:
 
     // Status methods
     bool isReady();
+    bool isRmtReceiving() { return rmtRx.isReady(); }
+    CapturePool &getCapturePool() { return capturePool; }
+    void getStatus(JsonObject status); // State only; its metrics render separately
     String getStatus();
 };
 
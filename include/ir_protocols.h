@@ -0,0 +1,44 @@
+/**
+ * IR Protocols - What this firmware can do with each IRremoteESP8266 protocol
+ *
+ * One entry per decode_type_t, in enum order, so a lookup is an array
+ * index. Codes of a protocol the library can both decode and send are
+ * stored in protocol form (value and bit count) rather than as raw
+ * timings. State protocols (mostly A/C remotes) carry a byte array
+ * instead of a 64-bit value; an IRCode keeps those bytes in its raw
+ * words, two per word in memory order, with bits = bytes * 8.
+ */
+
+#ifndef IR_PROTOCOLS_H
+#define IR_PROTOCOLS_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+
+#define IR_PROTO_DECODE 0x01   // The library decodes it, so it can be learned
+#define IR_PROTO_SEND 0x02     // The library sends it
+#define IR_PROTO_STATE 0x04    // Sent from a state byte array, not a 64-bit value
+#define IR_PROTO_WAVEFORM 0x08 // Compiled for the RMT transmitter (ir_waveform.h)
+
+struct IRProtocolInfo
+{
+    decode_type_t protocol;
+    uint8_t flags;
+    uint16_t defaultBits; // State protocols: the state length in bits
+};
+
+// nullptr for UNKNOWN or a value past the table
+const IRProtocolInfo *irProtocolInfo(decode_type_t protocol);
+
+// Decoded and sent by the library, so storable in protocol form
+bool irProtocolSupported(decode_type_t protocol);
+bool irProtocolHasState(decode_type_t protocol);
+
+// Raw words holding a state of `bits` bits
+inline uint16_t irStateWords(uint16_t bits) { return (bits / 8 + 1) / 2; }
+
+// Every entry, for coverage reports
+uint16_t irProtocolCount();
+const IRProtocolInfo &irProtocolAt(uint16_t index);
+
+#endif // IR_PROTOCOLS_H
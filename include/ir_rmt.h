@@ -0,0 +1,69 @@
+/**
+ * IR RMT - Transmit and receive through the RMT peripheral
+ *
+ * Transmit: the peripheral generates the carrier and walks the item stream
+ * itself, so a send costs the CPU the write call; the sending task then
+ * sleeps on the driver until the stream is out.
+ * Receive: the peripheral times every edge and hands over a whole frame
+ * once the line has been idle for IR_RMT_RX_IDLE_US, so there is one
+ * interrupt per frame instead of one per edge.
+ */
+
+#ifndef IR_RMT_H
+#define IR_RMT_H
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include "config.h"
+#include "ir_waveform.h"
+#include "ir_capture.h"
+
+class IRRmtTransmitter
+{
+private:
+    rmt_channel_t channel;
+    uint8_t pin;
+    bool installed;
+    uint16_t carrierHz; // Carrier the channel is set to
+    uint32_t sends;
+    uint32_t failures;
+
+public:
+    IRRmtTransmitter();
+
+    // Configures the channel and routes `pin` to it; again after the pin
+    // was handed to another driver, only the routing is redone
+    bool begin(uint8_t pin, uint8_t channel);
+    bool isReady() const { return installed; }
+
+    // Starts the stream and waits, without spinning, until it has been
+    // sent. The waveform must not change before this returns
+    bool send(const IRWaveform &wave);
+
+    uint32_t getSends() const { return sends; }
+    uint32_t getFailures() const { return failures; }
+};
+
+class IRRmtReceiver
+{
+private:
+    rmt_channel_t channel;
+    bool installed;
+    RingbufHandle_t ring; // Frames from the driver's RX interrupt
+    uint32_t overflows;
+
+public:
+    IRRmtReceiver();
+
+    bool begin(uint8_t pin, uint8_t channel);
+    bool isReady() const { return installed; }
+
+    // Moves every frame the driver holds into `frames` as timings, without
+    // waiting; frames stay with the driver while `frames` is full. Returns
+    // how many were moved
+    uint16_t drain(IRCaptureRing &frames);
+
+    uint32_t getOverflows() const { return overflows; }
+};
+
+#endif // IR_RMT_H
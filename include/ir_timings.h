@@ -0,0 +1,49 @@
+/**
+ * IR Timings - Protocol timings shared by the waveform compiler and the
+ * decoder, in microseconds, as IRremoteESP8266 sends them
+ *
+ * Kept in their own namespace: the library's protocol headers use the
+ * same names.
+ */
+
+#ifndef IR_TIMINGS_H
+#define IR_TIMINGS_H
+
+#include <stdint.h>
+
+namespace IRTiming
+{
+    const uint32_t kNecHdrMark = 8960;
+    const uint32_t kNecHdrSpace = 4480;
+    const uint32_t kNecRptSpace = 2240; // Repeat code: header mark, this space, one bit mark
+    const uint32_t kNecBitMark = 560;
+    const uint32_t kNecOneSpace = 1680;
+    const uint32_t kNecZeroSpace = 560;
+    const uint32_t kNecMinGap = 22400;
+    const uint32_t kNecMinCommandLength = 108080;
+    const uint16_t kNecBits = 32;
+    const uint16_t kNecFreq = 38000;
+
+    const uint32_t kSonyHdrMark = 2400;
+    const uint32_t kSonySpace = 600;
+    const uint32_t kSonyOneMark = 1200;
+    const uint32_t kSonyZeroMark = 600;
+    const uint32_t kSonyMinGap = 10000;
+    const uint32_t kSonyRptLength = 45000;
+    const uint16_t kSonyRepeat = 2; // sendSony() default: three frames
+    const uint16_t kSonyFreq = 40000;
+
+    const uint32_t kRc5T1 = 889;
+    const uint32_t kRc5MinGap = 88886;
+    const uint16_t kRc5XBits = 13; // A 13th bit rides in the inverted field bit
+
+    const uint32_t kRc6HdrMark = 2664;
+    const uint32_t kRc6HdrSpace = 888;
+    const uint32_t kRc6T1 = 444;
+    const uint16_t kRc6ToggleBit = 4; // Sent at twice the bit width
+    const uint32_t kRc6RptLength = 83000;
+
+    const uint16_t kRc56Freq = 36000;
+}
+
+#endif // IR_TIMINGS_H
@@ -0,0 +1,82 @@
+/**
+ * IR Waveform - Codes compiled to RMT item streams
+ *
+ * An item is 32 bits laid out like the RMT peripheral's rmt_item32_t:
+ *   [0..14] duration0  [15] level0  [16..30] duration1  [31] level1
+ * Durations are in IR_WAVE_TICK_US ticks; level 1 is a carrier burst
+ * (mark), level 0 silence (space). Protocol codes use the same timings,
+ * bit order, trailing gaps and default repeats as IRsend, so a waveform
+ * puts the frame IRsend would bit-bang on the air. A duration longer than
+ * one half holds is split over several halves of the same level, and
+ * adjacent marks or spaces are merged.
+ */
+
+#ifndef IR_WAVEFORM_H
+#define IR_WAVEFORM_H
+
+#include <Arduino.h>
+#include <IRremoteESP8266.h>
+#include "config.h"
+
+#define IR_WAVE_TICK_US 1           // RMT counter clock: 80 MHz APB / IR_RMT_CLK_DIV
+#define IR_WAVE_MAX_DURATION 32767  // Ticks in one item half
+#define IR_WAVE_MAX_ITEMS (MAX_IR_CODE_SIZE / 2 + 32) // A full raw capture plus split gaps
+
+typedef uint32_t IRWaveItem;
+
+struct IRWaveform
+{
+    uint16_t carrierHz; // Sent at IR_DUTY_CYCLE
+    uint16_t count;     // Items used
+    IRWaveItem items[IR_WAVE_MAX_ITEMS];
+};
+
+// Builds the stream IRsend would send for the code: raw timings when
+// present, else the protocol fields. False for protocols without
+// IR_PROTO_WAVEFORM (ir_protocols.h) or streams longer than IR_WAVE_MAX_ITEMS
+bool compileWaveform(decode_type_t protocol, uint64_t data, uint16_t bits, const uint16_t *rawData, uint16_t rawLen,
+                     IRWaveform &wave);
+
+// Flattens a stream back to alternating mark/space durations in
+// microseconds, starting with a mark; returns how many were written
+uint16_t waveformTimings(const IRWaveform &wave, uint32_t *out, uint16_t capacity);
+uint32_t waveformDurationUs(const IRWaveform &wave);
+
+// Compiled waveforms of recently sent codes, so a code sent again goes
+// straight to the peripheral. Keyed by the code's fields and raw timings;
+// the least recently used entry is recompiled over
+class IRWaveformCache
+{
+private:
+    struct Key
+    {
+        uint64_t hash;
+        uint64_t data;
+        int16_t protocol;
+        uint16_t bits;
+        uint16_t rawLen;
+    };
+
+    IRWaveform *entries;
+    Key keys[IR_WAVE_CACHE_ENTRIES];
+    uint32_t lastUse[IR_WAVE_CACHE_ENTRIES];
+    uint32_t clock;
+    uint32_t hits;
+    uint32_t misses;
+
+public:
+    IRWaveformCache();
+    ~IRWaveformCache();
+
+    bool begin();
+    void clear();
+
+    // The compiled code, or nullptr if it cannot be compiled. Valid until
+    // the next get()
+    const IRWaveform *get(decode_type_t protocol, uint64_t data, uint16_t bits, const uint16_t *rawData, uint16_t rawLen);
+
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+};
+
+#endif // IR_WAVEFORM_H
@@ -0,0 +1,91 @@
+/**
+ * JSON Stream Writer - Serializes without building a document
+ *
+ * Replies that walk the device store (LIST_DEVICES, EXPORT_DEVICES) write
+ * their JSON token by token into a JsonSink instead of filling a
+ * DynamicJsonDocument, so memory does not grow with the library. The
+ * writer keeps only the comma state of each open level. A message is
+ * usually produced twice: into a JsonCountSink to learn its length, then
+ * into the sink that sends it, so the producer must write the same bytes
+ * both times.
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+
+#define JSON_STREAM_MAX_DEPTH 16
+
+// Where streamed bytes go
+class JsonSink
+{
+public:
+    virtual ~JsonSink() {}
+    virtual void write(const char *data, size_t length) = 0;
+};
+
+// Measures a message without keeping it
+class JsonCountSink : public JsonSink
+{
+private:
+    size_t count;
+
+public:
+    JsonCountSink() : count(0) {}
+    void write(const char *data, size_t length) override { count += length; }
+    size_t size() const { return count; }
+};
+
+// Collects a message for callers that still want a String
+class JsonStringSink : public JsonSink
+{
+private:
+    String &out;
+
+public:
+    JsonStringSink(String &out) : out(out) {}
+    void write(const char *data, size_t length) override { out.concat(data, length); }
+};
+
+class JsonStreamWriter
+{
+private:
+    JsonSink &sink;
+    uint8_t depth;
+    uint16_t hasItems; // Bit per level: a comma goes before the next item
+    bool afterKey;
+
+    void separate();
+    void open(char bracket);
+    void close(char bracket);
+    void quoted(const char *text);
+
+public:
+    JsonStreamWriter(JsonSink &sink) : sink(sink), depth(0), hasItems(0), afterKey(false) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(const char *name);
+    void string(const char *text); // Escaped; nullptr writes ""
+    void number(uint64_t value);
+    void boolean(bool value);
+    void raw(const char *json); // An already serialized value
+
+    // One object member
+    void field(const char *name, const char *text)
+    {
+        key(name);
+        string(text);
+    }
+    void field(const char *name, uint64_t value)
+    {
+        key(name);
+        number(value);
+    }
+};
+
+#endif // JSON_STREAM_H
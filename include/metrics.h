@@ -0,0 +1,156 @@
+/**
+ * Metrics Registry - Typed counters, gauges and histograms
+ *
+ * Every manager updates its metrics in place, from any task, with relaxed
+ * atomics: nothing is serialized until a client asks. GET_STATUS renders
+ * each metric into the status object of its group, next to the state the
+ * managers report themselves, and the binary METRICS opcode returns all
+ * of them as one packed snapshot for frequent polling.
+ *
+ * Metric ids are the snapshot's layout: new metrics are appended to their
+ * enum, never inserted or reordered.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+
+// Status objects metrics are rendered into
+enum MetricGroup : uint8_t
+{
+    METRIC_GROUP_COMMANDS,     // "commands"
+    METRIC_GROUP_TASKS,        // "tasks"
+    METRIC_GROUP_MONITOR,      // "monitor"
+    METRIC_GROUP_IR,           // "ir"
+    METRIC_GROUP_BLE,          // "ble"
+    METRIC_GROUP_BLE_TX_QUEUE, // "ble.txQueue"
+    METRIC_GROUP_DEVICES,      // "devices"
+    METRIC_GROUP_STORAGE,      // "devices.storage"
+    METRIC_GROUP_COUNT
+};
+
+enum MetricType : uint8_t
+{
+    METRIC_COUNTER, // Only goes up
+    METRIC_GAUGE    // Set to the current value
+};
+
+enum MetricId : uint8_t
+{
+    METRIC_COMMANDS_PROCESSED,
+    METRIC_COMMANDS_DROPPED,
+    METRIC_COMMANDS_FAILED,
+    METRIC_MONITOR_MATCHED,
+    METRIC_MONITOR_UNMATCHED,
+    METRIC_MONITOR_DROPPED,
+    METRIC_IR_TRANSMITS,
+    METRIC_IR_TRANSMIT_FAILURES,
+    METRIC_IR_FRAMES_DECODED,
+    METRIC_IR_FRAMES_REPEATED,
+    METRIC_IR_FRAMES_MONITORED,
+    METRIC_IR_LEARNED,
+    METRIC_IR_LEARN_MISMATCHES,
+    METRIC_IR_LEARN_TIMEOUTS,
+    METRIC_IR_LEARN_CANCELLED,
+    METRIC_BLE_CONNECTS,
+    METRIC_BLE_DISCONNECTS,
+    METRIC_BLE_MTU,
+    METRIC_BLE_FRAGMENTS_SENT,
+    METRIC_BLE_FLOW_TIMEOUTS,
+    METRIC_BLE_NOTIFY_FAILURES,
+    METRIC_BLE_NOTIFY_RETRIES,
+    METRIC_BLE_ABANDONED,
+    METRIC_FLASH_COMMITS,
+    METRIC_FLASH_FAILURES,
+    METRIC_FLASH_COMPACTIONS,
+    METRIC_ARENA_PEAK,
+    METRIC_ARENA_OVERFLOWS,
+    METRIC_COUNT
+};
+
+// Histograms bucket by powers of two: bucket 0 holds 0, bucket b holds
+// [2^(b-1), 2^b), and the last bucket everything above
+#define METRIC_HISTOGRAM_BUCKETS 24
+
+enum MetricHistogramId : uint8_t
+{
+    METRIC_HIST_IR_TRANSMIT_US,
+    METRIC_HIST_FLASH_COMMIT_US,
+    METRIC_HIST_COUNT
+};
+
+struct MetricInfo
+{
+    MetricGroup group;
+    MetricType type;
+    const char *name;
+};
+
+struct MetricHistogramInfo
+{
+    MetricGroup group;
+    const char *name;
+};
+
+// What a histogram held when it was read
+struct MetricHistogramSummary
+{
+    uint32_t count;
+    uint32_t sum; // Wraps after 4294 s of microseconds
+    uint32_t max;
+    uint32_t p50; // Percentiles are bucket upper bounds, at most max
+    uint32_t p95;
+    uint32_t p99;
+};
+
+const MetricInfo &metricInfo(MetricId id);
+const MetricHistogramInfo &metricHistogramInfo(MetricHistogramId id);
+
+// One distribution; also used on its own by the request tracer (trace.h)
+class MetricHistogram
+{
+private:
+    std::atomic<uint32_t> buckets[METRIC_HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> sum;
+    std::atomic<uint32_t> max;
+
+    static uint32_t percentile(const uint32_t *buckets, uint32_t count, uint32_t max, uint8_t percent);
+
+public:
+    MetricHistogram() { reset(); }
+
+    void observe(uint32_t sample);
+    void summarize(MetricHistogramSummary &summary) const;
+    void reset();
+};
+
+class MetricsRegistry
+{
+private:
+    std::atomic<uint32_t> values[METRIC_COUNT];
+    MetricHistogram histograms[METRIC_HIST_COUNT];
+
+public:
+    MetricsRegistry();
+
+    void add(MetricId id, uint32_t amount = 1) { values[id].fetch_add(amount, std::memory_order_relaxed); }
+    void set(MetricId id, uint32_t value) { values[id].store(value, std::memory_order_relaxed); }
+    uint32_t get(MetricId id) const { return values[id].load(std::memory_order_relaxed); }
+
+    void observe(MetricHistogramId id, uint32_t sample) { histograms[id].observe(sample); }
+    void summarize(MetricHistogramId id, MetricHistogramSummary &summary) const { histograms[id].summarize(summary); }
+
+    // Into the group objects under root, adding any that are missing, or
+    // into one group's object
+    void render(JsonObject root) const;
+    void renderGroup(MetricGroup group, JsonObject into) const;
+
+    void reset();
+};
+
+extern MetricsRegistry metrics;
+
+#endif // METRICS_H
@@ -0,0 +1,67 @@
+/**
+ * Raw Codec - Compact encoding for raw IR timings
+ *
+ * Layout (little endian):
+ *   [0] RAW_CODEC_VERSION  [1] tick in microseconds  [2..3] timing count
+ *   [4] duration count N, then N durations in ticks (LEB128)
+ *   then pair count P, then P pairs of duration indices (mark, space;
+ *   RAW_CODEC_NO_SPACE on a trailing mark)
+ *   then one symbol per mark/space pair, bit-packed LSB first at the
+ *   smallest width holding P + 1 values. Symbol P is a run escape: the
+ *   8 bits after it repeat the previous pair that many times plus two.
+ *
+ * Durations are quantized to the tick. Marks within
+ * RAW_CODEC_TOLERANCE_PERCENT of each other share the midpoint of their
+ * range as one dictionary entry, and so do spaces, so decoding returns
+ * each timing within about that tolerance. Encoding decoded timings again
+ * gives the same bytes.
+ */
+
+#ifndef RAW_CODEC_H
+#define RAW_CODEC_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#define RAW_CODEC_VERSION 1
+#define RAW_CODEC_MAX_DURATIONS 255
+#define RAW_CODEC_MAX_PAIRS 255
+#define RAW_CODEC_NO_SPACE 0xFF
+#define RAW_CODEC_MAX_SIZE (2 * MAX_IR_CODE_SIZE) // Encodings never exceed the plain words
+
+// Working tables for one encode; keep it off small task stacks
+class RawTimingEncoder
+{
+private:
+    uint16_t durations[RAW_CODEC_MAX_DURATIONS]; // Distinct marks, then distinct spaces, each sorted
+    uint8_t entryOf[RAW_CODEC_MAX_DURATIONS];    // Dictionary entry of each distinct value
+    uint16_t entries[RAW_CODEC_MAX_DURATIONS];   // Dictionary values, in ticks
+    uint16_t pairs[RAW_CODEC_MAX_PAIRS];         // mark entry << 8 | space entry
+    uint8_t symbols[(MAX_IR_CODE_SIZE + 1) / 2];
+    uint16_t durationCount;
+    uint16_t markCount;
+    uint16_t entryCount;
+    uint16_t pairCount;
+
+    uint16_t find(uint16_t ticks, bool space) const; // Position in the mark or space run
+    void buildEntries(uint16_t tolerancePercent);
+
+public:
+    // Returns the encoded size, or 0 when the timings are empty, too long,
+    // do not fit `capacity`, or would not come out smaller than plain words
+    size_t encode(const uint16_t *timings, uint16_t length, uint8_t *out, size_t capacity, uint8_t tickUs = RAW_CODEC_TICK_US);
+};
+
+// Timing count of an encoded code, or 0 if the header is not recognised
+uint16_t rawTimingCount(const uint8_t *data, size_t size);
+
+// Decodes into `timings` (microseconds); false if malformed or longer than capacity
+bool decodeRawTimings(const uint8_t *data, size_t size, uint16_t *timings, uint16_t capacity);
+
+// Base64 for carrying encoded timings in JSON
+String base64Encode(const uint8_t *data, size_t length);
+size_t base64Decode(const char *text, size_t length, uint8_t *out, size_t capacity); // 0 if malformed
+
+#endif // RAW_CODEC_H
@@ -0,0 +1,76 @@
+/**
+ * Request Arena - Scratch memory for the command being handled
+ *
+ * The command path takes every JsonDocument pool and scratch string it
+ * needs from one static block instead of the heap, so months of commands
+ * cannot fragment it. Allocation bumps an offset; freeing the newest
+ * block gives it straight back, and anything else is reclaimed when the
+ * ArenaScope around the request ends. A request that outgrows
+ * REQUEST_ARENA_SIZE is served from the heap and counted in the metrics
+ * rather than failed.
+ *
+ * Only the command task allocates from it.
+ */
+
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+class RequestArena
+{
+private:
+    alignas(8) uint8_t buffer[REQUEST_ARENA_SIZE];
+    size_t used;
+    uint32_t top; // Offset of the newest block's header, NO_BLOCK when empty
+    size_t peak;  // Since boot
+
+    static const uint32_t NO_BLOCK = UINT32_MAX;
+
+public:
+    RequestArena();
+
+    void *allocate(size_t size);
+    void deallocate(void *ptr);
+    void *reallocate(void *ptr, size_t size);
+    bool owns(const void *ptr) const { return ptr >= buffer && ptr < buffer + sizeof(buffer); }
+
+    // Scratch strings, kept until the enclosing scope ends
+    const char *format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    const char *copy(const char *text, size_t length);
+
+    // Everything allocated after mark() is released by rewind()
+    size_t mark() const { return used; }
+    void rewind(size_t mark);
+
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    size_t getCapacity() const { return sizeof(buffer); }
+};
+
+extern RequestArena requestArena;
+
+// ArduinoJson allocator drawing from the request arena
+struct ArenaAllocator
+{
+    void *allocate(size_t size) { return requestArena.allocate(size); }
+    void deallocate(void *ptr) { requestArena.deallocate(ptr); }
+    void *reallocate(void *ptr, size_t size) { return requestArena.reallocate(ptr, size); }
+};
+
+typedef BasicJsonDocument<ArenaAllocator> ArenaJsonDocument;
+
+// Releases what the enclosing block allocated from the arena
+class ArenaScope
+{
+private:
+    size_t start;
+
+public:
+    ArenaScope() : start(requestArena.mark()) {}
+    ~ArenaScope() { requestArena.rewind(start); }
+};
+
+#endif // REQUEST_ARENA_H
@@ -0,0 +1,201 @@
+/**
+ * Request Tracer - Where the time between a BLE write and its reply goes
+ *
+ * Probes read the CPU cycle counter around the stages of a request on the
+ * command task: waiting in the command queue, parsing, the handler, device
+ * lookup, IR transmit, persistence and serializing the reply. Stage times
+ * are exclusive (a probe inside another is taken out of it), so the stages
+ * of a request add up to about its total. Each finished request feeds a
+ * latency histogram for its command and one per stage, and is kept in a
+ * ring of the last TRACE_RING_ENTRIES, which TRACE returns over BLE and
+ * the command task prints to Serial on request.
+ *
+ * A reply that waits for the IR task (TRANSMIT, BATCH, RUN_MACRO) parks
+ * its record in the pending slot and resumes it when the send completes;
+ * the wait counts as the transmit stage.
+ *
+ * Only the command task opens requests; probes record nothing while none
+ * is open. With TRACE_ENABLED 0 the TRACE_* macros expand to nothing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "metrics.h"
+#include "json_stream.h"
+
+enum TraceStage : uint8_t
+{
+    TRACE_QUEUE,
+    TRACE_PARSE,
+    TRACE_DISPATCH, // The handler, less the stages inside it
+    TRACE_LOOKUP,
+    TRACE_TRANSMIT,
+    TRACE_PERSIST,
+    TRACE_SERIALIZE, // Including the hand-off to the BLE queue
+    TRACE_STAGE_COUNT
+};
+
+// JSON commands as their command table entry names them, binary ones by opcode
+enum TraceCommand : uint8_t
+{
+    TRACE_CMD_UNKNOWN,
+    TRACE_CMD_LEARN,
+    TRACE_CMD_STOP_LEARN,
+    TRACE_CMD_TRANSMIT,
+    TRACE_CMD_LIST_DEVICES,
+    TRACE_CMD_EXPORT_DEVICES,
+    TRACE_CMD_ADD_DEVICE,
+    TRACE_CMD_DELETE_DEVICE,
+    TRACE_CMD_GET_STATUS,
+    TRACE_CMD_RESET,
+    TRACE_CMD_BATCH,
+    TRACE_CMD_ADD_MACRO,
+    TRACE_CMD_RUN_MACRO,
+    TRACE_CMD_DELETE_MACRO,
+    TRACE_CMD_LIST_MACROS,
+    TRACE_CMD_MONITOR,
+    TRACE_CMD_TRACE,
+    TRACE_CMD_BIN_HELLO,
+    TRACE_CMD_BIN_RESOLVE,
+    TRACE_CMD_BIN_TRANSMIT,
+    TRACE_CMD_BIN_PING,
+    TRACE_CMD_BIN_METRICS,
+    TRACE_CMD_COUNT // Also marks a pending slot with nothing parked
+};
+
+struct TraceRecord
+{
+    uint32_t sequence;
+    uint32_t startCycles;
+    uint32_t parkedCycles; // When it started waiting for the IR task
+    uint32_t totalCycles;
+    uint32_t stageCycles[TRACE_STAGE_COUNT];
+    TraceCommand command;
+};
+
+class Tracer
+{
+private:
+    static const uint8_t kMaxDepth = 4;
+
+    TraceRecord current;
+    bool open;
+    uint8_t depth;
+    uint32_t childCycles[kMaxDepth + 1]; // Finished probes inside each open one
+    uint32_t queuedCycles;               // When the message being handled was queued, 0 if it was not
+    TraceRecord *parkedIn;               // Slot the open request waits in
+
+    TraceRecord ring[TRACE_RING_ENTRIES];
+    uint32_t finished;
+    MetricHistogram commandNs[TRACE_CMD_COUNT];
+    MetricHistogram stageNs[TRACE_STAGE_COUNT];
+
+    void start();
+    void addStage(TraceStage stage, uint32_t cycles);
+
+public:
+    Tracer();
+
+    static uint32_t cycles() { return ESP.getCycleCount(); }
+    static uint32_t toNs(uint32_t cycles);
+    static const char *commandName(TraceCommand command);
+    static const char *stageName(TraceStage stage);
+    static TraceCommand binaryCommandOf(uint8_t opcode);
+
+    // Requests
+    void queued(uint32_t postedCycles) { queuedCycles = postedCycles ? postedCycles : 1; }
+    void begin();
+    void setCommand(TraceCommand command);
+    void end();
+    bool isOpen() const { return open; }
+
+    // Probes, nested at most kMaxDepth deep
+    void enter();
+    void leave(TraceStage stage, uint32_t elapsed);
+
+    // Waiting for the IR task. resume() reopens a request that ended while
+    // parked and returns true; the caller then ends it
+    void park(TraceRecord &slot);
+    bool resume(TraceRecord &slot);
+
+    // Histogram summaries in nanoseconds; records oldest first
+    uint32_t getFinished() const { return finished; }
+    void summarizeCommand(TraceCommand command, MetricHistogramSummary &summary) const { commandNs[command].summarize(summary); }
+    void summarizeStage(TraceStage stage, MetricHistogramSummary &summary) const { stageNs[stage].summarize(summary); }
+    uint8_t getRecent(TraceRecord *out, uint8_t max) const;
+    void write(JsonStreamWriter &out) const;
+    void reset();
+};
+
+extern Tracer tracer;
+
+// Probe for the enclosing block
+class TraceScope
+{
+private:
+    TraceStage stage;
+    uint32_t started;
+    bool active;
+
+public:
+    TraceScope(TraceStage stage) : stage(stage), started(0), active(tracer.isOpen())
+    {
+        if (active)
+        {
+            tracer.enter();
+            started = Tracer::cycles();
+        }
+    }
+    ~TraceScope()
+    {
+        if (active)
+            tracer.leave(stage, Tracer::cycles() - started);
+    }
+};
+
+// One request for the enclosing block
+class TraceRequest
+{
+public:
+    TraceRequest() { tracer.begin(); }
+    ~TraceRequest() { tracer.end(); }
+};
+
+// A parked request picked up again for the enclosing block
+class TraceResume
+{
+private:
+    bool reopened;
+
+public:
+    TraceResume(TraceRecord &slot) : reopened(tracer.resume(slot)) {}
+    ~TraceResume()
+    {
+        if (reopened)
+            tracer.end();
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACE_ENABLED
+#define TRACE_QUEUED(cycles) tracer.queued(cycles)
+#define TRACE_REQUEST() TraceRequest TRACE_CONCAT(traceRequest, __LINE__)
+#define TRACE_COMMAND(command) tracer.setCommand(command)
+#define TRACE_SCOPE(stage) TraceScope TRACE_CONCAT(traceScope, __LINE__)(stage)
+#define TRACE_PARK(slot) tracer.park(slot)
+#define TRACE_RESUME(slot) TraceResume TRACE_CONCAT(traceResume, __LINE__)(slot)
+#else
+#define TRACE_QUEUED(cycles) ((void)0)
+#define TRACE_REQUEST() ((void)0)
+#define TRACE_COMMAND(command) ((void)0)
+#define TRACE_SCOPE(stage) ((void)0)
+#define TRACE_PARK(slot) ((void)0)
+#define TRACE_RESUME(slot) ((void)0)
+#endif
+
+#endif // TRACE_H
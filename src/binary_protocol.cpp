@@ -0,0 +1,107 @@
+/**
+ * Binary Protocol Implementation
+ */
+
+#include "binary_protocol.h"
+#include <string.h>
+
+bool parseBinaryFrame(const uint8_t *data, size_t length, BinaryFrame &frame)
+{
+    if (!data || length < BIN_HEADER_SIZE || length > 0xFFFF || data[0] != BIN_MAGIC)
+        return false;
+
+    frame.version = data[1];
+    frame.opcode = data[2];
+    frame.requestId = data[3] | (data[4] << 8);
+    frame.status = data[5];
+    frame.payload = data + BIN_HEADER_SIZE;
+    frame.payloadLength = length - BIN_HEADER_SIZE;
+
+    // Walk the TLVs once so lookups never have to bounds-check again
+    size_t pos = 0;
+    while (pos < frame.payloadLength)
+    {
+        if (pos + 2 > frame.payloadLength)
+            return false;
+        pos += 2 + frame.payload[pos + 1];
+    }
+    return pos == frame.payloadLength;
+}
+
+bool findBinaryTlv(const BinaryFrame &frame, uint8_t tag, const uint8_t *&value, uint8_t &length)
+{
+    size_t pos = 0;
+    while (pos < frame.payloadLength)
+    {
+        uint8_t tlvLength = frame.payload[pos + 1];
+        if (frame.payload[pos] == tag)
+        {
+            value = frame.payload + pos + 2;
+            length = tlvLength;
+            return true;
+        }
+        pos += 2 + tlvLength;
+    }
+    return false;
+}
+
+bool readBinaryU8(const BinaryFrame &frame, uint8_t tag, uint8_t &value)
+{
+    const uint8_t *tlv;
+    uint8_t length;
+    if (!findBinaryTlv(frame, tag, tlv, length) || length != 1)
+        return false;
+    value = tlv[0];
+    return true;
+}
+
+void BinaryWriter::begin(uint8_t opcode, uint16_t requestId, uint8_t status)
+{
+    length = 0;
+    overflow = capacity < BIN_HEADER_SIZE;
+    if (overflow)
+        return;
+
+    buffer[0] = BIN_MAGIC;
+    buffer[1] = BIN_VERSION;
+    buffer[2] = opcode;
+    buffer[3] = requestId & 0xFF;
+    buffer[4] = requestId >> 8;
+    buffer[5] = status;
+    length = BIN_HEADER_SIZE;
+}
+
+void BinaryWriter::put(uint8_t tag, const uint8_t *value, uint8_t valueLength)
+{
+    if (overflow || length + 2 + valueLength > capacity)
+    {
+        overflow = true;
+        return;
+    }
+
+    buffer[length++] = tag;
+    buffer[length++] = valueLength;
+    memcpy(buffer + length, value, valueLength);
+    length += valueLength;
+}
+
+void BinaryWriter::addU16(uint8_t tag, uint16_t value)
+{
+    uint8_t bytes[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+    put(tag, bytes, 2);
+}
+
+void writeBinaryU32(uint8_t *out, uint32_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = value >> 24;
+}
+
+void BinaryWriter::addU32(uint8_t tag, uint32_t value)
+{
+    uint8_t bytes[4];
+    writeBinaryU32(bytes, value);
+    put(tag, bytes, 4);
+}
@@ -0,0 +1,123 @@
+/**
+ * BLE Framing Implementation
+ */
+
+#include "ble_framing.h"
+#include <string.h>
+
+size_t bleWriteLength(uint8_t *out, size_t length)
+{
+    size_t size = bleLengthSize(length);
+    for (size_t i = 0; i < size; i++)
+        out[i] = (length >> (8 * i)) & 0xFF;
+    return size;
+}
+
+BleFragmenter::BleFragmenter(const uint8_t *data, size_t length, uint16_t packetSize, uint8_t &sequence)
+    : data(data), length(length), offset(0), packetSize(packetSize), sequence(sequence)
+{
+}
+
+size_t BleFragmenter::fragmentCount() const
+{
+    if (!fragmented())
+        return 1;
+    size_t first = packetSize - BLE_FRAG_HEADER_SIZE - bleLengthSize(length);
+    size_t rest = packetSize - BLE_FRAG_HEADER_SIZE;
+    return 1 + (length - first + rest - 1) / rest;
+}
+
+size_t BleFragmenter::next(uint8_t *out)
+{
+    if (!fragmented())
+    {
+        memcpy(out, data, length);
+        offset = length;
+        return length;
+    }
+
+    bool first = offset == 0;
+    size_t header = BLE_FRAG_HEADER_SIZE + (first ? bleLengthSize(length) : 0);
+    size_t chunk = length - offset;
+    if (chunk > packetSize - header)
+        chunk = packetSize - header;
+
+    out[0] = BLE_FRAGMENT_MAGIC;
+    out[1] = sequence++;
+    out[2] = (first ? BLE_FRAG_FIRST : 0) | (offset + chunk < length ? BLE_FRAG_MORE : 0);
+    if (first)
+    {
+        out[2] |= length > BLE_FRAG_MAX_MESSAGE ? BLE_FRAG_LONG : 0;
+        bleWriteLength(out + BLE_FRAG_HEADER_SIZE, length);
+    }
+    memcpy(out + header, data + offset, chunk);
+    offset += chunk;
+    return header + chunk;
+}
+
+BleReassembler::BleReassembler(uint8_t *buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity), length(0), expected(0), nextSequence(0), active(false), dropped(0)
+{
+}
+
+void BleReassembler::reset()
+{
+    length = 0;
+    expected = 0;
+    active = false;
+}
+
+BleReassembly BleReassembler::fail()
+{
+    reset();
+    dropped++;
+    return BLE_REASSEMBLY_ERROR;
+}
+
+BleReassembly BleReassembler::add(const uint8_t *fragment, size_t fragmentLength)
+{
+    if (!isBleFragment(fragment, fragmentLength))
+        return fail();
+
+    uint8_t sequence = fragment[1];
+    uint8_t flags = fragment[2];
+    const uint8_t *payload = fragment + BLE_FRAG_HEADER_SIZE;
+    size_t payloadLength = fragmentLength - BLE_FRAG_HEADER_SIZE;
+
+    if (flags & BLE_FRAG_FIRST)
+    {
+        // A new message replaces an unfinished one
+        if (active)
+            dropped++;
+        reset();
+        size_t lengthSize = flags & BLE_FRAG_LONG ? BLE_FRAG_LONG_LENGTH_SIZE : BLE_FRAG_LENGTH_SIZE;
+        if (payloadLength < lengthSize)
+            return fail();
+        expected = 0;
+        for (size_t i = 0; i < lengthSize; i++)
+            expected |= (size_t)payload[i] << (8 * i);
+        payload += lengthSize;
+        payloadLength -= lengthSize;
+        if (expected > capacity)
+            return fail();
+        active = true;
+    }
+    else if (!active || sequence != nextSequence)
+    {
+        return fail();
+    }
+
+    if (length + payloadLength > expected)
+        return fail();
+    memcpy(buffer + length, payload, payloadLength);
+    length += payloadLength;
+    nextSequence = sequence + 1;
+
+    if (flags & BLE_FRAG_MORE)
+        return BLE_REASSEMBLY_PENDING;
+
+    if (length != expected)
+        return fail();
+    active = false;
+    return BLE_REASSEMBLY_COMPLETE;
+}
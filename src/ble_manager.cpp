@@ -3,6 +3,8 @@
  */
 
 #include "ble_manager.h"
+#include "binary_protocol.h"
+#include "metrics.h"
 #include <ArduinoJson.h>
 
 // Server Callbacks Implementation
@@ -10,27 +12,92 @@ void BLEManager::ServerCallbacks::onConnect(NimBLEServer *pServer)
 {
     manager->deviceConnected = true;
     manager->oldDeviceConnected = manager->deviceConnected;
+    manager->protocolVersion = 0;
+
+    // Framing state is per connection. Send state belongs to whoever holds
+    // sendMutex, which finds out from the generation
+    manager->mtu = BLE_ATT_MTU_DFLT;
+    manager->rxAssembler.reset();
+    manager->flowControl = false;
+    manager->credits = 0;
+    manager->connectionGeneration++;
+    metrics.add(METRIC_BLE_CONNECTS);
+    metrics.set(METRIC_BLE_MTU, BLE_ATT_MTU_DFLT);
     Serial.println("BLE Client connected");
+
+    // Messages queued while disconnected go out on the new connection
+    if (manager->txTask)
+        xTaskNotifyGive(manager->txTask);
 }
 
 void BLEManager::ServerCallbacks::onDisconnect(NimBLEServer *pServer)
 {
     manager->deviceConnected = false;
+    manager->protocolVersion = 0;
+    metrics.add(METRIC_BLE_DISCONNECTS);
     Serial.println("BLE Client disconnected");
     // Start advertising again
     pServer->startAdvertising();
 }
 
+void BLEManager::ServerCallbacks::onMTUChange(uint16_t MTU, ble_gap_conn_desc *desc)
+{
+    manager->mtu = MTU < BLE_MAX_MTU ? MTU : BLE_MAX_MTU;
+    metrics.set(METRIC_BLE_MTU, manager->mtu);
+    Serial.println("BLE MTU: " + String(manager->mtu));
+}
+
 // Characteristic Callbacks Implementation
 void BLEManager::CharacteristicCallbacks::onWrite(NimBLECharacteristic *pCharacteristic)
 {
     std::string value = pCharacteristic->getValue();
-    if (value.length() > 0 && manager->commandCallback)
+    const uint8_t *data = (const uint8_t *)value.data();
+    size_t length = value.length();
+
+    if (!isBleFragment(data, length))
+    {
+        manager->dispatchWrite(data, length);
+        return;
+    }
+
+    if (data[2] & BLE_FRAG_CREDIT)
     {
-        String command = String(value.c_str());
-        Serial.println("Received BLE command: " + command);
-        manager->commandCallback(command);
+        manager->credits += length > BLE_FRAG_HEADER_SIZE ? data[BLE_FRAG_HEADER_SIZE] : 0;
+        manager->flowControl = true;
+        return;
     }
+
+    if (manager->rxAssembler.add(data, length) == BLE_REASSEMBLY_COMPLETE)
+    {
+        manager->dispatchWrite(manager->rxAssembler.data(), manager->rxAssembler.size());
+    }
+}
+
+void BLEManager::CharacteristicCallbacks::onStatus(NimBLECharacteristic *pCharacteristic, Status s, int code)
+{
+    // ERROR_GATT: the host had no buffer for the notification, try again later
+    if (s == ERROR_GATT)
+        manager->notifyFailed = true;
+}
+
+void BLEManager::dispatchWrite(const uint8_t *data, size_t length)
+{
+    // Runs on the BLE host; replies sent from here must not wait for it
+    hostTask = xTaskGetCurrentTaskHandle();
+
+    // Binary frames skip the console echo
+    if (isBinaryFrame(data, length) && binaryCallback)
+    {
+        binaryCallback(data, length);
+    }
+    else if (length > 0 && commandCallback)
+    {
+        Serial.print("Received BLE command: ");
+        Serial.write(data, length);
+        Serial.println();
+        commandCallback((const char *)data, length);
+    }
+    hostTask = nullptr;
 }
 
 BLEManager::BLEManager() : pServer(nullptr),
@@ -38,9 +105,24 @@ BLEManager::BLEManager() : pServer(nullptr),
                            pCharacteristic(nullptr),
                            deviceConnected(false),
                            oldDeviceConnected(false),
+                           protocolVersion(0),
+                           mtu(BLE_ATT_MTU_DFLT),
+                           connectionGeneration(0),
+                           txGeneration(0),
+                           txSequence(0),
+                           sendMutex(nullptr),
+                           flowControl(false),
+                           credits(0),
+                           rxAssembler(rxMessage, sizeof(rxMessage)),
+                           txQueue(txReplyBuffer, sizeof(txReplyBuffer), txEventBuffer, sizeof(txEventBuffer)),
+                           queueMutex(nullptr),
+                           txTask(nullptr),
+                           notifyFailed(false),
+                           hostTask(nullptr),
                            serverCallbacks(nullptr),
                            charCallbacks(nullptr)
 {
+    address[0] = '\0';
 }
 
 BLEManager::~BLEManager()
@@ -55,8 +137,14 @@ bool BLEManager::begin()
 {
     DEBUG_PRINTLN("Initializing BLE Manager...");
 
-    // Initialize BLE device
+    // Initialize BLE device; the central settles the MTU at or below ours
     NimBLEDevice::init(DEVICE_NAME);
+    NimBLEDevice::setMTU(BLE_MAX_MTU);
+    strlcpy(address, NimBLEDevice::getAddress().toString().c_str(), sizeof(address));
+    if (!sendMutex)
+        sendMutex = xSemaphoreCreateMutex();
+    if (!queueMutex)
+        queueMutex = xSemaphoreCreateMutex();
 
     // Create BLE server
     pServer = NimBLEDevice::createServer();
@@ -102,31 +190,332 @@ void BLEManager::update()
     }
 }
 
-bool BLEManager::sendResponse(const String &response)
+bool BLEManager::startTask()
 {
-    if (!deviceConnected || !pCharacteristic)
+    if (txTask)
+        return true;
+
+    if (xTaskCreatePinnedToCore(taskLoop, "ble", BLE_TASK_STACK_SIZE, this, BLE_TASK_PRIORITY, &txTask, BLE_TASK_CORE) != pdPASS)
     {
+        txTask = nullptr;
         return false;
     }
 
+    DEBUG_PRINTLN("BLE task started");
+    return true;
+}
+
+void BLEManager::taskLoop(void *parameter)
+{
+    BLEManager *manager = static_cast<BLEManager *>(parameter);
+    BleTxMessage message;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;)
+        {
+            xSemaphoreTake(manager->queueMutex, portMAX_DELAY);
+            bool ready = manager->deviceConnected && manager->txQueue.front(message);
+            xSemaphoreGive(manager->queueMutex);
+            if (!ready)
+                break;
+
+            // The message stays in the ring while it is sent, so this copies nothing
+            uint32_t generation = manager->connectionGeneration;
+            bool sent = manager->transmit(message.data, message.length);
+
+            xSemaphoreTake(manager->queueMutex, portMAX_DELAY);
+            if (sent || (manager->deviceConnected && manager->connectionGeneration == generation))
+            {
+                if (!sent)
+                    metrics.add(METRIC_BLE_ABANDONED);
+                manager->txQueue.pop(message.lane);
+            }
+            else
+            {
+                // Cut off by a disconnect, even one already reconnected: send
+                // it whole on the current or next connection
+                manager->txQueue.requeue(message.lane);
+            }
+            xSemaphoreGive(manager->queueMutex);
+        }
+    }
+}
+
+uint32_t BLEManager::getStackHighWaterMark()
+{
+    return txTask ? uxTaskGetStackHighWaterMark(txTask) : 0;
+}
+
+bool BLEManager::sendResponse(const String &response)
+{
     DEBUG_PRINT("Sending BLE response: ");
     DEBUG_PRINTLN(response);
 
-    pCharacteristic->setValue(response.c_str());
-    pCharacteristic->notify();
-    return true;
+    return sendResponse((const uint8_t *)response.c_str(), response.length());
+}
+
+bool BLEManager::sendResponse(const uint8_t *data, size_t length)
+{
+    if (!txTask)
+        return transmit(data, length);
+
+    // A full reply lane holds the sender back briefly so replies are not
+    // lost to a slow central. Not the host: the lane drains through it
+    uint32_t waitMs = hostTask && xTaskGetCurrentTaskHandle() == hostTask ? 0 : BLE_TX_QUEUE_WAIT_MS;
+    return enqueue(BLE_LANE_REPLY, data, length, BLE_TX_NO_COALESCE, waitMs);
 }
 
-bool BLEManager::sendNotification(const String &notification)
+bool BLEManager::sendNotification(const String &notification, uint8_t coalesceKey)
 {
-    return sendResponse(notification);
+    return sendNotification((const uint8_t *)notification.c_str(), notification.length(), coalesceKey);
 }
 
-void BLEManager::setCommandCallback(std::function<void(const String &)> callback)
+bool BLEManager::sendNotification(const uint8_t *data, size_t length, uint8_t coalesceKey)
+{
+    if (!txTask)
+        return transmit(data, length);
+
+    return enqueue(BLE_LANE_EVENT, data, length, coalesceKey, 0);
+}
+
+bool BLEManager::enqueue(BleTxLane lane, const uint8_t *data, size_t length, uint8_t key, uint32_t waitMs)
+{
+    if (length > BLE_FRAG_MAX_MESSAGE)
+        return false;
+
+    for (uint32_t waited = 0;; waited++)
+    {
+        xSemaphoreTake(queueMutex, portMAX_DELAY);
+        bool queued = txQueue.push(lane, data, length, key);
+        if (!queued && waited >= waitMs)
+            txQueue.countDropped(lane);
+        xSemaphoreGive(queueMutex);
+
+        if (queued)
+        {
+            xTaskNotifyGive(txTask);
+            return true;
+        }
+        if (waited >= waitMs)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+bool BLEManager::transmit(const uint8_t *data, size_t length)
+{
+    if (!deviceConnected || !pCharacteristic)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(sendMutex, portMAX_DELAY);
+    beginMessage();
+    BleFragmenter fragmenter(data, length, mtu - BLE_ATT_OVERHEAD, txSequence);
+    bool sent = true;
+    do
+    {
+        sent = sendPacket(fragmenter.next(txPacket));
+        if (fragmenter.fragmented())
+            metrics.add(METRIC_BLE_FRAGMENTS_SENT);
+    } while (sent && !fragmenter.done());
+    xSemaphoreGive(sendMutex);
+    return sent;
+}
+
+void BLEManager::beginMessage()
+{
+    uint32_t generation = connectionGeneration;
+    if (txGeneration != generation)
+    {
+        txGeneration = generation;
+        txSequence = 0;
+    }
+}
+
+bool BLEManager::sendPacket(size_t length)
+{
+    // A message begun on an earlier connection is abandoned: its framing,
+    // and its packet size, belong to a link that is gone
+    if (!deviceConnected || connectionGeneration != txGeneration)
+        return false;
+
+    if (!takeCredit())
+    {
+        // The central sees the next message's first fragment and drops this one
+        if (deviceConnected && connectionGeneration == txGeneration)
+            metrics.add(METRIC_BLE_FLOW_TIMEOUTS);
+        return false;
+    }
+    if (connectionGeneration != txGeneration)
+        return false;
+
+    for (uint8_t attempt = 0;; attempt++)
+    {
+        notifyFailed = false;
+        // Not setValue() + notify(): a write from the central could land in between
+        pCharacteristic->notify(txPacket, length);
+        if (!notifyFailed)
+            return true;
+        if (attempt >= BLE_TX_MAX_RETRIES || !deviceConnected || connectionGeneration != txGeneration)
+        {
+            metrics.add(METRIC_BLE_NOTIFY_FAILURES);
+            return false;
+        }
+        metrics.add(METRIC_BLE_NOTIFY_RETRIES);
+        vTaskDelay(pdMS_TO_TICKS(BLE_TX_RETRY_MS));
+    }
+}
+
+// Fills txPacket as the producer writes and sends each packet once full,
+// framed as BleFragmenter would frame the whole message
+class BLEManager::StreamSink : public JsonSink
+{
+private:
+    BLEManager &manager;
+    size_t length;
+    size_t offset; // Message bytes taken so far
+    size_t fill;   // Bytes in txPacket
+    uint16_t packetSize;
+    bool fragmented;
+    bool first;
+
+    void flush()
+    {
+        if (fragmented)
+        {
+            manager.txPacket[0] = BLE_FRAGMENT_MAGIC;
+            manager.txPacket[1] = manager.txSequence++;
+            manager.txPacket[2] = (first ? BLE_FRAG_FIRST : 0) | (offset < length ? BLE_FRAG_MORE : 0);
+            if (first)
+            {
+                manager.txPacket[2] |= length > BLE_FRAG_MAX_MESSAGE ? BLE_FRAG_LONG : 0;
+                bleWriteLength(manager.txPacket + BLE_FRAG_HEADER_SIZE, length);
+            }
+            metrics.add(METRIC_BLE_FRAGMENTS_SENT);
+        }
+        sent = manager.sendPacket(fill);
+        first = false;
+        fill = fragmented ? BLE_FRAG_HEADER_SIZE : 0;
+    }
+
+public:
+    bool sent;
+
+    StreamSink(BLEManager &manager, size_t length)
+        : manager(manager), length(length), offset(0), first(true), sent(true)
+    {
+        manager.beginMessage();
+        packetSize = manager.mtu - BLE_ATT_OVERHEAD;
+        fragmented = length > packetSize;
+        fill = fragmented ? BLE_FRAG_HEADER_SIZE + bleLengthSize(length) : 0;
+    }
+
+    void write(const char *data, size_t count) override
+    {
+        // A failed packet breaks the chain; the rest is not sent
+        if (!sent)
+            return;
+        count = count < length - offset ? count : length - offset;
+        while (count > 0 && sent)
+        {
+            size_t chunk = packetSize - fill < count ? packetSize - fill : count;
+            memcpy(manager.txPacket + fill, data, chunk);
+            fill += chunk;
+            offset += chunk;
+            data += chunk;
+            count -= chunk;
+            if (fill == packetSize && offset < length)
+                flush();
+        }
+    }
+
+    bool finish()
+    {
+        static const char padding[16] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        while (sent && offset < length)
+            write(padding, length - offset < sizeof(padding) ? length - offset : sizeof(padding));
+        if (sent)
+            flush();
+        return sent;
+    }
+};
+
+bool BLEManager::sendStream(size_t length, BleStreamProducer produce, void *context)
+{
+    // The producer reads state only its own task changes, so the stream
+    // is written here rather than queued; it still goes out in order
+    bool sent = deviceConnected && pCharacteristic && length > 0 && waitForReplies();
+    if (sent)
+    {
+        xSemaphoreTake(sendMutex, portMAX_DELAY);
+        StreamSink sink(*this, length);
+        produce(sink, context);
+        sent = sink.finish();
+        xSemaphoreGive(sendMutex);
+    }
+
+    if (!sent)
+    {
+        if (deviceConnected)
+            metrics.add(METRIC_BLE_ABANDONED);
+        if (queueMutex)
+        {
+            xSemaphoreTake(queueMutex, portMAX_DELAY);
+            txQueue.countDropped(BLE_LANE_REPLY);
+            xSemaphoreGive(queueMutex);
+        }
+    }
+    return sent;
+}
+
+bool BLEManager::waitForReplies()
+{
+    if (!txTask)
+        return true;
+
+    for (;;)
+    {
+        xSemaphoreTake(queueMutex, portMAX_DELAY);
+        bool drained = txQueue.empty(BLE_LANE_REPLY);
+        xSemaphoreGive(queueMutex);
+        if (drained)
+            return true;
+        // Queued replies wait for the next connection, and so would this one
+        if (!deviceConnected)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+bool BLEManager::takeCredit()
+{
+    if (!flowControl)
+        return true;
+
+    for (uint32_t waited = 0; credits <= 0; waited++)
+    {
+        if (waited >= BLE_FLOW_TIMEOUT_MS || !deviceConnected || connectionGeneration != txGeneration)
+            return false;
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    credits--;
+    return true;
+}
+
+void BLEManager::setCommandCallback(std::function<void(const char *, size_t)> callback)
 {
     commandCallback = callback;
 }
 
+void BLEManager::setBinaryCallback(std::function<void(const uint8_t *, size_t)> callback)
+{
+    binaryCallback = callback;
+}
+
 void BLEManager::disconnect()
 {
     if (pServer && deviceConnected)
@@ -137,15 +526,35 @@ void BLEManager::disconnect()
 
 String BLEManager::getDeviceAddress()
 {
-    return String(NimBLEDevice::getAddress().toString().c_str());
+    return String(address);
 }
 
-String BLEManager::getStatus()
+void BLEManager::getStatus(JsonObject doc)
 {
-    DynamicJsonDocument doc(256);
     doc["connected"] = deviceConnected;
     doc["advertising"] = pServer ? pServer->getAdvertising()->isAdvertising() : false;
-    doc["address"] = getDeviceAddress();
+    doc["address"] = (const char *)address;
+    doc["fragmentsDropped"] = rxAssembler.getDropped();
+
+    xSemaphoreTake(queueMutex, portMAX_DELAY);
+    JsonObject queue = doc.createNestedObject("txQueue");
+    queue["queued"] = txQueue.getQueued();
+    queue["bytes"] = txQueue.getBytesUsed();
+    queue["peakBytes"] = txQueue.getPeakBytes();
+    queue["total"] = txQueue.getTotalQueued();
+    queue["droppedReplies"] = txQueue.getDropped(BLE_LANE_REPLY);
+    queue["droppedEvents"] = txQueue.getDropped(BLE_LANE_EVENT);
+    queue["coalesced"] = txQueue.getCoalesced();
+    xSemaphoreGive(queueMutex);
+}
+
+String BLEManager::getStatus()
+{
+    DynamicJsonDocument doc(1024);
+    JsonObject status = doc.to<JsonObject>();
+    getStatus(status);
+    metrics.renderGroup(METRIC_GROUP_BLE, status);
+    metrics.renderGroup(METRIC_GROUP_BLE_TX_QUEUE, status["txQueue"]);
 
     String result;
     serializeJson(doc, result);
@@ -0,0 +1,215 @@
+/**
+ * BLE Transmit Queue Implementation
+ */
+
+#include "ble_tx_queue.h"
+#include <string.h>
+
+namespace
+{
+    enum EntryState : uint8_t
+    {
+        ENTRY_LIVE,
+        ENTRY_REPLACED,
+        ENTRY_WRAP // Nothing else fits before the end of the ring
+    };
+}
+
+BleTxRing::BleTxRing(uint8_t *buffer, size_t capacity) : buffer(buffer), capacity(capacity)
+{
+    clear();
+}
+
+void BleTxRing::clear()
+{
+    head = 0;
+    tail = 0;
+    used = 0;
+    count = 0;
+    live = 0;
+    inFlight = false;
+}
+
+size_t BleTxRing::wrap(size_t offset) const
+{
+    if (capacity - offset < BLE_TX_ENTRY_HEADER || buffer[offset + 3] == ENTRY_WRAP)
+        return 0;
+    return offset;
+}
+
+size_t BleTxRing::entryLength(size_t offset) const
+{
+    return BLE_TX_ENTRY_HEADER + (buffer[offset] | (buffer[offset + 1] << 8));
+}
+
+void BleTxRing::skipDead()
+{
+    while (count > 0 && !inFlight)
+    {
+        size_t start = wrap(head);
+        if (start != head)
+        {
+            used -= capacity - head;
+            head = start;
+        }
+        if (buffer[head + 3] != ENTRY_REPLACED)
+            break;
+        size_t length = entryLength(head);
+        head += length;
+        used -= length;
+        count--;
+    }
+    if (count == 0)
+        clear();
+}
+
+bool BleTxRing::push(const uint8_t *data, size_t length, uint8_t key, uint16_t &replaced)
+{
+    size_t need = BLE_TX_ENTRY_HEADER + length;
+    if (length > 0xFFFF || need > capacity)
+        return false;
+
+    if (key != BLE_TX_NO_COALESCE)
+    {
+        size_t offset = head;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            offset = wrap(offset);
+            bool sending = i == 0 && inFlight;
+            if (!sending && buffer[offset + 2] == key && buffer[offset + 3] == ENTRY_LIVE)
+            {
+                buffer[offset + 3] = ENTRY_REPLACED;
+                live--;
+                replaced++;
+            }
+            offset += entryLength(offset);
+        }
+        skipDead();
+    }
+
+    size_t position;
+    if (used == 0 || tail > head)
+    {
+        size_t end = capacity - tail;
+        if (need <= end)
+        {
+            position = tail;
+        }
+        else if (need <= head)
+        {
+            if (end >= BLE_TX_ENTRY_HEADER)
+                buffer[tail + 3] = ENTRY_WRAP;
+            used += end;
+            position = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if (need <= head - tail)
+    {
+        position = tail;
+    }
+    else
+    {
+        return false;
+    }
+
+    buffer[position] = length & 0xFF;
+    buffer[position + 1] = length >> 8;
+    buffer[position + 2] = key;
+    buffer[position + 3] = ENTRY_LIVE;
+    memcpy(buffer + position + BLE_TX_ENTRY_HEADER, data, length);
+    tail = position + need;
+    used += need;
+    count++;
+    live++;
+    return true;
+}
+
+bool BleTxRing::front(const uint8_t *&data, size_t &length)
+{
+    skipDead();
+    if (live == 0)
+        return false;
+
+    inFlight = true;
+    length = entryLength(head) - BLE_TX_ENTRY_HEADER;
+    data = buffer + head + BLE_TX_ENTRY_HEADER;
+    return true;
+}
+
+void BleTxRing::pop()
+{
+    if (!inFlight)
+        return;
+
+    size_t length = entryLength(head);
+    head += length;
+    used -= length;
+    count--;
+    live--;
+    inFlight = false;
+    skipDead();
+}
+
+BleTxQueue::BleTxQueue(uint8_t *replyBuffer, size_t replySize, uint8_t *eventBuffer, size_t eventSize)
+    : lanes{BleTxRing(replyBuffer, replySize), BleTxRing(eventBuffer, eventSize)},
+      peakBytes(0), queued(0), dropped{0, 0}, coalesced(0)
+{
+}
+
+bool BleTxQueue::push(BleTxLane lane, const uint8_t *data, size_t length, uint8_t key)
+{
+    uint16_t replaced = 0;
+    bool pushed = lanes[lane].push(data, length, key, replaced);
+    coalesced += replaced;
+    if (!pushed)
+        return false;
+
+    queued++;
+    size_t bytes = getBytesUsed();
+    if (bytes > peakBytes)
+        peakBytes = bytes;
+    return true;
+}
+
+bool BleTxQueue::front(BleTxMessage &message)
+{
+    for (uint8_t lane = 0; lane < BLE_LANE_COUNT; lane++)
+    {
+        if (lanes[lane].front(message.data, message.length))
+        {
+            message.lane = (BleTxLane)lane;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BleTxQueue::pop(BleTxLane lane)
+{
+    lanes[lane].pop();
+}
+
+void BleTxQueue::requeue(BleTxLane lane)
+{
+    lanes[lane].release();
+}
+
+uint16_t BleTxQueue::getQueued() const
+{
+    uint16_t total = 0;
+    for (const BleTxRing &ring : lanes)
+        total += ring.size();
+    return total;
+}
+
+size_t BleTxQueue::getBytesUsed() const
+{
+    size_t total = 0;
+    for (const BleTxRing &ring : lanes)
+        total += ring.bytesUsed();
+    return total;
+}
@@ -0,0 +1,122 @@
+/**
+ * Capture Pool Implementation
+ */
+
+#include "capture_pool.h"
+
+RawBuffer::RawBuffer(const RawBuffer &other) : pool(other.pool), index(other.index)
+{
+    if (pool)
+        pool->retain(index);
+}
+
+RawBuffer &RawBuffer::operator=(const RawBuffer &other)
+{
+    if (other.pool)
+        other.pool->retain(other.index);
+    reset();
+    pool = other.pool;
+    index = other.index;
+    return *this;
+}
+
+RawBuffer &RawBuffer::operator=(RawBuffer &&other)
+{
+    if (this != &other)
+    {
+        reset();
+        pool = other.pool;
+        index = other.index;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+uint16_t *RawBuffer::data() const
+{
+    return pool ? pool->buffer(index) : nullptr;
+}
+
+void RawBuffer::reset()
+{
+    if (pool)
+        pool->release(index);
+    pool = nullptr;
+    index = CAPTURE_NONE;
+}
+
+uint8_t RawBuffer::detach()
+{
+    uint8_t detached = pool ? index : CAPTURE_NONE;
+    pool = nullptr;
+    index = CAPTURE_NONE;
+    return detached;
+}
+
+CapturePool::CapturePool() : storage(nullptr), psram(false), used(0), peak(0), acquisitions(0), failures(0)
+{
+    for (auto &ref : refs)
+        ref = 0;
+}
+
+CapturePool::~CapturePool()
+{
+    free(storage);
+}
+
+bool CapturePool::begin()
+{
+    if (storage)
+        return true;
+
+    size_t bytes = (size_t)CAPTURE_POOL_BUFFERS * MAX_IR_CODE_SIZE * sizeof(uint16_t);
+#ifdef BOARD_HAS_PSRAM
+    if (psramFound())
+    {
+        storage = (uint16_t *)ps_malloc(bytes);
+        psram = storage != nullptr;
+    }
+#endif
+    if (!storage)
+        storage = (uint16_t *)malloc(bytes);
+
+    if (!storage)
+    {
+        DEBUG_PRINTLN("ERROR: Capture pool allocation failed");
+        return false;
+    }
+    return true;
+}
+
+RawBuffer CapturePool::acquire()
+{
+    for (uint8_t i = 0; storage && i < CAPTURE_POOL_BUFFERS; i++)
+    {
+        // Claiming a free buffer is a 0 -> 1 swap, so no lock is needed
+        uint8_t expected = 0;
+        if (refs[i].compare_exchange_strong(expected, 1))
+        {
+            uint8_t nowUsed = used.fetch_add(1) + 1;
+            uint8_t oldPeak = peak;
+            while (nowUsed > oldPeak && !peak.compare_exchange_weak(oldPeak, nowUsed))
+            {
+            }
+            acquisitions.fetch_add(1);
+            return RawBuffer(this, i);
+        }
+    }
+
+    failures.fetch_add(1);
+    return RawBuffer();
+}
+
+RawBuffer CapturePool::adopt(uint8_t index)
+{
+    return index < CAPTURE_POOL_BUFFERS ? RawBuffer(this, index) : RawBuffer();
+}
+
+void CapturePool::release(uint8_t index)
+{
+    if (refs[index].fetch_sub(1) == 1)
+        used.fetch_sub(1);
+}
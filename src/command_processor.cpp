@@ -3,9 +3,44 @@
  */
 
 #include "command_processor.h"
+#include "metrics.h"
+#include "request_arena.h"
 
-CommandProcessor::CommandProcessor() : irManager(nullptr), bleManager(nullptr), deviceManager(nullptr)
+namespace
 {
+  // Code values as String(value, HEX) wrote them, in the arena
+  const char *hexValue(uint64_t value)
+  {
+    return requestArena.format("%llx", (unsigned long long)value);
+  }
+
+  // The request trace goes to the console as it is written
+  class JsonSerialSink : public JsonSink
+  {
+  public:
+    void write(const char *data, size_t length) override { Serial.write((const uint8_t *)data, length); }
+  };
+
+  // A command with required parameters says what to reply when they are missing
+  constexpr bool requiresParameter(const CommandParam *params, size_t i = 0)
+  {
+    return i < COMMAND_MAX_PARAMS && params[i].name && (params[i].required || requiresParameter(params, i + 1));
+  }
+
+  constexpr bool explainsMissing(const CommandProcessor::CommandSpec *specs, size_t count)
+  {
+    return count == 0 || ((specs->missing || !requiresParameter(specs->params)) && explainsMissing(specs + 1, count - 1));
+  }
+}
+
+CommandProcessor::CommandProcessor() : irManager(nullptr), bleManager(nullptr), deviceManager(nullptr),
+                                       commandTask(nullptr), commandQueue(nullptr), learnJobId(0),
+                                       pendingSightings(0)
+{
+  memset(pendingTransmits, 0, sizeof(pendingTransmits));
+  memset(pendingBatches, 0, sizeof(pendingBatches));
+  replyTo[0] = '\0';
+  learnReplyTo[0] = '\0';
 }
 
 CommandProcessor::~CommandProcessor()
@@ -18,6 +53,12 @@ void CommandProcessor::begin(IRManager *ir, BLEManager *ble, DeviceManager *devi
   bleManager = ble;
   deviceManager = device;
 
+  if (irManager)
+  {
+    irManager->setLearnCallback(onLearnComplete, this);
+    irManager->setMonitorCallback(onCodeSeen, this);
+  }
+
   DEBUG_PRINTLN("Command Processor initialized");
 }
 
@@ -27,12 +68,174 @@ void CommandProcessor::update()
   // Currently no periodic tasks required
 }
 
-void CommandProcessor::processCommand(const String &commandJson)
+bool CommandProcessor::startTask()
+{
+  if (commandTask)
+    return true;
+
+  commandQueue = xQueueCreate(CMD_QUEUE_LENGTH, sizeof(CommandMessage));
+  if (!commandQueue)
+    return false;
+
+  if (xTaskCreatePinnedToCore(taskLoop, "command", CMD_TASK_STACK_SIZE, this, CMD_TASK_PRIORITY, &commandTask, CMD_TASK_CORE) != pdPASS)
+  {
+    commandTask = nullptr;
+    return false;
+  }
+
+  DEBUG_PRINTLN("Command task started");
+  return true;
+}
+
+void CommandProcessor::taskLoop(void *parameter)
+{
+  CommandProcessor *processor = static_cast<CommandProcessor *>(parameter);
+
+  // Static: a message is larger than is comfortable on the task stack
+  static CommandMessage message;
+
+  for (;;)
+  {
+    if (xQueueReceive(processor->commandQueue, &message, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    if (message.type == MSG_TRANSMIT_DONE)
+    {
+      PendingTransmit &pending = processor->pendingTransmits[message.slot];
+      pending.success = message.success;
+      processor->finishTransmit(pending);
+    }
+    else if (message.type == MSG_BATCH_DONE)
+    {
+      PendingBatch &pending = processor->pendingBatches[message.slot];
+      pending.success = message.success;
+      processor->finishBatch(pending);
+    }
+    else if (message.type == MSG_BINARY)
+    {
+      TRACE_QUEUED(message.postedCycles);
+      processor->processBinary((const uint8_t *)message.data, message.length);
+    }
+    else if (message.type == MSG_LEARN_DONE)
+    {
+      IRCode code = IRCode();
+      code.protocol = message.protocol;
+      code.data = message.value;
+      code.bits = message.bits;
+      processor->finishLearn(message.jobId, message.success ? &code : nullptr);
+    }
+    else if (message.type == MSG_CODE_SEEN)
+    {
+      processor->pendingSightings--;
+      IRCode code = IRCode();
+      code.protocol = message.protocol;
+      code.data = message.value;
+      code.bits = message.bits;
+      code.rawData = message.length ? (uint16_t *)message.data : nullptr;
+      code.rawLen = message.length / sizeof(uint16_t);
+      processor->finishCodeSeen(code);
+    }
+    else if (message.type == MSG_TRACE_DUMP)
+    {
+      processor->dumpTrace();
+    }
+    else
+    {
+      TRACE_QUEUED(message.postedCycles);
+      processor->processCommand(message.data, message.length);
+    }
+  }
+}
+
+uint32_t CommandProcessor::getStackHighWaterMark()
+{
+  return commandTask ? uxTaskGetStackHighWaterMark(commandTask) : 0;
+}
+
+bool CommandProcessor::enqueueCommand(const char *json, size_t length)
 {
-  DEBUG_PRINTLN("Processing command: " + commandJson);
+  if (!commandQueue)
+  {
+    processCommand(json, length);
+    return true;
+  }
 
-  DynamicJsonDocument doc(1024);
-  DeserializationError error = deserializeJson(doc, commandJson);
+  char requestId[REQUEST_ID_MAX_SIZE + 1];
+  if (length >= CMD_MAX_SIZE)
+  {
+    char details[40];
+    snprintf(details, sizeof(details), "Command exceeds %d bytes", CMD_MAX_SIZE);
+    peekRequestId(json, length, requestId);
+    sendRejection("COMMAND_TOO_LARGE", details, requestId);
+    return false;
+  }
+
+  if (!postCommand(MSG_COMMAND, json, length))
+  {
+    peekRequestId(json, length, requestId);
+    sendRejection("BUSY", "Command queue full", requestId);
+    return false;
+  }
+  return true;
+}
+
+bool CommandProcessor::enqueueBinary(const uint8_t *data, size_t length)
+{
+  if (!commandQueue)
+  {
+    processBinary(data, length);
+    return true;
+  }
+
+  uint8_t opcode = length > 2 ? data[2] : 0;
+  uint16_t requestId = length >= BIN_HEADER_SIZE ? (data[3] | (data[4] << 8)) : 0;
+
+  if (length >= CMD_MAX_SIZE)
+  {
+    sendBinaryStatus(opcode, requestId, BIN_STATUS_TOO_LARGE);
+    return false;
+  }
+
+  if (!postCommand(MSG_BINARY, (const char *)data, length))
+  {
+    sendBinaryStatus(opcode, requestId, BIN_STATUS_BUSY);
+    return false;
+  }
+  return true;
+}
+
+bool CommandProcessor::postCommand(MessageType type, const char *data, size_t length)
+{
+  // Called from the NimBLE host task: copy and return without blocking
+  static CommandMessage message;
+  message.type = type;
+  message.length = length;
+  memcpy(message.data, data, length);
+#if TRACE_ENABLED
+  message.postedCycles = Tracer::cycles();
+#endif
+
+  if (xQueueSend(commandQueue, &message, 0) != pdPASS)
+  {
+    metrics.add(METRIC_COMMANDS_DROPPED);
+    return false;
+  }
+  return true;
+}
+
+void CommandProcessor::processCommand(const char *json, size_t length)
+{
+  TRACE_REQUEST();
+  DEBUG_PRINTLN("Processing command");
+
+  // The document, its strings and the reply all come from the arena
+  ArenaScope scope;
+  ArenaJsonDocument doc(2 * CMD_MAX_SIZE);
+  DeserializationError error;
+  {
+    TRACE_SCOPE(TRACE_PARSE);
+    error = deserializeJson(doc, json, length);
+  }
 
   if (error)
   {
@@ -40,142 +243,727 @@ void CommandProcessor::processCommand(const String &commandJson)
     return;
   }
 
-  String command = doc["command"];
-  if (command.isEmpty())
+  if (!readRequestId(doc["requestId"], replyTo))
+  {
+    sendError("INVALID_REQUEST_ID", requestArena.format("requestId must be a string or integer of at most %d characters", REQUEST_ID_MAX_SIZE));
+    return;
+  }
+
+  dispatchCommand(doc);
+  replyTo[0] = '\0';
+}
+
+bool CommandProcessor::readRequestId(JsonVariantConst id, char *out)
+{
+  out[0] = '\0';
+  if (id.isNull())
+    return true;
+  if (!id.is<const char *>() && !id.is<long>() && !id.is<unsigned long>())
+    return false;
+  if (measureJson(id) > REQUEST_ID_MAX_SIZE)
+    return false;
+  serializeJson(id, out, REQUEST_ID_MAX_SIZE + 1);
+  return true;
+}
+
+void CommandProcessor::peekRequestId(const char *json, size_t length, char *out)
+{
+  // Rejected before reaching the command task: parse only the requestId
+  StaticJsonDocument<16> filter;
+  filter["requestId"] = true;
+  StaticJsonDocument<96> doc;
+  deserializeJson(doc, json, length, DeserializationOption::Filter(filter));
+  readRequestId(doc["requestId"], out);
+}
+
+// The JSON command set. A command is added here: its name, its handler, the
+// trace it is counted under, and the parameters it reads
+constexpr CommandProcessor::CommandSpec CommandProcessor::commands[] = {
+  {CMD_LEARN, &CommandProcessor::handleLearnCommand, TRACE_CMD_LEARN, "Parameters must be a valid object",
+   {{"timeout", PARAM_INTEGER, false}, {"captures", PARAM_INTEGER, false}}},
+  {CMD_STOP_LEARN, &CommandProcessor::handleStopLearnCommand, TRACE_CMD_STOP_LEARN, nullptr, {}},
+  {CMD_TRANSMIT, &CommandProcessor::handleTransmitCommand, TRACE_CMD_TRANSMIT, "Device and command parameters required",
+   {{"device", PARAM_STRING, true}, {"command", PARAM_STRING, true}}},
+  {CMD_LIST_DEVICES, &CommandProcessor::handleListDevicesCommand, TRACE_CMD_LIST_DEVICES, nullptr, {}},
+  {CMD_EXPORT_DEVICES, &CommandProcessor::handleExportDevicesCommand, TRACE_CMD_EXPORT_DEVICES, nullptr, {}},
+  {CMD_ADD_DEVICE, &CommandProcessor::handleAddDeviceCommand, TRACE_CMD_ADD_DEVICE, "Name and type parameters required",
+   {{"name", PARAM_STRING, true}, {"type", PARAM_STRING, true}, {"manufacturer", PARAM_STRING, false}, {"model", PARAM_STRING, false}}},
+  {CMD_DELETE_DEVICE, &CommandProcessor::handleDeleteDeviceCommand, TRACE_CMD_DELETE_DEVICE, "Name parameter required",
+   {{"name", PARAM_STRING, true}}},
+  {CMD_GET_STATUS, &CommandProcessor::handleGetStatusCommand, TRACE_CMD_GET_STATUS, nullptr, {}},
+  {CMD_RESET, &CommandProcessor::handleResetCommand, TRACE_CMD_RESET, nullptr, {{"type", PARAM_STRING, false}}},
+  {CMD_BATCH, &CommandProcessor::handleBatchCommand, TRACE_CMD_BATCH, "Steps parameter required",
+   {{"steps", PARAM_ARRAY, true}}},
+  {CMD_ADD_MACRO, &CommandProcessor::handleAddMacroCommand, TRACE_CMD_ADD_MACRO, "Name and steps parameters required",
+   {{"name", PARAM_STRING, true}, {"steps", PARAM_ARRAY, true}}},
+  {CMD_RUN_MACRO, &CommandProcessor::handleRunMacroCommand, TRACE_CMD_RUN_MACRO, "Name parameter required",
+   {{"name", PARAM_STRING, true}}},
+  {CMD_DELETE_MACRO, &CommandProcessor::handleDeleteMacroCommand, TRACE_CMD_DELETE_MACRO, "Name parameter required",
+   {{"name", PARAM_STRING, true}}},
+  {CMD_LIST_MACROS, &CommandProcessor::handleListMacrosCommand, TRACE_CMD_LIST_MACROS, nullptr, {}},
+  {CMD_MONITOR, &CommandProcessor::handleMonitorCommand, TRACE_CMD_MONITOR, "enabled must be true or false",
+   {{"enabled", PARAM_BOOLEAN, true}}},
+  {CMD_TRACE, &CommandProcessor::handleTraceCommand, TRACE_CMD_TRACE, nullptr, {{"clear", PARAM_BOOLEAN, false}}},
+};
+
+const CommandProcessor::CommandSpec *CommandProcessor::findCommand(const char *name)
+{
+  typedef CommandHash<CommandSpec, sizeof(commands) / sizeof(commands[0])> TableHash;
+  static constexpr TableHash table = TableHash::build(commands);
+  static_assert(table.found(), "no seed gives every command name a slot of its own");
+  static_assert(explainsMissing(commands, sizeof(commands) / sizeof(commands[0])), "commands with required parameters need a missing message");
+  return table.find(commands, name);
+}
+
+void CommandProcessor::dispatchCommand(const JsonDocument &doc)
+{
+  metrics.add(METRIC_COMMANDS_PROCESSED);
+  TRACE_SCOPE(TRACE_DISPATCH);
+  const char *command = doc["command"] | "";
+  if (!command[0])
   {
     sendError("MISSING_COMMAND", "Command field is required");
     return;
   }
 
-  // Route to appropriate handler
-  if (command == CMD_LEARN)
+  const CommandSpec *spec = findCommand(command);
+  if (!spec)
+  {
+    sendError("UNKNOWN_COMMAND", requestArena.format("Command not recognized: %s", command));
+    return;
+  }
+  TRACE_COMMAND(spec->trace);
+
+  const CommandParam *failed = nullptr;
+  switch (checkParameters(doc["parameters"], spec->params, spec->missing != nullptr, failed))
+  {
+  case PARAMS_MISSING:
+    sendError("MISSING_PARAMETERS", spec->missing);
+    return;
+  case PARAMS_WRONG_TYPE:
+    sendError("INVALID_PARAMETER", requestArena.format("%s must be %s", failed->name, commandParamTypeName(failed->type)));
+    return;
+  default:
+    break;
+  }
+
+  (this->*spec->handler)(doc);
+}
+
+void CommandProcessor::handleLearnCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling LEARN command");
+
+  if (!irManager)
+  {
+    sendError("IR_MANAGER_ERROR", "IR Manager not available");
+    return;
+  }
+
+  JsonVariantConst timeoutParam = cmd["parameters"]["timeout"];
+  if (!timeoutParam.isNull() && (timeoutParam < 1 || timeoutParam > IR_LEARN_MAX_TIMEOUT_MS))
+  {
+    sendError("INVALID_TIMEOUT", requestArena.format("timeout must be 1 to %d ms", IR_LEARN_MAX_TIMEOUT_MS));
+    return;
+  }
+  unsigned long timeout = timeoutParam | IR_TIMEOUT_MS;
+  JsonVariantConst captures = cmd["parameters"]["captures"];
+  if (!captures.isNull() && (!captures.is<int>() || captures < 1 || captures > IR_LEARN_MAX_CAPTURES))
+  {
+    sendError("INVALID_CAPTURES", requestArena.format("captures must be 1 to %d", IR_LEARN_MAX_CAPTURES));
+    return;
+  }
+  uint8_t captureCount = captures | 1;
+
+  // Learning runs in IRManager::update(); the result arrives as a LEARN_RESULT notification
+  uint32_t jobId = irManager->startLearning(timeout, captureCount);
+  if (jobId)
+  {
+    learnJobId = jobId;
+    strlcpy(learnReplyTo, replyTo, sizeof(learnReplyTo));
+
+    ArenaJsonDocument responseData(256);
+    responseData["jobId"] = jobId;
+    responseData["timeout"] = timeout;
+    responseData["captures"] = captureCount;
+    responseData["status"] = "learning";
+
+    sendResponse(RESP_OK, "IR learning started", &responseData);
+  }
+  else if (irManager->isLearning())
+  {
+    sendError("LEARN_BUSY", requestArena.format("Learning job %lu already in progress", (unsigned long)irManager->getLearnJobId()));
+  }
+  else
+  {
+    sendError("LEARN_ERROR", "Failed to start IR learning");
+  }
+}
+
+void CommandProcessor::handleStopLearnCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling STOP_LEARN command");
+
+  if (!irManager)
+  {
+    sendError("IR_MANAGER_ERROR", "IR Manager not available");
+    return;
+  }
+
+  uint32_t jobId = irManager->stopLearning();
+  if (!jobId)
+  {
+    sendError("NOT_LEARNING", "No learning job in progress");
+    return;
+  }
+
+  ArenaJsonDocument responseData(256);
+  responseData["jobId"] = jobId;
+
+  sendResponse(RESP_OK, "IR learning stopped", &responseData);
+  sendResponse(RESP_CANCELLED, "Learning cancelled", &responseData, EVENT_LEARN_RESULT, jobId == learnJobId ? learnReplyTo : "");
+}
+
+void CommandProcessor::onLearnComplete(void *context, uint32_t jobId, const IRCode *code)
+{
+  CommandProcessor *processor = static_cast<CommandProcessor *>(context);
+
+  if (!processor->commandQueue)
+  {
+    processor->finishLearn(jobId, code);
+    return;
+  }
+
+  // Running on the IR task: hand the result back to the command task
+  static CommandMessage message;
+  message.type = MSG_LEARN_DONE;
+  message.jobId = jobId;
+  message.success = code != nullptr;
+  message.protocol = code ? code->protocol : UNKNOWN;
+  message.value = code ? code->data : 0;
+  message.bits = code ? code->bits : 0;
+  message.length = 0;
+  xQueueSendToFront(processor->commandQueue, &message, portMAX_DELAY);
+}
+
+void CommandProcessor::finishLearn(uint32_t jobId, const IRCode *code)
+{
+  ArenaScope scope;
+  ArenaJsonDocument learnedData(1536);
+  learnedData["jobId"] = jobId;
+
+  // The result answers the LEARN that started the job
+  const char *requestId = jobId == learnJobId ? learnReplyTo : "";
+
+  // How the presses agreed, when the job asked for more than one. Static:
+  // a report of every press is large for the task stack
+  static IRLearnReport report;
+  if (irManager)
+  {
+    irManager->getLearnReport(report);
+  }
+  bool reported = irManager && report.jobId == jobId && report.target > 1;
+  if (reported)
+  {
+    describeLearnReport(report, learnedData);
+  }
+
+  if (code)
+  {
+    learnedData["protocol"] = typeToString(code->protocol);
+    learnedData["value"] = hexValue(code->data);
+    learnedData["bits"] = code->bits;
+
+    // A button already stored is reported with the command holding it. The
+    // queued result carries no timings, so they come from the IR manager
+    IRCode learned = irManager && irManager->hasLearnedCode() ? irManager->getLearnedCode() : *code;
+    char deviceName[MAX_DEVICE_NAME + 1], commandName[MAX_DEVICE_NAME + 1];
+    if (deviceManager && deviceManager->findDuplicate(learned, deviceName, commandName))
+    {
+      JsonObject duplicate = learnedData.createNestedObject("duplicateOf");
+      duplicate["device"] = deviceName;
+      duplicate["command"] = commandName;
+    }
+    else if (deviceManager && !deviceManager->hasRawSpace(learned))
+    {
+      // Refused now rather than when the client tries to store it
+      learnedData["error"] = "RAW_STORAGE_FULL";
+      learnedData["details"] = "No room for more raw timings; delete undecoded commands first";
+      sendResponse(RESP_ERROR, "Raw storage full", &learnedData, EVENT_LEARN_RESULT, requestId);
+      return;
+    }
+
+    sendResponse(RESP_OK, "IR code learned successfully", &learnedData, EVENT_LEARN_RESULT, requestId);
+  }
+  else if (reported && report.status == LEARN_DISAGREED)
+  {
+    sendResponse(RESP_MISMATCH, "Captures did not agree", &learnedData, EVENT_LEARN_RESULT, requestId);
+  }
+  else
+  {
+    sendResponse(RESP_TIMEOUT, "Learning timeout - no IR signal received", &learnedData, EVENT_LEARN_RESULT, requestId);
+  }
+}
+
+void CommandProcessor::describeLearnReport(const IRLearnReport &report, JsonDocument &data)
+{
+  data["captures"] = report.taken;
+  data["agreeing"] = report.agreeing;
+  data["confidence"] = report.confidence;
+  data["deviation"] = report.deviation;
+  data["elapsedMs"] = report.elapsedMs;
+
+  // Only the presses left out of the result are described
+  JsonArray mismatches = data.createNestedArray("mismatches");
+  for (uint8_t i = 0; i < report.taken; i++)
+  {
+    const IRLearnCapture &capture = report.captures[i];
+    if (capture.mismatch == MISMATCH_NONE)
+    {
+      continue;
+    }
+    JsonObject entry = mismatches.createNestedObject();
+    entry["capture"] = i + 1;
+    entry["reason"] = irLearnMismatchName(capture.mismatch);
+    entry["protocol"] = typeToString(capture.protocol);
+    if (capture.protocol != UNKNOWN)
+    {
+      entry["value"] = hexValue(capture.data);
+      entry["bits"] = capture.bits;
+    }
+    else
+    {
+      entry["timings"] = capture.rawLen;
+    }
+    if (capture.mismatch == MISMATCH_TIMING)
+    {
+      entry["at"] = capture.mismatchAt;
+    }
+  }
+}
+
+void CommandProcessor::onCodeSeen(void *context, const IRCode &code)
+{
+  CommandProcessor *processor = static_cast<CommandProcessor *>(context);
+
+  if (!processor->commandQueue)
+  {
+    processor->finishCodeSeen(code);
+    return;
+  }
+
+  // Running on the IR task: the command task matches the code. A held
+  // remote must not crowd BLE commands out of the queue, so sightings
+  // beyond IR_MONITOR_MAX_PENDING are dropped and counted
+  if (processor->pendingSightings >= IR_MONITOR_MAX_PENDING)
+  {
+    metrics.add(METRIC_MONITOR_DROPPED);
+    return;
+  }
+
+  static_assert(MAX_IR_CODE_SIZE * sizeof(uint16_t) <= CMD_MAX_SIZE, "a sighting's timings fit a message");
+  static CommandMessage message;
+  message.type = MSG_CODE_SEEN;
+  message.protocol = code.protocol;
+  message.value = code.data;
+  message.bits = code.bits;
+  message.length = code.rawData ? code.rawLen * sizeof(uint16_t) : 0;
+  memcpy(message.data, code.rawData, message.length);
+  processor->pendingSightings++;
+  if (xQueueSend(processor->commandQueue, &message, 0) != pdPASS)
+  {
+    processor->pendingSightings--;
+    metrics.add(METRIC_MONITOR_DROPPED);
+  }
+}
+
+void CommandProcessor::finishCodeSeen(const IRCode &code)
+{
+  ArenaScope scope;
+  char deviceName[MAX_DEVICE_NAME + 1], commandName[MAX_DEVICE_NAME + 1];
+  if (!deviceManager || !deviceManager->findDuplicate(code, deviceName, commandName))
+  {
+    metrics.add(METRIC_MONITOR_UNMATCHED);
+    return;
+  }
+  metrics.add(METRIC_MONITOR_MATCHED);
+
+  ArenaJsonDocument seenData(256);
+  seenData["device"] = deviceName;
+  seenData["command"] = commandName;
+  seenData["protocol"] = typeToString(code.protocol);
+  if (code.protocol != UNKNOWN)
+  {
+    seenData["value"] = hexValue(code.data);
+  }
+  sendResponse(RESP_OK, requestArena.format("%s/%s seen", deviceName, commandName), &seenData, EVENT_CODE_SEEN, "");
+}
+
+void CommandProcessor::handleTransmitCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling TRANSMIT command");
+
+  if (!irManager || !deviceManager)
+  {
+    sendError("MANAGER_ERROR", "Required managers not available");
+    return;
+  }
+
+  const char *deviceName = cmd["parameters"]["device"] | "";
+  const char *commandName = cmd["parameters"]["command"] | "";
+
+  IRCode code;
+  bool found;
+  {
+    TRACE_SCOPE(TRACE_LOOKUP);
+    found = deviceManager->getCommand(deviceName, commandName, code);
+  }
+  if (!found)
+  {
+    sendError("COMMAND_NOT_FOUND", requestArena.format("Command '%s' not found for device '%s'", commandName, deviceName));
+    return;
+  }
+
+  PendingTransmit *pending = claimPendingTransmit();
+  if (!pending)
+  {
+    sendError("BUSY", "Too many transmissions in progress");
+    return;
+  }
+
+  strlcpy(pending->replyTo, replyTo, sizeof(pending->replyTo));
+  strlcpy(pending->device, deviceName, sizeof(pending->device));
+  strlcpy(pending->command, commandName, sizeof(pending->command));
+
+  // The reply is sent from finishTransmit() once the IR task is done
+  TRACE_PARK(pending->trace);
+  if (!irManager->queueTransmit(code, onTransmitComplete, pending))
+  {
+    TRACE_RESUME(pending->trace);
+    pending->inUse = false;
+    sendError("BUSY", "IR transmit queue full");
+  }
+}
+
+CommandProcessor::PendingTransmit *CommandProcessor::claimPendingTransmit()
+{
+  for (uint8_t i = 0; i < IR_QUEUE_LENGTH; i++)
+  {
+    PendingTransmit &pending = pendingTransmits[i];
+    if (!pending.inUse)
+    {
+      pending.owner = this;
+      pending.inUse = true;
+      pending.binary = false;
+      pending.requestId = 0;
+      pending.replyTo[0] = '\0';
+      return &pending;
+    }
+  }
+  return nullptr;
+}
+
+void CommandProcessor::onTransmitComplete(void *context, bool success)
+{
+  PendingTransmit *pending = static_cast<PendingTransmit *>(context);
+  CommandProcessor *processor = pending->owner;
+
+  if (!processor->commandQueue)
+  {
+    pending->success = success;
+    processor->finishTransmit(*pending);
+    return;
+  }
+
+  // Running on the IR task: hand the reply back to the command task
+  static CommandMessage message;
+  message.type = MSG_TRANSMIT_DONE;
+  message.slot = pending - processor->pendingTransmits;
+  message.success = success;
+  message.length = 0;
+  xQueueSendToFront(processor->commandQueue, &message, portMAX_DELAY);
+}
+
+void CommandProcessor::finishTransmit(PendingTransmit &pending)
+{
+  TRACE_RESUME(pending.trace);
+  ArenaScope scope;
+  if (pending.binary)
+  {
+    sendBinaryStatus(BIN_OP_TRANSMIT, pending.requestId, pending.success ? BIN_STATUS_OK : BIN_STATUS_TRANSMIT_ERROR);
+  }
+  else if (pending.success)
+  {
+    ArenaJsonDocument responseData(256);
+    responseData["device"] = pending.device;
+    responseData["command"] = pending.command;
+
+    sendResponse(RESP_OK, "IR command transmitted successfully", &responseData, nullptr, pending.replyTo);
+  }
+  else
+  {
+    sendError("TRANSMIT_ERROR", "Failed to transmit IR command", pending.replyTo);
+  }
+
+  pending.inUse = false;
+}
+
+void CommandProcessor::handleBatchCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling BATCH command");
+
+  if (!irManager || !deviceManager)
+  {
+    sendError("MANAGER_ERROR", "Required managers not available");
+    return;
+  }
+
+  MacroStep steps[BATCH_MAX_STEPS];
+  uint8_t count;
+  if (parseSteps(cmd["parameters"]["steps"], steps, count))
+  {
+    runSteps(steps, count, "");
+  }
+}
+
+void CommandProcessor::handleAddMacroCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling ADD_MACRO command");
+
+  if (!deviceManager)
+  {
+    sendError("DEVICE_MANAGER_ERROR", "Device Manager not available");
+    return;
+  }
+
+  const char *name = cmd["parameters"]["name"] | "";
+  MacroStep steps[BATCH_MAX_STEPS];
+  uint8_t count;
+  if (!parseSteps(cmd["parameters"]["steps"], steps, count))
   {
-    handleLearnCommand(doc);
+    return;
   }
-  else if (command == CMD_TRANSMIT)
+
+  if (deviceManager->setMacro(name, steps, count))
   {
-    handleTransmitCommand(doc);
+    ArenaJsonDocument responseData(256);
+    responseData["macro"] = name;
+    responseData["steps"] = count;
+
+    sendResponse(RESP_OK, "Macro stored successfully", &responseData);
   }
-  else if (command == CMD_LIST_DEVICES)
+  else
   {
-    handleListDevicesCommand(doc);
+    sendError("ADD_MACRO_ERROR", requestArena.format("Failed to store macro (invalid name or %d macros stored)", MAX_MACROS));
   }
-  else if (command == CMD_ADD_DEVICE)
+}
+
+void CommandProcessor::handleRunMacroCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling RUN_MACRO command");
+
+  if (!irManager || !deviceManager)
   {
-    handleAddDeviceCommand(doc);
+    sendError("MANAGER_ERROR", "Required managers not available");
+    return;
   }
-  else if (command == CMD_DELETE_DEVICE)
+
+  const char *name = cmd["parameters"]["name"] | "";
+  MacroStep steps[BATCH_MAX_STEPS];
+  uint8_t count;
+  if (!deviceManager->getMacro(name, steps, count))
   {
-    handleDeleteDeviceCommand(doc);
+    sendError("MACRO_NOT_FOUND", requestArena.format("Macro '%s' not found", name));
+    return;
   }
-  else if (command == CMD_GET_STATUS)
+
+  runSteps(steps, count, name);
+}
+
+void CommandProcessor::handleDeleteMacroCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling DELETE_MACRO command");
+
+  if (!deviceManager)
   {
-    handleGetStatusCommand(doc);
+    sendError("DEVICE_MANAGER_ERROR", "Device Manager not available");
+    return;
   }
-  else if (command == CMD_RESET)
+
+  const char *name = cmd["parameters"]["name"] | "";
+  if (deviceManager->removeMacro(name))
   {
-    handleResetCommand(doc);
+    ArenaJsonDocument responseData(256);
+    responseData["macro"] = name;
+
+    sendResponse(RESP_OK, "Macro deleted successfully", &responseData);
   }
   else
   {
-    sendError("UNKNOWN_COMMAND", "Command not recognized: " + command);
+    sendError("MACRO_NOT_FOUND", requestArena.format("Macro '%s' not found", name));
   }
 }
 
-void CommandProcessor::handleLearnCommand(const JsonDocument &cmd)
+void CommandProcessor::handleListMacrosCommand(const JsonDocument &cmd)
 {
-  DEBUG_PRINTLN("Handling LEARN command");
+  DEBUG_PRINTLN("Handling LIST_MACROS command");
 
-  if (!irManager)
+  if (!deviceManager)
   {
-    sendError("IR_MANAGER_ERROR", "IR Manager not available");
+    sendError("DEVICE_MANAGER_ERROR", "Device Manager not available");
     return;
   }
 
-  if (!cmd.containsKey("parameters") || !cmd["parameters"].is<JsonObject>())
+  sendStreamResponse("Macro list retrieved", [](DeviceManager &devices, JsonStreamWriter &writer, uint32_t timestamp)
+                     { devices.writeMacroList(writer); });
+}
+
+bool CommandProcessor::parseSteps(JsonVariantConst stepsJson, MacroStep *out, uint8_t &count)
+{
+  // Every step is checked and resolved before anything is sent
+  JsonArrayConst steps = stepsJson.as<JsonArrayConst>();
+  if (!stepsJson.is<JsonArrayConst>() || steps.size() == 0 || steps.size() > BATCH_MAX_STEPS)
   {
-    sendError("MISSING_PARAMETERS", "Parameters must be a valid object");
-    return;
+    sendError("INVALID_STEPS", requestArena.format("Steps must be an array of 1 to %d device/command pairs", BATCH_MAX_STEPS));
+    return false;
   }
 
-  int timeout = cmd["parameters"]["timeout"] | IR_TIMEOUT_MS;
-
-  if (irManager->startLearning())
+  count = 0;
+  for (JsonVariantConst step : steps)
   {
-    DynamicJsonDocument responseData(256);
-    responseData["timeout"] = timeout;
-    responseData["status"] = "learning";
-
-    sendResponse(RESP_OK, "IR learning started", &responseData);
-
-    // Wait for learning completion or timeout
-    unsigned long startTime = millis();
-    while (irManager->isLearning() && (millis() - startTime < timeout))
+    if (!step["device"].is<const char *>() || !step["command"].is<const char *>())
     {
-      irManager->update();
-      delay(50);
+      sendError("INVALID_STEP", requestArena.format("Step %u: device and command are required", count));
+      return false;
     }
-
-    if (irManager->hasLearnedCode())
+    if (!step["repeat"].isNull() && (!step["repeat"].is<int>() || step["repeat"] < 1 || step["repeat"] > BATCH_MAX_REPEAT))
     {
-      IRCode learnedCode = irManager->getLearnedCode();
-      DynamicJsonDocument learnedData(512);
-      learnedData["protocol"] = typeToString(learnedCode.protocol);
-      learnedData["value"] = String(learnedCode.data, HEX);
-      learnedData["bits"] = learnedCode.bits;
-
-      sendResponse(RESP_OK, "IR code learned successfully", &learnedData);
+      sendError("INVALID_STEP", requestArena.format("Step %u: repeat must be 1 to %d", count, BATCH_MAX_REPEAT));
+      return false;
     }
-    else
+    if (!step["delay"].isNull() && (!step["delay"].is<long>() || step["delay"] < 0 || step["delay"] > BATCH_MAX_DELAY_MS))
     {
-      sendResponse(RESP_TIMEOUT, "Learning timeout - no IR signal received");
+      sendError("INVALID_STEP", requestArena.format("Step %u: delay must be 0 to %d ms", count, BATCH_MAX_DELAY_MS));
+      return false;
     }
+
+    const char *deviceName = step["device"];
+    const char *commandName = step["command"];
+    MacroStep &parsed = out[count];
+    if (!deviceManager->findCommandId(deviceName, commandName, parsed.deviceId, parsed.commandId))
+    {
+      sendError("COMMAND_NOT_FOUND", requestArena.format("Step %u: command '%s' not found for device '%s'", count, commandName, deviceName));
+      return false;
+    }
+    parsed.repeat = step["repeat"] | 1;
+    parsed.delayMs = step["delay"] | 0;
+    count++;
   }
-  else
-  {
-    sendError("LEARN_ERROR", "Failed to start IR learning");
-  }
+  return true;
 }
 
-void CommandProcessor::handleTransmitCommand(const JsonDocument &cmd)
+void CommandProcessor::runSteps(const MacroStep *steps, uint8_t count, const char *macro)
 {
-  DEBUG_PRINTLN("Handling TRANSMIT command");
-
-  if (!irManager || !deviceManager)
+  PendingBatch *pending = nullptr;
+  for (PendingBatch &batch : pendingBatches)
   {
-    sendError("MANAGER_ERROR", "Required managers not available");
+    if (!batch.inUse)
+    {
+      pending = &batch;
+      break;
+    }
+  }
+  if (!pending)
+  {
+    sendError("BUSY", "Too many batches in progress");
     return;
   }
 
-  const String requiredFields[] = {"device", "command"};
-  if (!validateCommand(cmd, requiredFields, 2))
+  // Compile: codes are copied into the plan now, so nothing is looked up
+  // between sends
+  IRPlan &plan = pending->plan;
+  plan.clear();
+  for (uint8_t i = 0; i < count; i++)
   {
-    sendError("MISSING_PARAMETERS", "Device and command parameters required");
-    return;
+    IRCode code;
+    bool found;
+    {
+      TRACE_SCOPE(TRACE_LOOKUP);
+      found = deviceManager->getCommand(steps[i].deviceId, steps[i].commandId, code);
+    }
+    if (!found)
+    {
+      sendError("COMMAND_NOT_FOUND", requestArena.format("Step %u: command no longer exists", i));
+      return;
+    }
+    if (!irManager->addPlanStep(plan, code, steps[i].repeat, steps[i].delayMs))
+    {
+      sendError("BATCH_TOO_LARGE", requestArena.format("Raw timings of the steps exceed %d bytes", BATCH_PLAN_RAW_BYTES));
+      return;
+    }
+  }
+
+  pending->owner = this;
+  pending->inUse = true;
+  pending->startedAt = millis();
+  strlcpy(pending->replyTo, replyTo, sizeof(pending->replyTo));
+  strlcpy(pending->macro, macro, sizeof(pending->macro));
+
+  // The reply is sent from finishBatch() once the IR task is done
+  TRACE_PARK(pending->trace);
+  if (!irManager->queuePlan(plan, onBatchComplete, pending))
+  {
+    TRACE_RESUME(pending->trace);
+    pending->inUse = false;
+    sendError("BUSY", "IR transmit queue full");
   }
+}
 
-  String deviceName = cmd["parameters"]["device"];
-  String commandName = cmd["parameters"]["command"];
+void CommandProcessor::onBatchComplete(void *context, bool success)
+{
+  PendingBatch *pending = static_cast<PendingBatch *>(context);
+  CommandProcessor *processor = pending->owner;
 
-  IRCommand *irCommand = deviceManager->getCommand(deviceName, commandName);
-  if (!irCommand)
+  if (!processor->commandQueue)
   {
-    sendError("COMMAND_NOT_FOUND", "Command '" + commandName + "' not found for device '" + deviceName + "'");
+    pending->success = success;
+    processor->finishBatch(*pending);
     return;
   }
 
-  if (irManager->transmitCode(irCommand->code))
+  // Running on the IR task: hand the reply back to the command task
+  static CommandMessage message;
+  message.type = MSG_BATCH_DONE;
+  message.slot = pending - processor->pendingBatches;
+  message.success = success;
+  message.length = 0;
+  xQueueSendToFront(processor->commandQueue, &message, portMAX_DELAY);
+}
+
+void CommandProcessor::finishBatch(PendingBatch &pending)
+{
+  TRACE_RESUME(pending.trace);
+  ArenaScope scope;
+  const IRPlan &plan = pending.plan;
+  if (pending.success)
   {
-    DynamicJsonDocument responseData(256);
-    responseData["device"] = deviceName;
-    responseData["command"] = commandName;
+    ArenaJsonDocument responseData(256);
+    if (pending.macro[0])
+    {
+      responseData["macro"] = pending.macro;
+    }
+    responseData["steps"] = plan.stepCount;
+    responseData["sends"] = plan.sends;
+    responseData["durationMs"] = millis() - pending.startedAt;
 
-    sendResponse(RESP_OK, "IR command transmitted successfully", &responseData);
+    sendResponse(RESP_OK, "Batch transmitted successfully", &responseData, nullptr, pending.replyTo);
   }
   else
   {
-    sendError("TRANSMIT_ERROR", "Failed to transmit IR command");
+    sendError("TRANSMIT_ERROR", requestArena.format("Step %u failed after %u sends", plan.completedSteps, plan.sends), pending.replyTo);
   }
+
+  pending.inUse = false;
 }
 
 void CommandProcessor::handleListDevicesCommand(const JsonDocument &cmd)
@@ -188,16 +976,13 @@ void CommandProcessor::handleListDevicesCommand(const JsonDocument &cmd)
     return;
   }
 
-  String deviceListJson = deviceManager->getDeviceList();
-  DynamicJsonDocument deviceList(2048);
-  deserializeJson(deviceList, deviceListJson);
-
-  sendResponse(RESP_OK, "Device list retrieved", &deviceList);
+  sendStreamResponse("Device list retrieved", [](DeviceManager &devices, JsonStreamWriter &writer, uint32_t timestamp)
+                     { devices.writeDeviceList(writer); });
 }
 
-void CommandProcessor::handleAddDeviceCommand(const JsonDocument &cmd)
+void CommandProcessor::handleExportDevicesCommand(const JsonDocument &cmd)
 {
-  DEBUG_PRINTLN("Handling ADD_DEVICE command");
+  DEBUG_PRINTLN("Handling EXPORT_DEVICES command");
 
   if (!deviceManager)
   {
@@ -205,10 +990,17 @@ void CommandProcessor::handleAddDeviceCommand(const JsonDocument &cmd)
     return;
   }
 
-  const String requiredFields[] = {"name", "type"};
-  if (!validateCommand(cmd, requiredFields, 2))
+  sendStreamResponse("Devices exported", [](DeviceManager &devices, JsonStreamWriter &writer, uint32_t timestamp)
+                     { devices.writeExport(writer, timestamp); });
+}
+
+void CommandProcessor::handleAddDeviceCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling ADD_DEVICE command");
+
+  if (!deviceManager)
   {
-    sendError("MISSING_PARAMETERS", "Name and type parameters required");
+    sendError("DEVICE_MANAGER_ERROR", "Device Manager not available");
     return;
   }
 
@@ -221,7 +1013,7 @@ void CommandProcessor::handleAddDeviceCommand(const JsonDocument &cmd)
 
   if (deviceManager->addDevice(device))
   {
-    DynamicJsonDocument responseData(256);
+    ArenaJsonDocument responseData(256);
     responseData["device"] = device.name;
     responseData["type"] = device.type;
 
@@ -243,18 +1035,11 @@ void CommandProcessor::handleDeleteDeviceCommand(const JsonDocument &cmd)
     return;
   }
 
-  const String requiredFields[] = {"name"};
-  if (!validateCommand(cmd, requiredFields, 1))
-  {
-    sendError("MISSING_PARAMETERS", "Name parameter required");
-    return;
-  }
-
-  String deviceName = cmd["parameters"]["name"];
+  const char *deviceName = cmd["parameters"]["name"] | "";
 
   if (deviceManager->removeDevice(deviceName))
   {
-    DynamicJsonDocument responseData(256);
+    ArenaJsonDocument responseData(256);
     responseData["device"] = deviceName;
 
     sendResponse(RESP_OK, "Device deleted successfully", &responseData);
@@ -265,33 +1050,111 @@ void CommandProcessor::handleDeleteDeviceCommand(const JsonDocument &cmd)
   }
 }
 
+void CommandProcessor::handleMonitorCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling MONITOR command");
+
+  if (!irManager)
+  {
+    sendError("IR_MANAGER_ERROR", "IR Manager not available");
+    return;
+  }
+
+  bool enabled = cmd["parameters"]["enabled"].as<bool>();
+
+  // Sightings are matched through the code index, which covers loaded
+  // devices; loading them all now keeps the first sighting quick
+  char deviceName[MAX_DEVICE_NAME + 1], commandName[MAX_DEVICE_NAME + 1];
+  if (enabled && deviceManager)
+  {
+    deviceManager->findDuplicate(IRCode(), deviceName, commandName);
+  }
+  irManager->setMonitoring(enabled);
+
+  ArenaJsonDocument responseData(128);
+  responseData["enabled"] = enabled;
+  sendResponse(RESP_OK, enabled ? "IR monitor started" : "IR monitor stopped", &responseData);
+}
+
+void CommandProcessor::handleTraceCommand(const JsonDocument &cmd)
+{
+  DEBUG_PRINTLN("Handling TRACE command");
+
+#if TRACE_ENABLED
+  if (!deviceManager)
+  {
+    sendError("MANAGER_ERROR", "Required managers not available");
+    return;
+  }
+
+  // This request is still open, so it is not in its own dump
+  sendStreamResponse("Request trace retrieved", [](DeviceManager &devices, JsonStreamWriter &writer, uint32_t timestamp)
+                     { tracer.write(writer); });
+  if (cmd["parameters"]["clear"] | false)
+  {
+    tracer.reset();
+  }
+#else
+  sendError("TRACE_DISABLED", "Firmware built with TRACE_ENABLED 0");
+#endif
+}
+
+void CommandProcessor::dumpTrace()
+{
+#if TRACE_ENABLED
+  if (commandQueue && xTaskGetCurrentTaskHandle() != commandTask)
+  {
+    // The trace belongs to the command task: print it from there
+    static CommandMessage message;
+    message.type = MSG_TRACE_DUMP;
+    message.length = 0;
+    xQueueSend(commandQueue, &message, 0);
+    return;
+  }
+
+  JsonSerialSink sink;
+  JsonStreamWriter writer(sink);
+  tracer.write(writer);
+  Serial.println();
+#endif
+}
+
 void CommandProcessor::handleGetStatusCommand(const JsonDocument &cmd)
 {
   DEBUG_PRINTLN("Handling GET_STATUS command");
 
-  DynamicJsonDocument statusData(512);
+  // Each manager fills its own object, then the registry adds the metrics
+  // of every group; nothing goes through a String on the way
+  ArenaJsonDocument statusData(3072);
+  statusData.createNestedObject("commands")["arenaBytes"] = requestArena.getCapacity();
 
   if (irManager)
   {
-    DynamicJsonDocument irStatus(256);
-    deserializeJson(irStatus, irManager->getStatus());
-    statusData["ir"] = irStatus;
+    irManager->getStatus(statusData.createNestedObject("ir"));
   }
 
   if (bleManager)
   {
-    DynamicJsonDocument bleStatus(256);
-    deserializeJson(bleStatus, bleManager->getStatus());
-    statusData["ble"] = bleStatus;
+    bleManager->getStatus(statusData.createNestedObject("ble"));
   }
 
   if (deviceManager)
   {
-    DynamicJsonDocument deviceStatus(256);
-    deserializeJson(deviceStatus, deviceManager->getStatus());
-    statusData["devices"] = deviceStatus;
+    deviceManager->getStatus(statusData.createNestedObject("devices"));
   }
 
+  JsonObject tasks = statusData.createNestedObject("tasks");
+  tasks["irStackFree"] = irManager ? irManager->getStackHighWaterMark() : 0;
+  tasks["commandStackFree"] = getStackHighWaterMark();
+  tasks["persistStackFree"] = deviceManager ? deviceManager->getStackHighWaterMark() : 0;
+  tasks["bleStackFree"] = bleManager ? bleManager->getStackHighWaterMark() : 0;
+  tasks["queued"] = commandQueue ? uxQueueMessagesWaiting(commandQueue) : 0;
+
+  JsonObject monitor = statusData.createNestedObject("monitor");
+  monitor["enabled"] = irManager && irManager->isMonitoring();
+
+  metrics.render(statusData.as<JsonObject>());
+
   statusData["firmware"] = FIRMWARE_VERSION;
   statusData["uptime"] = millis();
   statusData["freeHeap"] = ESP.getFreeHeap();
@@ -303,13 +1166,13 @@ void CommandProcessor::handleResetCommand(const JsonDocument &cmd)
 {
   DEBUG_PRINTLN("Handling RESET command");
 
-  String resetType = "soft"; // Default value
+  const char *resetType = "soft"; // Default value
   if (cmd.containsKey("parameters"))
   {
-    resetType = cmd["parameters"]["type"] | String("soft");
+    resetType = cmd["parameters"]["type"] | "soft";
   }
 
-  if (resetType == "factory")
+  if (strcmp(resetType, "factory") == 0)
   {
     // Factory reset - clear all stored data
     if (deviceManager)
@@ -329,10 +1192,237 @@ void CommandProcessor::handleResetCommand(const JsonDocument &cmd)
   }
 }
 
-void CommandProcessor::sendResponse(const String &status, const String &message, DynamicJsonDocument *data)
+void CommandProcessor::processBinary(const uint8_t *data, size_t length)
+{
+  TRACE_REQUEST();
+  BinaryFrame frame;
+  bool parsed;
+  {
+    TRACE_SCOPE(TRACE_PARSE);
+    parsed = parseBinaryFrame(data, length, frame);
+  }
+  if (!parsed)
+  {
+    uint8_t opcode = length > 2 ? data[2] : 0;
+    uint16_t requestId = length >= BIN_HEADER_SIZE ? (data[3] | (data[4] << 8)) : 0;
+    sendBinaryStatus(opcode, requestId, BIN_STATUS_MALFORMED);
+    return;
+  }
+
+  metrics.add(METRIC_COMMANDS_PROCESSED);
+  TRACE_COMMAND(Tracer::binaryCommandOf(frame.opcode));
+  TRACE_SCOPE(TRACE_DISPATCH);
+  if (frame.opcode == BIN_OP_HELLO)
+  {
+    handleBinaryHello(frame);
+    return;
+  }
+
+  // Everything else needs a version agreed on this connection
+  uint8_t version = bleManager ? bleManager->getProtocolVersion() : 0;
+  if (version == 0)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_NOT_NEGOTIATED);
+    return;
+  }
+  if (frame.version != version)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_UNSUPPORTED_VERSION);
+    return;
+  }
+
+  switch (frame.opcode)
+  {
+  case BIN_OP_TRANSMIT:
+    handleBinaryTransmit(frame);
+    break;
+  case BIN_OP_RESOLVE:
+    handleBinaryResolve(frame);
+    break;
+  case BIN_OP_PING:
+    handleBinaryPing(frame);
+    break;
+  case BIN_OP_METRICS:
+    handleBinaryMetrics(frame);
+    break;
+  default:
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_UNKNOWN_OPCODE);
+    break;
+  }
+}
+
+void CommandProcessor::handleBinaryHello(const BinaryFrame &frame)
+{
+  uint8_t requested = frame.version;
+  readBinaryU8(frame, BIN_TAG_VERSION, requested);
+
+  if (requested == 0 || !bleManager)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_UNSUPPORTED_VERSION);
+    return;
+  }
+
+  uint8_t version = requested < BIN_VERSION ? requested : BIN_VERSION;
+  bleManager->setProtocolVersion(version);
+
+  uint8_t buffer[BIN_MAX_FRAME];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.begin(frame.opcode | BIN_RESPONSE_FLAG, frame.requestId, BIN_STATUS_OK);
+  writer.addU8(BIN_TAG_VERSION, version);
+  writer.addU16(BIN_TAG_MAX_FRAME, CMD_MAX_SIZE - 1);
+  sendBinary(writer);
+}
+
+void CommandProcessor::handleBinaryResolve(const BinaryFrame &frame)
+{
+  const uint8_t *deviceName, *commandName;
+  uint8_t deviceLength, commandLength;
+  if (!findBinaryTlv(frame, BIN_TAG_DEVICE_NAME, deviceName, deviceLength) ||
+      !findBinaryTlv(frame, BIN_TAG_COMMAND_NAME, commandName, commandLength))
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_MISSING_PARAMETER);
+    return;
+  }
+
+  // TLV values are not terminated; a name too long to store cannot match
+  char device[MAX_DEVICE_NAME + 1], command[MAX_DEVICE_NAME + 1];
+  uint8_t deviceId, commandId;
+  bool found = false;
+  if (deviceManager && deviceLength <= MAX_DEVICE_NAME && commandLength <= MAX_DEVICE_NAME)
+  {
+    memcpy(device, deviceName, deviceLength);
+    device[deviceLength] = '\0';
+    memcpy(command, commandName, commandLength);
+    command[commandLength] = '\0';
+    TRACE_SCOPE(TRACE_LOOKUP);
+    found = deviceManager->findCommandId(device, command, deviceId, commandId);
+  }
+  if (!found)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_NOT_FOUND);
+    return;
+  }
+
+  uint8_t buffer[BIN_MAX_FRAME];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.begin(frame.opcode | BIN_RESPONSE_FLAG, frame.requestId, BIN_STATUS_OK);
+  writer.addU8(BIN_TAG_DEVICE_ID, deviceId);
+  writer.addU8(BIN_TAG_COMMAND_ID, commandId);
+  sendBinary(writer);
+}
+
+void CommandProcessor::handleBinaryTransmit(const BinaryFrame &frame)
+{
+  uint8_t deviceId, commandId;
+  if (!readBinaryU8(frame, BIN_TAG_DEVICE_ID, deviceId) || !readBinaryU8(frame, BIN_TAG_COMMAND_ID, commandId))
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_MISSING_PARAMETER);
+    return;
+  }
+
+  IRCode code;
+  bool found = false;
+  if (irManager && deviceManager)
+  {
+    TRACE_SCOPE(TRACE_LOOKUP);
+    found = deviceManager->getCommand(deviceId, commandId, code);
+  }
+  if (!found)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_NOT_FOUND);
+    return;
+  }
+
+  PendingTransmit *pending = claimPendingTransmit();
+  if (!pending)
+  {
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_BUSY);
+    return;
+  }
+
+  pending->binary = true;
+  pending->requestId = frame.requestId;
+
+  TRACE_PARK(pending->trace);
+  if (!irManager->queueTransmit(code, onTransmitComplete, pending))
+  {
+    TRACE_RESUME(pending->trace);
+    pending->inUse = false;
+    sendBinaryStatus(frame.opcode, frame.requestId, BIN_STATUS_BUSY);
+  }
+}
+
+void CommandProcessor::handleBinaryPing(const BinaryFrame &frame)
+{
+  uint8_t buffer[BIN_MAX_FRAME];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.begin(frame.opcode | BIN_RESPONSE_FLAG, frame.requestId, BIN_STATUS_OK);
+  writer.addU32(BIN_TAG_UPTIME, millis());
+  sendBinary(writer);
+}
+
+void CommandProcessor::handleBinaryMetrics(const BinaryFrame &frame)
+{
+  static_assert(METRIC_COUNT * 4 <= 255, "metric values fit one TLV");
+  static_assert(BIN_HEADER_SIZE + 6 + 2 + METRIC_COUNT * 4 + METRIC_HIST_COUNT * (2 + 25) <= BIN_METRICS_MAX_FRAME,
+                "the snapshot fits its frame");
+
+  // Read straight from the registry into the frame: nothing is allocated
+  uint8_t buffer[BIN_METRICS_MAX_FRAME];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.begin(frame.opcode | BIN_RESPONSE_FLAG, frame.requestId, BIN_STATUS_OK);
+  writer.addU32(BIN_TAG_UPTIME, millis());
+
+  uint8_t values[METRIC_COUNT * 4];
+  for (uint8_t id = 0; id < METRIC_COUNT; id++)
+  {
+    writeBinaryU32(values + id * 4, metrics.get((MetricId)id));
+  }
+  writer.addBytes(BIN_TAG_METRIC_VALUES, values, sizeof(values));
+
+  MetricHistogramSummary summary;
+  for (uint8_t id = 0; id < METRIC_HIST_COUNT; id++)
+  {
+    metrics.summarize((MetricHistogramId)id, summary);
+    uint8_t histogram[25] = {id};
+    const uint32_t fields[] = {summary.count, summary.sum, summary.max, summary.p50, summary.p95, summary.p99};
+    for (uint8_t f = 0; f < 6; f++)
+    {
+      writeBinaryU32(histogram + 1 + f * 4, fields[f]);
+    }
+    writer.addBytes(BIN_TAG_HISTOGRAM, histogram, sizeof(histogram));
+  }
+  sendBinary(writer);
+}
+
+void CommandProcessor::sendBinary(const BinaryWriter &writer)
+{
+  TRACE_SCOPE(TRACE_SERIALIZE);
+  if (bleManager && writer.ok())
+  {
+    bleManager->sendResponse(writer.data(), writer.size());
+  }
+}
+
+void CommandProcessor::sendBinaryStatus(uint8_t opcode, uint16_t requestId, uint8_t status)
+{
+  uint8_t buffer[BIN_HEADER_SIZE];
+  BinaryWriter writer(buffer, sizeof(buffer));
+  writer.begin(opcode | BIN_RESPONSE_FLAG, requestId, status);
+  sendBinary(writer);
+}
+
+void CommandProcessor::sendResponse(const char *status, const char *message, JsonDocument *data, const char *event, const char *requestId)
 {
-  DynamicJsonDocument response(1024);
+  TRACE_SCOPE(TRACE_SERIALIZE);
+  // Copying data duplicates its strings, so size the envelope after it
+  ArenaJsonDocument response(256 + (data ? data->memoryUsage() : 0));
 
+  // Unsolicited notifications carry the event name so clients can tell them from replies
+  if (event)
+  {
+    response["event"] = event;
+  }
   response["status"] = status;
   response["message"] = message;
   response["timestamp"] = millis();
@@ -342,60 +1432,122 @@ void CommandProcessor::sendResponse(const String &status, const String &message,
     response["data"] = *data;
   }
 
-  String responseJson;
-  serializeJson(response, responseJson);
+  // Lets a client with several commands in flight match replies that complete out of order
+  if (!requestId)
+  {
+    requestId = replyTo;
+  }
+  if (requestId[0])
+  {
+    response["requestId"] = serialized(requestId);
+  }
+
+  // Serialized into the arena too; the BLE queue keeps its own copy
+  size_t length = measureJson(response);
+  char *json = static_cast<char *>(requestArena.allocate(length + 1));
+  if (!json)
+  {
+    return;
+  }
+  serializeJson(response, json, length + 1);
 
-  if (bleManager)
+  // Replies go ahead of queued event notifications
+  if (bleManager && event)
+  {
+    bleManager->sendNotification((const uint8_t *)json, length);
+  }
+  else if (bleManager)
   {
-    bleManager->sendResponse(responseJson);
+    bleManager->sendResponse((const uint8_t *)json, length);
   }
 
-  DEBUG_PRINTLN("Response sent: " + responseJson);
+  DEBUG_PRINT("Response sent: ");
+  DEBUG_PRINTLN(json);
+  requestArena.deallocate(json);
 }
 
-void CommandProcessor::sendError(const String &error, const String &details)
+void CommandProcessor::writeStreamReply(JsonSink &sink, void *context)
 {
-  DynamicJsonDocument errorData(256);
-  errorData["error"] = error;
-  if (!details.isEmpty())
+  const StreamReply *reply = static_cast<const StreamReply *>(context);
+  JsonStreamWriter writer(sink);
+
+  // The envelope sendResponse() builds, with the body as data
+  writer.beginObject();
+  writer.field("status", RESP_OK);
+  writer.field("message", reply->message);
+  writer.field("timestamp", reply->timestamp);
+  writer.key("data");
+  reply->body(*reply->processor->deviceManager, writer, reply->timestamp);
+  if (reply->processor->replyTo[0])
   {
-    errorData["details"] = details;
+    writer.key("requestId");
+    writer.raw(reply->processor->replyTo);
   }
-
-  sendResponse(RESP_ERROR, "Command failed", &errorData);
+  writer.endObject();
 }
 
-bool CommandProcessor::validateCommand(const JsonDocument &cmd, const String requiredFields[], int fieldCount)
+void CommandProcessor::sendStreamResponse(const char *message, StreamBody body)
 {
-  if (!cmd.containsKey("parameters"))
+  TRACE_SCOPE(TRACE_SERIALIZE);
+  StreamReply reply = {this, message, body, (uint32_t)millis()};
+  JsonCountSink counter;
+  writeStreamReply(counter, &reply);
+
+  // Written on this task once the replies queued before it are sent
+  if (bleManager && !bleManager->sendStream(counter.size(), writeStreamReply, &reply))
   {
-    DEBUG_PRINTLN("Missing parameters object");
-    return false;
+    DEBUG_PRINTLN("Streamed response not sent");
+    return;
   }
 
-  if (!cmd["parameters"].is<JsonObject>())
+  DEBUG_PRINT("Response streamed, bytes: ");
+  DEBUG_PRINTLN(counter.size());
+}
+
+void CommandProcessor::sendError(const char *error, const char *details, const char *requestId)
+{
+  metrics.add(METRIC_COMMANDS_FAILED);
+  ArenaJsonDocument errorData(256);
+  errorData["error"] = error;
+  if (details[0])
   {
-    DEBUG_PRINTLN("Parameters is not an object");
-    return false;
+    errorData["details"] = details;
   }
 
-  for (int i = 0; i < fieldCount; i++)
+  sendResponse(RESP_ERROR, "Command failed", &errorData, nullptr, requestId);
+}
+
+void CommandProcessor::sendRejection(const char *error, const char *details, const char *requestId)
+{
+  // The reply sendError() would build, without the arena: this runs in
+  // the BLE host's write callback while the command task may be using it.
+  // A full reply queue drops it at once rather than stall the host
+  metrics.add(METRIC_COMMANDS_FAILED);
+  StaticJsonDocument<384> response;
+  response["status"] = RESP_ERROR;
+  response["message"] = "Command failed";
+  response["timestamp"] = millis();
+  JsonObject data = response.createNestedObject("data");
+  data["error"] = error;
+  data["details"] = details;
+  if (requestId[0])
   {
-    if (!cmd["parameters"].containsKey(requiredFields[i]))
-    {
-      DEBUG_PRINTLN("Missing required field: " + requiredFields[i]);
-      return false;
-    }
+    response["requestId"] = serialized(requestId);
   }
 
-  return true;
+  char json[384];
+  size_t length = serializeJson(response, json, sizeof(json));
+  if (bleManager)
+  {
+    bleManager->sendResponse((const uint8_t *)json, length);
+  }
 }
 
 String CommandProcessor::getStatus()
 {
   DynamicJsonDocument doc(256);
   doc["initialized"] = (irManager != nullptr && bleManager != nullptr && deviceManager != nullptr);
-  doc["commandsProcessed"] = 0; // Could add a counter in future
+  doc["commandsProcessed"] = metrics.get(METRIC_COMMANDS_PROCESSED);
 
   String result;
   serializeJson(doc, result);
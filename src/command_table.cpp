@@ -0,0 +1,71 @@
+/**
+ * Command Table Implementation
+ */
+
+#include "command_table.h"
+
+namespace
+{
+    bool hasType(JsonVariantConst value, CommandParamType type)
+    {
+        switch (type)
+        {
+        case PARAM_STRING:
+            return value.is<const char *>();
+        case PARAM_INTEGER:
+            return value.is<long>() || value.is<unsigned long>();
+        case PARAM_BOOLEAN:
+            return value.is<bool>();
+        case PARAM_ARRAY:
+            return value.is<JsonArrayConst>();
+        case PARAM_OBJECT:
+            return value.is<JsonObjectConst>();
+        }
+        return false;
+    }
+}
+
+CommandParamCheck checkParameters(JsonVariantConst parameters, const CommandParam *params, bool needsObject, const CommandParam *&failed)
+{
+    failed = nullptr;
+    if (!parameters.is<JsonObjectConst>())
+        return needsObject ? PARAMS_MISSING : PARAMS_OK;
+
+    for (uint8_t i = 0; i < COMMAND_MAX_PARAMS && params[i].name; i++)
+    {
+        JsonVariantConst value = parameters[params[i].name];
+        if (value.isNull())
+        {
+            if (params[i].required)
+            {
+                failed = &params[i];
+                return PARAMS_MISSING;
+            }
+            continue;
+        }
+        if (!hasType(value, params[i].type))
+        {
+            failed = &params[i];
+            return PARAMS_WRONG_TYPE;
+        }
+    }
+    return PARAMS_OK;
+}
+
+const char *commandParamTypeName(CommandParamType type)
+{
+    switch (type)
+    {
+    case PARAM_STRING:
+        return "a string";
+    case PARAM_INTEGER:
+        return "an integer";
+    case PARAM_BOOLEAN:
+        return "true or false";
+    case PARAM_ARRAY:
+        return "an array";
+    case PARAM_OBJECT:
+        return "an object";
+    }
+    return "valid";
+}
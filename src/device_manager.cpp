@@ -3,10 +3,55 @@
  */
 
 #include "device_manager.h"
+#include "metrics.h"
+#include "trace.h"
 
-DeviceManager::DeviceManager() : deviceCount(0), dataLoaded(false)
+// Holds a recursive FreeRTOS mutex for the lifetime of a scope
+class MutexLock
 {
-  memset(devices, 0, sizeof(devices));
+  SemaphoreHandle_t mutex;
+
+public:
+  explicit MutexLock(SemaphoreHandle_t m) : mutex(m)
+  {
+    if (mutex)
+      xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+  }
+  ~MutexLock()
+  {
+    if (mutex)
+      xSemaphoreGiveRecursive(mutex);
+  }
+};
+
+// Device slots must stay clear of INDEX_NONE; command slots of the device flag
+static_assert(MAX_DEVICES < INDEX_NONE && STORE_MAX_COMMANDS < INDEX_DEVICE_ENTRY, "store slots must fit the index");
+
+// Write-ahead log record types
+enum LogRecordType : uint8_t
+{
+  LOG_ADD_DEVICE = 1,     // id, next device id, name, type, manufacturer, model
+  LOG_UPDATE_DEVICE = 2,  // id, type, manufacturer, model
+  LOG_REMOVE_DEVICE = 3,  // id
+  LOG_ADD_COMMAND = 4,    // device id, id, next command id, code, name, description, raw timings
+  LOG_REMOVE_COMMAND = 5, // device id, id
+  LOG_CLEAR = 6,          // Every device and macro goes (import)
+  LOG_SET_MACRO = 7,      // name, step count, steps
+  LOG_REMOVE_MACRO = 8    // name
+};
+
+DeviceManager::DeviceManager()
+    : dataLoaded(false), nextDeviceId(0), persistTask(nullptr), dataMutex(nullptr), flashMutex(nullptr), activeLog(0),
+      logOverflow(false), compactRequested(false), storageGeneration(0), logFileBytes(0), macrosDirty(false)
+{
+  memset(macros, 0, sizeof(macros));
+  memset(deviceSlots, INDEX_NONE, sizeof(deviceSlots));
+  memset(commandsLoaded, 0, sizeof(commandsLoaded));
+  memset(loadFailed, 0, sizeof(loadFailed));
+  memset(storedCommandCounts, 0, sizeof(storedCommandCounts));
+  memset(deviceDirty, 0, sizeof(deviceDirty));
+  memset(staleFiles, 0, sizeof(staleFiles));
+  memset(logLengths, 0, sizeof(logLengths));
 }
 
 DeviceManager::~DeviceManager()
@@ -18,20 +63,79 @@ bool DeviceManager::begin()
 {
   DEBUG_PRINTLN("Initializing Device Manager...");
 
-  // Initialize EEPROM
-  EEPROM.begin(EEPROM_SIZE);
+  if (!dataMutex)
+  {
+    dataMutex = xSemaphoreCreateRecursiveMutex();
+    flashMutex = xSemaphoreCreateRecursiveMutex();
+  }
+
+  // Everything in RAM is rebuilt from flash
+  MutexLock flashLock(flashMutex);
+  MutexLock dataLock(dataMutex);
+  store.clear();
+  nextDeviceId = 0;
+  memset(commandsLoaded, 0, sizeof(commandsLoaded));
+  memset(loadFailed, 0, sizeof(loadFailed));
+  memset(deviceDirty, 0, sizeof(deviceDirty));
+  memset(staleFiles, 0, sizeof(staleFiles));
+  memset(logLengths, 0, sizeof(logLengths));
+  logOverflow = false;
+  compactRequested = false;
+  storageGeneration = 0;
+  logFileBytes = 0;
+  clearMacros();
+
+  if (!LittleFS.begin(true))
+  {
+    DEBUG_PRINTLN("ERROR: Failed to mount LittleFS");
+    return false;
+  }
+  if (!LittleFS.exists(STORAGE_DIR))
+  {
+    LittleFS.mkdir(STORAGE_DIR);
+  }
+
+  // Load device metadata; commands are read on first use
+  bool legacy = false;
+  if (!loadManifest())
+  {
+    EEPROM.begin(EEPROM_SIZE);
+    legacy = loadFromEEPROM();
+    EEPROM.end();
+
+    if (legacy)
+    {
+      DEBUG_PRINTLN("Migrating devices from EEPROM");
+      for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+      {
+        deviceDirty[slot] = store.isDevice(slot);
+      }
+    }
+    else
+    {
+      DEBUG_PRINTLN("No valid device data found, starting fresh");
+      store.clear();
+    }
+  }
+  rebuildIndex();
+  loadMacros();
 
-  // Load devices from EEPROM
-  if (!loadFromEEPROM())
+  // Then everything logged since. A torn tail or a stale log is cut off by
+  // compacting straight away, so later appends are never stranded behind it
+  bool logClean = replayLog();
+  if (legacy || !logClean)
   {
-    DEBUG_PRINTLN("No valid device data found, starting fresh");
-    deviceCount = 0;
+    // The old EEPROM layout goes once it is safely on LittleFS
+    if (compactStorage() && legacy)
+    {
+      clearEEPROM();
+    }
   }
 
   dataLoaded = true;
   DEBUG_PRINTLN("Device Manager initialized successfully");
   DEBUG_PRINT("Loaded devices: ");
-  DEBUG_PRINTLN(deviceCount);
+  DEBUG_PRINTLN(store.getDeviceCount());
 
   return true;
 }
@@ -42,9 +146,70 @@ void DeviceManager::update()
   // Currently no periodic tasks required
 }
 
+bool DeviceManager::startPersistTask()
+{
+  if (persistTask)
+    return true;
+
+  if (xTaskCreatePinnedToCore(persistLoop, "persist", PERSIST_TASK_STACK_SIZE, this, PERSIST_TASK_PRIORITY, &persistTask, PERSIST_TASK_CORE) != pdPASS)
+  {
+    persistTask = nullptr;
+    return false;
+  }
+
+  DEBUG_PRINTLN("Persistence task started");
+  return true;
+}
+
+void DeviceManager::persistLoop(void *parameter)
+{
+  DeviceManager *manager = static_cast<DeviceManager *>(parameter);
+
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Let a burst of mutations settle, then absorb their notifications
+    vTaskDelay(pdMS_TO_TICKS(PERSIST_DEBOUNCE_MS));
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    manager->saveToStorage();
+  }
+}
+
+uint32_t DeviceManager::getStackHighWaterMark()
+{
+  return persistTask ? uxTaskGetStackHighWaterMark(persistTask) : 0;
+}
+
+void DeviceManager::schedulePersist()
+{
+  TRACE_SCOPE(TRACE_PERSIST);
+  if (persistTask)
+  {
+    xTaskNotifyGive(persistTask);
+  }
+  else
+  {
+    saveToStorage();
+  }
+}
+
+void DeviceManager::markDirty(uint8_t slot)
+{
+  // Rewriting a device whose commands never loaded would empty its file
+  if (commandsLoaded[slot])
+  {
+    deviceDirty[slot] = true;
+  }
+  schedulePersist();
+}
+
 bool DeviceManager::addDevice(const Device &device)
 {
-  if (deviceCount >= MAX_DEVICES)
+  MutexLock lock(dataMutex);
+
+  if (store.getDeviceCount() >= MAX_DEVICES)
   {
     DEBUG_PRINTLN("ERROR: Maximum device count reached");
     return false;
@@ -57,13 +222,22 @@ bool DeviceManager::addDevice(const Device &device)
     return false;
   }
 
-  // Add device to array
-  devices[deviceCount] = device;
-  devices[deviceCount].commandCount = 0; // Initialize command count
-  deviceCount++;
+  // Add device to the store
+  uint8_t slot = store.allocDevice(allocateDeviceId());
+  if (!storeString(store.name(slot), device.name) || !storeString(store.type(slot), device.type) ||
+      !storeString(store.manufacturer(slot), device.manufacturer) || !storeString(store.model(slot), device.model))
+  {
+    DEBUG_PRINTLN("ERROR: String pool full");
+    store.freeDevice(slot);
+    return false;
+  }
+  deviceSlots[store.deviceId(slot)] = slot;
+  commandsLoaded[slot] = true;
+  indexDevice(slot);
 
-  // Save to EEPROM
-  saveToEEPROM();
+  // Save to flash
+  logDevice(LOG_ADD_DEVICE, slot);
+  markDirty(slot);
 
   DEBUG_PRINTLN("Added device: " + device.name);
   return true;
@@ -71,68 +245,82 @@ bool DeviceManager::addDevice(const Device &device)
 
 bool DeviceManager::removeDevice(const String &deviceName)
 {
-  for (uint8_t i = 0; i < deviceCount; i++)
+  MutexLock lock(dataMutex);
+
+  uint8_t slot = findDeviceSlot(deviceName.c_str());
+  if (slot == INDEX_NONE)
   {
-    if (devices[i].name == deviceName)
-    {
-      // Shift remaining devices down
-      for (uint8_t j = i; j < deviceCount - 1; j++)
-      {
-        devices[j] = devices[j + 1];
-      }
-      deviceCount--;
+    DEBUG_PRINTLN("ERROR: Device not found: " + deviceName);
+    return false;
+  }
 
-      // Save to EEPROM
-      saveToEEPROM();
+  uint8_t id = store.deviceId(slot);
+  removeDeviceAt(slot);
 
-      DEBUG_PRINTLN("Removed device: " + deviceName);
-      return true;
-    }
-  }
+  // Save to flash
+  logRemoval(LOG_REMOVE_DEVICE, id, 0);
+  schedulePersist();
 
-  DEBUG_PRINTLN("ERROR: Device not found: " + deviceName);
-  return false;
+  DEBUG_PRINTLN("Removed device: " + deviceName);
+  return true;
 }
 
 bool DeviceManager::updateDevice(const Device &device)
 {
-  for (uint8_t i = 0; i < deviceCount; i++)
+  MutexLock lock(dataMutex);
+
+  uint8_t slot = findDeviceSlot(device.name.c_str());
+  if (slot == INDEX_NONE)
   {
-    if (devices[i].name == device.name)
-    {
-      devices[i] = device;
-      saveToEEPROM();
-      DEBUG_PRINTLN("Updated device: " + device.name);
-      return true;
-    }
+    DEBUG_PRINTLN("ERROR: Device not found for update: " + device.name);
+    return false;
   }
 
-  DEBUG_PRINTLN("ERROR: Device not found for update: " + device.name);
-  return false;
+  // The name is the key, so the index is unaffected
+  if (!storeString(store.type(slot), device.type) || !storeString(store.manufacturer(slot), device.manufacturer) ||
+      !storeString(store.model(slot), device.model))
+  {
+    DEBUG_PRINTLN("ERROR: String pool full");
+    return false;
+  }
+
+  logDevice(LOG_UPDATE_DEVICE, slot);
+  schedulePersist();
+  DEBUG_PRINTLN("Updated device: " + device.name);
+  return true;
 }
 
-Device *DeviceManager::getDevice(const String &deviceName)
+bool DeviceManager::getDevice(const String &deviceName, Device &device)
 {
-  for (uint8_t i = 0; i < deviceCount; i++)
+  MutexLock lock(dataMutex);
+
+  uint8_t slot = findDeviceSlot(deviceName.c_str());
+  if (slot == INDEX_NONE)
   {
-    if (devices[i].name == deviceName)
-    {
-      return &devices[i];
-    }
+    return false;
   }
-  return nullptr;
+
+  device = describeDevice(slot);
+  return true;
 }
 
 bool DeviceManager::addCommand(const String &deviceName, const IRCommand &command)
 {
-  Device *device = getDevice(deviceName);
-  if (!device)
+  MutexLock lock(dataMutex);
+
+  uint8_t slot = findDeviceSlot(deviceName.c_str());
+  if (slot == INDEX_NONE)
   {
     DEBUG_PRINTLN("ERROR: Device not found: " + deviceName);
     return false;
   }
 
-  if (device->commandCount >= MAX_COMMANDS)
+  if (!ensureCommandsLoaded(slot))
+  {
+    DEBUG_PRINTLN("ERROR: Commands did not load, device is read-only: " + deviceName);
+    return false;
+  }
+  if (store.getCommandCount(slot) >= MAX_COMMANDS)
   {
     DEBUG_PRINTLN("ERROR: Maximum command count reached for device: " + deviceName);
     return false;
@@ -145,12 +333,35 @@ bool DeviceManager::addCommand(const String &deviceName, const IRCommand &comman
     return false;
   }
 
-  // Add command
-  device->commands[device->commandCount] = command;
-  device->commandCount++;
+  if (!hasRawSpace(command.code))
+  {
+    DEBUG_PRINTLN("ERROR: Raw storage full");
+    return false;
+  }
+
+  // Add command to the shared slab
+  uint16_t added = store.allocCommand(slot, allocateCommandId(slot));
+  if (added == STORE_NONE)
+  {
+    DEBUG_PRINTLN("ERROR: Command storage full");
+    return false;
+  }
+  // Timings already stored are shared, which takes no arena space
+  uint16_t holder = findRawHolder(command.code, STORE_NONE, false);
+  bool shared = holder != STORE_NONE && store.shareRaw(added, holder);
+  if (!storeString(store.commandName(added), command.name) || !storeString(store.commandDescription(added), command.description) ||
+      (!shared && !storeRaw(added, command.code.protocol, command.code.rawData, command.code.rawLen)))
+  {
+    DEBUG_PRINTLN("ERROR: Command storage full");
+    store.freeCommand(added);
+    return false;
+  }
+  store.setCode(added, command.code.protocol, command.code.data, command.code.bits);
+  indexCommand(added);
 
-  // Save to EEPROM
-  saveToEEPROM();
+  // Save to flash
+  logCommand(added);
+  markDirty(slot);
 
   DEBUG_PRINTLN("Added command: " + command.name + " to device: " + deviceName);
   return true;
@@ -158,275 +369,1883 @@ bool DeviceManager::addCommand(const String &deviceName, const IRCommand &comman
 
 bool DeviceManager::removeCommand(const String &deviceName, const String &commandName)
 {
-  Device *device = getDevice(deviceName);
-  if (!device)
+  MutexLock lock(dataMutex);
+
+  uint16_t command = findCommandSlot(deviceName.c_str(), commandName.c_str());
+  if (command == STORE_NONE)
   {
-    DEBUG_PRINTLN("ERROR: Device not found: " + deviceName);
+    DEBUG_PRINTLN("ERROR: Command not found: " + commandName);
     return false;
   }
 
-  for (uint8_t i = 0; i < device->commandCount; i++)
-  {
-    if (device->commands[i].name == commandName)
-    {
-      // Shift remaining commands down
-      for (uint8_t j = i; j < device->commandCount - 1; j++)
-      {
-        device->commands[j] = device->commands[j + 1];
-      }
-      device->commandCount--;
+  uint8_t slot = store.commandDevice(command);
+  uint8_t commandId = store.commandId(command);
+  removeCommandAt(command);
 
-      // Save to EEPROM
-      saveToEEPROM();
+  // Save to flash
+  logRemoval(LOG_REMOVE_COMMAND, store.deviceId(slot), commandId);
+  markDirty(slot);
 
-      DEBUG_PRINTLN("Removed command: " + commandName + " from device: " + deviceName);
-      return true;
-    }
-  }
-
-  DEBUG_PRINTLN("ERROR: Command not found: " + commandName);
-  return false;
+  DEBUG_PRINTLN("Removed command: " + commandName + " from device: " + deviceName);
+  return true;
 }
 
-IRCommand *DeviceManager::getCommand(const String &deviceName, const String &commandName)
+bool DeviceManager::getCommand(const char *deviceName, const char *commandName, IRCode &code)
 {
-  Device *device = getDevice(deviceName);
-  if (!device)
-  {
-    return nullptr;
-  }
+  MutexLock lock(dataMutex);
 
-  for (uint8_t i = 0; i < device->commandCount; i++)
+  uint16_t command = findCommandSlot(deviceName, commandName);
+  if (command == STORE_NONE)
   {
-    if (device->commands[i].name == commandName)
-    {
-      return &device->commands[i];
-    }
+    return false;
   }
 
-  return nullptr;
+  readCommand(command, code);
+  return true;
 }
 
-String DeviceManager::getDeviceList()
+bool DeviceManager::getCommand(uint8_t deviceId, uint8_t commandId, IRCode &code)
 {
-  DynamicJsonDocument doc(2048);
-  JsonArray deviceArray = doc.createNestedArray("devices");
+  MutexLock lock(dataMutex);
 
-  for (uint8_t i = 0; i < deviceCount; i++)
+  uint8_t slot = deviceSlots[deviceId];
+  if (slot == INDEX_NONE || !ensureCommandsLoaded(slot))
   {
-    JsonObject deviceObj = deviceArray.createNestedObject();
-    deviceObj["name"] = devices[i].name;
-    deviceObj["type"] = devices[i].type;
-    deviceObj["manufacturer"] = devices[i].manufacturer;
-    deviceObj["model"] = devices[i].model;
-    deviceObj["commandCount"] = devices[i].commandCount;
+    return false;
   }
 
-  doc["count"] = deviceCount;
+  uint16_t command = commandSlotById(slot, commandId);
+  if (command == STORE_NONE)
+  {
+    return false;
+  }
 
-  String result;
-  serializeJson(doc, result);
-  return result;
+  readCommand(command, code);
+  return true;
 }
 
-String DeviceManager::getCommandList(const String &deviceName)
+uint16_t DeviceManager::commandSlotById(uint8_t slot, uint8_t commandId)
 {
-  Device *device = getDevice(deviceName);
-  if (!device)
+  // At most MAX_COMMANDS byte compares; no names involved
+  for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
   {
-    return "{\"error\":\"Device not found\"}";
+    if (store.commandId(c) == commandId)
+    {
+      return c;
+    }
   }
+  return STORE_NONE;
+}
 
-  DynamicJsonDocument doc(2048);
-  JsonArray commandArray = doc.createNestedArray("commands");
+bool DeviceManager::findCommandId(const char *deviceName, const char *commandName, uint8_t &deviceId, uint8_t &commandId)
+{
+  MutexLock lock(dataMutex);
 
-  for (uint8_t i = 0; i < device->commandCount; i++)
+  uint16_t command = findCommandSlot(deviceName, commandName);
+  if (command == STORE_NONE)
   {
-    JsonObject commandObj = commandArray.createNestedObject();
-    commandObj["name"] = device->commands[i].name;
-    commandObj["description"] = device->commands[i].description;
+    return false;
   }
 
-  doc["device"] = deviceName;
-  doc["count"] = device->commandCount;
-
-  String result;
-  serializeJson(doc, result);
-  return result;
+  deviceId = store.deviceId(store.commandDevice(command));
+  commandId = store.commandId(command);
+  return true;
 }
 
-String DeviceManager::exportDevices()
+bool DeviceManager::findDuplicate(const IRCode &code, String &deviceName, String &commandName)
 {
-  DynamicJsonDocument doc(4096);
-  JsonArray deviceArray = doc.createNestedArray("devices");
-
-  for (uint8_t i = 0; i < deviceCount; i++)
+  char device[MAX_DEVICE_NAME + 1], command[MAX_DEVICE_NAME + 1];
+  if (!findDuplicate(code, device, command))
   {
-    JsonObject deviceObj = deviceArray.createNestedObject();
-    deviceObj["name"] = devices[i].name;
-    deviceObj["type"] = devices[i].type;
-    deviceObj["manufacturer"] = devices[i].manufacturer;
-    deviceObj["model"] = devices[i].model;
-
-    JsonArray commandArray = deviceObj.createNestedArray("commands");
-    for (uint8_t j = 0; j < devices[i].commandCount; j++)
-    {
-      JsonObject commandObj = commandArray.createNestedObject();
-      commandObj["name"] = devices[i].commands[j].name;
-      commandObj["description"] = devices[i].commands[j].description;
-      // Note: IR code data would be serialized here in a real implementation
-    }
+    return false;
   }
+  deviceName = device;
+  commandName = command;
+  return true;
+}
+
+bool DeviceManager::findDuplicate(const IRCode &code, char *deviceName, char *commandName)
+{
+  MutexLock lock(dataMutex);
 
-  doc["version"] = "1.0";
-  doc["exported"] = millis();
+  // The index only covers commands already loaded
+  loadAllCommands();
 
-  String result;
-  serializeJson(doc, result);
-  return result;
+  uint16_t command = findCodeSlot(code, STORE_NONE);
+  if (command == STORE_NONE)
+  {
+    return false;
+  }
+  strlcpy(deviceName, store.strings.get(store.name(store.commandDevice(command))), MAX_DEVICE_NAME + 1);
+  strlcpy(commandName, store.strings.get(store.commandName(command)), MAX_DEVICE_NAME + 1);
+  return true;
 }
 
-bool DeviceManager::importDevices(const String &jsonData)
+bool DeviceManager::hasRawSpace(const IRCode &code)
 {
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, jsonData);
+  MutexLock lock(dataMutex);
 
-  if (error)
+  if (!code.rawData || !code.rawLen)
+  {
+    return true;
+  }
+  if (code.rawLen > MAX_IR_CODE_SIZE)
   {
-    DEBUG_PRINTLN("ERROR: Failed to parse import data");
     return false;
   }
+  loadAllCommands();
+  return findRawHolder(code, STORE_NONE, false) != STORE_NONE || store.rawFits(code.rawLen, STORE_RAW_SPARE);
+}
 
-  // Reset current devices
-  deviceCount = 0;
+bool DeviceManager::setMacro(const char *name, const MacroStep *steps, uint8_t count)
+{
+  MutexLock lock(dataMutex);
 
-  JsonArray deviceArray = doc["devices"];
-  for (JsonObject deviceObj : deviceArray)
+  size_t length = strlen(name);
+  if (length == 0 || length > MAX_DEVICE_NAME || count == 0 || count > BATCH_MAX_STEPS)
   {
-    if (deviceCount >= MAX_DEVICES)
-      break;
-
-    Device device;
-    device.name = deviceObj["name"].as<String>();
-    device.type = deviceObj["type"].as<String>();
-    device.manufacturer = deviceObj["manufacturer"].as<String>();
-    device.model = deviceObj["model"].as<String>();
-    device.commandCount = 0;
+    return false;
+  }
+  if (!storeMacro(name, length, steps, count))
+  {
+    DEBUG_PRINTLN("ERROR: Maximum macro count reached");
+    return false;
+  }
 
-    JsonArray commandArray = deviceObj["commands"];
-    for (JsonObject commandObj : commandArray)
-    {
-      if (device.commandCount >= MAX_COMMANDS)
-        break;
+  logMacro(LOG_SET_MACRO, name, length, steps, count);
+  macrosDirty = true;
+  schedulePersist();
 
-      IRCommand command;
-      memset(&command, 0, sizeof(IRCommand)); // Initialize all fields
-      command.name = commandObj["name"].as<String>();
-      command.description = commandObj["description"].as<String>();
-      // Initialize IR code data
-      command.code.protocol = decode_type_t::UNKNOWN;
-      command.code.data = 0;
-      command.code.bits = 0;
-      // Note: IR code data would be deserialized here
+  DEBUG_PRINT("Stored macro: ");
+  DEBUG_PRINTLN(name);
+  return true;
+}
 
-      device.commands[device.commandCount] = command;
-      device.commandCount++;
-    }
+bool DeviceManager::removeMacro(const char *name)
+{
+  MutexLock lock(dataMutex);
 
-    devices[deviceCount] = device;
-    deviceCount++;
+  size_t length = strlen(name);
+  uint8_t index = findMacro(name, length);
+  if (index == INDEX_NONE)
+  {
+    return false;
   }
+  macros[index].stepCount = 0;
 
-  // Save imported data
-  saveToEEPROM();
+  logMacro(LOG_REMOVE_MACRO, name, length, nullptr, 0);
+  macrosDirty = true;
+  schedulePersist();
 
-  DEBUG_PRINTLN("Imported " + String(deviceCount) + " devices");
+  DEBUG_PRINT("Removed macro: ");
+  DEBUG_PRINTLN(name);
   return true;
 }
 
-bool DeviceManager::deviceExists(const String &deviceName)
+bool DeviceManager::getMacro(const char *name, MacroStep *steps, uint8_t &count)
 {
-  return getDevice(deviceName) != nullptr;
-}
+  MutexLock lock(dataMutex);
 
-bool DeviceManager::commandExists(const String &deviceName, const String &commandName)
-{
-  return getCommand(deviceName, commandName) != nullptr;
-}
+  size_t length = strlen(name);
+  uint8_t index = findMacro(name, length);
+  if (index == INDEX_NONE)
+  {
+    return false;
+  }
 
-void DeviceManager::printDeviceInfo(const Device &device)
-{
-  DEBUG_PRINTLN("Device: " + device.name);
-  DEBUG_PRINTLN("  Type: " + device.type);
-  DEBUG_PRINTLN("  Manufacturer: " + device.manufacturer);
-  DEBUG_PRINTLN("  Model: " + device.model);
-  DEBUG_PRINTLN("  Commands: " + String(device.commandCount));
+  count = macros[index].stepCount;
+  memcpy(steps, macros[index].steps, count * sizeof(MacroStep));
+  return true;
 }
 
-String DeviceManager::getStatus()
+void DeviceManager::writeMacroList(JsonStreamWriter &writer)
 {
-  DynamicJsonDocument doc(256);
-  doc["loaded"] = dataLoaded;
-  doc["deviceCount"] = deviceCount;
-  doc["maxDevices"] = MAX_DEVICES;
-  doc["eepromSize"] = EEPROM_SIZE;
+  MutexLock lock(dataMutex);
 
-  String result;
-  serializeJson(doc, result);
-  return result;
+  uint8_t count = 0;
+  writer.beginObject();
+  writer.key("macros");
+  writer.beginArray();
+  for (const Macro &macro : macros)
+  {
+    if (!macro.stepCount)
+      continue;
+
+    writer.beginObject();
+    writer.field("name", (const char *)macro.name);
+    writer.field("steps", macro.stepCount);
+    writer.endObject();
+    count++;
+  }
+  writer.endArray();
+  writer.field("count", count);
+  writer.endObject();
 }
 
-void DeviceManager::reset()
+String DeviceManager::getMacroList()
 {
-  DEBUG_PRINTLN("Resetting Device Manager...");
-  deviceCount = 0;
-  clearEEPROM();
-  DEBUG_PRINTLN("Device Manager reset complete");
+  String result;
+  JsonStringSink sink(result);
+  JsonStreamWriter writer(sink);
+  writeMacroList(writer);
+  return result;
 }
 
-void DeviceManager::saveToEEPROM()
+uint8_t DeviceManager::findMacro(const char *name, size_t length)
 {
-  DEBUG_PRINTLN("Saving devices to EEPROM...");
-
-  int address = CONFIG_ADDR;
-
-  // Write header
-  EEPROM.write(address++, 0xAA); // Magic byte 1
-  EEPROM.write(address++, 0x55); // Magic byte 2
-  EEPROM.write(address++, deviceCount);
-
-  // Write devices
-  for (uint8_t i = 0; i < deviceCount; i++)
+  // A handful of entries: a scan beats keeping them in the index
+  for (uint8_t i = 0; i < MAX_MACROS; i++)
   {
-    // Write device name length and data
-    uint8_t nameLen = devices[i].name.length();
-    EEPROM.write(address++, nameLen);
-    for (uint8_t j = 0; j < nameLen; j++)
+    if (macros[i].stepCount && strlen(macros[i].name) == length && memcmp(macros[i].name, name, length) == 0)
     {
-      EEPROM.write(address++, devices[i].name[j]);
+      return i;
     }
+  }
+  return INDEX_NONE;
+}
 
-    // Write other string fields similarly
-    uint8_t typeLen = devices[i].type.length();
-    EEPROM.write(address++, typeLen);
-    for (uint8_t j = 0; j < typeLen; j++)
+bool DeviceManager::storeMacro(const char *name, size_t length, const MacroStep *steps, uint8_t count)
+{
+  uint8_t index = findMacro(name, length);
+  for (uint8_t i = 0; i < MAX_MACROS && index == INDEX_NONE; i++)
+  {
+    if (!macros[i].stepCount)
     {
-      EEPROM.write(address++, devices[i].type[j]);
+      index = i;
     }
-
-    // Write command count
-    EEPROM.write(address++, devices[i].commandCount);
-
-    // Note: In a full implementation, all device data would be serialized here
+  }
+  if (index == INDEX_NONE || length > MAX_DEVICE_NAME || count > BATCH_MAX_STEPS)
+  {
+    return false;
   }
 
-  EEPROM.commit();
-  DEBUG_PRINTLN("EEPROM save complete");
+  Macro &macro = macros[index];
+  memcpy(macro.name, name, length);
+  macro.name[length] = '\0';
+  macro.stepCount = count;
+  memcpy(macro.steps, steps, count * sizeof(MacroStep));
+  return true;
 }
 
-bool DeviceManager::loadFromEEPROM()
+void DeviceManager::clearMacros()
 {
-  DEBUG_PRINTLN("Loading devices from EEPROM...");
+  memset(macros, 0, sizeof(macros));
+  macrosDirty = false;
+}
+
+void DeviceManager::readCommand(uint16_t command, IRCode &code)
+{
+  code.protocol = (decode_type_t)store.protocol(command);
+  code.data = store.data(command);
+  code.bits = store.bits(command);
+  code.rawData = store.raw(command);
+  code.rawLen = store.rawLength(command);
+  code.buffer.reset();
+}
+
+Device DeviceManager::describeDevice(uint8_t slot)
+{
+  Device device;
+  device.id = store.deviceId(slot);
+  device.name = store.strings.get(store.name(slot));
+  device.type = store.strings.get(store.type(slot));
+  device.manufacturer = store.strings.get(store.manufacturer(slot));
+  device.model = store.strings.get(store.model(slot));
+  device.commandCount = commandCountOf(slot);
+  return device;
+}
+
+uint8_t DeviceManager::findDeviceSlot(const char *deviceName)
+{
+  size_t deviceLength = strlen(deviceName);
+  uint16_t slot;
+  bool found = index.find(
+      indexHash(deviceName, deviceLength),
+      [&](uint16_t s)
+      { return (s & INDEX_DEVICE_ENTRY) && store.strings.equals(store.name(s & 0xFF), deviceName, deviceLength); },
+      slot);
+  return found ? slot & 0xFF : INDEX_NONE;
+}
+
+uint16_t DeviceManager::findCommandSlot(const char *deviceName, const char *commandName)
+{
+  uint16_t command = lookupCommandSlot(deviceName, commandName);
+  if (command != STORE_NONE)
+  {
+    return command;
+  }
+
+  // A miss may only mean the device's commands are still on flash
+  uint8_t slot = findDeviceSlot(deviceName);
+  if (slot == INDEX_NONE || commandsLoaded[slot] || !ensureCommandsLoaded(slot))
+  {
+    return STORE_NONE;
+  }
+  return lookupCommandSlot(deviceName, commandName);
+}
+
+uint16_t DeviceManager::lookupCommandSlot(const char *deviceName, const char *commandName)
+{
+  size_t deviceLength = strlen(deviceName), commandLength = strlen(commandName);
+  uint16_t command;
+  bool found = index.find(
+      indexHash(deviceName, deviceLength, commandName, commandLength),
+      [&](uint16_t c)
+      {
+        return !(c & INDEX_DEVICE_ENTRY) && store.strings.equals(store.commandName(c), commandName, commandLength) &&
+               store.strings.equals(store.name(store.commandDevice(c)), deviceName, deviceLength);
+      },
+      command);
+  return found ? command : STORE_NONE;
+}
+
+uint32_t DeviceManager::commandHash(uint16_t command)
+{
+  uint16_t device = store.name(store.commandDevice(command)), name = store.commandName(command);
+  return indexHash(store.strings.get(device), store.strings.length(device), store.strings.get(name), store.strings.length(name));
+}
+
+uint8_t DeviceManager::allocateDeviceId()
+{
+  // Rotate through ids so a freed id is not handed out again straight away
+  while (deviceSlots[nextDeviceId] != INDEX_NONE || nextDeviceId == INDEX_NONE)
+  {
+    nextDeviceId++;
+  }
+  return nextDeviceId++;
+}
+
+uint8_t DeviceManager::allocateCommandId(uint8_t slot)
+{
+  for (;;)
+  {
+    uint8_t id = store.nextCommandId(slot)++;
+    if (id == INDEX_NONE)
+    {
+      continue;
+    }
+
+    bool inUse = false;
+    for (uint16_t c = store.firstCommand(slot); c != STORE_NONE && !inUse; c = store.nextCommand(c))
+    {
+      inUse = store.commandId(c) == id;
+    }
+    if (!inUse)
+    {
+      return id;
+    }
+  }
+}
+
+bool DeviceManager::storeString(uint16_t &handle, const String &value)
+{
+  // Intern before releasing so an unchanged value keeps its record
+  uint16_t interned = store.strings.intern(value.c_str(), value.length());
+  store.strings.release(handle);
+  handle = interned;
+  return interned != STORE_NONE || value.length() == 0;
+}
+
+bool DeviceManager::storeRaw(uint16_t command, decode_type_t protocol, const uint16_t *timings, uint16_t length)
+{
+  if (!store.setRaw(command, timings, length))
+    return false;
+
+  // Hold what flash will give back after a reboot, not the exact capture.
+  // A/C state bytes are stored exactly
+  size_t size = length && !irProtocolHasState(protocol) ? rawEncoder.encode(timings, length, rawScratch, sizeof(rawScratch)) : 0;
+  if (size)
+    decodeRawTimings(rawScratch, size, store.raw(command), length);
+  return true;
+}
+
+void DeviceManager::indexDevice(uint8_t slot)
+{
+  // The table holds every entry at two-thirds load and is rebuilt before
+  // tombstones pass a quarter of it, so inserts always find a free bucket
+  uint16_t name = store.name(slot);
+  index.insert(indexHash(store.strings.get(name), store.strings.length(name)), INDEX_DEVICE_ENTRY | slot);
+  for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
+  {
+    shareCode(c);
+    indexCommand(c);
+  }
+}
+
+void DeviceManager::indexCommand(uint16_t command)
+{
+  index.insert(commandHash(command), command);
+
+  IRCode code;
+  readCommand(command, code);
+  if (irHasCode(code))
+  {
+    codeIndex.insert(canonicalizer.fingerprint(code), command);
+  }
+}
+
+void DeviceManager::unindexCommand(uint16_t command)
+{
+  index.remove(commandHash(command), command);
+
+  IRCode code;
+  readCommand(command, code);
+  if (irHasCode(code))
+  {
+    codeIndex.remove(canonicalizer.fingerprint(code), command);
+  }
+}
+
+uint16_t DeviceManager::findCodeSlot(const IRCode &code, uint16_t except)
+{
+  if (!irHasCode(code))
+  {
+    return STORE_NONE;
+  }
+
+  // Equal fingerprints are only candidates; the codes themselves decide
+  IRCode stored;
+  uint16_t command;
+  bool found = codeIndex.find(
+      canonicalizer.fingerprint(code),
+      [&](uint16_t c)
+      {
+        if (c == except)
+        {
+          return false;
+        }
+        readCommand(c, stored);
+        return irCodesMatch(stored, code);
+      },
+      command);
+  return found ? command : STORE_NONE;
+}
+
+uint16_t DeviceManager::findRawHolder(const IRCode &code, uint16_t except, bool exact)
+{
+  // Codes loaded from flash share only exact copies, so a reboot never
+  // changes what a command sends; a new command takes the stored timings
+  // when its own are within the match tolerance. State bytes are exact
+  uint16_t length = code.rawLen;
+  uint16_t other = code.rawData && length ? findCodeSlot(code, except) : STORE_NONE;
+  if (other == STORE_NONE || store.rawLength(other) != length)
+  {
+    return STORE_NONE;
+  }
+
+  const uint16_t *theirs = store.raw(other);
+  bool same = exact || irProtocolHasState(code.protocol) ? memcmp(code.rawData, theirs, length * sizeof(uint16_t)) == 0
+                                                         : irTimingsMatch(code.rawData, length, theirs, length);
+  return same ? other : STORE_NONE;
+}
+
+void DeviceManager::shareCode(uint16_t command)
+{
+  IRCode code;
+  readCommand(command, code);
+  uint16_t other = findRawHolder(code, command, true);
+  if (other != STORE_NONE)
+  {
+    store.shareRaw(command, other);
+  }
+}
+
+void DeviceManager::rebuildIndex()
+{
+  index.clear();
+  codeIndex.clear();
+  memset(deviceSlots, INDEX_NONE, sizeof(deviceSlots));
+
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    if (store.isDevice(slot))
+    {
+      deviceSlots[store.deviceId(slot)] = slot;
+      indexDevice(slot);
+    }
+  }
+}
+
+void DeviceManager::removeDeviceAt(uint8_t slot)
+{
+  uint16_t name = store.name(slot);
+  index.remove(indexHash(store.strings.get(name), store.strings.length(name)), INDEX_DEVICE_ENTRY | slot);
+  for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
+  {
+    unindexCommand(c);
+  }
+  uint8_t id = store.deviceId(slot);
+  deviceSlots[id] = INDEX_NONE;
+  staleFiles[id / 8] |= 1 << (id % 8);
+  commandsLoaded[slot] = false;
+  loadFailed[slot] = false;
+  deviceDirty[slot] = false;
+  store.freeDevice(slot);
+
+  if (index.needsRebuild() || codeIndex.needsRebuild())
+  {
+    rebuildIndex();
+  }
+}
+
+void DeviceManager::removeCommandAt(uint16_t command)
+{
+  unindexCommand(command);
+  store.freeCommand(command);
+
+  if (index.needsRebuild() || codeIndex.needsRebuild())
+  {
+    rebuildIndex();
+  }
+}
+
+void DeviceManager::writeDeviceList(JsonStreamWriter &writer)
+{
+  MutexLock lock(dataMutex);
+
+  writer.beginObject();
+  writer.key("devices");
+  writer.beginArray();
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    if (!store.isDevice(slot))
+      continue;
+
+    writer.beginObject();
+    writer.field("id", store.deviceId(slot));
+    writer.field("name", store.strings.get(store.name(slot)));
+    writer.field("type", store.strings.get(store.type(slot)));
+    writer.field("manufacturer", store.strings.get(store.manufacturer(slot)));
+    writer.field("model", store.strings.get(store.model(slot)));
+    writer.field("commandCount", commandCountOf(slot));
+    writer.endObject();
+  }
+  writer.endArray();
+  writer.field("count", store.getDeviceCount());
+  writer.endObject();
+}
+
+String DeviceManager::getDeviceList()
+{
+  String result;
+  JsonStringSink sink(result);
+  JsonStreamWriter writer(sink);
+  writeDeviceList(writer);
+  return result;
+}
+
+String DeviceManager::getCommandList(const String &deviceName)
+{
+  MutexLock lock(dataMutex);
+
+  uint8_t slot = findDeviceSlot(deviceName.c_str());
+  if (slot == INDEX_NONE)
+  {
+    return "{\"error\":\"Device not found\"}";
+  }
+  ensureCommandsLoaded(slot);
+
+  DynamicJsonDocument doc(2048);
+  JsonArray commandArray = doc.createNestedArray("commands");
+
+  for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
+  {
+    JsonObject commandObj = commandArray.createNestedObject();
+    commandObj["id"] = store.commandId(c);
+    commandObj["name"] = store.strings.get(store.commandName(c));
+    commandObj["description"] = store.strings.get(store.commandDescription(c));
+  }
+
+  doc["device"] = deviceName;
+  doc["count"] = store.getCommandCount(slot);
+
+  String result;
+  serializeJson(doc, result);
+  return result;
+}
+
+void DeviceManager::writeExport(JsonStreamWriter &writer, uint32_t exported)
+{
+  MutexLock lock(dataMutex);
+
+  writer.beginObject();
+  writer.key("devices");
+  writer.beginArray();
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    if (!store.isDevice(slot) || !ensureCommandsLoaded(slot))
+      continue;
+
+    writer.beginObject();
+    writer.field("name", store.strings.get(store.name(slot)));
+    writer.field("type", store.strings.get(store.type(slot)));
+    writer.field("manufacturer", store.strings.get(store.manufacturer(slot)));
+    writer.field("model", store.strings.get(store.model(slot)));
+
+    writer.key("commands");
+    writer.beginArray();
+    for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
+    {
+      writer.beginObject();
+      writer.field("name", store.strings.get(store.commandName(c)));
+      writer.field("description", store.strings.get(store.commandDescription(c)));
+      writeCode(writer, c);
+      writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+  }
+  writer.endArray();
+  writer.field("version", "1.0");
+  writer.field("exported", exported);
+  writer.endObject();
+}
+
+void DeviceManager::writeCode(JsonStreamWriter &writer, uint16_t command)
+{
+  // The fields IRManager::encodeIRCode() writes, for decodeIRCode() to read
+  IRCode code;
+  readCommand(command, code);
+  writer.key("code");
+  writer.beginObject();
+  writer.field("protocol", typeToString(code.protocol).c_str());
+  writer.field("value", String(code.data, HEX).c_str());
+  writer.field("bits", code.bits);
+  if (irProtocolHasState(code.protocol))
+  {
+    static const char digits[] = "0123456789ABCDEF";
+    char hex[2 * kStateSizeMax + 1];
+    uint16_t bytes = code.rawData && code.rawLen >= irStateWords(code.bits) && code.bits / 8 <= kStateSizeMax ? code.bits / 8 : 0;
+    const uint8_t *state = (const uint8_t *)code.rawData;
+    for (uint16_t i = 0; i < bytes; i++)
+    {
+      hex[2 * i] = digits[state[i] >> 4];
+      hex[2 * i + 1] = digits[state[i] & 0x0F];
+    }
+    hex[2 * bytes] = '\0';
+    writer.field("state", hex);
+  }
+  else if (code.rawData && code.rawLen > 0)
+  {
+    size_t size = rawEncoder.encode(code.rawData, code.rawLen, rawScratch, sizeof(rawScratch));
+    if (size > 0)
+    {
+      writer.field("rawz", base64Encode(rawScratch, size).c_str());
+    }
+    else
+    {
+      writer.key("raw");
+      writer.beginArray();
+      for (uint16_t i = 0; i < code.rawLen; i++)
+      {
+        writer.number(code.rawData[i]);
+      }
+      writer.endArray();
+    }
+  }
+  writer.endObject();
+}
+
+String DeviceManager::exportDevices()
+{
+  String result;
+  JsonStringSink sink(result);
+  JsonStreamWriter writer(sink);
+  writeExport(writer, millis());
+  return result;
+}
+
+bool DeviceManager::importDevices(const String &jsonData, IRManager &codec)
+{
+  // Values and their copied strings take about as much again as the text
+  DynamicJsonDocument doc(2 * jsonData.length() + 1024);
+  DeserializationError error = deserializeJson(doc, jsonData);
+
+  if (error)
+  {
+    DEBUG_PRINTLN("ERROR: Failed to parse import data");
+    return false;
+  }
+
+  MutexLock lock(dataMutex);
+
+  // Reset current devices; their record files go with the next compaction
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    if (store.isDevice(slot))
+    {
+      staleFiles[store.deviceId(slot) / 8] |= 1 << (store.deviceId(slot) % 8);
+    }
+  }
+  store.clear();
+  memset(commandsLoaded, 0, sizeof(commandsLoaded));
+  memset(loadFailed, 0, sizeof(loadFailed));
+  memset(deviceDirty, 0, sizeof(deviceDirty));
+  rebuildIndex();
+  nextDeviceId = 0;
+
+  // Imported devices are numbered afresh, so stored steps would point elsewhere
+  clearMacros();
+  macrosDirty = true;
+  logRemoval(LOG_CLEAR, 0, 0);
+  schedulePersist();
+
+  // Added as a client would add them, so the same limits apply. The first
+  // device or command that does not fit ends the import; those before it stay
+  JsonArray deviceArray = doc["devices"];
+  for (JsonObject deviceObj : deviceArray)
+  {
+    Device device;
+    device.name = deviceObj["name"].as<String>();
+    device.type = deviceObj["type"].as<String>();
+    device.manufacturer = deviceObj["manufacturer"].as<String>();
+    device.model = deviceObj["model"].as<String>();
+    if (!addDevice(device))
+    {
+      DEBUG_PRINTLN("ERROR: Import stopped at device: " + device.name);
+      return false;
+    }
+
+    JsonArray commandArray = deviceObj["commands"];
+    for (JsonObject commandObj : commandArray)
+    {
+      IRCommand command;
+      command.name = commandObj["name"].as<String>();
+      command.description = commandObj["description"].as<String>();
+      command.code = IRCode();
+      JsonObject codeObj = commandObj["code"];
+      if (!codeObj.isNull())
+      {
+        String encoded;
+        serializeJson(codeObj, encoded);
+        command.code = codec.decodeIRCode(encoded);
+      }
+      // Timings that did not decode would store a code that cannot be sent
+      bool timed = codeObj.containsKey("rawz") || codeObj.containsKey("raw") || codeObj.containsKey("state");
+      if ((timed && !command.code.rawLen) || !addCommand(device.name, command))
+      {
+        DEBUG_PRINTLN("ERROR: Import stopped at command: " + command.name);
+        return false;
+      }
+    }
+  }
+
+  DEBUG_PRINTLN("Imported " + String(store.getDeviceCount()) + " devices");
+  return true;
+}
+
+bool DeviceManager::deviceExists(const String &deviceName)
+{
+  return findDeviceSlot(deviceName.c_str()) != INDEX_NONE;
+}
+
+bool DeviceManager::commandExists(const String &deviceName, const String &commandName)
+{
+  return findCommandSlot(deviceName.c_str(), commandName.c_str()) != STORE_NONE;
+}
+
+void DeviceManager::printDeviceInfo(const Device &device)
+{
+  DEBUG_PRINTLN("Device: " + device.name);
+  DEBUG_PRINTLN("  Type: " + device.type);
+  DEBUG_PRINTLN("  Manufacturer: " + device.manufacturer);
+  DEBUG_PRINTLN("  Model: " + device.model);
+  DEBUG_PRINTLN("  Commands: " + String(device.commandCount));
+}
+
+void DeviceManager::getStatus(JsonObject doc)
+{
+  MutexLock lock(dataMutex);
+
+  // The array-of-structs layout this store replaced: four Strings per
+  // device and a fixed IRCommand array each (which had no pool handle),
+  // String contents not included
+  const size_t legacyBytes = MAX_DEVICES * (4 * sizeof(String) + 2 + MAX_COMMANDS * (sizeof(IRCommand) - sizeof(RawBuffer)));
+  const size_t storeBytes = sizeof(store) + sizeof(index) + sizeof(codeIndex) + sizeof(deviceSlots);
+
+  uint8_t loadedDevices = 0, failedDevices = 0;
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    loadedDevices += store.isDevice(slot) && commandsLoaded[slot];
+    failedDevices += store.isDevice(slot) && loadFailed[slot];
+  }
+  uint8_t macroCount = 0;
+  for (const Macro &macro : macros)
+  {
+    macroCount += macro.stepCount > 0;
+  }
+
+  doc["loaded"] = dataLoaded;
+  doc["deviceCount"] = store.getDeviceCount();
+  doc["maxDevices"] = MAX_DEVICES;
+  doc["macroCount"] = macroCount;
+
+  JsonObject storage = doc.createNestedObject("storage");
+  storage["usedBytes"] = LittleFS.usedBytes();
+  storage["totalBytes"] = LittleFS.totalBytes();
+  storage["loadedDevices"] = loadedDevices;
+  storage["failedDevices"] = failedDevices;
+  storage["logBytes"] = logFileBytes;
+  storage["generation"] = storageGeneration;
+
+  JsonObject memory = doc.createNestedObject("memory");
+  memory["storeBytes"] = storeBytes;
+  memory["legacyBytes"] = legacyBytes;
+  memory["savedBytes"] = (long)legacyBytes - (long)storeBytes;
+  memory["commands"] = store.getStoredCommands();
+  memory["maxCommands"] = STORE_MAX_COMMANDS;
+  memory["strings"] = store.strings.stringsUsed();
+  memory["stringBytes"] = store.strings.bytesUsed();
+  memory["stringPoolSize"] = STORE_STRING_POOL_SIZE;
+  memory["rawWords"] = store.getRawUsed();
+  memory["rawArenaSize"] = STORE_RAW_ARENA_SIZE;
+  // What new commands may still take; rawWords covers loaded devices only
+  const uint16_t rawLimit = STORE_RAW_ARENA_SIZE - STORE_RAW_SPARE;
+  memory["rawAvailable"] = store.getRawUsed() < rawLimit ? rawLimit - store.getRawUsed() : 0;
+  memory["sharedCodes"] = store.getRawShared();
+}
+
+String DeviceManager::getStatus()
+{
+  DynamicJsonDocument doc(1024);
+  JsonObject status = doc.to<JsonObject>();
+  getStatus(status);
+  metrics.renderGroup(METRIC_GROUP_DEVICES, status);
+  metrics.renderGroup(METRIC_GROUP_STORAGE, status["storage"]);
+
+  String result;
+  serializeJson(doc, result);
+  return result;
+}
+
+void DeviceManager::reset()
+{
+  DEBUG_PRINTLN("Resetting Device Manager...");
+  MutexLock flashLock(flashMutex);
+  MutexLock dataLock(dataMutex);
+  store.clear();
+  nextDeviceId = 0;
+  memset(commandsLoaded, 0, sizeof(commandsLoaded));
+  memset(loadFailed, 0, sizeof(loadFailed));
+  memset(deviceDirty, 0, sizeof(deviceDirty));
+  memset(staleFiles, 0, sizeof(staleFiles));
+  memset(logLengths, 0, sizeof(logLengths));
+  logOverflow = false;
+  compactRequested = false;
+  storageGeneration = 0;
+  logFileBytes = 0;
+  clearMacros();
+  rebuildIndex();
+  clearStorage();
+  clearEEPROM();
+  DEBUG_PRINTLN("Device Manager reset complete");
+}
+
+namespace
+{
+  // Little-endian field codec over a LittleFS file or a RAM buffer. Short
+  // reads and writes are remembered so a record is checked once, at the end
+  struct RecordWriter
+  {
+    File *file;
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    bool ok;
+
+    explicit RecordWriter(File &f) : file(&f), buffer(nullptr), capacity(0), length(0), ok(true) {}
+    RecordWriter(uint8_t *b, size_t c) : file(nullptr), buffer(b), capacity(c), length(0), ok(true) {}
+    void bytes(const void *data, size_t count)
+    {
+      if (file)
+      {
+        ok &= file->write((const uint8_t *)data, count) == count;
+      }
+      else if (ok && length + count <= capacity)
+      {
+        memcpy(buffer + length, data, count);
+      }
+      else
+      {
+        ok = false;
+      }
+      length += count;
+    }
+    void u8(uint8_t value) { bytes(&value, 1); }
+    void u16(uint16_t value)
+    {
+      uint8_t b[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+      bytes(b, 2);
+    }
+    void u32(uint32_t value)
+    {
+      uint8_t b[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+      bytes(b, 4);
+    }
+    void u64(uint64_t value)
+    {
+      uint8_t b[8];
+      for (int i = 0; i < 8; i++)
+        b[i] = value >> (8 * i);
+      bytes(b, 8);
+    }
+    void str(const char *text, uint8_t length)
+    {
+      u8(length);
+      bytes(text, length);
+    }
+  };
+
+  struct RecordReader
+  {
+    File *file;
+    const uint8_t *buffer;
+    size_t length;
+    size_t pos;
+    bool ok;
+
+    explicit RecordReader(File &f) : file(&f), buffer(nullptr), length(0), pos(0), ok(true) {}
+    RecordReader(const uint8_t *b, size_t l) : file(nullptr), buffer(b), length(l), pos(0), ok(true) {}
+    void bytes(void *data, size_t count)
+    {
+      if (ok && file)
+      {
+        ok = file->read((uint8_t *)data, count) == count;
+      }
+      else if (ok && pos + count <= length)
+      {
+        memcpy(data, buffer + pos, count);
+        pos += count;
+      }
+      else
+      {
+        ok = false;
+      }
+      if (!ok)
+      {
+        memset(data, 0, count);
+      }
+    }
+    uint8_t u8()
+    {
+      uint8_t value = 0;
+      bytes(&value, 1);
+      return value;
+    }
+    uint16_t u16()
+    {
+      uint8_t b[2];
+      bytes(b, 2);
+      return b[0] | (b[1] << 8);
+    }
+    uint32_t u32()
+    {
+      uint8_t b[4];
+      bytes(b, 4);
+      return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+    uint64_t u64()
+    {
+      uint8_t b[8];
+      bytes(b, 8);
+      uint64_t value = 0;
+      for (int i = 7; i >= 0; i--)
+        value = (value << 8) | b[i];
+      return value;
+    }
+    uint8_t str(char *text) // text holds at least 256 bytes
+    {
+      uint8_t length = u8();
+      bytes(text, length);
+      text[ok ? length : 0] = '\0';
+      return ok ? length : 0;
+    }
+  };
+
+  // Raw timings: [count:2], then [encoded size:2][codec bytes], or an
+  // encoded size of 0 and plain words when the codec cannot shrink them
+  void writeRaw(RecordWriter &out, RawTimingEncoder &encoder, uint8_t *scratch, decode_type_t protocol, const uint16_t *raw,
+                uint16_t length)
+  {
+    out.u16(length);
+    if (!length)
+      return;
+
+    // A/C state bytes go out plain; the codec would round them
+    size_t size = irProtocolHasState(protocol) ? 0 : encoder.encode(raw, length, scratch, RAW_CODEC_MAX_SIZE);
+    out.u16(size);
+    if (size)
+    {
+      out.bytes(scratch, size);
+      return;
+    }
+    for (uint16_t i = 0; i < length; i++)
+      out.u16(raw[i]);
+  }
+
+  // Decodes straight into the raw arena; false if the section is damaged
+  // or the arena is full
+  bool readRaw(RecordReader &in, DeviceStore &store, uint16_t command, uint8_t *scratch)
+  {
+    uint16_t length = in.u16();
+    if (!length)
+      return in.ok;
+
+    uint16_t size = in.u16();
+    if (!in.ok || length > MAX_IR_CODE_SIZE || size > RAW_CODEC_MAX_SIZE)
+      return false;
+    uint16_t *raw = store.reserveRaw(command, length);
+    if (!raw)
+      return false;
+
+    if (size)
+    {
+      in.bytes(scratch, size);
+      return in.ok && rawTimingCount(scratch, size) == length && decodeRawTimings(scratch, size, raw, length);
+    }
+    for (uint16_t i = 0; i < length; i++)
+      raw[i] = in.u16();
+    return in.ok;
+  }
+
+  // Macro steps: [count:1], then [device id:1][command id:1][repeat:1][delay:2] each
+  void writeMacroSteps(RecordWriter &out, const MacroStep *steps, uint8_t count)
+  {
+    out.u8(count);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      out.u8(steps[i].deviceId);
+      out.u8(steps[i].commandId);
+      out.u8(steps[i].repeat);
+      out.u16(steps[i].delayMs);
+    }
+  }
+
+  uint8_t readMacroSteps(RecordReader &in, MacroStep *steps)
+  {
+    uint8_t count = in.u8();
+    if (count > BATCH_MAX_STEPS)
+    {
+      in.ok = false;
+      return 0;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+      steps[i].deviceId = in.u8();
+      steps[i].commandId = in.u8();
+      steps[i].repeat = in.u8();
+      steps[i].delayMs = in.u16();
+    }
+    return in.ok ? count : 0;
+  }
+
+  const uint8_t MANIFEST_MAGIC[4] = {'E', 'I', 'R', 'M'};
+  const uint8_t DEVICE_FILE_MAGIC[4] = {'E', 'I', 'R', 'D'};
+  const uint8_t MACROS_MAGIC[4] = {'E', 'I', 'R', 'S'};
+  const uint8_t LOG_MAGIC[4] = {'E', 'I', 'R', 'L'};
+
+  // Log file: [magic:4][version:1][generation:4], then records of
+  // [type:1][length:2][payload][crc32:4], the CRC covering type to payload
+  const size_t LOG_HEADER_SIZE = 9;
+  const size_t LOG_RECORD_OVERHEAD = 7;
+
+  // The largest record, a command with full names and raw timings, fits a buffer
+  static_assert(LOG_RECORD_OVERHEAD + 19 + 2 * 256 + 2 * MAX_IR_CODE_SIZE <= STORAGE_LOG_BUFFER_SIZE, "log buffer too small");
+
+  uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+  {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+      crc ^= data[i];
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+  }
+
+  void devicePath(char *path, size_t size, uint8_t deviceId)
+  {
+    snprintf(path, size, STORAGE_DIR "/d%02x.bin", deviceId);
+  }
+
+  // Writes to a temporary file and renames it over the target, so a reader
+  // sees either the old record or the complete new one
+  template <typename Fill>
+  bool writeRecordFile(const char *path, Fill fill)
+  {
+    char temp[40];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    File file = LittleFS.open(temp, "w");
+    if (!file)
+    {
+      return false;
+    }
+    RecordWriter out(file);
+    fill(out);
+    file.close();
+
+    if (!out.ok || !LittleFS.rename(temp, path))
+    {
+      LittleFS.remove(temp);
+      return false;
+    }
+    return true;
+  }
+}
+
+bool DeviceManager::ensureCommandsLoaded(uint8_t slot)
+{
+  if (commandsLoaded[slot])
+  {
+    return true;
+  }
+  if (loadFailed[slot])
+  {
+    return false;
+  }
+
+  if (loadDeviceFile(slot))
+  {
+    commandsLoaded[slot] = true;
+    indexDevice(slot);
+    return true;
+  }
+
+  // Drop whatever was read before the failure: a partial set is never
+  // served or saved over the file, and the file is not read again
+  while (store.firstCommand(slot) != STORE_NONE)
+  {
+    store.freeCommand(store.firstCommand(slot));
+  }
+  loadFailed[slot] = true;
+  DEBUG_PRINTLN("ERROR: Failed to load commands for device: " + String(store.strings.get(store.name(slot))));
+  return false;
+}
+
+void DeviceManager::loadAllCommands()
+{
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    if (store.isDevice(slot))
+    {
+      ensureCommandsLoaded(slot);
+    }
+  }
+}
+
+uint8_t DeviceManager::commandCountOf(uint8_t slot)
+{
+  return commandsLoaded[slot] ? store.getCommandCount(slot) : storedCommandCounts[slot];
+}
+
+bool DeviceManager::saveToStorage()
+{
+  MutexLock flashLock(flashMutex);
+
+  // Swap buffers so mutations keep logging while this one is written
+  uint8_t flushing;
+  bool compact;
+  {
+    MutexLock dataLock(dataMutex);
+    flushing = activeLog;
+    activeLog ^= 1;
+    compact = compactRequested || logOverflow || logFileBytes + logLengths[flushing] > STORAGE_LOG_COMPACT_BYTES;
+  }
+
+  if (!logLengths[flushing] && !compact)
+  {
+    return true;
+  }
+
+  // Appended even when a compaction follows, so a crash part way through it
+  // still finds these records
+  uint32_t start = micros();
+  bool ok = true;
+  if (logLengths[flushing] && !compactRequested)
+  {
+    ok = appendLogFile(logBuffers[flushing], logLengths[flushing]);
+  }
+  logLengths[flushing] = 0;
+
+  if (compact || !ok)
+  {
+    ok = compactStorage();
+  }
+  metrics.observe(METRIC_HIST_FLASH_COMMIT_US, micros() - start);
+  metrics.add(ok ? METRIC_FLASH_COMMITS : METRIC_FLASH_FAILURES);
+  return ok;
+}
+
+bool DeviceManager::compactStorage()
+{
+  DEBUG_PRINTLN("Compacting device storage...");
+
+  MutexLock flashLock(flashMutex);
+  {
+    // From here on, RAM is what the new records capture
+    MutexLock dataLock(dataMutex);
+    compactRequested = false;
+    logOverflow = false;
+  }
+  uint32_t generation = storageGeneration + 1;
+  bool ok = true;
+
+  // Device files first, so the manifest never describes commands that are
+  // not on flash yet. The old log still replays cleanly over them, since
+  // every record sets or deletes by id. dataMutex is held per file
+  for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+  {
+    MutexLock dataLock(dataMutex);
+    if (store.isDevice(slot) && deviceDirty[slot])
+    {
+      // Stays dirty until written, so the retry covers it before the log goes
+      deviceDirty[slot] = !saveDeviceFile(slot);
+      ok &= !deviceDirty[slot];
+    }
+  }
+
+  MutexLock dataLock(dataMutex);
+  if (ok && macrosDirty)
+  {
+    ok = saveMacros();
+    macrosDirty = !ok;
+  }
+  if (ok && saveManifest(generation))
+  {
+    storageGeneration = generation;
+
+    // Nothing on flash refers to these any more
+    for (int id = 0; id < 256; id++)
+    {
+      if ((staleFiles[id / 8] & (1 << (id % 8))) && deviceSlots[id] == INDEX_NONE)
+      {
+        char path[32];
+        devicePath(path, sizeof(path), id);
+        LittleFS.remove(path);
+      }
+    }
+    memset(staleFiles, 0, sizeof(staleFiles));
+
+    // Records still buffered belong to the new log
+    ok = resetLogFile(generation);
+  }
+  else
+  {
+    ok = false;
+  }
+
+  // Until a compaction succeeds the log file cannot take appends
+  compactRequested = !ok;
+  if (ok)
+  {
+    metrics.add(METRIC_FLASH_COMPACTIONS);
+  }
+  DEBUG_PRINTLN(ok ? "Compaction complete" : "ERROR: Compaction failed");
+  return ok;
+}
+
+bool DeviceManager::saveManifest(uint32_t generation)
+{
+  return writeRecordFile(STORAGE_MANIFEST, [&](RecordWriter &out)
+                         {
+    out.bytes(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    out.u8(STORAGE_FORMAT_VERSION);
+    out.u32(generation);
+    out.u8(nextDeviceId);
+    out.u8(store.getDeviceCount());
+
+    for (uint8_t slot = 0; slot < MAX_DEVICES; slot++)
+    {
+      if (!store.isDevice(slot))
+        continue;
+
+      out.u8(store.deviceId(slot));
+      out.u8(store.nextCommandId(slot));
+      out.u8(commandCountOf(slot));
+      const uint16_t fields[] = {store.name(slot), store.type(slot), store.manufacturer(slot), store.model(slot)};
+      for (uint16_t field : fields)
+        out.str(store.strings.get(field), store.strings.length(field));
+    } });
+}
+
+bool DeviceManager::loadManifest()
+{
+  DEBUG_PRINTLN("Loading device manifest...");
+
+  File file = LittleFS.open(STORAGE_MANIFEST, "r");
+  if (!file)
+  {
+    DEBUG_PRINTLN("No device manifest found");
+    return false;
+  }
+
+  RecordReader in(file);
+  uint8_t magic[4];
+  in.bytes(magic, sizeof(magic));
+  if (!in.ok || memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) != 0 || in.u8() != STORAGE_FORMAT_VERSION)
+  {
+    DEBUG_PRINTLN("Unrecognised device manifest");
+    return false;
+  }
+
+  store.clear();
+  storageGeneration = in.u32();
+  nextDeviceId = in.u8();
+  uint8_t deviceCount = in.u8();
+  char text[256];
+
+  for (uint8_t i = 0; i < deviceCount && in.ok; i++)
+  {
+    uint8_t slot = store.allocDevice(in.u8());
+    if (slot == INDEX_NONE)
+    {
+      break;
+    }
+    store.nextCommandId(slot) = in.u8();
+    storedCommandCounts[slot] = in.u8();
+    commandsLoaded[slot] = storedCommandCounts[slot] == 0;
+
+    uint16_t *fields[] = {&store.name(slot), &store.type(slot), &store.manufacturer(slot), &store.model(slot)};
+    for (uint16_t *field : fields)
+    {
+      uint8_t length = in.str(text);
+      *field = store.strings.intern(text, length);
+    }
+  }
+  file.close();
+
+  if (!in.ok)
+  {
+    DEBUG_PRINTLN("Device manifest is truncated");
+    store.clear();
+    storageGeneration = 0;
+    memset(commandsLoaded, 0, sizeof(commandsLoaded));
+    memset(loadFailed, 0, sizeof(loadFailed));
+    return false;
+  }
+
+  DEBUG_PRINTLN("Manifest load complete");
+  return true;
+}
+
+bool DeviceManager::saveDeviceFile(uint8_t slot)
+{
+  char path[32];
+  devicePath(path, sizeof(path), store.deviceId(slot));
+
+  return writeRecordFile(path, [&](RecordWriter &out)
+                         {
+    out.bytes(DEVICE_FILE_MAGIC, sizeof(DEVICE_FILE_MAGIC));
+    out.u8(STORAGE_FORMAT_VERSION);
+    out.u8(store.deviceId(slot));
+    out.u8(store.getCommandCount(slot));
+
+    for (uint16_t c = store.firstCommand(slot); c != STORE_NONE; c = store.nextCommand(c))
+    {
+      out.u8(store.commandId(c));
+      out.u16(store.protocol(c));
+      out.u16(store.bits(c));
+      out.u64(store.data(c));
+      out.str(store.strings.get(store.commandName(c)), store.strings.length(store.commandName(c)));
+      out.str(store.strings.get(store.commandDescription(c)), store.strings.length(store.commandDescription(c)));
+
+      writeRaw(out, rawEncoder, rawScratch, (decode_type_t)store.protocol(c), store.raw(c), store.rawLength(c));
+    } });
+}
+
+bool DeviceManager::loadDeviceFile(uint8_t slot)
+{
+  char path[32];
+  devicePath(path, sizeof(path), store.deviceId(slot));
+
+  File file = LittleFS.open(path, "r");
+  if (!file)
+  {
+    return false;
+  }
+
+  RecordReader in(file);
+  uint8_t magic[4];
+  in.bytes(magic, sizeof(magic));
+  if (!in.ok || memcmp(magic, DEVICE_FILE_MAGIC, sizeof(magic)) != 0 || in.u8() != STORAGE_FORMAT_VERSION ||
+      in.u8() != store.deviceId(slot))
+  {
+    return false;
+  }
+
+  uint8_t commandCount = in.u8();
+  char text[256];
+
+  for (uint8_t i = 0; i < commandCount && in.ok; i++)
+  {
+    uint16_t command = store.allocCommand(slot, in.u8());
+    if (command == STORE_NONE)
+    {
+      return false;
+    }
+
+    int16_t protocol = in.u16();
+    uint16_t bits = in.u16();
+    uint64_t data = in.u64();
+    store.setCode(command, protocol, data, bits);
+
+    uint8_t length = in.str(text);
+    store.commandName(command) = store.strings.intern(text, length);
+    length = in.str(text);
+    store.commandDescription(command) = store.strings.intern(text, length);
+
+    if (!readRaw(in, store, command, rawScratch))
+    {
+      return false;
+    }
+
+    // Shared straight away, so a load never holds more than one spare copy
+    uint16_t rawLength = store.rawLength(command);
+    shareCode(command);
+    for (uint16_t c = store.firstCommand(slot); c != command && rawLength; c = store.nextCommand(c))
+    {
+      if (store.rawLength(c) == rawLength && memcmp(store.raw(c), store.raw(command), rawLength * sizeof(uint16_t)) == 0)
+      {
+        store.shareRaw(command, c);
+        break;
+      }
+    }
+  }
+
+  return in.ok;
+}
+
+bool DeviceManager::saveMacros()
+{
+  return writeRecordFile(STORAGE_MACROS, [&](RecordWriter &out)
+                         {
+    uint8_t count = 0;
+    for (const Macro &macro : macros)
+      count += macro.stepCount > 0;
+
+    out.bytes(MACROS_MAGIC, sizeof(MACROS_MAGIC));
+    out.u8(STORAGE_FORMAT_VERSION);
+    out.u8(count);
+    for (const Macro &macro : macros)
+    {
+      if (!macro.stepCount)
+        continue;
+      out.str(macro.name, strlen(macro.name));
+      writeMacroSteps(out, macro.steps, macro.stepCount);
+    } });
+}
+
+bool DeviceManager::loadMacros()
+{
+  File file = LittleFS.open(STORAGE_MACROS, "r");
+  if (!file)
+  {
+    return true;
+  }
+
+  RecordReader in(file);
+  uint8_t magic[4];
+  in.bytes(magic, sizeof(magic));
+  if (!in.ok || memcmp(magic, MACROS_MAGIC, sizeof(magic)) != 0 || in.u8() != STORAGE_FORMAT_VERSION)
+  {
+    DEBUG_PRINTLN("Unrecognised macro file");
+    return false;
+  }
+
+  uint8_t count = in.u8();
+  char name[256];
+  MacroStep steps[BATCH_MAX_STEPS];
+  for (uint8_t i = 0; i < count && in.ok; i++)
+  {
+    uint8_t length = in.str(name);
+    uint8_t stepCount = readMacroSteps(in, steps);
+    if (in.ok && stepCount)
+    {
+      storeMacro(name, length, steps, stepCount);
+    }
+  }
+
+  if (!in.ok)
+  {
+    DEBUG_PRINTLN("Macro file is truncated");
+  }
+  return in.ok;
+}
+
+template <typename Fill>
+void DeviceManager::logRecord(uint8_t type, Fill fill)
+{
+  // Nothing is logged while a compaction is owed; it captures RAM anyway
+  uint16_t &length = logLengths[activeLog];
+  if (logOverflow || compactRequested)
+  {
+    return;
+  }
+  if (length + LOG_RECORD_OVERHEAD > STORAGE_LOG_BUFFER_SIZE)
+  {
+    logOverflow = true;
+    return;
+  }
+
+  uint8_t *record = logBuffers[activeLog] + length;
+  RecordWriter out(record + 3, STORAGE_LOG_BUFFER_SIZE - length - LOG_RECORD_OVERHEAD);
+  fill(out);
+  if (!out.ok)
+  {
+    DEBUG_PRINTLN("Log buffer full, compacting instead");
+    logOverflow = true;
+    return;
+  }
+
+  record[0] = type;
+  record[1] = out.length & 0xFF;
+  record[2] = out.length >> 8;
+  uint32_t crc = crc32(record, 3 + out.length);
+  for (int i = 0; i < 4; i++)
+  {
+    record[3 + out.length + i] = crc >> (8 * i);
+  }
+  length += LOG_RECORD_OVERHEAD + out.length;
+}
+
+void DeviceManager::logDevice(uint8_t type, uint8_t slot)
+{
+  logRecord(type, [&](RecordWriter &out)
+            {
+    out.u8(store.deviceId(slot));
+    if (type == LOG_ADD_DEVICE)
+    {
+      out.u8(nextDeviceId);
+      out.str(store.strings.get(store.name(slot)), store.strings.length(store.name(slot)));
+    }
+    const uint16_t fields[] = {store.type(slot), store.manufacturer(slot), store.model(slot)};
+    for (uint16_t field : fields)
+      out.str(store.strings.get(field), store.strings.length(field)); });
+}
+
+void DeviceManager::logCommand(uint16_t command)
+{
+  uint8_t slot = store.commandDevice(command);
+  logRecord(LOG_ADD_COMMAND, [&](RecordWriter &out)
+            {
+    out.u8(store.deviceId(slot));
+    out.u8(store.commandId(command));
+    out.u8(store.nextCommandId(slot));
+    out.u16(store.protocol(command));
+    out.u16(store.bits(command));
+    out.u64(store.data(command));
+    out.str(store.strings.get(store.commandName(command)), store.strings.length(store.commandName(command)));
+    out.str(store.strings.get(store.commandDescription(command)), store.strings.length(store.commandDescription(command)));
+    writeRaw(out, rawEncoder, rawScratch, (decode_type_t)store.protocol(command), store.raw(command), store.rawLength(command)); });
+}
+
+void DeviceManager::logRemoval(uint8_t type, uint8_t deviceId, uint8_t commandId)
+{
+  logRecord(type, [&](RecordWriter &out)
+            {
+    out.u8(deviceId);
+    out.u8(commandId); });
+}
+
+void DeviceManager::logMacro(uint8_t type, const char *name, size_t length, const MacroStep *steps, uint8_t count)
+{
+  logRecord(type, [&](RecordWriter &out)
+            {
+    out.str(name, length);
+    if (type == LOG_SET_MACRO)
+      writeMacroSteps(out, steps, count); });
+}
+
+bool DeviceManager::appendLogFile(const uint8_t *data, size_t length)
+{
+  File file = LittleFS.open(STORAGE_LOG, "a");
+  if (!file)
+  {
+    return false;
+  }
+
+  RecordWriter out(file);
+  if (file.size() == 0)
+  {
+    out.bytes(LOG_MAGIC, sizeof(LOG_MAGIC));
+    out.u8(STORAGE_FORMAT_VERSION);
+    out.u32(storageGeneration);
+  }
+  out.bytes(data, length);
+  file.close();
+
+  logFileBytes += out.length;
+  return out.ok;
+}
+
+bool DeviceManager::resetLogFile(uint32_t generation)
+{
+  bool ok = writeRecordFile(STORAGE_LOG, [&](RecordWriter &out)
+                            {
+    out.bytes(LOG_MAGIC, sizeof(LOG_MAGIC));
+    out.u8(STORAGE_FORMAT_VERSION);
+    out.u32(generation); });
+  logFileBytes = ok ? LOG_HEADER_SIZE : logFileBytes;
+  return ok;
+}
+
+bool DeviceManager::replayLog()
+{
+  File file = LittleFS.open(STORAGE_LOG, "r");
+  if (!file)
+  {
+    return true;
+  }
+
+  RecordReader in(file);
+  uint8_t magic[4];
+  in.bytes(magic, sizeof(magic));
+  uint8_t version = in.u8();
+  uint32_t generation = in.u32();
+  if (!in.ok || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0 || version != STORAGE_FORMAT_VERSION || generation != storageGeneration)
+  {
+    // Left over from before the manifest was last written
+    DEBUG_PRINTLN("Discarding stale device log");
+    return false;
+  }
+  logFileBytes = LOG_HEADER_SIZE;
+
+  // Nothing is buffered yet at boot, so the second log buffer holds payloads
+  uint8_t *payload = logBuffers[1];
+  uint16_t replayed = 0;
+  for (;;)
+  {
+    uint8_t head[3], tail[4];
+    size_t read = file.read(head, sizeof(head));
+    if (read == 0)
+    {
+      break;
+    }
+
+    // Stop at the first torn or corrupt record; nothing after it was acknowledged
+    uint16_t length = head[1] | (head[2] << 8);
+    if (read != sizeof(head) || length > STORAGE_LOG_BUFFER_SIZE - LOG_RECORD_OVERHEAD || file.read(payload, length) != length ||
+        file.read(tail, sizeof(tail)) != sizeof(tail) ||
+        crc32(payload, length, crc32(head, sizeof(head))) != (tail[0] | (tail[1] << 8) | (tail[2] << 16) | ((uint32_t)tail[3] << 24)))
+    {
+      DEBUG_PRINTLN("Device log ends in a torn record");
+      return false;
+    }
+
+    applyLogRecord(head[0], payload, length);
+    logFileBytes += LOG_RECORD_OVERHEAD + length;
+    replayed++;
+  }
+
+  DEBUG_PRINTLN("Replayed " + String(replayed) + " log records");
+  return true;
+}
+
+void DeviceManager::applyLogRecord(uint8_t type, const uint8_t *payload, uint16_t length)
+{
+  if (type == LOG_SET_MACRO || type == LOG_REMOVE_MACRO)
+  {
+    applyMacroRecord(type, payload, length);
+    return;
+  }
+
+  // Records set or delete by id, so replaying one over a record file that
+  // already holds it is harmless
+  RecordReader in(payload, length);
+  char text[256];
+  uint8_t deviceId = in.u8();
+  uint8_t slot = deviceSlots[deviceId];
+
+  switch (type)
+  {
+  case LOG_ADD_DEVICE:
+  case LOG_UPDATE_DEVICE:
+  {
+    uint8_t next = type == LOG_ADD_DEVICE ? in.u8() : 0;
+    uint16_t fields[4] = {STORE_NONE, STORE_NONE, STORE_NONE, STORE_NONE};
+    for (int i = type == LOG_ADD_DEVICE ? 0 : 1; i < 4; i++)
+    {
+      uint8_t textLength = in.str(text);
+      fields[i] = store.strings.intern(text, textLength);
+    }
+
+    if (in.ok && type == LOG_ADD_DEVICE)
+    {
+      if (slot != INDEX_NONE)
+      {
+        removeDeviceAt(slot);
+      }
+      slot = store.allocDevice(deviceId);
+    }
+    if (!in.ok || slot == INDEX_NONE)
+    {
+      for (uint16_t field : fields)
+        store.strings.release(field);
+      return;
+    }
+
+    uint16_t *handles[] = {&store.name(slot), &store.type(slot), &store.manufacturer(slot), &store.model(slot)};
+    for (int i = type == LOG_ADD_DEVICE ? 0 : 1; i < 4; i++)
+    {
+      store.strings.release(*handles[i]);
+      *handles[i] = fields[i];
+    }
+    if (type == LOG_ADD_DEVICE)
+    {
+      nextDeviceId = next;
+      deviceSlots[deviceId] = slot;
+      commandsLoaded[slot] = true;
+      indexDevice(slot);
+    }
+    // Metadata lives in the manifest; the record file only holds commands
+    deviceDirty[slot] |= commandsLoaded[slot];
+    break;
+  }
+
+  case LOG_REMOVE_DEVICE:
+    if (slot != INDEX_NONE)
+    {
+      removeDeviceAt(slot);
+    }
+    break;
+
+  case LOG_ADD_COMMAND:
+  {
+    uint8_t commandId = in.u8();
+    uint8_t next = in.u8();
+    int16_t protocol = in.u16();
+    uint16_t bits = in.u16();
+    uint64_t data = in.u64();
+    // A device whose record file does not load is left as the file has it
+    if (!in.ok || slot == INDEX_NONE || !ensureCommandsLoaded(slot))
+    {
+      return;
+    }
+
+    // A command this record replaces stays until the new one is complete
+    uint16_t replaced = commandSlotById(slot, commandId);
+    uint16_t command = store.allocCommand(slot, commandId);
+    if (command == STORE_NONE)
+    {
+      return;
+    }
+
+    store.setCode(command, protocol, data, bits);
+    uint8_t textLength = in.str(text);
+    store.commandName(command) = store.strings.intern(text, textLength);
+    textLength = in.str(text);
+    store.commandDescription(command) = store.strings.intern(text, textLength);
+
+    // Dropped rather than kept without its timings, which a compaction
+    // would save as an empty code. The record itself stays in the log
+    if (!readRaw(in, store, command, rawScratch))
+    {
+      DEBUG_PRINTLN("ERROR: Raw timings of logged command did not load: " + String(store.strings.get(store.commandName(command))));
+      store.freeCommand(command);
+      return;
+    }
+
+    store.nextCommandId(slot) = next;
+    shareCode(command);
+    indexCommand(command);
+    if (replaced != STORE_NONE)
+    {
+      removeCommandAt(replaced);
+    }
+    deviceDirty[slot] = true;
+    break;
+  }
+
+  case LOG_REMOVE_COMMAND:
+    if (slot != INDEX_NONE && ensureCommandsLoaded(slot))
+    {
+      uint16_t command = commandSlotById(slot, in.u8());
+      if (command != STORE_NONE)
+      {
+        removeCommandAt(command);
+        deviceDirty[slot] = true;
+      }
+    }
+    break;
+
+  case LOG_CLEAR:
+    for (slot = 0; slot < MAX_DEVICES; slot++)
+    {
+      if (store.isDevice(slot))
+      {
+        removeDeviceAt(slot);
+      }
+    }
+    clearMacros();
+    macrosDirty = true;
+    break;
+  }
+}
+
+void DeviceManager::applyMacroRecord(uint8_t type, const uint8_t *payload, uint16_t length)
+{
+  // Keyed by name, so replaying over a macro file that already has it is harmless
+  RecordReader in(payload, length);
+  char name[256];
+  uint8_t nameLength = in.str(name);
+  if (!in.ok)
+  {
+    return;
+  }
+
+  if (type == LOG_SET_MACRO)
+  {
+    MacroStep steps[BATCH_MAX_STEPS];
+    uint8_t count = readMacroSteps(in, steps);
+    if (!count || !storeMacro(name, nameLength, steps, count))
+    {
+      return;
+    }
+  }
+  else
+  {
+    uint8_t index = findMacro(name, nameLength);
+    if (index == INDEX_NONE)
+    {
+      return;
+    }
+    macros[index].stepCount = 0;
+  }
+  macrosDirty = true;
+}
+
+void DeviceManager::clearStorage()
+{
+  DEBUG_PRINTLN("Clearing device records...");
+
+  // Collect names in batches; removing while iterating a directory is not portable
+  for (;;)
+  {
+    char paths[16][32];
+    uint8_t count = 0;
+    File dir = LittleFS.open(STORAGE_DIR);
+    for (File entry = dir.openNextFile(); entry && count < 16; entry = dir.openNextFile())
+    {
+      snprintf(paths[count++], sizeof(paths[0]), STORAGE_DIR "/%s", entry.name());
+    }
+    dir.close();
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      LittleFS.remove(paths[i]);
+    }
+    if (count < 16)
+    {
+      break;
+    }
+  }
+}
+
+bool DeviceManager::loadFromEEPROM()
+{
+  DEBUG_PRINTLN("Loading devices from EEPROM...");
 
   int address = CONFIG_ADDR;
 
@@ -438,39 +2257,43 @@ bool DeviceManager::loadFromEEPROM()
   }
 
   // Read device count
-  deviceCount = EEPROM.read(address++);
+  uint8_t deviceCount = EEPROM.read(address++);
   if (deviceCount > MAX_DEVICES)
   {
     DEBUG_PRINTLN("Invalid device count in EEPROM");
-    deviceCount = 0;
     return false;
   }
 
-  // Read devices (simplified implementation)
+  // Devices are numbered in load order
+  store.clear();
   for (uint8_t i = 0; i < deviceCount; i++)
   {
+    uint8_t slot = store.allocDevice(i);
+    commandsLoaded[slot] = true;
+    char text[256];
+
     // Read device name
     uint8_t nameLen = EEPROM.read(address++);
-    devices[i].name = "";
     for (uint8_t j = 0; j < nameLen; j++)
     {
-      devices[i].name += (char)EEPROM.read(address++);
+      text[j] = (char)EEPROM.read(address++);
     }
+    store.name(slot) = store.strings.intern(text, nameLen);
 
     // Read device type
     uint8_t typeLen = EEPROM.read(address++);
-    devices[i].type = "";
     for (uint8_t j = 0; j < typeLen; j++)
     {
-      devices[i].type += (char)EEPROM.read(address++);
+      text[j] = (char)EEPROM.read(address++);
     }
+    store.type(slot) = store.strings.intern(text, typeLen);
 
-    // Read command count
-    devices[i].commandCount = EEPROM.read(address++);
-
-    // Note: In a full implementation, all device data would be deserialized here
+    // The old layout stored only a command count, never the commands
+    // themselves, so there is nothing to migrate for them
+    address++;
   }
 
+  nextDeviceId = deviceCount;
   DEBUG_PRINTLN("EEPROM load complete");
   return true;
 }
@@ -478,10 +2301,15 @@ bool DeviceManager::loadFromEEPROM()
 void DeviceManager::clearEEPROM()
 {
   DEBUG_PRINTLN("Clearing EEPROM...");
-  for (int i = 0; i < EEPROM_SIZE; i++)
+  // The loader rejects the region without its magic bytes, so those are
+  // all that has to change; the rest of the sector is left alone
+  EEPROM.begin(EEPROM_SIZE);
+  if (EEPROM.read(CONFIG_ADDR) != 0xFF || EEPROM.read(CONFIG_ADDR + 1) != 0xFF)
   {
-    EEPROM.write(i, 0xFF);
+    EEPROM.write(CONFIG_ADDR, 0xFF);
+    EEPROM.write(CONFIG_ADDR + 1, 0xFF);
+    EEPROM.commit();
   }
-  EEPROM.commit();
+  EEPROM.end();
   DEBUG_PRINTLN("EEPROM cleared");
 }
\ No newline at end of file
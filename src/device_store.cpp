@@ -0,0 +1,354 @@
+/**
+ * Device Store Implementation
+ */
+
+#include "device_store.h"
+#include <string.h>
+
+static_assert(MAX_DEVICES < 0xFF, "device slots are 8-bit");
+static_assert(STORE_MAX_COMMANDS < STORE_NONE && STORE_MAX_STRINGS < STORE_NONE, "slots are 16-bit");
+static_assert(STORE_STRING_POOL_SIZE <= 0xFFFF && STORE_RAW_ARENA_SIZE <= 0xFFFF, "arena offsets are 16-bit");
+
+#define STRING_RECORD_HEADER 3
+#define RAW_RECORD_HEADER 2
+
+// String pool
+
+void StringPool::clear()
+{
+    handleCount = 0;
+    freeHandle = STORE_NONE;
+    top = 0;
+    liveBytes = 0;
+}
+
+uint16_t StringPool::intern(const char *str, size_t length)
+{
+    if (length == 0)
+        return STORE_NONE;
+    if (length > 0xFF)
+        length = 0xFF;
+
+    for (uint16_t h = 0; h < handleCount; h++)
+    {
+        if (refs[h] > 0 && lengths[h] == length && memcmp(arena + offsets[h], str, length) == 0)
+            return retain(h);
+    }
+
+    size_t record = STRING_RECORD_HEADER + length + 1;
+    if (top + record > STORE_STRING_POOL_SIZE)
+    {
+        if (liveBytes + record > STORE_STRING_POOL_SIZE)
+            return STORE_NONE;
+        compact();
+    }
+
+    uint16_t handle;
+    if (freeHandle != STORE_NONE)
+    {
+        handle = freeHandle;
+        freeHandle = offsets[handle];
+    }
+    else if (handleCount < STORE_MAX_STRINGS)
+    {
+        handle = handleCount++;
+    }
+    else
+    {
+        return STORE_NONE;
+    }
+
+    char *out = arena + top;
+    out[0] = handle & 0xFF;
+    out[1] = handle >> 8;
+    out[2] = (char)length;
+    memcpy(out + STRING_RECORD_HEADER, str, length);
+    out[STRING_RECORD_HEADER + length] = '\0';
+
+    offsets[handle] = top + STRING_RECORD_HEADER;
+    lengths[handle] = length;
+    refs[handle] = 1;
+    top += record;
+    liveBytes += record;
+    return handle;
+}
+
+uint16_t StringPool::retain(uint16_t handle)
+{
+    if (handle != STORE_NONE)
+        refs[handle]++;
+    return handle;
+}
+
+void StringPool::release(uint16_t handle)
+{
+    if (handle == STORE_NONE || refs[handle] == 0 || --refs[handle] > 0)
+        return;
+
+    // The record stays in the arena until the next compaction
+    liveBytes -= STRING_RECORD_HEADER + lengths[handle] + 1;
+    offsets[handle] = freeHandle;
+    freeHandle = handle;
+}
+
+bool StringPool::equals(uint16_t handle, const char *str, size_t length) const
+{
+    return this->length(handle) == length && memcmp(get(handle), str, length) == 0;
+}
+
+uint16_t StringPool::stringsUsed() const
+{
+    uint16_t used = 0;
+    for (uint16_t h = 0; h < handleCount; h++)
+        used += refs[h] > 0;
+    return used;
+}
+
+void StringPool::compact()
+{
+    uint16_t write = 0;
+    for (uint16_t read = 0; read < top;)
+    {
+        uint16_t handle = (uint8_t)arena[read] | ((uint8_t)arena[read + 1] << 8);
+        uint16_t record = STRING_RECORD_HEADER + (uint8_t)arena[read + 2] + 1;
+
+        // Live only if the handle is still referenced and still points here
+        if (refs[handle] > 0 && offsets[handle] == read + STRING_RECORD_HEADER)
+        {
+            memmove(arena + write, arena + read, record);
+            offsets[handle] = write + STRING_RECORD_HEADER;
+            write += record;
+        }
+        read += record;
+    }
+    top = write;
+}
+
+// Device store
+
+void DeviceStore::clear()
+{
+    strings.clear();
+
+    for (uint8_t i = 0; i < MAX_DEVICES; i++)
+    {
+        deviceUsed[i] = false;
+        deviceNext[i] = i + 1 < MAX_DEVICES ? i + 1 : 0xFF;
+    }
+    freeDeviceHead = 0;
+    deviceCount = 0;
+
+    for (uint16_t i = 0; i < STORE_MAX_COMMANDS; i++)
+        commandNext[i] = i + 1 < STORE_MAX_COMMANDS ? i + 1 : STORE_NONE;
+    freeCommandHead = 0;
+    commandCount = 0;
+
+    for (uint16_t i = 0; i < STORE_MAX_COMMANDS; i++)
+    {
+        rawOffsets[i] = i + 1 < STORE_MAX_COMMANDS ? i + 1 : STORE_NONE;
+        rawRefs[i] = 0;
+    }
+    freeRawHandle = 0;
+    rawTop = 0;
+    rawLive = 0;
+    rawShared = 0;
+}
+
+uint8_t DeviceStore::allocDevice(uint8_t id)
+{
+    if (freeDeviceHead == 0xFF)
+        return 0xFF;
+
+    uint8_t slot = freeDeviceHead;
+    freeDeviceHead = deviceNext[slot];
+
+    deviceUsed[slot] = true;
+    deviceNames[slot] = deviceTypes[slot] = deviceManufacturers[slot] = deviceModels[slot] = STORE_NONE;
+    firstCommands[slot] = lastCommands[slot] = STORE_NONE;
+    deviceIds[slot] = id;
+    nextCommandIds[slot] = 0;
+    commandCounts[slot] = 0;
+    deviceCount++;
+    return slot;
+}
+
+void DeviceStore::freeDevice(uint8_t slot)
+{
+    while (firstCommands[slot] != STORE_NONE)
+        freeCommand(firstCommands[slot]);
+
+    strings.release(deviceNames[slot]);
+    strings.release(deviceTypes[slot]);
+    strings.release(deviceManufacturers[slot]);
+    strings.release(deviceModels[slot]);
+
+    deviceUsed[slot] = false;
+    deviceNext[slot] = freeDeviceHead;
+    freeDeviceHead = slot;
+    deviceCount--;
+}
+
+uint16_t DeviceStore::allocCommand(uint8_t deviceSlot, uint8_t id)
+{
+    if (freeCommandHead == STORE_NONE)
+        return STORE_NONE;
+
+    uint16_t command = freeCommandHead;
+    freeCommandHead = commandNext[command];
+
+    commandNames[command] = commandDescriptions[command] = STORE_NONE;
+    commandProtocols[command] = -1;
+    commandData[command] = 0;
+    commandBits[command] = 0;
+    commandRaw[command] = STORE_NONE;
+    commandIds[command] = id;
+    commandDevices[command] = deviceSlot;
+
+    // Append so listing keeps insertion order
+    commandPrev[command] = lastCommands[deviceSlot];
+    commandNext[command] = STORE_NONE;
+    if (lastCommands[deviceSlot] != STORE_NONE)
+        commandNext[lastCommands[deviceSlot]] = command;
+    else
+        firstCommands[deviceSlot] = command;
+    lastCommands[deviceSlot] = command;
+
+    commandCounts[deviceSlot]++;
+    commandCount++;
+    return command;
+}
+
+void DeviceStore::freeCommand(uint16_t command)
+{
+    uint8_t deviceSlot = commandDevices[command];
+    uint16_t prev = commandPrev[command], next = commandNext[command];
+
+    if (prev != STORE_NONE)
+        commandNext[prev] = next;
+    else
+        firstCommands[deviceSlot] = next;
+    if (next != STORE_NONE)
+        commandPrev[next] = prev;
+    else
+        lastCommands[deviceSlot] = prev;
+
+    strings.release(commandNames[command]);
+    strings.release(commandDescriptions[command]);
+    releaseRaw(command);
+
+    commandNext[command] = freeCommandHead;
+    freeCommandHead = command;
+    commandCounts[deviceSlot]--;
+    commandCount--;
+}
+
+void DeviceStore::setCode(uint16_t command, int16_t protocol, uint64_t data, uint16_t bits)
+{
+    commandProtocols[command] = protocol;
+    commandData[command] = data;
+    commandBits[command] = bits;
+}
+
+bool DeviceStore::setRaw(uint16_t command, const uint16_t *timings, uint16_t length)
+{
+    if (!timings || length == 0)
+    {
+        releaseRaw(command);
+        return true;
+    }
+
+    uint16_t *words = reserveRaw(command, length);
+    if (!words)
+        return false;
+    memcpy(words, timings, length * sizeof(uint16_t));
+    return true;
+}
+
+uint16_t *DeviceStore::reserveRaw(uint16_t command, uint16_t length)
+{
+    releaseRaw(command);
+    if (length == 0)
+        return nullptr;
+
+    uint32_t record = RAW_RECORD_HEADER + length;
+    if (rawTop + record > STORE_RAW_ARENA_SIZE)
+    {
+        if (rawLive + record > STORE_RAW_ARENA_SIZE)
+            return nullptr;
+        compactRaw();
+    }
+
+    // There are as many handles as commands, so one is always free here
+    uint16_t handle = freeRawHandle;
+    freeRawHandle = rawOffsets[handle];
+
+    rawArena[rawTop] = handle;
+    rawArena[rawTop + 1] = length;
+
+    rawOffsets[handle] = rawTop + RAW_RECORD_HEADER;
+    rawLengths[handle] = length;
+    rawRefs[handle] = 1;
+    commandRaw[command] = handle;
+    rawTop += record;
+    rawLive += record;
+    return rawArena + rawOffsets[handle];
+}
+
+bool DeviceStore::rawFits(uint16_t length, uint16_t spare) const
+{
+    return (uint32_t)rawLive + RAW_RECORD_HEADER + length + spare <= STORE_RAW_ARENA_SIZE;
+}
+
+bool DeviceStore::shareRaw(uint16_t command, uint16_t from)
+{
+    uint16_t handle = commandRaw[from];
+    if (handle == STORE_NONE || rawRefs[handle] == 0xFF)
+        return false;
+    if (commandRaw[command] == handle)
+        return true;
+
+    releaseRaw(command);
+    rawRefs[handle]++;
+    rawShared++;
+    commandRaw[command] = handle;
+    return true;
+}
+
+void DeviceStore::releaseRaw(uint16_t command)
+{
+    uint16_t handle = commandRaw[command];
+    if (handle == STORE_NONE)
+        return;
+    commandRaw[command] = STORE_NONE;
+
+    if (--rawRefs[handle] > 0)
+    {
+        rawShared--;
+        return;
+    }
+
+    // The record stays in the arena until the next compaction
+    rawLive -= RAW_RECORD_HEADER + rawLengths[handle];
+    rawOffsets[handle] = freeRawHandle;
+    freeRawHandle = handle;
+}
+
+void DeviceStore::compactRaw()
+{
+    uint16_t write = 0;
+    for (uint16_t read = 0; read < rawTop;)
+    {
+        uint16_t handle = rawArena[read];
+        uint16_t record = RAW_RECORD_HEADER + rawArena[read + 1];
+
+        // Live only if the handle is still referenced and still points here
+        if (rawRefs[handle] > 0 && rawOffsets[handle] == read + RAW_RECORD_HEADER)
+        {
+            memmove(rawArena + write, rawArena + read, record * sizeof(uint16_t));
+            rawOffsets[handle] = write + RAW_RECORD_HEADER;
+            write += record;
+        }
+        read += record;
+    }
+    rawTop = write;
+}
@@ -0,0 +1,203 @@
+/**
+ * IR Canonicalizer Implementation
+ */
+
+#include "ir_canonical.h"
+#include "ir_manager.h"
+#include "command_index.h"
+#include <string.h>
+#include <algorithm>
+
+static_assert(MAX_IR_CODE_SIZE <= 0xFFFF, "capture offsets are 16-bit");
+
+namespace
+{
+    bool near(uint16_t a, uint16_t b)
+    {
+        uint32_t high = a > b ? a : b, low = a > b ? b : a;
+        return high * 100 <= low * (100 + IR_CANON_TOLERANCE_PERCENT);
+    }
+
+    uint16_t snap(uint32_t us)
+    {
+        uint32_t snapped = (us + IR_CANON_GRID_US / 2) / IR_CANON_GRID_US * IR_CANON_GRID_US;
+        if (snapped < IR_CANON_GRID_US)
+            return IR_CANON_GRID_US;
+        return snapped < 0xFFFF ? snapped : 0xFFFF / IR_CANON_GRID_US * IR_CANON_GRID_US;
+    }
+}
+
+bool irHasCode(const IRCode &code)
+{
+    return code.protocol != UNKNOWN || (code.rawData && code.rawLen > 0);
+}
+
+bool irTimingsMatch(const uint16_t *a, uint16_t aLength, const uint16_t *b, uint16_t bLength)
+{
+    if (!a || !b || aLength != bLength || aLength == 0)
+        return false;
+    for (uint16_t i = 0; i < aLength; i++)
+    {
+        if (!near(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+bool irCodesMatch(const IRCode &a, const IRCode &b)
+{
+    if (a.protocol != b.protocol)
+        return false;
+
+    if (irProtocolHasState(a.protocol))
+    {
+        uint16_t words = irStateWords(a.bits);
+        return a.bits == b.bits && a.rawData && b.rawData && a.rawLen >= words && b.rawLen >= words &&
+               memcmp(a.rawData, b.rawData, a.bits / 8) == 0;
+    }
+    if (a.protocol != UNKNOWN)
+        return a.data == b.data && a.bits == b.bits;
+    return irTimingsMatch(a.rawData, a.rawLen, b.rawData, b.rawLen);
+}
+
+void IRCanonicalizer::cluster(const uint16_t *timings, uint16_t length)
+{
+    // Marks, then spaces, shortest first; a cluster takes durations until
+    // one is more than half the tolerance longer than the one before it.
+    // Noise spreads one duration out without gaps, distinct durations sit
+    // apart, and sorting keeps the result independent of arrival order
+    for (uint16_t i = 0; i < length; i++)
+        order[i] = i;
+    std::sort(order, order + length, [timings](uint16_t a, uint16_t b)
+              { return (a & 1) != (b & 1) ? (a & 1) < (b & 1) : timings[a] < timings[b]; });
+
+    clusterCount = 0;
+    for (uint16_t n = 0; n < length; n++)
+    {
+        uint16_t i = order[n];
+        uint16_t us = timings[i];
+        bool space = i & 1;
+        Cluster *into = clusterCount ? &clusters[clusterCount - 1] : nullptr;
+        if (!into || into->space != space || (uint32_t)us * 100 > (uint32_t)into->max * (100 + IR_CANON_TOLERANCE_PERCENT / 2))
+        {
+            if (clusterCount == kMaxClusters)
+            {
+                clusterOf[i] = kMaxClusters;
+                continue;
+            }
+            into = &clusters[clusterCount++];
+            *into = {us, us, 0, 0, space};
+        }
+
+        into->max = us;
+        into->sum += us;
+        into->count++;
+        clusterOf[i] = into - clusters;
+    }
+}
+
+uint16_t IRCanonicalizer::canonicalize(uint16_t *timings, uint16_t length)
+{
+    if (!timings)
+        return 0;
+    if (length > MAX_IR_CODE_SIZE)
+        length = MAX_IR_CODE_SIZE;
+
+    // Frames start on a mark, so their gaps sit at odd positions; past
+    // kMaxFrames the last frame takes the rest of the capture
+    uint8_t frameCount = 0;
+    uint16_t start = 0;
+    for (uint16_t i = 1; i < length && frameCount < kMaxFrames - 1; i += 2)
+    {
+        if (timings[i] >= IR_CANON_FRAME_GAP_US)
+        {
+            frames[frameCount++] = {start, (uint16_t)(i - start), timings[i], 1};
+            start = i + 1;
+        }
+    }
+    if (start < length)
+        frames[frameCount++] = {start, (uint16_t)(length - start), 0, 1};
+
+    // Repeats are folded into the frame they repeat as a running mean
+    uint8_t kept = 0;
+    for (uint8_t f = 0; f < frameCount; f++)
+    {
+        Frame frame = frames[f];
+        if (kept > 0 && frame.length <= IR_CANON_REPEAT_TIMINGS)
+            continue;
+
+        uint8_t k = 0;
+        while (k < kept && !irTimingsMatch(timings + frames[k].offset, frames[k].length, timings + frame.offset, frame.length))
+            k++;
+        if (k == kept)
+        {
+            frames[kept++] = frame;
+            continue;
+        }
+
+        Frame &into = frames[k];
+        for (uint16_t j = 0; j < frame.length; j++)
+        {
+            uint32_t total = (uint32_t)timings[into.offset + j] * into.count + timings[frame.offset + j];
+            timings[into.offset + j] = (total + (into.count + 1) / 2) / (into.count + 1);
+        }
+        into.count++;
+    }
+
+    // Kept frames move down in order, joined by the gap that followed each
+    uint16_t out = 0;
+    for (uint8_t k = 0; k < kept; k++)
+    {
+        memmove(timings + out, timings + frames[k].offset, frames[k].length * sizeof(uint16_t));
+        out += frames[k].length;
+        if (k + 1 < kept)
+            timings[out++] = frames[k].gap ? frames[k].gap : IR_CANON_FRAME_GAP_US;
+    }
+    if (out % 2 == 0 && out > 0)
+        out--; // A trailing space is never sent
+
+    cluster(timings, out);
+    for (uint16_t i = 0; i < out; i++)
+    {
+        const Cluster *c = clusterOf[i] < kMaxClusters ? &clusters[clusterOf[i]] : nullptr;
+        timings[i] = snap(c ? (c->sum + c->count / 2) / c->count : timings[i]);
+    }
+    return out;
+}
+
+uint32_t IRCanonicalizer::fingerprint(const IRCode &code)
+{
+    int16_t protocol = code.protocol;
+    uint32_t hash = indexHash((const char *)&protocol, sizeof(protocol));
+
+    if (irProtocolHasState(code.protocol))
+    {
+        uint16_t bytes = code.rawData && code.rawLen >= irStateWords(code.bits) ? code.bits / 8 : 0;
+        hash = indexHash((const char *)&code.bits, sizeof(code.bits), hash);
+        return indexHash((const char *)code.rawData, bytes, hash);
+    }
+    if (code.protocol != UNKNOWN)
+    {
+        hash = indexHash((const char *)&code.bits, sizeof(code.bits), hash);
+        return indexHash((const char *)&code.data, sizeof(code.data), hash);
+    }
+
+    // Undecoded: the shape, which jitter does not change
+    uint16_t length = code.rawData ? (code.rawLen < MAX_IR_CODE_SIZE ? code.rawLen : MAX_IR_CODE_SIZE) : 0;
+    hash = indexHash((const char *)&length, sizeof(length), hash);
+    cluster(code.rawData, length);
+
+    // Clusters come out shortest first, marks then spaces
+    uint8_t rank[kMaxClusters];
+    uint8_t marks = 0;
+    while (marks < clusterCount && !clusters[marks].space)
+        marks++;
+    for (uint8_t c = 0; c < clusterCount; c++)
+        rank[c] = c < marks ? c : c - marks;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        char symbol = clusterOf[i] < kMaxClusters ? rank[clusterOf[i]] : kMaxClusters;
+        hash = indexHash(&symbol, 1, hash);
+    }
+    return hash;
+}
@@ -0,0 +1,64 @@
+/**
+ * IR Capture Ring Implementation
+ */
+
+#include "ir_capture.h"
+
+IRCaptureRing::IRCaptureRing() : frames(nullptr), psram(false), head(0), tail(0), captured(0)
+{
+}
+
+IRCaptureRing::~IRCaptureRing()
+{
+    free(frames);
+}
+
+bool IRCaptureRing::begin()
+{
+    if (frames)
+        return true;
+
+    size_t bytes = sizeof(IRCaptureFrame) * IR_CAPTURE_RING_FRAMES;
+#ifdef BOARD_HAS_PSRAM
+    if (psramFound())
+    {
+        frames = (IRCaptureFrame *)ps_malloc(bytes);
+        psram = frames != nullptr;
+    }
+#endif
+    if (!frames)
+        frames = (IRCaptureFrame *)malloc(bytes);
+    if (!frames)
+    {
+        DEBUG_PRINTLN("ERROR: Capture ring allocation failed");
+        return false;
+    }
+    return true;
+}
+
+IRCaptureFrame *IRCaptureRing::reserve()
+{
+    uint32_t index = head.load(std::memory_order_relaxed);
+    if (!frames || index - tail.load(std::memory_order_acquire) >= IR_CAPTURE_RING_FRAMES)
+        return nullptr;
+    return &frames[index % IR_CAPTURE_RING_FRAMES];
+}
+
+void IRCaptureRing::commit()
+{
+    head.fetch_add(1, std::memory_order_release);
+    captured++;
+}
+
+IRCaptureFrame *IRCaptureRing::front()
+{
+    uint32_t index = tail.load(std::memory_order_relaxed);
+    if (!frames || index == head.load(std::memory_order_acquire))
+        return nullptr;
+    return &frames[index % IR_CAPTURE_RING_FRAMES];
+}
+
+void IRCaptureRing::release()
+{
+    tail.fetch_add(1, std::memory_order_release);
+}
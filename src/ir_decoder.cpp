@@ -0,0 +1,215 @@
+/**
+ * IR Decoder Implementation
+ */
+
+#include "ir_decoder.h"
+#include "ir_timings.h"
+
+namespace
+{
+    using namespace IRTiming;
+
+    const uint8_t kTolerancePercent = 25;
+    const uint32_t kMarkExcess = 50;          // Receivers lengthen marks and shorten spaces by about this much
+    const uint8_t kUnitTolerancePercent = 40; // Bi-phase halves: distance from a whole number of units
+    const uint16_t kMaxHalves = 160;          // Bi-phase half-bit units of the longest accepted frame
+
+    bool match(uint32_t measured, uint32_t desired)
+    {
+        uint32_t slack = desired * kTolerancePercent / 100;
+        return measured + slack >= desired && measured <= desired + slack;
+    }
+
+    bool matchMark(uint32_t measured, uint32_t desired) { return match(measured, desired + kMarkExcess); }
+
+    bool matchSpace(uint32_t measured, uint32_t desired)
+    {
+        return match(measured, desired > kMarkExcess ? desired - kMarkExcess : desired);
+    }
+
+    // MSB-first bits starting at timings[at]: the mark tells pulse-width
+    // bits apart, the space pulse-distance ones. The last bit's space may be
+    // missing, having merged into the gap that ended the frame
+    bool decodeBits(const uint16_t *t, uint16_t count, uint16_t at, uint16_t bits, uint32_t oneMark, uint32_t oneSpace,
+                    uint32_t zeroMark, uint32_t zeroSpace, uint64_t &data)
+    {
+        data = 0;
+        for (uint16_t i = 0; i < bits; i++, at += 2)
+        {
+            if (at >= count)
+                return false;
+            bool hasSpace = at + 1 < count;
+            bool one;
+            if (oneMark != zeroMark)
+            {
+                if (matchMark(t[at], oneMark))
+                    one = true;
+                else if (matchMark(t[at], zeroMark))
+                    one = false;
+                else
+                    return false;
+                if (hasSpace && !matchSpace(t[at + 1], one ? oneSpace : zeroSpace))
+                    return false;
+            }
+            else
+            {
+                if (!hasSpace || !matchMark(t[at], oneMark))
+                    return false;
+                if (matchSpace(t[at + 1], oneSpace))
+                    one = true;
+                else if (matchSpace(t[at + 1], zeroSpace))
+                    one = false;
+                else
+                    return false;
+            }
+            data = (data << 1) | (one ? 1 : 0);
+        }
+        return true;
+    }
+
+    bool decodeNEC(const uint16_t *t, uint16_t count, IRDecoded &result)
+    {
+        if (count < 3 || !matchMark(t[0], kNecHdrMark))
+            return false;
+
+        if (count <= 4 && matchSpace(t[1], kNecRptSpace) && matchMark(t[2], kNecBitMark))
+        {
+            result = {NEC, 0, kNecBits, true};
+            return true;
+        }
+
+        uint64_t data;
+        if (count < 2 + 2 * kNecBits + 1 || !matchSpace(t[1], kNecHdrSpace) ||
+            !decodeBits(t, count, 2, kNecBits, kNecBitMark, kNecOneSpace, kNecBitMark, kNecZeroSpace, data) ||
+            !matchMark(t[2 + 2 * kNecBits], kNecBitMark))
+            return false;
+        result = {NEC, data, kNecBits, false};
+        return true;
+    }
+
+    bool decodeSony(const uint16_t *t, uint16_t count, IRDecoded &result)
+    {
+        // Header, then a mark per bit with a space between bits
+        uint16_t bits = (count - 1) / 2;
+        if (count % 2 == 0 || (bits != 12 && bits != 15 && bits != 20))
+            return false;
+        if (!matchMark(t[0], kSonyHdrMark) || !matchSpace(t[1], kSonySpace))
+            return false;
+
+        uint64_t data;
+        if (!decodeBits(t, count, 2, bits, kSonyOneMark, kSonySpace, kSonyZeroMark, kSonySpace, data))
+            return false;
+        result = {SONY, data, bits, false};
+        return true;
+    }
+
+    // Splits timings into half-bit units of `unit` microseconds: levels[i] is
+    // 1 for a mark. `leadingSpace` adds the space a frame starting with a
+    // 0-then-1 bit loses to the idle line
+    uint16_t toHalves(const uint16_t *t, uint16_t count, uint16_t from, uint32_t unit, uint8_t maxUnits, bool leadingSpace,
+                      uint8_t *levels)
+    {
+        uint16_t n = 0;
+        if (leadingSpace)
+            levels[n++] = 0;
+        for (uint16_t i = from; i < count; i++)
+        {
+            uint32_t units = (t[i] + unit / 2) / unit;
+            uint32_t error = t[i] > units * unit ? t[i] - units * unit : units * unit - t[i];
+            if (units == 0 || units > maxUnits || error > unit * kUnitTolerancePercent / 100 || n + units > kMaxHalves)
+                return 0;
+            for (uint32_t u = 0; u < units; u++)
+                levels[n++] = i % 2 == 0 ? 1 : 0;
+        }
+        return n;
+    }
+
+    // One bi-phase bit of `width` units per half; `markFirst` is the level
+    // order of a 1. Reading past the end sees the idle line (space)
+    bool biphaseBit(const uint8_t *levels, uint16_t n, uint16_t &pos, uint8_t width, bool markFirst, bool &bit)
+    {
+        uint8_t first = pos < n ? levels[pos] : 0;
+        for (uint8_t i = 0; i < 2 * width; i++)
+        {
+            uint8_t level = pos + i < n ? levels[pos + i] : 0;
+            if (level != (i < width ? first : !first))
+                return false;
+        }
+        pos += 2 * width;
+        bit = markFirst ? first == 1 : first == 0;
+        return true;
+    }
+
+    bool decodeRC5(const uint16_t *t, uint16_t count, IRDecoded &result)
+    {
+        uint8_t levels[kMaxHalves];
+        uint16_t n = toHalves(t, count, 0, kRc5T1, 2, true, levels);
+        if (n < 4)
+            return false;
+
+        uint16_t pos = 0;
+        bool start, field;
+        if (!biphaseBit(levels, n, pos, 1, false, start) || !start || !biphaseBit(levels, n, pos, 1, false, field))
+            return false;
+
+        uint64_t data = 0;
+        uint16_t dataBits = 0;
+        while (pos < n)
+        {
+            bool bit;
+            if (!biphaseBit(levels, n, pos, 1, false, bit))
+                return false;
+            data = (data << 1) | bit;
+            dataBits++;
+        }
+
+        if (dataBits != kRc5XBits - 1)
+            return false;
+        if (field)
+        {
+            result = {RC5, data, dataBits, false};
+            return true;
+        }
+        // RC5X: the sender takes the inverted field bit from bit 12
+        data |= 1ULL << dataBits;
+        result = {RC5, data, kRc5XBits, false};
+        return true;
+    }
+
+    bool decodeRC6(const uint16_t *t, uint16_t count, IRDecoded &result)
+    {
+        if (count < 4 || !matchMark(t[0], kRc6HdrMark) || !matchSpace(t[1], kRc6HdrSpace))
+            return false;
+
+        uint8_t levels[kMaxHalves];
+        uint16_t n = toHalves(t, count, 2, kRc6T1, 3, false, levels);
+        uint16_t pos = 0;
+        bool start;
+        if (n < 2 || !biphaseBit(levels, n, pos, 1, true, start) || !start)
+            return false;
+
+        uint64_t data = 0;
+        uint16_t bits = 0;
+        while (pos < n && bits < 64)
+        {
+            bool bit;
+            if (!biphaseBit(levels, n, pos, bits + 1 == kRc6ToggleBit ? 2 : 1, true, bit))
+                return false;
+            data = (data << 1) | bit;
+            bits++;
+        }
+        if (pos < n || bits < 8)
+            return false;
+        result = {RC6, data, bits, false};
+        return true;
+    }
+}
+
+bool decodeTimings(const uint16_t *timings, uint16_t count, IRDecoded &result)
+{
+    result = {UNKNOWN, 0, 0, false};
+    if (!timings || count == 0)
+        return false;
+    return decodeNEC(timings, count, result) || decodeSony(timings, count, result) || decodeRC5(timings, count, result) ||
+           decodeRC6(timings, count, result);
+}
@@ -0,0 +1,215 @@
+/**
+ * IR Learn Session Implementation
+ */
+
+#include "ir_learn.h"
+#include "ir_manager.h"
+#include <string.h>
+
+namespace
+{
+    // A/C states are bytes, not timings: they are matched, never averaged
+    bool hasTimings(const IRCode &code)
+    {
+        return code.rawData && code.rawLen > 0 && !irProtocolHasState(code.protocol);
+    }
+}
+
+IRLearnSession::IRLearnSession() : groupCount(0), startMs(0)
+{
+    memset(&report, 0, sizeof(report));
+}
+
+void IRLearnSession::begin(uint32_t jobId, uint8_t target)
+{
+    end(LEARN_PENDING);
+    memset(&report, 0, sizeof(report));
+    report.jobId = jobId;
+    report.status = LEARN_PENDING;
+    report.target = target < 1 ? 1 : (target > IR_LEARN_MAX_CAPTURES ? IR_LEARN_MAX_CAPTURES : target);
+    startMs = millis();
+}
+
+void IRLearnSession::view(const Group &group, IRCode &code) const
+{
+    code.protocol = group.protocol;
+    code.data = group.data;
+    code.bits = group.bits;
+    code.rawData = group.buffer ? group.buffer.data() : nullptr;
+    code.rawLen = group.buffer ? group.rawLen : 0;
+}
+
+uint8_t IRLearnSession::fold(Group &group, const IRCode &capture)
+{
+    // Deviation is measured against the mean before the capture joins it
+    uint32_t worst = 0;
+    if (hasTimings(capture) && group.buffer && group.rawLen == capture.rawLen)
+    {
+        uint16_t *mean = group.buffer.data();
+        for (uint16_t i = 0; i < capture.rawLen; i++)
+        {
+            uint32_t m = mean[i], c = capture.rawData[i];
+            uint32_t percent = m ? (m > c ? m - c : c - m) * 100 / m : 100;
+            worst = percent > worst ? percent : worst;
+            mean[i] = (m * group.count + c + (group.count + 1) / 2) / (group.count + 1);
+        }
+    }
+    uint8_t deviation = worst < 0xFF ? worst : 0xFF;
+    group.count++;
+    group.deviation = deviation > group.deviation ? deviation : group.deviation;
+    return deviation;
+}
+
+uint8_t IRLearnSession::leader() const
+{
+    // Most captures, then the steadiest
+    uint8_t lead = 0;
+    for (uint8_t g = 1; g < groupCount; g++)
+    {
+        const Group &group = groups[g];
+        if (group.count > groups[lead].count || (group.count == groups[lead].count && group.deviation < groups[lead].deviation))
+            lead = g;
+    }
+    return lead;
+}
+
+uint8_t IRLearnSession::compare(const IRCode &a, const IRCode &b, uint16_t &at)
+{
+    at = 0;
+    if (a.protocol != b.protocol)
+        return MISMATCH_PROTOCOL;
+    if (a.protocol != UNKNOWN)
+        return MISMATCH_VALUE;
+    if (!a.rawData || !b.rawData || a.rawLen != b.rawLen)
+        return MISMATCH_LENGTH;
+    while (at < a.rawLen && irTimingsMatch(a.rawData + at, 1, b.rawData + at, 1))
+        at++;
+    return MISMATCH_TIMING;
+}
+
+uint8_t IRLearnSession::add(const IRCode &capture)
+{
+    if (report.status != LEARN_PENDING || report.taken >= IR_LEARN_MAX_CAPTURES)
+        return report.status;
+
+    IRLearnCapture &entry = report.captures[report.taken++];
+    entry.protocol = capture.protocol;
+    entry.data = capture.data;
+    entry.bits = capture.bits;
+    entry.rawLen = capture.rawData ? capture.rawLen : 0;
+    entry.deviation = 0;
+    entry.mismatch = MISMATCH_NONE;
+    entry.mismatchAt = 0;
+
+    IRCode stored = IRCode();
+    uint8_t g = 0;
+    for (; g < groupCount; g++)
+    {
+        view(groups[g], stored);
+        if (irCodesMatch(stored, capture))
+            break;
+    }
+
+    if (g < groupCount)
+    {
+        entry.deviation = fold(groups[g], capture);
+    }
+    else if (groupCount < IR_LEARN_MAX_GROUPS)
+    {
+        // The press's pool buffer becomes the group's mean
+        Group &group = groups[groupCount++];
+        group.protocol = capture.protocol;
+        group.data = capture.data;
+        group.bits = capture.bits;
+        group.buffer = capture.buffer;
+        group.rawLen = group.buffer ? capture.rawLen : 0;
+        group.count = 1;
+        group.deviation = 0;
+    }
+    else
+    {
+        // Not kept: described now, while its timings are at hand
+        view(groups[leader()], stored);
+        entry.mismatch = compare(capture, stored, entry.mismatchAt);
+        g = IR_LEARN_MAX_GROUPS;
+    }
+    entry.group = g;
+
+    decide();
+    return report.status;
+}
+
+void IRLearnSession::decide()
+{
+    const Group &lead = groups[leader()];
+    uint32_t penalty = (uint32_t)lead.deviation * 100 / IR_CANON_TOLERANCE_PERCENT;
+    uint32_t quality = 100 - (penalty < 100 ? penalty : 100) / 2;
+    report.agreeing = lead.count;
+    report.deviation = lead.deviation;
+    report.confidence = lead.count * quality / report.taken;
+
+    uint8_t needed = report.target > 1 ? 2 : 1;
+    if (report.taken >= report.target && lead.count >= needed &&
+        lead.count * 100 >= report.taken * IR_LEARN_AGREE_PERCENT)
+        conclude(LEARN_AGREED);
+    else if (report.taken >= IR_LEARN_MAX_CAPTURES)
+        conclude(LEARN_DISAGREED);
+}
+
+bool IRLearnSession::result(IRCode &code) const
+{
+    if (groupCount == 0)
+        return false;
+    const Group &lead = groups[leader()];
+    view(lead, code);
+    code.buffer = lead.buffer;
+    return true;
+}
+
+void IRLearnSession::conclude(uint8_t status)
+{
+    if (report.status != LEARN_PENDING || status == LEARN_PENDING)
+        return;
+    report.status = status;
+    report.elapsedMs = millis() - startMs;
+
+    // Kept captures differ from the leader as their group does
+    if (groupCount == 0)
+        return;
+    uint8_t lead = leader();
+    IRCode leading = IRCode(), other = IRCode();
+    view(groups[lead], leading);
+    for (uint8_t i = 0; i < report.taken; i++)
+    {
+        IRLearnCapture &entry = report.captures[i];
+        if (entry.group >= groupCount || entry.group == lead)
+            continue;
+        view(groups[entry.group], other);
+        entry.mismatch = compare(other, leading, entry.mismatchAt);
+    }
+}
+
+void IRLearnSession::end(uint8_t status)
+{
+    conclude(status);
+    for (uint8_t g = 0; g < groupCount; g++)
+        groups[g].buffer.reset();
+    groupCount = 0;
+}
+
+const char *irLearnMismatchName(uint8_t mismatch)
+{
+    switch (mismatch)
+    {
+    case MISMATCH_PROTOCOL:
+        return "protocol";
+    case MISMATCH_VALUE:
+        return "value";
+    case MISMATCH_LENGTH:
+        return "length";
+    case MISMATCH_TIMING:
+        return "timing";
+    default:
+        return "none";
+    }
+}
@@ -4,10 +4,16 @@
 
 #include "ir_manager.h"
 #include <ArduinoJson.h>
-
-IRManager::IRManager() : irSend(nullptr), irRecv(nullptr), learning(false), learnStartTime(0)
+#include "metrics.h"
+
+IRManager::IRManager() : irSend(nullptr), irRecv(nullptr), learning(false), learnStartTime(0), learnTimeout(IR_TIMEOUT_MS),
+                         learnJobId(0), nextLearnJobId(1), learnCallback(nullptr), learnContext(nullptr),
+                         lastLearned(), irTask(nullptr), transmitQueue(nullptr), stateMutex(nullptr), codecMutex(nullptr),
+                         rmtEnabled(false), lastFrame{UNKNOWN, 0, 0, false}, lastFrameMs(0),
+                         learnFrames(0), learnFrameMs(0), monitoring(false), monitorCallback(nullptr), monitorContext(nullptr),
+                         monitorPrint(0), monitorMs(0)
 {
-    memset(&lastLearned, 0, sizeof(IRCode));
+    lastLearned.protocol = UNKNOWN;
     memset(&results, 0, sizeof(decode_results));
 }
 
@@ -27,121 +33,718 @@ bool IRManager::begin()
     irSend = new IRsend(IR_TRANSMIT_PIN);
     irSend->begin();
 
-    // Initialize IR receiver
-    irRecv = new IRrecv(IR_RECEIVE_PIN);
-    irRecv->setUnknownThreshold(12);
-    irRecv->enableIRIn();
+    if (!capturePool.begin() || !captureRing.begin())
+        return false;
+
+    // Initialize IR receiver; IRrecv, polled, when the RMT cannot take it
+#if IR_RX_RMT
+    rmtRx.begin(IR_RECEIVE_PIN, IR_RMT_RX_CHANNEL);
+#endif
+    if (!rmtRx.isReady())
+    {
+        irRecv = new IRrecv(IR_RECEIVE_PIN);
+        irRecv->setUnknownThreshold(12);
+        irRecv->enableIRIn();
+    }
+
+#if IR_TX_RMT
+    // Takes the pin over from IRsend, which stays as the fallback
+    setRmtEnabled(true);
+#endif
+
+    // Learning state is shared between the IR task and the command task
+    stateMutex = xSemaphoreCreateMutex();
+    codecMutex = xSemaphoreCreateMutex();
 
     DEBUG_PRINTLN("IR Manager initialized successfully");
     return true;
 }
 
-void IRManager::update()
+bool IRManager::startTask()
 {
-    if (learning && irRecv->decode(&results))
+    if (irTask)
+        return true;
+
+    transmitQueue = xQueueCreate(IR_QUEUE_LENGTH, sizeof(IRTransmitJob));
+    if (!transmitQueue)
+        return false;
+
+    if (xTaskCreatePinnedToCore(taskLoop, "ir", IR_TASK_STACK_SIZE, this, IR_TASK_PRIORITY, &irTask, IR_TASK_CORE) != pdPASS)
     {
-        // Copy the decoded result to lastLearned
-        lastLearned.protocol = results.decode_type;
-        lastLearned.data = results.value; // Fixed: use 'data' field
-        lastLearned.bits = results.bits;
+        irTask = nullptr;
+        return false;
+    }
+
+    DEBUG_PRINTLN("IR task started");
+    return true;
+}
 
-        // Copy raw data if available
-        if (results.rawlen > 0)
+void IRManager::taskLoop(void *parameter)
+{
+    IRManager *manager = static_cast<IRManager *>(parameter);
+    IRTransmitJob job;
+
+    for (;;)
+    {
+        // Block until a transmission is queued, polling the receiver between jobs
+        if (xQueueReceive(manager->transmitQueue, &job, pdMS_TO_TICKS(IR_TASK_POLL_MS)) == pdTRUE)
         {
-            lastLearned.rawLen = results.rawlen;
-            lastLearned.rawData = new uint16_t[results.rawlen];
-            memcpy(lastLearned.rawData, (const void *)results.rawbuf, results.rawlen * sizeof(uint16_t));
+            bool success;
+            if (job.plan)
+            {
+                uint16_t *timings = job.rawBuffer != CAPTURE_NONE ? manager->capturePool.buffer(job.rawBuffer) : nullptr;
+                success = manager->runPlan(*job.plan, timings);
+            }
+            else
+            {
+                success = manager->sendCode(job.protocol, job.data, job.bits, job.rawData, job.rawLen);
+            }
+            manager->capturePool.adopt(job.rawBuffer).reset();
+            if (job.callback)
+                job.callback(job.context, success);
         }
 
-        learning = false;
-        DEBUG_PRINTLN("IR code learned successfully");
-        printIRCode(lastLearned);
+        manager->update();
+    }
+}
 
-        irRecv->resume(); // Prepare for next reception
+uint32_t IRManager::getStackHighWaterMark()
+{
+    return irTask ? uxTaskGetStackHighWaterMark(irTask) : 0;
+}
+
+void IRManager::update()
+{
+    // Frames are captured whether or not a job wants them
+    if (rmtRx.isReady())
+        rmtRx.drain(captureRing);
+    else if (irRecv)
+        pollReceiver();
+
+    if (!learning && !captureRing.front())
+        return;
+
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+
+    uint32_t finishedJob = 0;
+    bool learned = false;
+
+    while (IRCaptureFrame *frame = captureRing.front())
+    {
+        bool repeated = classifyFrame(*frame);
+
+        // A repeat code only says a button is still held, and so does the
+        // same code again once a press has been taken. A decoded frame is
+        // learned at once, and replaces undecoded ones collected so far
+        if (learning && !frame->code.repeatCode && !(repeated && learnSession.getTaken() > 0))
+        {
+            bool done = true;
+            if (frame->code.protocol == UNKNOWN)
+                done = collectFrame(*frame);
+            else
+                learnFrame(*frame);
+            uint8_t status = done ? completeLearn() : (uint8_t)LEARN_PENDING;
+            if (status != LEARN_PENDING)
+            {
+                learned = status == LEARN_AGREED;
+                finishedJob = learnJobId;
+            }
+        }
+        if (monitoring && !frame->code.repeatCode)
+            monitorFrame(*frame, repeated);
+        captureRing.release();
+    }
+
+    // Collected frames are complete once their repeats stop
+    if (learning && learnFrames > 0 &&
+        (millis() - learnFrameMs > IR_REPEAT_WINDOW_MS || millis() - learnStartTime > learnTimeout))
+    {
+        uint8_t status = completeLearn();
+        if (status != LEARN_PENDING)
+        {
+            learned = status == LEARN_AGREED;
+            finishedJob = learnJobId;
+        }
     }
 
     // Check for learning timeout
-    if (learning && (millis() - learnStartTime > IR_TIMEOUT_MS))
+    if (learning && (millis() - learnStartTime > learnTimeout))
     {
         learning = false;
+        learnSession.end(LEARN_TIMED_OUT);
+        metrics.add(METRIC_IR_LEARN_TIMEOUTS);
+        finishedJob = learnJobId;
         DEBUG_PRINTLN("IR learning timeout");
     }
+
+    IRLearnCallback callback = learnCallback;
+    void *context = learnContext;
+    IRCode captured = IRCode();
+    if (learned)
+        captured = lastLearned;
+    xSemaphoreGive(stateMutex);
+
+    // Outside the lock so the callback is free to call back into the manager
+    if (finishedJob && callback)
+        callback(context, finishedJob, learned ? &captured : nullptr);
+}
+
+void IRManager::pollReceiver()
+{
+    IRCaptureFrame *frame;
+    while ((frame = captureRing.reserve()) != nullptr && irRecv->decode(&results))
+    {
+        frame->timestampMs = millis();
+        frame->decoded = true;
+        frame->code = {results.decode_type, results.value, results.bits, results.repeat};
+        if (irProtocolHasState(results.decode_type))
+            memcpy(frame->state, results.state, sizeof(frame->state));
+
+        // rawbuf starts with the gap before the frame, then receiver ticks
+        uint16_t length = results.rawlen > 1 ? results.rawlen - 1 : 0;
+        frame->overflow = results.overflow || length > MAX_IR_CODE_SIZE;
+        frame->length = length < MAX_IR_CODE_SIZE ? length : MAX_IR_CODE_SIZE;
+        for (uint16_t i = 0; i < frame->length; i++)
+        {
+            uint32_t us = (uint32_t)results.rawbuf[i + 1] * kRawTick;
+            frame->timings[i] = us < 0xFFFF ? us : 0xFFFF;
+        }
+
+        irRecv->resume(); // Prepare for next reception
+        captureRing.commit();
+    }
+}
+
+bool IRManager::classifyFrame(IRCaptureFrame &frame)
+{
+    if (!frame.decoded)
+    {
+        decodeTimings(frame.timings, frame.length, frame.code);
+        frame.decoded = true;
+    }
+    if (frame.code.protocol != UNKNOWN)
+        metrics.add(METRIC_IR_FRAMES_DECODED);
+
+    // A held button: a repeat code, or the same code again within the window
+    bool recent = lastFrame.protocol != UNKNOWN && frame.timestampMs - lastFrameMs <= IR_REPEAT_WINDOW_MS;
+    bool repeated = frame.code.repeatCode ? recent && lastFrame.protocol == frame.code.protocol
+                                          : recent && lastFrame.protocol == frame.code.protocol &&
+                                                lastFrame.data == frame.code.data && lastFrame.bits == frame.code.bits;
+    if (repeated)
+        metrics.add(METRIC_IR_FRAMES_REPEATED);
+    if (!frame.code.repeatCode)
+        lastFrame = frame.code;
+    lastFrameMs = frame.timestampMs;
+    return repeated;
+}
+
+void IRManager::learnFrame(const IRCaptureFrame &frame)
+{
+    lastLearned.protocol = frame.code.protocol;
+    lastLearned.data = frame.code.data;
+    lastLearned.bits = frame.code.bits;
+    lastLearned.rawData = nullptr;
+    lastLearned.rawLen = 0;
+    lastLearned.buffer.reset();
+
+    // The ring slot is reused, so the timings (or an A/C state, which
+    // replaces them) move to a pool buffer; everything downstream shares it
+    bool hasState = irProtocolHasState(frame.code.protocol) && frame.code.bits / 8 <= kStateSizeMax;
+    if (frame.length > 0 || hasState)
+    {
+        lastLearned.buffer = capturePool.acquire();
+        if (lastLearned.buffer)
+        {
+            lastLearned.rawData = lastLearned.buffer.data();
+            if (hasState)
+            {
+                lastLearned.rawLen = irStateWords(frame.code.bits);
+                lastLearned.rawData[lastLearned.rawLen - 1] = 0;
+                memcpy(lastLearned.rawData, frame.state, frame.code.bits / 8);
+            }
+            else
+            {
+                lastLearned.rawLen = frame.length;
+                memcpy(lastLearned.rawData, frame.timings, frame.length * sizeof(uint16_t));
+            }
+        }
+        else
+        {
+            DEBUG_PRINTLN("Capture pool exhausted; raw timings dropped");
+        }
+    }
+}
+
+bool IRManager::collectFrame(const IRCaptureFrame &frame)
+{
+    if (learnFrames == 0)
+    {
+        learnFrame(frame);
+        learnFrames = 1;
+        learnFrameMs = frame.timestampMs;
+        return !lastLearned.rawData || lastLearned.rawLen == 0;
+    }
+
+    // Appended after the silence that separated the frames: the time
+    // between their arrivals less this frame's own duration
+    if (frame.length == 0 || lastLearned.rawLen + 1 + frame.length > MAX_IR_CODE_SIZE)
+        return true;
+    uint32_t duration = 0;
+    for (uint16_t i = 0; i < frame.length; i++)
+        duration += frame.timings[i];
+    uint32_t elapsed = (frame.timestampMs - learnFrameMs) * 1000;
+    uint32_t gap = elapsed > duration + IR_CANON_FRAME_GAP_US ? elapsed - duration : IR_CANON_FRAME_GAP_US;
+
+    if (lastLearned.rawLen % 2 == 0)
+        lastLearned.rawLen--; // Ended on a space; the gap replaces it
+    lastLearned.rawData[lastLearned.rawLen++] = gap < 0xFFFF ? gap : 0xFFFF;
+    memcpy(lastLearned.rawData + lastLearned.rawLen, frame.timings, frame.length * sizeof(uint16_t));
+    lastLearned.rawLen += frame.length;
+    learnFrameMs = frame.timestampMs;
+    return ++learnFrames >= IR_LEARN_MAX_FRAMES;
+}
+
+void IRManager::monitorFrame(IRCaptureFrame &frame, bool repeated)
+{
+    IRCode seen = IRCode();
+    seen.protocol = frame.code.protocol;
+    seen.data = frame.code.data;
+    seen.bits = frame.code.bits;
+
+    if (frame.code.protocol == UNKNOWN)
+    {
+        // Learning has copied what it needs: the ring slot is canonicalized
+        // in place, so the code matches what a learn job stored
+        seen.rawData = frame.timings;
+        seen.rawLen = canonicalizer.canonicalize(frame.timings, frame.length);
+        if (seen.rawLen == 0)
+            return;
+        uint32_t print = canonicalizer.fingerprint(seen);
+        repeated = print == monitorPrint && frame.timestampMs - monitorMs <= IR_REPEAT_WINDOW_MS;
+        monitorPrint = print;
+        monitorMs = frame.timestampMs;
+    }
+    else if (irProtocolHasState(frame.code.protocol) && frame.code.bits / 8 <= kStateSizeMax)
+    {
+        seen.rawData = monitorState;
+        seen.rawLen = irStateWords(frame.code.bits);
+        monitorState[seen.rawLen - 1] = 0;
+        memcpy(monitorState, frame.state, frame.code.bits / 8);
+    }
+
+    if (repeated || !monitorCallback)
+        return;
+    metrics.add(METRIC_IR_FRAMES_MONITORED);
+    monitorCallback(monitorContext, seen);
+}
+
+uint8_t IRManager::completeLearn()
+{
+    // Repeats collected with the frame are folded in and the timings snapped
+    bool timings = lastLearned.rawData && lastLearned.rawLen > 0 && !irProtocolHasState(lastLearned.protocol);
+    if (timings)
+        lastLearned.rawLen = canonicalizer.canonicalize(lastLearned.rawData, lastLearned.rawLen);
+    learnFrames = 0;
+
+    // The session keeps the buffer of a press that starts a group
+    uint8_t status = learnSession.add(lastLearned);
+    lastLearned = IRCode();
+    lastLearned.protocol = UNKNOWN;
+    if (status == LEARN_PENDING)
+    {
+        DEBUG_PRINTLN("IR capture " + String(learnSession.getTaken()) + " taken");
+        return status;
+    }
+
+    learning = false;
+    metrics.add(status == LEARN_AGREED ? METRIC_IR_LEARNED : METRIC_IR_LEARN_MISMATCHES);
+    if (status == LEARN_AGREED && learnSession.result(lastLearned))
+    {
+        // Averaged presses are snapped to the grid again
+        timings = lastLearned.rawData && lastLearned.rawLen > 0 && !irProtocolHasState(lastLearned.protocol);
+        if (timings && learnSession.getReport().agreeing > 1)
+            lastLearned.rawLen = canonicalizer.canonicalize(lastLearned.rawData, lastLearned.rawLen);
+        DEBUG_PRINTLN("IR code learned successfully");
+        printIRCode(lastLearned);
+    }
+    else
+    {
+        DEBUG_PRINTLN("IR learning failed: captures disagree");
+    }
+    learnSession.end(status);
+    return status;
 }
 
 bool IRManager::transmitCode(const IRCode &code)
 {
-    if (!irSend)
+    return sendCode(code.protocol, code.data, code.bits, code.rawData, code.rawLen);
+}
+
+bool IRManager::queueTransmit(const IRCode &code, IRTransmitCallback callback, void *context)
+{
+    if (!irTask)
+    {
+        // No IR task: transmit inline and complete immediately
+        bool success = transmitCode(code);
+        if (callback)
+            callback(context, success);
+        return true;
+    }
+
+    // The job holds a pool reference until the IR task has sent it. Pool
+    // timings are shared; others (the device store's arena can compact
+    // before the job runs) are copied into a buffer first
+    RawBuffer raw;
+    uint16_t rawLen = code.rawLen < MAX_IR_CODE_SIZE ? code.rawLen : MAX_IR_CODE_SIZE;
+    if (code.rawData && rawLen > 0)
+    {
+        if (code.buffer && code.rawData == code.buffer.data())
+        {
+            raw = code.buffer;
+        }
+        else
+        {
+            raw = capturePool.acquire();
+            if (!raw)
+                return false;
+            memcpy(raw.data(), code.rawData, rawLen * sizeof(uint16_t));
+        }
+    }
+
+    IRTransmitJob job = {code.protocol, code.data, code.bits, raw.data(), raw ? rawLen : (uint16_t)0, CAPTURE_NONE, nullptr, callback, context};
+    job.rawBuffer = raw.detach();
+    if (xQueueSend(transmitQueue, &job, 0) != pdPASS)
+    {
+        capturePool.adopt(job.rawBuffer).reset();
         return false;
+    }
+    return true;
+}
 
-    DEBUG_PRINT("Transmitting IR code: ");
-    DEBUG_PRINTLN(typeToString(code.protocol));
+bool IRManager::addPlanStep(IRPlan &plan, const IRCode &code, uint8_t repeat, uint16_t delayMs)
+{
+    if (plan.stepCount >= BATCH_MAX_STEPS)
+        return false;
+
+    IRPlanStep &step = plan.steps[plan.stepCount];
+    step.protocol = code.protocol;
+    step.data = code.data;
+    step.bits = code.bits;
+    step.rawLen = 0;
+    step.rawOffset = 0;
+    step.rawSize = 0;
+    step.rawPlain = false;
+    step.repeat = repeat;
+    step.delayMs = delayMs;
+
+    uint16_t rawLen = code.rawLen < MAX_IR_CODE_SIZE ? code.rawLen : MAX_IR_CODE_SIZE;
+    if (code.rawData && rawLen > 0)
+    {
+        // Encoded, a learned capture takes tens of bytes instead of a pool
+        // buffer. A/C state bytes are kept as they are: the codec is lossy
+        xSemaphoreTake(codecMutex, portMAX_DELAY);
+        size_t size = irProtocolHasState(code.protocol) ? 0 : rawEncoder.encode(code.rawData, rawLen, rawScratch, sizeof(rawScratch));
+        const uint8_t *bytes = rawScratch;
+        step.rawPlain = size == 0;
+        if (step.rawPlain)
+        {
+            size = rawLen * sizeof(uint16_t);
+            bytes = (const uint8_t *)code.rawData;
+        }
+
+        // Steps sending the same code share its bytes
+        step.rawOffset = plan.rawUsed;
+        for (uint8_t i = 0; i < plan.stepCount; i++)
+        {
+            const IRPlanStep &other = plan.steps[i];
+            if (other.rawSize == size && other.rawPlain == step.rawPlain && memcmp(plan.raw + other.rawOffset, bytes, size) == 0)
+            {
+                step.rawOffset = other.rawOffset;
+                break;
+            }
+        }
+
+        bool shared = step.rawOffset != plan.rawUsed;
+        bool fits = shared || plan.rawUsed + size <= sizeof(plan.raw);
+        if (fits && !shared)
+        {
+            memcpy(plan.raw + plan.rawUsed, bytes, size);
+            plan.rawUsed += size;
+        }
+        xSemaphoreGive(codecMutex);
+
+        if (!fits)
+            return false;
+        step.rawLen = rawLen;
+        step.rawSize = size;
+    }
 
-    if (code.rawData && code.rawLen > 0)
+    plan.stepCount++;
+    return true;
+}
+
+bool IRManager::queuePlan(IRPlan &plan, IRTransmitCallback callback, void *context)
+{
+    // Raw steps are decoded one at a time into a single pool buffer, held
+    // for the whole batch
+    RawBuffer timings;
+    for (uint8_t i = 0; i < plan.stepCount; i++)
     {
-        // Send raw data
-        irSend->sendRaw(code.rawData, code.rawLen, IR_FREQUENCY);
+        if (plan.steps[i].rawSize)
+        {
+            timings = capturePool.acquire();
+            if (!timings)
+                return false;
+            break;
+        }
+    }
+
+    if (!irTask)
+    {
+        bool success = runPlan(plan, timings.data());
+        if (callback)
+            callback(context, success);
+        return true;
+    }
+
+    IRTransmitJob job = {UNKNOWN, 0, 0, nullptr, 0, CAPTURE_NONE, &plan, callback, context};
+    job.rawBuffer = timings.detach();
+    if (xQueueSend(transmitQueue, &job, 0) != pdPASS)
+    {
+        capturePool.adopt(job.rawBuffer).reset();
+        return false;
+    }
+    return true;
+}
+
+bool IRManager::runPlan(IRPlan &plan, uint16_t *timings)
+{
+    plan.completedSteps = 0;
+    plan.sends = 0;
+
+    for (uint8_t i = 0; i < plan.stepCount; i++)
+    {
+        const IRPlanStep &step = plan.steps[i];
+        uint16_t *rawData = nullptr;
+        if (step.rawSize)
+        {
+            if (!timings)
+                return false;
+            if (step.rawPlain)
+                memcpy(timings, plan.raw + step.rawOffset, step.rawSize);
+            else if (!decodeRawTimings(plan.raw + step.rawOffset, step.rawSize, timings, MAX_IR_CODE_SIZE))
+                return false;
+            rawData = timings;
+        }
+
+        for (uint8_t r = 0; r < step.repeat; r++)
+        {
+            if (r > 0)
+                pause(BATCH_REPEAT_GAP_MS);
+            if (!sendCode(step.protocol, step.data, step.bits, rawData, step.rawLen))
+                return false;
+            plan.sends++;
+        }
+        plan.completedSteps++;
+
+        if (step.delayMs && i + 1 < plan.stepCount)
+            pause(step.delayMs);
     }
+    return true;
+}
+
+void IRManager::pause(uint32_t ms)
+{
+    // Only the IR task runs plans once it exists; otherwise they run inline
+    if (irTask)
+        vTaskDelay(pdMS_TO_TICKS(ms));
     else
+        delay(ms);
+}
+
+bool IRManager::setRmtEnabled(bool enabled)
+{
+    if (!irSend)
+        return false;
+
+    if (!enabled)
+    {
+        rmtEnabled = false;
+        irSend->begin(); // Back to a plain GPIO output
+        return true;
+    }
+
+    rmtEnabled = waveCache.begin() && rmt.begin(IR_TRANSMIT_PIN, IR_RMT_CHANNEL);
+    return rmtEnabled;
+}
+
+bool IRManager::sendCode(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t *rawData, uint16_t rawLen)
+{
+    if (!irSend)
+        return false;
+
+    uint32_t start = micros();
+    bool sent = emitCode(protocol, data, bits, rawData, rawLen);
+    metrics.observe(METRIC_HIST_IR_TRANSMIT_US, micros() - start);
+    metrics.add(sent ? METRIC_IR_TRANSMITS : METRIC_IR_TRANSMIT_FAILURES);
+    return sent;
+}
+
+bool IRManager::emitCode(decode_type_t protocol, uint64_t data, uint16_t bits, uint16_t *rawData, uint16_t rawLen)
+{
+    DEBUG_PRINT("Transmitting IR code: ");
+    DEBUG_PRINTLN(typeToString(protocol));
+
+    // State protocols keep their bytes in the raw words; other raw timings
+    // are sent as captured, whatever the protocol
+    const IRProtocolInfo *info = irProtocolInfo(protocol);
+    bool hasState = info && (info->flags & IR_PROTO_STATE);
+    bool raw = rawData && rawLen > 0 && !hasState;
+    if (!raw && (!info || !(info->flags & IR_PROTO_SEND)))
+    {
+        DEBUG_PRINTLN("Unsupported protocol");
+        return false;
+    }
+    if (!raw && bits == 0)
+        bits = info->defaultBits;
+
+    if (rmtEnabled && (raw || (info->flags & IR_PROTO_WAVEFORM)))
     {
-        // Send protocol-specific data
-        switch (code.protocol)
+        // Compiled once per code; a repeat send goes straight to the peripheral
+        const IRWaveform *wave = waveCache.get(protocol, data, bits, rawData, rawLen);
+        if (!wave)
         {
-        case NEC:
-            irSend->sendNEC(code.data, code.bits);
-            break;
-        case SONY:
-            irSend->sendSony(code.data, code.bits);
-            break;
-        case RC5:
-            irSend->sendRC5(code.data, code.bits);
-            break;
-        case RC6:
-            irSend->sendRC6(code.data, code.bits);
-            break;
-        default:
             DEBUG_PRINTLN("Unsupported protocol");
             return false;
         }
+        return rmt.send(*wave);
     }
 
-    return true;
+    // The library encodes everything else. With the RMT on, IRsend borrows
+    // the pin for the frame and the RMT routing is restored after
+    if (rmtEnabled)
+        irSend->begin();
+
+    bool sent;
+    if (raw)
+    {
+        irSend->sendRaw(rawData, rawLen, IR_FREQUENCY);
+        sent = true;
+    }
+    else if (hasState)
+    {
+        uint16_t bytes = bits / 8;
+        sent = rawData && rawLen >= irStateWords(bits) && irSend->send(protocol, (const uint8_t *)rawData, bytes);
+    }
+    else
+    {
+        sent = irSend->send(protocol, data, bits);
+    }
+
+    if (rmtEnabled)
+        rmt.begin(IR_TRANSMIT_PIN, IR_RMT_CHANNEL);
+    if (!sent)
+    {
+        DEBUG_PRINTLN("Unsupported protocol");
+    }
+    return sent;
 }
 
-bool IRManager::startLearning()
+void IRManager::setLearnCallback(IRLearnCallback callback, void *context)
 {
-    if (!irRecv)
-        return false;
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    learnCallback = callback;
+    learnContext = context;
+    xSemaphoreGive(stateMutex);
+}
 
-    DEBUG_PRINTLN("Starting IR learning mode");
-    learning = true;
-    learnStartTime = millis();
+uint32_t IRManager::startLearning(unsigned long timeoutMs, uint8_t captures)
+{
+    if (!isReady())
+        return 0;
 
-    // Clear previous learned code
-    if (lastLearned.rawData)
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+
+    if (learning)
     {
-        delete[] lastLearned.rawData;
-        lastLearned.rawData = nullptr;
+        xSemaphoreGive(stateMutex);
+        return 0;
     }
-    memset(&lastLearned, 0, sizeof(IRCode));
 
-    return true;
+    DEBUG_PRINTLN("Starting IR learning mode");
+
+    // Clear previous learned code; holders of a copy keep its buffer
+    lastLearned = IRCode();
+    lastLearned.protocol = UNKNOWN;
+    learnFrames = 0;
+
+    learnJobId = nextLearnJobId++;
+    if (nextLearnJobId == 0)
+        nextLearnJobId = 1;
+    learnTimeout = timeoutMs;
+    learnStartTime = millis();
+    learnSession.begin(learnJobId, captures);
+    learning = true;
+
+    uint32_t jobId = learnJobId;
+    xSemaphoreGive(stateMutex);
+    return jobId;
 }
 
-bool IRManager::stopLearning()
+uint32_t IRManager::stopLearning()
 {
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    uint32_t cancelledJob = learning ? learnJobId : 0;
     learning = false;
-    DEBUG_PRINTLN("Stopped IR learning mode");
-    return true;
+    learnSession.end(LEARN_CANCELLED);
+    xSemaphoreGive(stateMutex);
+
+    if (cancelledJob)
+    {
+        metrics.add(METRIC_IR_LEARN_CANCELLED);
+        DEBUG_PRINTLN("Stopped IR learning mode");
+    }
+    return cancelledJob;
 }
 
 bool IRManager::hasLearnedCode()
 {
-    return !learning && (lastLearned.protocol != UNKNOWN || lastLearned.rawLen > 0);
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    bool learned = !learning && (lastLearned.protocol != UNKNOWN || lastLearned.rawLen > 0);
+    xSemaphoreGive(stateMutex);
+    return learned;
 }
 
 IRCode IRManager::getLearnedCode()
 {
-    return lastLearned;
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    IRCode code = lastLearned;
+    xSemaphoreGive(stateMutex);
+    return code;
+}
+
+void IRManager::setMonitorCallback(IRMonitorCallback callback, void *context)
+{
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    monitorCallback = callback;
+    monitorContext = context;
+    xSemaphoreGive(stateMutex);
+}
+
+void IRManager::setMonitoring(bool enabled)
+{
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    monitoring = enabled;
+    monitorPrint = 0;
+    xSemaphoreGive(stateMutex);
+    DEBUG_PRINTLN(enabled ? "IR monitor mode on" : "IR monitor mode off");
+}
+
+void IRManager::getLearnReport(IRLearnReport &report)
+{
+    xSemaphoreTake(stateMutex, portMAX_DELAY);
+    report = learnSession.getReport();
+    xSemaphoreGive(stateMutex);
 }
 
 String IRManager::encodeIRCode(const IRCode &code)
@@ -153,12 +756,38 @@ String IRManager::encodeIRCode(const IRCode &code)
     doc["bits"] = code.bits;
     doc["description"] = code.description;
 
-    if (code.rawData && code.rawLen > 0)
+    if (irProtocolHasState(code.protocol))
     {
-        JsonArray rawArray = doc.createNestedArray("raw");
-        for (uint16_t i = 0; i < code.rawLen; i++)
+        // The state's bytes in hex, as IRremoteESP8266 prints them
+        static const char digits[] = "0123456789ABCDEF";
+        char hex[2 * kStateSizeMax + 1];
+        uint16_t bytes = code.rawData && code.rawLen >= irStateWords(code.bits) && code.bits / 8 <= kStateSizeMax ? code.bits / 8 : 0;
+        const uint8_t *state = (const uint8_t *)code.rawData;
+        for (uint16_t i = 0; i < bytes; i++)
         {
-            rawArray.add(code.rawData[i]);
+            hex[2 * i] = digits[state[i] >> 4];
+            hex[2 * i + 1] = digits[state[i] & 0x0F];
+        }
+        hex[2 * bytes] = '\0';
+        doc["state"] = hex;
+    }
+    else if (code.rawData && code.rawLen > 0)
+    {
+        // Compressed timings as base64; captures the codec cannot shrink
+        // keep the plain integer array
+        xSemaphoreTake(codecMutex, portMAX_DELAY);
+        size_t size = rawEncoder.encode(code.rawData, code.rawLen, rawScratch, sizeof(rawScratch));
+        if (size > 0)
+            doc["rawz"] = base64Encode(rawScratch, size);
+        xSemaphoreGive(codecMutex);
+
+        if (size == 0)
+        {
+            JsonArray rawArray = doc.createNestedArray("raw");
+            for (uint16_t i = 0; i < code.rawLen; i++)
+            {
+                rawArray.add(code.rawData[i]);
+            }
         }
     }
 
@@ -169,8 +798,7 @@ String IRManager::encodeIRCode(const IRCode &code)
 
 IRCode IRManager::decodeIRCode(const String &encoded)
 {
-    IRCode code;
-    memset(&code, 0, sizeof(IRCode));
+    IRCode code = IRCode();
 
     DynamicJsonDocument doc(1024);
     deserializeJson(doc, encoded);
@@ -180,14 +808,75 @@ IRCode IRManager::decodeIRCode(const String &encoded)
     code.bits = doc["bits"];
     code.description = doc["description"].as<String>();
 
-    if (doc.containsKey("raw"))
+    if (doc.containsKey("state"))
+    {
+        const char *hex = doc["state"];
+        size_t length = hex ? strlen(hex) : 0;
+        code.buffer = capturePool.acquire();
+        if (code.buffer && length % 2 == 0 && length / 2 <= kStateSizeMax)
+        {
+            uint8_t *state = (uint8_t *)code.buffer.data();
+            bool valid = true;
+            for (size_t i = 0; i < length && valid; i++)
+            {
+                char c = hex[i];
+                uint8_t nibble = 0;
+                if (c >= '0' && c <= '9')
+                    nibble = c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    nibble = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    nibble = c - 'A' + 10;
+                else
+                    valid = false;
+                state[i / 2] = i % 2 ? (state[i / 2] << 4) | nibble : nibble;
+            }
+            if (valid && length > 0)
+            {
+                code.bits = length / 2 * 8;
+                code.rawData = code.buffer.data();
+                code.rawLen = irStateWords(code.bits);
+                if (length / 2 % 2)
+                    state[length / 2] = 0;
+            }
+        }
+        if (!code.rawData)
+            code.buffer.reset();
+    }
+    else if (doc.containsKey("rawz"))
+    {
+        const char *text = doc["rawz"];
+        size_t length = text ? strlen(text) : 0;
+        xSemaphoreTake(codecMutex, portMAX_DELAY);
+        size_t size = base64Decode(text, length, rawScratch, sizeof(rawScratch));
+        uint16_t count = rawTimingCount(rawScratch, size);
+        if (count > 0)
+        {
+            code.buffer = capturePool.acquire();
+            if (code.buffer && decodeRawTimings(rawScratch, size, code.buffer.data(), MAX_IR_CODE_SIZE))
+            {
+                code.rawData = code.buffer.data();
+                code.rawLen = count;
+            }
+            else
+            {
+                code.buffer.reset();
+            }
+        }
+        xSemaphoreGive(codecMutex);
+    }
+    else if (doc.containsKey("raw"))
     {
         JsonArray rawArray = doc["raw"];
-        code.rawLen = rawArray.size();
-        code.rawData = new uint16_t[code.rawLen];
-        for (uint16_t i = 0; i < code.rawLen; i++)
+        code.buffer = capturePool.acquire();
+        if (code.buffer)
         {
-            code.rawData[i] = rawArray[i];
+            code.rawData = code.buffer.data();
+            code.rawLen = rawArray.size() < MAX_IR_CODE_SIZE ? rawArray.size() : MAX_IR_CODE_SIZE;
+            for (uint16_t i = 0; i < code.rawLen; i++)
+            {
+                code.rawData[i] = rawArray[i];
+            }
         }
     }
 
@@ -211,15 +900,35 @@ void IRManager::printIRCode(const IRCode &code)
 
 bool IRManager::isReady()
 {
-    return (irSend != nullptr && irRecv != nullptr);
+    return irSend != nullptr && (rmtRx.isReady() || irRecv != nullptr);
 }
 
-String IRManager::getStatus()
+void IRManager::getStatus(JsonObject doc)
 {
-    DynamicJsonDocument doc(256);
     doc["ready"] = isReady();
     doc["learning"] = learning;
+    doc["learnJob"] = learnJobId;
     doc["hasLearned"] = hasLearnedCode();
+    doc["poolBuffers"] = capturePool.getCapacity();
+    doc["poolUsed"] = capturePool.getUsed();
+    doc["poolPeak"] = capturePool.getPeakUsed();
+    doc["poolFailures"] = capturePool.getFailures();
+    doc["poolPsram"] = capturePool.inPsram();
+    doc["txBackend"] = rmtEnabled ? "rmt" : "irsend";
+    doc["waveCacheHits"] = waveCache.getHits();
+    doc["waveCacheMisses"] = waveCache.getMisses();
+    doc["rmtFailures"] = rmt.getFailures();
+    doc["rxBackend"] = rmtRx.isReady() ? "rmt" : "irrecv";
+    doc["framesCaptured"] = captureRing.getCaptured();
+    doc["monitoring"] = monitoring;
+}
+
+String IRManager::getStatus()
+{
+    DynamicJsonDocument doc(1024);
+    JsonObject status = doc.to<JsonObject>();
+    getStatus(status);
+    metrics.renderGroup(METRIC_GROUP_IR, status);
 
     String result;
     serializeJson(doc, result);
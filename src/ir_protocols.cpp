@@ -0,0 +1,178 @@
+/**
+ * IR Protocols Implementation
+ */
+
+#include "ir_protocols.h"
+
+namespace
+{
+    // The library's protocol list up to YORK; bit counts are its kXxxBits /
+    // kXxxStateLength defaults. Protocols added by later library versions
+    // fall past the end and are treated as unsupported
+    constexpr IRProtocolInfo kProtocols[] = {
+        {UNUSED, 0, 0},
+        {RC5, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_WAVEFORM, 12},
+        {RC6, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_WAVEFORM, 20},
+        {NEC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_WAVEFORM, 32},
+        {SONY, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_WAVEFORM, 12},
+        {PANASONIC, IR_PROTO_DECODE | IR_PROTO_SEND, 48},
+        {JVC, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {SAMSUNG, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {WHYNTER, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {AIWA_RC_T501, IR_PROTO_DECODE | IR_PROTO_SEND, 15},
+        {LG, IR_PROTO_DECODE | IR_PROTO_SEND, 28},
+        {SANYO, IR_PROTO_DECODE, 12},
+        {MITSUBISHI, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {DISH, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {SHARP, IR_PROTO_DECODE | IR_PROTO_SEND, 15},
+        {COOLIX, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {DAIKIN, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 280},
+        {DENON, IR_PROTO_DECODE | IR_PROTO_SEND, 15},
+        {KELVINATOR, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 128},
+        {SHERWOOD, IR_PROTO_SEND, 32},
+        {MITSUBISHI_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 144},
+        {RCMM, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {SANYO_LC7461, IR_PROTO_DECODE | IR_PROTO_SEND, 42},
+        {RC5X, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_WAVEFORM, 13},
+        {GREE, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 64},
+        {PRONTO, 0, 0},
+        {NEC_LIKE, IR_PROTO_DECODE, 32},
+        {ARGO, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 104},
+        {TROTEC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 72},
+        {NIKAI, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {RAW, 0, 0},
+        {GLOBALCACHE, 0, 0},
+        {TOSHIBA_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 72},
+        {FUJITSU_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 128},
+        {MIDEA, IR_PROTO_DECODE | IR_PROTO_SEND, 48},
+        {MAGIQUEST, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {LASERTAG, IR_PROTO_DECODE | IR_PROTO_SEND, 13},
+        {CARRIER_AC, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {HAIER_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 72},
+        {MITSUBISHI2, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {HITACHI_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 224},
+        {HITACHI_AC1, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 104},
+        {HITACHI_AC2, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 424},
+        {GICABLE, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {HAIER_AC_YRW02, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 112},
+        {WHIRLPOOL_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 168},
+        {SAMSUNG_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 112},
+        {LUTRON, IR_PROTO_DECODE | IR_PROTO_SEND, 35},
+        {ELECTRA_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 104},
+        {PANASONIC_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 216},
+        {PIONEER, IR_PROTO_DECODE | IR_PROTO_SEND, 64},
+        {LG2, IR_PROTO_DECODE | IR_PROTO_SEND, 28},
+        {MWM, IR_PROTO_DECODE, 24},
+        {DAIKIN2, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 312},
+        {VESTEL_AC, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {TECO, IR_PROTO_DECODE | IR_PROTO_SEND, 35},
+        {SAMSUNG36, IR_PROTO_DECODE | IR_PROTO_SEND, 36},
+        {TCL112AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 112},
+        {LEGOPF, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {MITSUBISHI_HEAVY_88, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 88},
+        {MITSUBISHI_HEAVY_152, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 152},
+        {DAIKIN216, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 216},
+        {SHARP_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 104},
+        {GOODWEATHER, IR_PROTO_DECODE | IR_PROTO_SEND, 48},
+        {INAX, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {DAIKIN160, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 160},
+        {NEOCLIMA, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 96},
+        {DAIKIN176, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 176},
+        {DAIKIN128, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 128},
+        {AMCOR, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 64},
+        {DAIKIN152, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 152},
+        {MITSUBISHI136, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 136},
+        {MITSUBISHI112, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 112},
+        {HITACHI_AC424, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 424},
+        {SONY_38K, IR_PROTO_DECODE | IR_PROTO_SEND, 20},
+        {EPSON, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {SYMPHONY, IR_PROTO_DECODE | IR_PROTO_SEND, 12},
+        {HITACHI_AC3, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 216},
+        {DAIKIN64, IR_PROTO_DECODE | IR_PROTO_SEND, 64},
+        {AIRWELL, IR_PROTO_DECODE | IR_PROTO_SEND, 34},
+        {DELONGHI_AC, IR_PROTO_DECODE | IR_PROTO_SEND, 64},
+        {DOSHISHA, IR_PROTO_DECODE | IR_PROTO_SEND, 40},
+        {MULTIBRACKETS, IR_PROTO_DECODE | IR_PROTO_SEND, 8},
+        {CARRIER_AC40, IR_PROTO_DECODE | IR_PROTO_SEND, 40},
+        {CARRIER_AC64, IR_PROTO_DECODE | IR_PROTO_SEND, 64},
+        {HITACHI_AC344, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 344},
+        {CORONA_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 168},
+        {MIDEA24, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {ZEPEAL, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {SANYO_AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 72},
+        {VOLTAS, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 80},
+        {METZ, IR_PROTO_DECODE | IR_PROTO_SEND, 19},
+        {TRANSCOLD, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {TECHNIBEL_AC, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {MIRAGE, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 120},
+        {ELITESCREENS, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {PANASONIC_AC32, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {MILESTAG2, IR_PROTO_DECODE | IR_PROTO_SEND, 22},
+        {ECOCLIM, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {XMP, IR_PROTO_DECODE | IR_PROTO_SEND, 64},
+        {TRUMA, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {HAIER_AC176, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 176},
+        {TEKNOPOINT, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 112},
+        {KELON, IR_PROTO_DECODE | IR_PROTO_SEND, 48},
+        {TROTEC_3550, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 72},
+        {SANYO_AC88, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 88},
+        {BOSE, IR_PROTO_DECODE | IR_PROTO_SEND, 16},
+        {ARRIS, IR_PROTO_DECODE | IR_PROTO_SEND, 32},
+        {RHOSS, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 96},
+        {AIRTON, IR_PROTO_DECODE | IR_PROTO_SEND, 56},
+        {COOLIX48, IR_PROTO_DECODE | IR_PROTO_SEND, 48},
+        {HITACHI_AC264, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 264},
+        {KELON168, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 168},
+        {HITACHI_AC296, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 296},
+        {DAIKIN200, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 200},
+        {HAIER_AC160, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 160},
+        {CARRIER_AC128, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 128},
+        {TOTO, IR_PROTO_DECODE | IR_PROTO_SEND, 24},
+        {CLIMABUTLER, IR_PROTO_DECODE | IR_PROTO_SEND, 52},
+        {TCL96AC, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 96},
+        {BOSCH144, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 144},
+        {SANYO_AC152, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 152},
+        {DAIKIN312, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 312},
+        {GORENJE, IR_PROTO_DECODE | IR_PROTO_SEND, 8},
+        {WOWWEE, IR_PROTO_DECODE | IR_PROTO_SEND, 11},
+        {CARRIER_AC84, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 88},
+        {YORK, IR_PROTO_DECODE | IR_PROTO_SEND | IR_PROTO_STATE, 136},
+    };
+
+    constexpr uint16_t kProtocolCount = sizeof(kProtocols) / sizeof(kProtocols[0]);
+
+    constexpr bool inEnumOrder(uint16_t i = 0)
+    {
+        return i >= kProtocolCount || (kProtocols[i].protocol == (decode_type_t)i && inEnumOrder(i + 1));
+    }
+
+    static_assert(kProtocolCount <= kLastDecodeType + 1, "no entries past the library's protocols");
+    static_assert(inEnumOrder(), "entries are indexed by protocol");
+}
+
+const IRProtocolInfo *irProtocolInfo(decode_type_t protocol)
+{
+    return protocol >= 0 && protocol < kProtocolCount ? &kProtocols[protocol] : nullptr;
+}
+
+bool irProtocolSupported(decode_type_t protocol)
+{
+    const IRProtocolInfo *info = irProtocolInfo(protocol);
+    return info && (info->flags & (IR_PROTO_DECODE | IR_PROTO_SEND)) == (IR_PROTO_DECODE | IR_PROTO_SEND);
+}
+
+bool irProtocolHasState(decode_type_t protocol)
+{
+    const IRProtocolInfo *info = irProtocolInfo(protocol);
+    return info && (info->flags & IR_PROTO_STATE);
+}
+
+uint16_t irProtocolCount()
+{
+    return kProtocolCount;
+}
+
+const IRProtocolInfo &irProtocolAt(uint16_t index)
+{
+    return kProtocols[index];
+}
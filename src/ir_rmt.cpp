@@ -0,0 +1,173 @@
+/**
+ * IR RMT Implementation
+ */
+
+#include "ir_rmt.h"
+
+namespace
+{
+    const uint32_t kRmtSourceClockHz = 80000000; // APB; the carrier is timed from it, not the divided clock
+
+    static_assert(sizeof(rmt_item32_t) == sizeof(IRWaveItem), "waveform items are written to the RMT as-is");
+}
+
+IRRmtTransmitter::IRRmtTransmitter() : channel(RMT_CHANNEL_0), pin(0), installed(false), carrierHz(0), sends(0), failures(0)
+{
+}
+
+bool IRRmtTransmitter::begin(uint8_t txPin, uint8_t txChannel)
+{
+    if (installed)
+        return rmt_set_gpio(channel, RMT_MODE_TX, (gpio_num_t)pin, false) == ESP_OK;
+
+    channel = (rmt_channel_t)txChannel;
+    pin = txPin;
+
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_TX;
+    config.channel = channel;
+    config.gpio_num = (gpio_num_t)pin;
+    config.clk_div = IR_RMT_CLK_DIV;
+    config.mem_block_num = IR_RMT_MEM_BLOCKS;
+    config.tx_config.carrier_en = true;
+    config.tx_config.carrier_freq_hz = IR_FREQUENCY;
+    config.tx_config.carrier_duty_percent = IR_DUTY_CYCLE;
+    config.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    config.tx_config.idle_output_en = true;
+
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(channel, 0, 0) != ESP_OK)
+    {
+        DEBUG_PRINTLN("RMT transmitter unavailable");
+        return false;
+    }
+
+    installed = true;
+    carrierHz = IR_FREQUENCY;
+    DEBUG_PRINTLN("RMT transmitter ready");
+    return true;
+}
+
+bool IRRmtTransmitter::send(const IRWaveform &wave)
+{
+    if (!installed || wave.count == 0)
+        return false;
+
+    if (wave.carrierHz != carrierHz)
+    {
+        uint32_t period = kRmtSourceClockHz / wave.carrierHz;
+        uint16_t high = period * IR_DUTY_CYCLE / 100;
+        if (rmt_set_tx_carrier(channel, true, high, period - high, RMT_CARRIER_LEVEL_HIGH) != ESP_OK)
+        {
+            failures++;
+            return false;
+        }
+        carrierHz = wave.carrierHz;
+    }
+
+    TickType_t timeout = pdMS_TO_TICKS(waveformDurationUs(wave) / 1000 + IR_RMT_TX_TIMEOUT_MS);
+    if (rmt_write_items(channel, (const rmt_item32_t *)wave.items, wave.count, false) != ESP_OK ||
+        rmt_wait_tx_done(channel, timeout) != ESP_OK)
+    {
+        failures++;
+        return false;
+    }
+
+    sends++;
+    return true;
+}
+
+IRRmtReceiver::IRRmtReceiver() : channel(RMT_CHANNEL_0), installed(false), ring(nullptr), overflows(0)
+{
+}
+
+bool IRRmtReceiver::begin(uint8_t rxPin, uint8_t rxChannel)
+{
+    if (installed)
+        return true;
+
+    channel = (rmt_channel_t)rxChannel;
+
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_RX;
+    config.channel = channel;
+    config.gpio_num = (gpio_num_t)rxPin;
+    config.clk_div = IR_RMT_CLK_DIV;
+    config.mem_block_num = IR_RMT_RX_MEM_BLOCKS;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = IR_RMT_RX_FILTER_CYCLES;
+    config.rx_config.idle_threshold = IR_RMT_RX_IDLE_US / IR_WAVE_TICK_US;
+
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(channel, IR_RMT_RX_BUFFER_BYTES, 0) != ESP_OK ||
+        rmt_get_ringbuf_handle(channel, &ring) != ESP_OK || rmt_rx_start(channel, true) != ESP_OK)
+    {
+        DEBUG_PRINTLN("RMT receiver unavailable");
+        return false;
+    }
+
+    installed = true;
+    DEBUG_PRINTLN("RMT receiver ready");
+    return true;
+}
+
+uint16_t IRRmtReceiver::drain(IRCaptureRing &frames)
+{
+    uint16_t moved = 0;
+    IRCaptureFrame *frame;
+    while (installed && (frame = frames.reserve()) != nullptr)
+    {
+        size_t size = 0;
+        rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(ring, &size, 0);
+        if (!items)
+            break;
+
+        // The receiver module pulls the line low during a burst, so level 0
+        // is a mark. Runs of one level are joined and the frame ends at the
+        // first zero duration
+        frame->timestampMs = millis();
+        frame->length = 0;
+        frame->overflow = false;
+        frame->decoded = false;
+        int8_t level = -1;
+        bool ended = false;
+        for (size_t i = 0; i < size / sizeof(rmt_item32_t) && !ended; i++)
+        {
+            for (uint8_t h = 0; h < 2; h++)
+            {
+                uint32_t ticks = h ? items[i].duration1 : items[i].duration0;
+                int8_t halfLevel = (h ? items[i].level1 : items[i].level0) ? 0 : 1;
+                if (ticks == 0)
+                {
+                    ended = true;
+                    break;
+                }
+                if (level < 0 && halfLevel == 0)
+                    continue; // Line noise before the first mark
+                uint32_t us = ticks * IR_WAVE_TICK_US;
+                if (halfLevel == level)
+                {
+                    uint32_t joined = frame->timings[frame->length - 1] + us;
+                    frame->timings[frame->length - 1] = joined < 0xFFFF ? joined : 0xFFFF;
+                    continue;
+                }
+                if (frame->length >= MAX_IR_CODE_SIZE)
+                {
+                    frame->overflow = true;
+                    ended = true;
+                    break;
+                }
+                frame->timings[frame->length++] = us;
+                level = halfLevel;
+            }
+        }
+        vRingbufferReturnItem(ring, items);
+
+        if (frame->overflow)
+            overflows++;
+        if (frame->length == 0)
+            continue;
+        frames.commit();
+        moved++;
+    }
+    return moved;
+}
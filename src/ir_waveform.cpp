@@ -0,0 +1,347 @@
+/**
+ * IR Waveform Implementation
+ */
+
+#include "ir_waveform.h"
+#include "ir_timings.h"
+#include <string.h>
+
+namespace
+{
+    using namespace IRTiming;
+
+    // Appends marks and spaces as item halves, merging runs of one level
+    class WaveBuilder
+    {
+    private:
+        IRWaveform &wave;
+        uint32_t halves;
+        uint32_t pending; // Duration of the current run, not yet written
+        uint8_t level;
+        uint32_t elapsed;
+        bool overflow;
+
+        void writeHalf(uint8_t halfLevel, uint32_t ticks)
+        {
+            uint32_t half = ticks | ((uint32_t)halfLevel << 15);
+            if (halves % 2 == 0)
+            {
+                if (wave.count >= IR_WAVE_MAX_ITEMS)
+                {
+                    overflow = true;
+                    return;
+                }
+                wave.items[wave.count++] = half;
+            }
+            else
+            {
+                wave.items[wave.count - 1] |= half << 16;
+            }
+            halves++;
+        }
+
+        void flush()
+        {
+            uint32_t ticks = pending / IR_WAVE_TICK_US;
+            while (ticks > 0 && !overflow)
+            {
+                uint32_t part = ticks < IR_WAVE_MAX_DURATION ? ticks : IR_WAVE_MAX_DURATION;
+                writeHalf(level, part);
+                ticks -= part;
+            }
+            pending = 0;
+        }
+
+        void emit(uint8_t runLevel, uint32_t us)
+        {
+            if (us == 0)
+                return;
+            if (runLevel != level)
+            {
+                flush();
+                level = runLevel;
+            }
+            pending += us;
+            elapsed += us;
+        }
+
+    public:
+        WaveBuilder(IRWaveform &wave, uint16_t carrierHz) : wave(wave), halves(0), pending(0), level(1), elapsed(0), overflow(false)
+        {
+            wave.carrierHz = carrierHz;
+            wave.count = 0;
+        }
+
+        void mark(uint32_t us) { emit(1, us); }
+
+        void space(uint32_t us)
+        {
+            // The output idles low, so a stream never starts with a space
+            if (halves == 0 && pending == 0)
+                return;
+            emit(0, us);
+        }
+
+        uint32_t getElapsed() const { return elapsed; }
+
+        bool finish()
+        {
+            flush();
+            return !overflow && wave.count > 0;
+        }
+    };
+
+    // IRsend::sendGeneric(): header, one mark/space pair per bit MSB first,
+    // optional footer mark, then a gap that pads the frame to `mesgtime`
+    void pulseFrames(WaveBuilder &out, uint32_t hdrMark, uint32_t hdrSpace, uint32_t oneMark, uint32_t oneSpace,
+                     uint32_t zeroMark, uint32_t zeroSpace, uint32_t footerMark, uint32_t gap, uint32_t mesgtime,
+                     uint64_t data, uint16_t bits, uint16_t repeat)
+    {
+        for (uint16_t r = 0; r <= repeat; r++)
+        {
+            uint32_t start = out.getElapsed();
+            out.mark(hdrMark);
+            out.space(hdrSpace);
+            for (uint64_t mask = 1ULL << (bits - 1); mask; mask >>= 1)
+            {
+                if (data & mask)
+                {
+                    out.mark(oneMark);
+                    out.space(oneSpace);
+                }
+                else
+                {
+                    out.mark(zeroMark);
+                    out.space(zeroSpace);
+                }
+            }
+            out.mark(footerMark);
+
+            uint32_t frame = out.getElapsed() - start;
+            out.space(mesgtime > frame && mesgtime - frame > gap ? mesgtime - frame : gap);
+        }
+    }
+
+    // Bi-phase bit: 1 is space then mark for RC5, mark then space for RC6
+    void manchester(WaveBuilder &out, bool markFirst, uint32_t us)
+    {
+        if (markFirst)
+        {
+            out.mark(us);
+            out.space(us);
+        }
+        else
+        {
+            out.space(us);
+            out.mark(us);
+        }
+    }
+
+    void rc5Frame(WaveBuilder &out, uint64_t data, uint16_t bits)
+    {
+        bool field = true;
+        if (bits >= kRc5XBits)
+        {
+            field = (data & (1ULL << (kRc5XBits - 1))) == 0;
+            bits--;
+        }
+
+        out.space(kRc5T1); // Dropped on the first frame
+        out.mark(kRc5T1);
+        manchester(out, !field, kRc5T1);
+        for (uint64_t mask = 1ULL << (bits - 1); mask; mask >>= 1)
+            manchester(out, (data & mask) == 0, kRc5T1);
+        out.space(kRc5MinGap);
+    }
+
+    void rc6Frame(WaveBuilder &out, uint64_t data, uint16_t bits)
+    {
+        out.mark(kRc6HdrMark);
+        out.space(kRc6HdrSpace);
+        out.mark(kRc6T1);
+        out.space(kRc6T1);
+        uint16_t i = 1;
+        for (uint64_t mask = 1ULL << (bits - 1); mask; mask >>= 1, i++)
+            manchester(out, (data & mask) != 0, i == kRc6ToggleBit ? 2 * kRc6T1 : kRc6T1);
+        out.space(kRc6RptLength);
+    }
+
+    uint64_t fnv1a(const void *data, size_t length, uint64_t hash = 14695981039346656037ULL)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+bool compileWaveform(decode_type_t protocol, uint64_t data, uint16_t bits, const uint16_t *rawData, uint16_t rawLen,
+                     IRWaveform &wave)
+{
+    if (rawData && rawLen > 0)
+    {
+        // sendRaw(): alternating mark and space, no trailing gap
+        WaveBuilder out(wave, IR_FREQUENCY);
+        for (uint16_t i = 0; i < rawLen; i++)
+        {
+            if (i & 1)
+                out.space(rawData[i]);
+            else
+                out.mark(rawData[i]);
+        }
+        return out.finish();
+    }
+
+    if (bits == 0 || bits > 64)
+        return false;
+
+    switch (protocol)
+    {
+    case NEC:
+    {
+        WaveBuilder out(wave, kNecFreq);
+        pulseFrames(out, kNecHdrMark, kNecHdrSpace, kNecBitMark, kNecOneSpace, kNecBitMark, kNecZeroSpace, kNecBitMark,
+                    kNecMinGap, kNecMinCommandLength, data, bits, 0);
+        return out.finish();
+    }
+    case SONY:
+    {
+        WaveBuilder out(wave, kSonyFreq);
+        pulseFrames(out, kSonyHdrMark, kSonySpace, kSonyOneMark, kSonySpace, kSonyZeroMark, kSonySpace, 0,
+                    kSonyMinGap, kSonyRptLength, data, bits, kSonyRepeat);
+        return out.finish();
+    }
+    case RC5:
+    case RC5X:
+    {
+        WaveBuilder out(wave, kRc56Freq);
+        rc5Frame(out, data, bits);
+        return out.finish();
+    }
+    case RC6:
+    {
+        WaveBuilder out(wave, kRc56Freq);
+        rc6Frame(out, data, bits);
+        return out.finish();
+    }
+    default:
+        return false;
+    }
+}
+
+uint16_t waveformTimings(const IRWaveform &wave, uint32_t *out, uint16_t capacity)
+{
+    uint16_t count = 0;
+    int8_t level = -1;
+    for (uint16_t i = 0; i < wave.count; i++)
+    {
+        for (uint8_t h = 0; h < 2; h++)
+        {
+            uint32_t half = (wave.items[i] >> (16 * h)) & 0xFFFF;
+            uint32_t ticks = half & 0x7FFF;
+            if (ticks == 0)
+                return count; // End marker
+            int8_t halfLevel = half >> 15;
+            if (halfLevel == level)
+            {
+                out[count - 1] += ticks * IR_WAVE_TICK_US;
+                continue;
+            }
+            if (count >= capacity)
+                return count;
+            out[count++] = ticks * IR_WAVE_TICK_US;
+            level = halfLevel;
+        }
+    }
+    return count;
+}
+
+uint32_t waveformDurationUs(const IRWaveform &wave)
+{
+    uint32_t ticks = 0;
+    for (uint16_t i = 0; i < wave.count; i++)
+        ticks += (wave.items[i] & 0x7FFF) + ((wave.items[i] >> 16) & 0x7FFF);
+    return ticks * IR_WAVE_TICK_US;
+}
+
+IRWaveformCache::IRWaveformCache() : entries(nullptr), clock(0), hits(0), misses(0)
+{
+    clear();
+}
+
+IRWaveformCache::~IRWaveformCache()
+{
+    free(entries);
+}
+
+bool IRWaveformCache::begin()
+{
+    if (entries)
+        return true;
+
+    // Internal RAM, not PSRAM: the RMT interrupt refills the peripheral from it
+    entries = (IRWaveform *)malloc(sizeof(IRWaveform) * IR_WAVE_CACHE_ENTRIES);
+    if (!entries)
+    {
+        DEBUG_PRINTLN("ERROR: Waveform cache allocation failed");
+        return false;
+    }
+    return true;
+}
+
+void IRWaveformCache::clear()
+{
+    for (uint8_t i = 0; i < IR_WAVE_CACHE_ENTRIES; i++)
+    {
+        keys[i] = {0, 0, UNKNOWN, 0, 0};
+        lastUse[i] = 0; // Never used
+    }
+}
+
+const IRWaveform *IRWaveformCache::get(decode_type_t protocol, uint64_t data, uint16_t bits, const uint16_t *rawData, uint16_t rawLen)
+{
+    if (!entries)
+        return nullptr;
+
+    Key key = {0, 0, (int16_t)protocol, bits, 0};
+    if (rawData && rawLen > 0)
+    {
+        // Raw timings alone decide the waveform
+        key.protocol = RAW;
+        key.bits = 0;
+        key.rawLen = rawLen;
+        key.hash = fnv1a(rawData, rawLen * sizeof(uint16_t));
+    }
+    else
+    {
+        key.data = data;
+    }
+
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < IR_WAVE_CACHE_ENTRIES; i++)
+    {
+        const Key &k = keys[i];
+        if (lastUse[i] && k.hash == key.hash && k.data == key.data && k.protocol == key.protocol && k.bits == key.bits &&
+            k.rawLen == key.rawLen)
+        {
+            hits++;
+            lastUse[i] = ++clock;
+            return &entries[i];
+        }
+        if (lastUse[i] < lastUse[victim])
+            victim = i;
+    }
+
+    misses++;
+    if (!compileWaveform(protocol, data, bits, rawData, rawLen, entries[victim]))
+    {
+        lastUse[victim] = 0;
+        return nullptr;
+    }
+    keys[victim] = key;
+    lastUse[victim] = ++clock;
+    return &entries[victim];
+}
@@ -0,0 +1,123 @@
+/**
+ * JSON Stream Writer Implementation
+ */
+
+#include "json_stream.h"
+#include <string.h>
+
+void JsonStreamWriter::separate()
+{
+    // A value after its key, or the first item of a level, needs no comma
+    if (afterKey)
+    {
+        afterKey = false;
+        return;
+    }
+    uint16_t bit = 1 << depth;
+    if (hasItems & bit)
+        sink.write(",", 1);
+    hasItems |= bit;
+}
+
+void JsonStreamWriter::open(char bracket)
+{
+    separate();
+    sink.write(&bracket, 1);
+    if (depth + 1 < JSON_STREAM_MAX_DEPTH)
+        depth++;
+    hasItems &= ~(1 << depth);
+}
+
+void JsonStreamWriter::close(char bracket)
+{
+    sink.write(&bracket, 1);
+    if (depth > 0)
+        depth--;
+}
+
+void JsonStreamWriter::quoted(const char *text)
+{
+    static const char hex[] = "0123456789abcdef";
+    sink.write("\"", 1);
+    const char *run = text;
+    for (const char *p = text; p && *p; p++)
+    {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        // Plain runs go out in one write; escapes in between
+        sink.write(run, p - run);
+        run = p + 1;
+        char escape[6] = {'\\', 0, '0', '0', 0, 0};
+        size_t length = 2;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            escape[1] = c;
+            break;
+        case '\n':
+            escape[1] = 'n';
+            break;
+        case '\r':
+            escape[1] = 'r';
+            break;
+        case '\t':
+            escape[1] = 't';
+            break;
+        default:
+            escape[1] = 'u';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xF];
+            length = 6;
+            break;
+        }
+        sink.write(escape, length);
+    }
+    if (run)
+        sink.write(run, strlen(run));
+    sink.write("\"", 1);
+}
+
+void JsonStreamWriter::key(const char *name)
+{
+    separate();
+    quoted(name);
+    sink.write(":", 1);
+    afterKey = true;
+}
+
+void JsonStreamWriter::string(const char *text)
+{
+    separate();
+    quoted(text);
+}
+
+void JsonStreamWriter::number(uint64_t value)
+{
+    separate();
+    char digits[20];
+    size_t length = 0;
+    do
+    {
+        digits[sizeof(digits) - ++length] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    sink.write(digits + sizeof(digits) - length, length);
+}
+
+void JsonStreamWriter::boolean(bool value)
+{
+    separate();
+    if (value)
+        sink.write("true", 4);
+    else
+        sink.write("false", 5);
+}
+
+void JsonStreamWriter::raw(const char *json)
+{
+    separate();
+    sink.write(json, strlen(json));
+}
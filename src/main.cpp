@@ -8,6 +8,13 @@
  * - Device configuration
  * - Command processing
  *
+ * After setup() the firmware runs as FreeRTOS tasks:
+ * - ir:      IR capture and transmission, pinned to IR_TASK_CORE
+ * - command: JSON command handling, fed by a bounded queue from onWrite
+ * - persist: debounced flash writes
+ * - ble:     outbound queue, replies ahead of event notifications
+ * The Arduino loop() only services BLE advertising state.
+ *
  * Author: ESPIR Development Team
  * License: Proprietary
  */
@@ -81,9 +88,24 @@ void setup()
 
     cmdProcessor.begin(&irManager, &bleManager, &deviceManager);
 
-    // Set up BLE command callback
-    bleManager.setCommandCallback([](const String &command)
-                                  { cmdProcessor.processCommand(command); });
+    // Start the task runtime
+    if (!irManager.startTask() || !deviceManager.startPersistTask() || !bleManager.startTask() || !cmdProcessor.startTask())
+    {
+        Serial.println("ERROR: Failed to start tasks");
+        while (1)
+        {
+            digitalWrite(STATUS_LED_PIN, HIGH);
+            delay(100);
+            digitalWrite(STATUS_LED_PIN, LOW);
+            delay(100);
+        }
+    }
+
+    // Set up BLE command callback; commands are queued for the command task
+    bleManager.setCommandCallback([](const char *json, size_t length)
+                                  { cmdProcessor.enqueueCommand(json, length); });
+    bleManager.setBinaryCallback([](const uint8_t *data, size_t length)
+                                 { cmdProcessor.enqueueBinary(data, length); });
 
     Serial.println("ESPIR-FW Ready!");
     digitalWrite(STATUS_LED_PIN, HIGH);
@@ -91,12 +113,17 @@ void setup()
 
 void loop()
 {
-    // Update all managers
+    // IR, command and persistence work runs on their own tasks
     bleManager.update();
-    irManager.update();
-    deviceManager.update();
-    cmdProcessor.update();
 
-    // Yield to allow other tasks
-    yield();
+#if TRACE_ENABLED
+    // 't' on the console prints the request trace
+    if (Serial.available() && Serial.read() == 't')
+    {
+        cmdProcessor.dumpTrace();
+    }
+#endif
+
+    // Sleep so the idle task on this core can run
+    vTaskDelay(pdMS_TO_TICKS(10));
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+/**
+ * Metrics Registry Implementation
+ */
+
+#include "metrics.h"
+
+MetricsRegistry metrics;
+
+namespace
+{
+    struct GroupInfo
+    {
+        const char *name;
+        MetricGroup parent; // METRIC_GROUP_COUNT at the top level
+    };
+
+    const GroupInfo groups[METRIC_GROUP_COUNT] = {
+        {"commands", METRIC_GROUP_COUNT},
+        {"tasks", METRIC_GROUP_COUNT},
+        {"monitor", METRIC_GROUP_COUNT},
+        {"ir", METRIC_GROUP_COUNT},
+        {"ble", METRIC_GROUP_COUNT},
+        {"txQueue", METRIC_GROUP_BLE},
+        {"devices", METRIC_GROUP_COUNT},
+        {"storage", METRIC_GROUP_DEVICES},
+    };
+
+    const MetricInfo infos[METRIC_COUNT] = {
+        {METRIC_GROUP_COMMANDS, METRIC_COUNTER, "processed"},
+        {METRIC_GROUP_TASKS, METRIC_COUNTER, "dropped"},
+        {METRIC_GROUP_COMMANDS, METRIC_COUNTER, "failed"},
+        {METRIC_GROUP_MONITOR, METRIC_COUNTER, "matched"},
+        {METRIC_GROUP_MONITOR, METRIC_COUNTER, "unmatched"},
+        {METRIC_GROUP_MONITOR, METRIC_COUNTER, "dropped"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "transmits"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "transmitFailures"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "framesDecoded"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "framesRepeated"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "framesMonitored"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "learned"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "learnMismatches"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "learnTimeouts"},
+        {METRIC_GROUP_IR, METRIC_COUNTER, "learnCancelled"},
+        {METRIC_GROUP_BLE, METRIC_COUNTER, "connects"},
+        {METRIC_GROUP_BLE, METRIC_COUNTER, "disconnects"},
+        {METRIC_GROUP_BLE, METRIC_GAUGE, "mtu"},
+        {METRIC_GROUP_BLE, METRIC_COUNTER, "fragmentsSent"},
+        {METRIC_GROUP_BLE, METRIC_COUNTER, "flowTimeouts"},
+        {METRIC_GROUP_BLE, METRIC_COUNTER, "notifyFailures"},
+        {METRIC_GROUP_BLE_TX_QUEUE, METRIC_COUNTER, "retries"},
+        {METRIC_GROUP_BLE_TX_QUEUE, METRIC_COUNTER, "abandoned"},
+        {METRIC_GROUP_STORAGE, METRIC_COUNTER, "commits"},
+        {METRIC_GROUP_STORAGE, METRIC_COUNTER, "commitFailures"},
+        {METRIC_GROUP_STORAGE, METRIC_COUNTER, "compactions"},
+        {METRIC_GROUP_COMMANDS, METRIC_GAUGE, "arenaPeak"},
+        {METRIC_GROUP_COMMANDS, METRIC_COUNTER, "arenaOverflows"},
+    };
+
+    const MetricHistogramInfo histogramInfos[METRIC_HIST_COUNT] = {
+        {METRIC_GROUP_IR, "transmitUs"},
+        {METRIC_GROUP_STORAGE, "commitUs"},
+    };
+
+    uint8_t bucketOf(uint32_t sample)
+    {
+        uint8_t bucket = sample ? 32 - __builtin_clz(sample) : 0;
+        return bucket < METRIC_HISTOGRAM_BUCKETS ? bucket : METRIC_HISTOGRAM_BUCKETS - 1;
+    }
+
+    JsonObject groupObject(JsonObject root, MetricGroup group)
+    {
+        const GroupInfo &info = groups[group];
+        JsonObject parent = info.parent == METRIC_GROUP_COUNT ? root : groupObject(root, info.parent);
+        JsonObject object = parent[info.name].as<JsonObject>();
+        return object.isNull() ? parent.createNestedObject(info.name) : object;
+    }
+}
+
+const MetricInfo &metricInfo(MetricId id)
+{
+    return infos[id];
+}
+
+const MetricHistogramInfo &metricHistogramInfo(MetricHistogramId id)
+{
+    return histogramInfos[id];
+}
+
+void MetricHistogram::reset()
+{
+    for (std::atomic<uint32_t> &bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+void MetricHistogram::observe(uint32_t sample)
+{
+    buckets[bucketOf(sample)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(sample, std::memory_order_relaxed);
+    uint32_t seen = max.load(std::memory_order_relaxed);
+    while (sample > seen && !max.compare_exchange_weak(seen, sample, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint32_t MetricHistogram::percentile(const uint32_t *buckets, uint32_t count, uint32_t max, uint8_t percent)
+{
+    // The first bucket reaching the rank, reported by its upper bound
+    uint32_t rank = ((uint64_t)count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < METRIC_HISTOGRAM_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen >= rank && seen > 0)
+        {
+            uint32_t upper = b == 0 ? 0 : (b >= 32 ? UINT32_MAX : (uint32_t)((1ull << b) - 1));
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+void MetricHistogram::summarize(MetricHistogramSummary &summary) const
+{
+    // The count is the buckets' total, so percentiles always find their rank
+    uint32_t counts[METRIC_HISTOGRAM_BUCKETS];
+    uint32_t count = 0;
+    for (uint8_t b = 0; b < METRIC_HISTOGRAM_BUCKETS; b++)
+    {
+        counts[b] = buckets[b].load(std::memory_order_relaxed);
+        count += counts[b];
+    }
+    summary.count = count;
+    summary.sum = sum.load(std::memory_order_relaxed);
+    summary.max = max.load(std::memory_order_relaxed);
+    summary.p50 = percentile(counts, count, summary.max, 50);
+    summary.p95 = percentile(counts, count, summary.max, 95);
+    summary.p99 = percentile(counts, count, summary.max, 99);
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+    reset();
+}
+
+void MetricsRegistry::reset()
+{
+    for (std::atomic<uint32_t> &value : values)
+        value.store(0, std::memory_order_relaxed);
+    for (MetricHistogram &histogram : histograms)
+        histogram.reset();
+}
+
+void MetricsRegistry::renderGroup(MetricGroup group, JsonObject into) const
+{
+    for (uint8_t id = 0; id < METRIC_COUNT; id++)
+    {
+        if (infos[id].group == group)
+            into[infos[id].name] = get((MetricId)id);
+    }
+
+    MetricHistogramSummary summary;
+    for (uint8_t id = 0; id < METRIC_HIST_COUNT; id++)
+    {
+        if (histogramInfos[id].group != group)
+            continue;
+        summarize((MetricHistogramId)id, summary);
+        JsonObject histogram = into.createNestedObject(histogramInfos[id].name);
+        histogram["count"] = summary.count;
+        histogram["sum"] = summary.sum;
+        histogram["max"] = summary.max;
+        histogram["p50"] = summary.p50;
+        histogram["p95"] = summary.p95;
+        histogram["p99"] = summary.p99;
+    }
+}
+
+void MetricsRegistry::render(JsonObject root) const
+{
+    for (uint8_t group = 0; group < METRIC_GROUP_COUNT; group++)
+        renderGroup((MetricGroup)group, groupObject(root, (MetricGroup)group));
+}
@@ -0,0 +1,409 @@
+/**
+ * Raw Codec Implementation
+ */
+
+#include "raw_codec.h"
+#include <string.h>
+
+namespace
+{
+    // Bounded output; anything past the limit only clears ok
+    struct ByteSink
+    {
+        uint8_t *out;
+        size_t limit;
+        size_t length;
+        bool ok;
+        uint32_t bitBuffer;
+        uint8_t bitCount;
+
+        ByteSink(uint8_t *o, size_t l) : out(o), limit(l), length(0), ok(true), bitBuffer(0), bitCount(0) {}
+
+        void put(uint8_t value)
+        {
+            if (length < limit)
+                out[length] = value;
+            else
+                ok = false;
+            length++;
+        }
+
+        void leb128(uint16_t value)
+        {
+            while (value >= 0x80)
+            {
+                put((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+            put(value);
+        }
+
+        void bits(uint32_t value, uint8_t width)
+        {
+            bitBuffer |= value << bitCount;
+            bitCount += width;
+            while (bitCount >= 8)
+            {
+                put(bitBuffer & 0xFF);
+                bitBuffer >>= 8;
+                bitCount -= 8;
+            }
+        }
+
+        void flushBits()
+        {
+            if (bitCount)
+                put(bitBuffer & 0xFF);
+            bitBuffer = 0;
+            bitCount = 0;
+        }
+    };
+
+    struct ByteSource
+    {
+        const uint8_t *data;
+        size_t size;
+        size_t pos;
+        bool ok;
+        uint32_t bitBuffer;
+        uint8_t bitCount;
+
+        ByteSource(const uint8_t *d, size_t s) : data(d), size(s), pos(0), ok(true), bitBuffer(0), bitCount(0) {}
+
+        uint8_t get()
+        {
+            if (pos < size)
+                return data[pos++];
+            ok = false;
+            return 0;
+        }
+
+        uint16_t leb128()
+        {
+            uint32_t value = 0;
+            for (uint8_t shift = 0; shift < 21; shift += 7)
+            {
+                uint8_t b = get();
+                value |= (uint32_t)(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                {
+                    ok &= value <= 0xFFFF;
+                    return value;
+                }
+            }
+            ok = false;
+            return 0;
+        }
+
+        uint32_t bits(uint8_t width)
+        {
+            while (bitCount < width)
+            {
+                if (pos >= size)
+                {
+                    ok = false;
+                    return 0;
+                }
+                bitBuffer |= (uint32_t)data[pos++] << bitCount;
+                bitCount += 8;
+            }
+            uint32_t value = bitBuffer & ((1u << width) - 1);
+            bitBuffer >>= width;
+            bitCount -= width;
+            return value;
+        }
+    };
+
+    const uint8_t RUN_BITS = 8;
+    const uint16_t RUN_MIN = 2;
+
+    // Smallest width holding values 0..count-1
+    uint8_t widthFor(uint16_t count)
+    {
+        uint8_t width = 1;
+        while ((1u << width) < count)
+            width++;
+        return width;
+    }
+
+    uint16_t quantize(uint16_t timing, uint8_t tickUs)
+    {
+        uint32_t ticks = ((uint32_t)timing + tickUs / 2) / tickUs;
+        // Decoding multiplies back, which must stay within 16 bits
+        return ticks > 0xFFFFu / tickUs ? 0xFFFFu / tickUs : ticks;
+    }
+}
+
+uint16_t RawTimingEncoder::find(uint16_t ticks, bool space) const
+{
+    uint16_t low = space ? markCount : 0, high = space ? durationCount : markCount;
+    while (low < high)
+    {
+        uint16_t mid = (low + high) / 2;
+        if (durations[mid] < ticks)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+void RawTimingEncoder::buildEntries(uint16_t tolerancePercent)
+{
+    // A new entry starts wherever the gap to the previous duration is
+    // wider than the tolerance. Entries take the midpoint of their range,
+    // so neighbouring midpoints stay more than the tolerance apart and a
+    // decoded code splits into the same entries again
+    entryCount = 0;
+    uint16_t first = 0;
+    for (uint16_t d = 0; d <= durationCount; d++)
+    {
+        bool split = d == durationCount || d == 0 || d == markCount ||
+                     (uint32_t)durations[d] * 100 > (uint32_t)durations[d - 1] * (100 + tolerancePercent);
+        if (split && d > 0)
+        {
+            entries[entryCount++] = ((uint32_t)durations[first] + durations[d - 1] + 1) / 2;
+            first = d;
+        }
+        if (d < durationCount)
+            entryOf[d] = entryCount;
+    }
+}
+
+size_t RawTimingEncoder::encode(const uint16_t *timings, uint16_t length, uint8_t *out, size_t capacity, uint8_t tickUs)
+{
+    if (!timings || !out || length == 0 || length > MAX_IR_CODE_SIZE || tickUs == 0)
+        return 0;
+
+    // Distinct durations in ticks, kept sorted. Receivers stretch marks and
+    // shrink spaces, so the two are grouped apart: marks, then spaces
+    durationCount = 0;
+    markCount = 0;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t ticks = quantize(timings[i], tickUs);
+        bool space = i % 2;
+        uint16_t pos = find(ticks, space);
+        if (pos < (space ? durationCount : markCount) && durations[pos] == ticks)
+            continue;
+        if (durationCount == RAW_CODEC_MAX_DURATIONS)
+            return 0;
+        memmove(durations + pos + 1, durations + pos, (durationCount - pos) * sizeof(uint16_t));
+        durations[pos] = ticks;
+        durationCount++;
+        markCount += !space;
+    }
+
+    // A chain of close durations can merge into one wide entry; such a
+    // capture keeps its exact durations instead
+    buildEntries(RAW_CODEC_TOLERANCE_PERCENT);
+    for (uint16_t d = 0, first = 0; d < durationCount; d++)
+    {
+        if (d > 0 && entryOf[d] != entryOf[d - 1])
+            first = d;
+        if ((uint32_t)durations[d] * 100 > (uint32_t)durations[first] * (100 + RAW_CODEC_MAX_SPREAD_PERCENT))
+        {
+            buildEntries(0);
+            break;
+        }
+    }
+
+    // Mark/space pairs, numbered by first appearance
+    pairCount = 0;
+    uint16_t symbolCount = (length + 1) / 2;
+    for (uint16_t p = 0; p < symbolCount; p++)
+    {
+        uint8_t mark = entryOf[find(quantize(timings[2 * p], tickUs), false)];
+        uint8_t space = 2 * p + 1 < length ? entryOf[find(quantize(timings[2 * p + 1], tickUs), true)] : RAW_CODEC_NO_SPACE;
+        uint16_t key = (mark << 8) | space;
+
+        uint16_t index = 0;
+        while (index < pairCount && pairs[index] != key)
+            index++;
+        if (index == pairCount)
+        {
+            if (pairCount == RAW_CODEC_MAX_PAIRS)
+                return 0;
+            pairs[pairCount++] = key;
+        }
+        symbols[p] = index;
+    }
+
+    // Only worth keeping when smaller than the plain words
+    ByteSink sink(out, capacity < 2u * length ? capacity : 2u * length - 1);
+    sink.put(RAW_CODEC_VERSION);
+    sink.put(tickUs);
+    sink.put(length & 0xFF);
+    sink.put(length >> 8);
+    sink.put(entryCount);
+    for (uint16_t e = 0; e < entryCount; e++)
+        sink.leb128(entries[e]);
+    sink.put(pairCount);
+    for (uint16_t p = 0; p < pairCount; p++)
+    {
+        sink.put(pairs[p] >> 8);
+        sink.put(pairs[p] & 0xFF);
+    }
+
+    uint8_t width = widthFor(pairCount + 1);
+    uint16_t escape = pairCount;
+    for (uint16_t p = 0; p < symbolCount && sink.ok;)
+    {
+        uint8_t symbol = symbols[p++];
+        sink.bits(symbol, width);
+
+        // Escape a run of repeats once it costs more than escape + count
+        uint16_t run = 0;
+        while (p + run < symbolCount && symbols[p + run] == symbol && run < RUN_MIN + (1 << RUN_BITS) - 1)
+            run++;
+        if (run >= RUN_MIN && run * width > width + RUN_BITS)
+        {
+            sink.bits(escape, width);
+            sink.bits(run - RUN_MIN, RUN_BITS);
+            p += run;
+        }
+    }
+    sink.flushBits();
+
+    return sink.ok ? sink.length : 0;
+}
+
+uint16_t rawTimingCount(const uint8_t *data, size_t size)
+{
+    if (!data || size < 5 || data[0] != RAW_CODEC_VERSION || data[1] == 0)
+        return 0;
+    return data[2] | (data[3] << 8);
+}
+
+bool decodeRawTimings(const uint8_t *data, size_t size, uint16_t *timings, uint16_t capacity)
+{
+    uint16_t count = rawTimingCount(data, size);
+    if (count == 0 || count > capacity || !timings)
+        return false;
+
+    ByteSource in(data, size);
+    in.pos = 4;
+    uint8_t tickUs = data[1];
+
+    uint16_t entries[RAW_CODEC_MAX_DURATIONS];
+    uint8_t entryCount = in.get();
+    for (uint8_t e = 0; e < entryCount && in.ok; e++)
+    {
+        uint16_t ticks = in.leb128();
+        in.ok &= ticks <= 0xFFFFu / tickUs;
+        entries[e] = ticks * tickUs;
+    }
+
+    // Pairs resolved to microseconds up front; a missing space is 0xFFFF
+    uint16_t marks[RAW_CODEC_MAX_PAIRS], spaces[RAW_CODEC_MAX_PAIRS];
+    uint8_t pairCount = in.get();
+    for (uint8_t p = 0; p < pairCount && in.ok; p++)
+    {
+        uint8_t mark = in.get(), space = in.get();
+        in.ok &= mark < entryCount && (space < entryCount || space == RAW_CODEC_NO_SPACE);
+        marks[p] = in.ok ? entries[mark] : 0;
+        spaces[p] = in.ok && space != RAW_CODEC_NO_SPACE ? entries[space] : 0xFFFF;
+    }
+    if (!in.ok || entryCount == 0 || pairCount == 0)
+        return false;
+
+    uint8_t width = widthFor(pairCount + 1);
+    uint16_t out = 0;
+    int previous = -1;
+    while (out < count)
+    {
+        uint32_t symbol = in.bits(width);
+        uint16_t repeats = 1;
+        if (symbol == pairCount)
+        {
+            repeats = in.bits(RUN_BITS) + RUN_MIN;
+            symbol = previous;
+        }
+        // An escape with nothing before it resolves to an invalid symbol
+        if (!in.ok || symbol >= pairCount)
+            return false;
+
+        for (uint16_t r = 0; r < repeats && out < count; r++)
+        {
+            timings[out++] = marks[symbol];
+            if (out == count)
+                break;
+            // Only the last pair may lack its space
+            if (spaces[symbol] == 0xFFFF)
+                return false;
+            timings[out++] = spaces[symbol];
+        }
+        previous = symbol;
+    }
+    return true;
+}
+
+namespace
+{
+    const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    int base64Value(char c)
+    {
+        if (c >= 'A' && c <= 'Z')
+            return c - 'A';
+        if (c >= 'a' && c <= 'z')
+            return c - 'a' + 26;
+        if (c >= '0' && c <= '9')
+            return c - '0' + 52;
+        return c == '+' ? 62 : c == '/' ? 63 : -1;
+    }
+}
+
+String base64Encode(const uint8_t *data, size_t length)
+{
+    String result;
+    result.reserve((length + 2) / 3 * 4);
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if (i + 1 < length)
+            group |= data[i + 1] << 8;
+        if (i + 2 < length)
+            group |= data[i + 2];
+
+        result += BASE64_ALPHABET[(group >> 18) & 0x3F];
+        result += BASE64_ALPHABET[(group >> 12) & 0x3F];
+        result += i + 1 < length ? BASE64_ALPHABET[(group >> 6) & 0x3F] : '=';
+        result += i + 2 < length ? BASE64_ALPHABET[group & 0x3F] : '=';
+    }
+    return result;
+}
+
+size_t base64Decode(const char *text, size_t length, uint8_t *out, size_t capacity)
+{
+    if (!text || length % 4 != 0)
+        return 0;
+
+    size_t written = 0;
+    for (size_t i = 0; i < length; i += 4)
+    {
+        int values[4];
+        uint8_t padding = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            // Padding only at the very end
+            if (text[i + j] == '=' && i + 4 == length && j >= 2)
+            {
+                values[j] = 0;
+                padding++;
+                continue;
+            }
+            values[j] = padding ? -1 : base64Value(text[i + j]);
+            if (values[j] < 0)
+                return 0;
+        }
+
+        uint32_t group = (values[0] << 18) | (values[1] << 12) | (values[2] << 6) | values[3];
+        uint8_t bytes = 3 - padding;
+        if (written + bytes > capacity)
+            return 0;
+        for (uint8_t b = 0; b < bytes; b++)
+            out[written++] = group >> (16 - 8 * b);
+    }
+    return written;
+}
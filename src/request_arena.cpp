@@ -0,0 +1,138 @@
+/**
+ * Request Arena Implementation
+ */
+
+#include "request_arena.h"
+#include "metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+RequestArena requestArena;
+
+namespace
+{
+    // Ahead of every block: the block before it, for freeing newest first
+    struct BlockHeader
+    {
+        uint32_t previous;
+        uint32_t size;
+    };
+
+    size_t blockSpan(size_t size)
+    {
+        return sizeof(BlockHeader) + ((size + 7) & ~(size_t)7);
+    }
+}
+
+RequestArena::RequestArena() : used(0), top(NO_BLOCK), peak(0)
+{
+}
+
+void *RequestArena::allocate(size_t size)
+{
+    size_t span = blockSpan(size);
+    if (span > sizeof(buffer) - used)
+    {
+        metrics.add(METRIC_ARENA_OVERFLOWS);
+        return malloc(size);
+    }
+
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(buffer + used);
+    header->previous = top;
+    header->size = size;
+    top = used;
+    used += span;
+    if (used > peak)
+    {
+        peak = used;
+        metrics.set(METRIC_ARENA_PEAK, peak);
+    }
+    return header + 1;
+}
+
+void RequestArena::deallocate(void *ptr)
+{
+    if (!owns(ptr))
+    {
+        free(ptr);
+        return;
+    }
+
+    // Older blocks wait for the scope to end
+    if (top != NO_BLOCK && ptr == buffer + top + sizeof(BlockHeader))
+    {
+        used = top;
+        top = reinterpret_cast<BlockHeader *>(buffer + top)->previous;
+    }
+}
+
+void *RequestArena::reallocate(void *ptr, size_t size)
+{
+    if (!ptr)
+        return allocate(size);
+    if (!owns(ptr))
+        return realloc(ptr, size);
+
+    // The newest block resizes in place
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+    if ((uint8_t *)header == buffer + top && blockSpan(size) <= sizeof(buffer) - top)
+    {
+        header->size = size;
+        used = top + blockSpan(size);
+        if (used > peak)
+        {
+            peak = used;
+            metrics.set(METRIC_ARENA_PEAK, peak);
+        }
+        return ptr;
+    }
+
+    void *moved = allocate(size);
+    if (moved)
+        memcpy(moved, ptr, header->size < size ? header->size : size);
+    deallocate(ptr);
+    return moved;
+}
+
+const char *RequestArena::format(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(nullptr, 0, fmt, args);
+    va_end(args);
+
+    // Scratch strings are never worth a heap block: one that does not fit comes back empty
+    if (length < 0 || blockSpan(length + 1) > sizeof(buffer) - used)
+    {
+        metrics.add(METRIC_ARENA_OVERFLOWS);
+        return "";
+    }
+    char *text = static_cast<char *>(allocate(length + 1));
+    va_start(args, fmt);
+    vsnprintf(text, length + 1, fmt, args);
+    va_end(args);
+    return text;
+}
+
+const char *RequestArena::copy(const char *text, size_t length)
+{
+    if (blockSpan(length + 1) > sizeof(buffer) - used)
+    {
+        metrics.add(METRIC_ARENA_OVERFLOWS);
+        return "";
+    }
+    char *out = static_cast<char *>(allocate(length + 1));
+    memcpy(out, text, length);
+    out[length] = '\0';
+    return out;
+}
+
+void RequestArena::rewind(size_t mark)
+{
+    if (mark >= used)
+        return;
+    used = mark;
+    while (top != NO_BLOCK && top >= mark)
+        top = reinterpret_cast<BlockHeader *>(buffer + top)->previous;
+}
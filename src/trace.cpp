@@ -0,0 +1,273 @@
+/**
+ * Request Tracer Implementation
+ */
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <string.h>
+
+Tracer tracer;
+
+namespace
+{
+    const char *const commandNames[TRACE_CMD_COUNT] = {
+        "UNKNOWN",
+        CMD_LEARN,
+        CMD_STOP_LEARN,
+        CMD_TRANSMIT,
+        CMD_LIST_DEVICES,
+        CMD_EXPORT_DEVICES,
+        CMD_ADD_DEVICE,
+        CMD_DELETE_DEVICE,
+        CMD_GET_STATUS,
+        CMD_RESET,
+        CMD_BATCH,
+        CMD_ADD_MACRO,
+        CMD_RUN_MACRO,
+        CMD_DELETE_MACRO,
+        CMD_LIST_MACROS,
+        CMD_MONITOR,
+        CMD_TRACE,
+        "BIN_HELLO",
+        "BIN_RESOLVE",
+        "BIN_TRANSMIT",
+        "BIN_PING",
+        "BIN_METRICS",
+    };
+
+    const char *const stageNames[TRACE_STAGE_COUNT] = {
+        "queue", "parse", "dispatch", "lookup", "transmit", "persist", "serialize",
+    };
+
+    void writeSummary(JsonStreamWriter &out, const char *name, const MetricHistogramSummary &summary)
+    {
+        out.key(name);
+        out.beginObject();
+        out.field("count", (uint64_t)summary.count);
+        out.field("p50Ns", (uint64_t)summary.p50);
+        out.field("p95Ns", (uint64_t)summary.p95);
+        out.field("p99Ns", (uint64_t)summary.p99);
+        out.field("maxNs", (uint64_t)summary.max);
+        out.endObject();
+    }
+}
+
+Tracer::Tracer() : open(false), depth(0), queuedCycles(0), parkedIn(nullptr), finished(0)
+{
+    memset(&current, 0, sizeof(current));
+    memset(ring, 0, sizeof(ring));
+}
+
+uint32_t Tracer::toNs(uint32_t cycles)
+{
+    uint64_t ns = (uint64_t)cycles * 1000 / ESP.getCpuFreqMHz();
+    return ns < UINT32_MAX ? ns : UINT32_MAX;
+}
+
+const char *Tracer::commandName(TraceCommand command)
+{
+    return command < TRACE_CMD_COUNT ? commandNames[command] : commandNames[TRACE_CMD_UNKNOWN];
+}
+
+const char *Tracer::stageName(TraceStage stage)
+{
+    return stageNames[stage];
+}
+
+TraceCommand Tracer::binaryCommandOf(uint8_t opcode)
+{
+    // Binary opcodes are numbered from 1 in the same order
+    if (opcode >= 1 && opcode <= TRACE_CMD_BIN_METRICS - TRACE_CMD_BIN_HELLO + 1)
+        return (TraceCommand)(TRACE_CMD_BIN_HELLO + opcode - 1);
+    return TRACE_CMD_UNKNOWN;
+}
+
+void Tracer::start()
+{
+    open = true;
+    depth = 0;
+    childCycles[0] = 0;
+}
+
+void Tracer::begin()
+{
+    uint32_t now = cycles();
+    memset(&current, 0, sizeof(current));
+    current.startCycles = now;
+    if (queuedCycles)
+    {
+        current.startCycles = queuedCycles;
+        current.stageCycles[TRACE_QUEUE] = now - queuedCycles;
+        queuedCycles = 0;
+    }
+    parkedIn = nullptr;
+    start();
+}
+
+void Tracer::setCommand(TraceCommand command)
+{
+    if (open)
+        current.command = command;
+}
+
+void Tracer::end()
+{
+    if (!open)
+        return;
+    open = false;
+
+    // Still waiting for the IR task: resume() finishes it
+    if (parkedIn)
+    {
+        uint32_t parkedCycles = parkedIn->parkedCycles;
+        *parkedIn = current;
+        parkedIn->parkedCycles = parkedCycles;
+        parkedIn = nullptr;
+        return;
+    }
+
+    current.totalCycles = cycles() - current.startCycles;
+    current.sequence = ++finished;
+    ring[(finished - 1) % TRACE_RING_ENTRIES] = current;
+
+    commandNs[current.command].observe(toNs(current.totalCycles));
+    for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        if (current.stageCycles[stage])
+            stageNs[stage].observe(toNs(current.stageCycles[stage]));
+    }
+}
+
+void Tracer::addStage(TraceStage stage, uint32_t cycles)
+{
+    current.stageCycles[stage] += cycles;
+    childCycles[depth] += cycles;
+}
+
+void Tracer::enter()
+{
+    // Deeper probes are counted as part of the deepest one
+    if (depth < kMaxDepth)
+        childCycles[++depth] = 0;
+}
+
+void Tracer::leave(TraceStage stage, uint32_t elapsed)
+{
+    uint32_t inner = childCycles[depth];
+    if (depth > 0)
+        depth--;
+    current.stageCycles[stage] += elapsed > inner ? elapsed - inner : 0;
+    childCycles[depth] += elapsed;
+}
+
+void Tracer::park(TraceRecord &slot)
+{
+    slot.command = TRACE_CMD_COUNT;
+    if (!open)
+        return;
+    slot.command = current.command;
+    slot.parkedCycles = cycles();
+    parkedIn = &slot;
+}
+
+bool Tracer::resume(TraceRecord &slot)
+{
+    if (slot.command == TRACE_CMD_COUNT)
+        return false;
+    uint32_t waited = cycles() - slot.parkedCycles;
+
+    // Completed before the request ended (no IR task): still the open one
+    if (open)
+    {
+        if (parkedIn == &slot)
+        {
+            addStage(TRACE_TRANSMIT, waited);
+            parkedIn = nullptr;
+        }
+        slot.command = TRACE_CMD_COUNT;
+        return false;
+    }
+
+    current = slot;
+    slot.command = TRACE_CMD_COUNT;
+    current.stageCycles[TRACE_TRANSMIT] += waited;
+    parkedIn = nullptr;
+    start();
+    return true;
+}
+
+uint8_t Tracer::getRecent(TraceRecord *out, uint8_t max) const
+{
+    uint8_t count = finished < TRACE_RING_ENTRIES ? finished : TRACE_RING_ENTRIES;
+    if (count > max)
+        count = max;
+    for (uint8_t i = 0; i < count; i++)
+        out[i] = ring[(finished - count + i) % TRACE_RING_ENTRIES];
+    return count;
+}
+
+void Tracer::write(JsonStreamWriter &out) const
+{
+    MetricHistogramSummary summary;
+    out.beginObject();
+    out.field("cpuMHz", (uint64_t)ESP.getCpuFreqMHz());
+    out.field("requests", (uint64_t)finished);
+
+    out.key("commands");
+    out.beginObject();
+    for (uint8_t command = 0; command < TRACE_CMD_COUNT; command++)
+    {
+        commandNs[command].summarize(summary);
+        if (summary.count)
+            writeSummary(out, commandNames[command], summary);
+    }
+    out.endObject();
+
+    out.key("stages");
+    out.beginObject();
+    for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        stageNs[stage].summarize(summary);
+        if (summary.count)
+            writeSummary(out, stageNames[stage], summary);
+    }
+    out.endObject();
+
+    // Oldest first; stages a request did not reach are left out
+    out.key("recent");
+    out.beginArray();
+    uint8_t count = finished < TRACE_RING_ENTRIES ? finished : TRACE_RING_ENTRIES;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const TraceRecord &record = ring[(finished - count + i) % TRACE_RING_ENTRIES];
+        out.beginObject();
+        out.field("seq", (uint64_t)record.sequence);
+        out.field("command", commandName(record.command));
+        out.field("totalNs", (uint64_t)toNs(record.totalCycles));
+        out.key("stagesNs");
+        out.beginObject();
+        for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+        {
+            if (record.stageCycles[stage])
+                out.field(stageNames[stage], (uint64_t)toNs(record.stageCycles[stage]));
+        }
+        out.endObject();
+        out.endObject();
+    }
+    out.endArray();
+    out.endObject();
+}
+
+void Tracer::reset()
+{
+    finished = 0;
+    memset(ring, 0, sizeof(ring));
+    for (MetricHistogram &histogram : commandNs)
+        histogram.reset();
+    for (MetricHistogram &histogram : stageNs)
+        histogram.reset();
+}
+
+#endif // TRACE_ENABLED